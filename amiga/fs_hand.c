@@ -186,7 +186,7 @@ main(int argc, char *argv[])
         printf("Failed to open %s\n", DOSNAME);
         return (1);
     }
-    cpu_control_init();
+    msg_init();
 
     for (arg = 1; arg < argc; arg++) {
         const char *ptr = argv[arg];
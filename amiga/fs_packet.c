@@ -32,6 +32,7 @@
 #define GARG2 (gpack->dp_Arg2)
 #define GARG3 (gpack->dp_Arg3)
 #define GARG4 (gpack->dp_Arg4)
+#define GARG5 (gpack->dp_Arg5)
 
 /* Ralph Babel packets */
 #define ACTION_GET_DISK_FSSM    4201
@@ -41,6 +42,12 @@
 #define ACTION_EX_OBJECT        50
 #define ACTION_EX_NEXT          51
 
+/*
+ * SmashFS packet: copy a file or directory tree on the USB host.
+ * Arguments are as ACTION_RENAME_OBJECT, plus Arg5 = HM_COPY_* flags.
+ */
+#define ACTION_SMASH_COPY       0x534d4350  /* 'SMCP' */
+
 /* BFFS extended fib_DirEntryType values */
 #define ST_BDEVICE      -10     /* block special device */
 #define ST_CDEVICE      -11     /* char special device */
@@ -66,6 +73,8 @@ typedef struct fs_lock {
     uint            fl_Flags;     /* Flags for this lock */
 } fs_lock_t;
 
+#define FS_WBUF_SIZE 16384 /* Write-behind buffer size per file handle */
+
 typedef struct fh_private fh_private_t;
 struct fh_private {
     fs_lock_t    *fp_lock;        /* Parent lock */
@@ -73,8 +82,16 @@ struct fh_private {
     handle_t      fp_handle;      /* KS file handle */
     uint64_t      fp_pos_cur;     /* Current file position */
     uint64_t      fp_pos_max;     /* Maximum file position */
+    fh_private_t *fp_next;        /* Next open file */
+    uint8_t      *fp_wbuf;        /* Write-behind buffer (header + data) */
+    uint          fp_wlen;        /* Data bytes in write-behind buffer */
+    uint          fp_wtag;        /* Tag of write awaiting reply */
+    uint          fp_werr;        /* Deferred write error */
+    uint8_t       fp_wpending;    /* Write reply is outstanding */
 };
 
+static fh_private_t *fp_list = NULL;  /* All open files */
+
 typedef struct {
     ULONG   fa_type;
     ULONG   fa_mode;
@@ -617,20 +634,122 @@ action_examine_object(void)
     return (examine_common(lock, fib, fattr));
 }
 
+/*
+ * fp_init
+ * -------
+ * Initializes private state for a newly opened file and adds it to
+ * the list of open files.
+ */
+static void
+fp_init(fh_private_t *fp, fs_lock_t *lock, FileHandle_t *fh, handle_t handle)
+{
+    fp->fp_lock     = lock;
+    fp->fp_fh       = fh;
+    fp->fp_handle   = handle;
+    fp->fp_pos_cur  = 0;
+    fp->fp_pos_max  = 0;
+    fp->fp_wbuf     = NULL;
+    fp->fp_wlen     = 0;
+    fp->fp_wtag     = 0;
+    fp->fp_werr     = 0;
+    fp->fp_wpending = 0;
+    fp->fp_next     = fp_list;
+    fp_list         = fp;
+}
+
+/*
+ * fp_write_collect
+ * ----------------
+ * Waits for the reply to an outstanding write-behind message. A failure
+ * is held to be reported by the next operation on the file.
+ */
+static void
+fp_write_collect(fh_private_t *fp)
+{
+    uint rc;
+
+    if (fp->fp_wpending == 0)
+        return;
+    fp->fp_wpending = 0;
+    rc = sm_fwrite_finish(fp->fp_wtag);
+    if (rc != 0) {
+        printf("write-behind %x failed: %d\n", fp->fp_handle, rc);
+        if (fp->fp_werr == 0)
+            fp->fp_werr = rc;
+    }
+}
+
+/*
+ * fp_write_send
+ * -------------
+ * Sends buffered write data to the USB host. Only one write-behind
+ * reply is kept outstanding per file, so the host can be writing one
+ * buffer while the next is being filled.
+ */
+static void
+fp_write_send(fh_private_t *fp)
+{
+    uint rc;
+
+    if (fp->fp_wlen == 0)
+        return;
+    fp_write_collect(fp);
+    rc = sm_fwrite_start(fp->fp_handle, fp->fp_wbuf, fp->fp_wlen, 0,
+                         &fp->fp_wtag);
+    if (rc == 0)
+        fp->fp_wpending = 1;
+    else if (fp->fp_werr == 0)
+        fp->fp_werr = rc;
+    fp->fp_wlen = 0;
+}
+
+/*
+ * fp_write_flush
+ * --------------
+ * Writes all buffered data and waits for completion. Returns (and
+ * clears) any deferred write error.
+ */
+static uint
+fp_write_flush(fh_private_t *fp)
+{
+    uint rc;
+
+    fp_write_send(fp);
+    fp_write_collect(fp);
+    rc = fp->fp_werr;
+    fp->fp_werr = 0;
+    return (rc);
+}
+
 static ULONG
 action_end(void)
 {
     fh_private_t *fp  = (fh_private_t *) GARG1;  // Comes from fh_Arg1
+    fh_private_t **fpp;
+    uint          rc = 0;
 
     printf("END %p %p %x\n", fp, fp->fp_lock, fp->fp_handle);
     if (fp != NULL) {
         fs_lock_t *lock   = (fs_lock_t *) fp->fp_lock;
         handle_t   handle = fp->fp_handle;
+        rc = fp_write_flush(fp);
         sm_fclose(handle);
         if (lock != NULL)
             FreeLock(lock);
+        for (fpp = &fp_list; *fpp != NULL; fpp = &(*fpp)->fp_next) {
+            if (*fpp == fp) {
+                *fpp = fp->fp_next;
+                break;
+            }
+        }
+        if (fp->fp_wbuf != NULL)
+            FreeMem(fp->fp_wbuf, sizeof (hm_freadwrite_t) + FS_WBUF_SIZE);
         FreeMem(fp, sizeof (*fp));
     }
+    if (rc != 0) {
+        gpack->dp_Res2 = km_status_to_amiga_error(rc);
+        return (DOSFALSE);
+    }
     return (DOSTRUE);
 }
 
@@ -689,11 +808,7 @@ action_findinput(void)
         gpack->dp_Res2 = ERROR_NO_FREE_STORE;
         return (DOSFALSE);
     }
-    fp->fp_lock    = newlock;
-    fp->fp_fh      = fh;
-    fp->fp_handle  = handle;
-    fp->fp_pos_cur = 0;
-    fp->fp_pos_max = 0;
+    fp_init(fp, newlock, fh, handle);
 
     fh->fh_Port = NULL;            // Non-zero only if interactive
     fh->fh_Type = gvol->vl_msgport;   // Handler message port
@@ -706,6 +821,22 @@ action_findinput(void)
 static ULONG
 action_flush(void)
 {
+    fh_private_t *fp;
+    uint          rc;
+
+    /* Push write-behind data of all open files to the USB host */
+    for (fp = fp_list; fp != NULL; fp = fp->fp_next) {
+        fp_write_send(fp);
+        fp_write_collect(fp);
+    }
+    for (fp = fp_list; fp != NULL; fp = fp->fp_next) {
+        if (fp->fp_werr != 0) {
+            rc = fp->fp_werr;
+            fp->fp_werr = 0;
+            gpack->dp_Res2 = km_status_to_amiga_error(rc);
+            return (DOSFALSE);
+        }
+    }
     return (DOSTRUE);
 }
 
@@ -756,11 +887,7 @@ action_findoutput(void)
         gpack->dp_Res2 = ERROR_NO_FREE_STORE;
         return (DOSFALSE);
     }
-    fp->fp_lock    = newlock;
-    fp->fp_fh      = fh;
-    fp->fp_handle  = handle;
-    fp->fp_pos_cur = 0;
-    fp->fp_pos_max = 0;
+    fp_init(fp, newlock, fh, handle);
 
     fh->fh_Port = NULL;            // Non-zero only if interactive
     fh->fh_Type = gvol->vl_msgport;   // Handler message port
@@ -983,6 +1110,8 @@ action_read(void)
     uint          rlen;
     uint          count = 0;
     uint          buflen = 16384;
+    uint          resync = 0;
+    sm_fread_pipe_t rpipe;
 
     if (fp == NULL) {
         gpack->dp_Res2 = ERROR_REQUIRED_ARG_MISSING;
@@ -993,8 +1122,17 @@ action_read(void)
     handle = fp->fp_handle;
     printf("READ %x at pos=%llx len=%x\n", handle, fp->fp_pos_cur, len);
 
+    rc = fp_write_flush(fp);
+    if (rc != 0) {
+        gpack->dp_Res2 = km_status_to_amiga_error(rc);
+        return (DOSFALSE);
+    }
+
+    /* Large reads are split into pipelined requests of buflen bytes */
+    (void) sm_fread_pipe_start(&rpipe, handle, buflen, len,
+                               SM_FREAD_PIPE_DEFAULT, 0);
     while (count < len) {
-        rc = sm_fread(handle, len, &data, &rlen, 0);
+        rc = sm_fread_pipe_next(&rpipe, &data, &rlen);
         if ((rc != 0) && (rc != KM_STATUS_EOF))
             printf("sm_fread got %d\n", rc);
         if (rlen == 0) {
@@ -1002,8 +1140,10 @@ action_read(void)
                    handle, fp->fp_pos_cur, count, rc);
             break;
         }
-        if (rlen > len)
-            rlen = len;
+        if (rlen > len - count) {
+            rlen = len - count;
+            resync = 1;  // Host delivered more than was requested
+        }
         memcpy(buf, data, rlen);
         buf            += rlen;
         count          += rlen;
@@ -1013,6 +1153,20 @@ action_read(void)
         if (rc == KM_STATUS_EOF)
             break;
     }
+    sm_fread_pipe_end(&rpipe);
+
+    if (((count < len) && (rc != KM_STATUS_EOF)) || resync) {
+        /*
+         * The read stopped early, but requests which were already in
+         * flight have moved the host file position beyond fp_pos_cur.
+         * Put it back where the next read or relative seek expects it.
+         */
+        uint rc2 = sm_fseek(handle, OFFSET_BEGINNING, fp->fp_pos_cur,
+                            NULL, NULL);
+        if (rc2 != 0)
+            printf("fseek(%x) to %llx failed: %d\n",
+                   handle, fp->fp_pos_cur, rc2);
+    }
     if ((rc != 0) && (rc != KM_STATUS_EOF)) {
         gpack->dp_Res2 = km_status_to_amiga_error(rc);
         return (DOSFALSE);
@@ -1114,6 +1268,67 @@ action_rename_object(void)
     return (DOSTRUE);
 }
 
+/*
+ * action_copy_object
+ * ------------------
+ * Copies an object to a new name entirely on the USB host, so that
+ * file data does not need to be read into and written back from the
+ * Amiga.
+ */
+static ULONG
+action_copy_object(void)
+{
+    fs_lock_t    *slock  = (fs_lock_t *) BTOC(GARG1);
+    char         *sbname = (char *) BTOC(GARG2);
+    fs_lock_t    *dlock  = (fs_lock_t *) BTOC(GARG3);
+    char         *dbname = (char *) BTOC(GARG4);
+    uint          flags  = GARG5;
+    char         *sname  = sbname + 1;
+    char         *dname  = dbname + 1;
+    handle_t      shandle;
+    handle_t      dhandle;
+    char          scho;
+    char          dcho;
+    uint          rc;
+    fh_private_t *fp;
+
+    if ((sbname == NULL) || (dbname == NULL) ||
+        (*sname == '\0') || (*dname == '\0')) {
+        gpack->dp_Res2 = ERROR_REQUIRED_ARG_MISSING;
+        return (DOSFALSE);
+    }
+
+    /* Host must see all data written so far */
+    for (fp = fp_list; fp != NULL; fp = fp->fp_next) {
+        fp_write_send(fp);
+        fp_write_collect(fp);
+    }
+
+    shandle = (slock == NULL) ? gvol->vl_handle : slock->fl_Key;
+    dhandle = (dlock == NULL) ? gvol->vl_handle : dlock->fl_Key;
+
+    /* Temporarily NIL-terminate names (careful: order matters here) */
+    sbname = sname + *sbname;
+    dbname = dname + *dbname;
+    scho = *sbname;
+    dcho = *dbname;
+    *sbname = '\0';
+    *dbname = '\0';
+
+    printf("COPYOBJECT p=%x %p '%s' -> %p '%s' %x\n",
+           shandle, slock, sname, dlock, dname, flags);
+
+    rc = sm_fcopy(shandle, sname, dhandle, dname, flags, NULL);
+    *sbname = scho;
+    *dbname = dcho;
+
+    if (rc != 0) {
+        gpack->dp_Res2 = km_status_to_amiga_error(rc);
+        return (DOSFALSE);
+    }
+    return (DOSTRUE);
+}
+
 static ULONG
 action_seek(void)
 {
@@ -1139,6 +1354,12 @@ action_seek(void)
     else if (seek_mode > 0)
         seek_mode = OFFSET_END;
 
+    rc = fp_write_flush(fp);
+    if (rc != 0) {
+        gpack->dp_Res2 = km_status_to_amiga_error(rc);
+        return (DOSFALSE);
+    }
+
     rc = sm_fseek(handle, seek_mode, offset, &new_pos, &prev_pos);
     if (rc != 0) {
         printf("fseek(%x) to %llx failed: %d\n", handle, new_pos, rc);
@@ -1393,12 +1614,40 @@ action_write(void)
     printf("WRITE %x buf=%p at pos=%llx len=%x\n",
            handle, buf, fp->fp_pos_cur, len);
 
-    rc = sm_fwrite(handle, buf, len, 0, 0);
-    if (rc != 0) {
-        printf("sm_fwrite(%x) got %d at pos=%llx, count=%x\n",
-               handle, rc, fp->fp_pos_cur, count);
-        gpack->dp_Res2 = km_status_to_amiga_error(rc);
-        return (DOSFALSE);
+    if (fp->fp_werr != 0) {
+        /* Report failure of an earlier write-behind */
+        rc = fp->fp_werr;
+        fp->fp_werr = 0;
+        goto write_fail;
+    }
+    if (len <= 0)
+        return (0);
+
+    if (fp->fp_wbuf == NULL)
+        fp->fp_wbuf = AllocMem(sizeof (hm_freadwrite_t) + FS_WBUF_SIZE,
+                               MEMF_PUBLIC);
+
+    if ((fp->fp_wbuf == NULL) || (len >= FS_WBUF_SIZE)) {
+        /* Large write (or no buffer): send directly after buffered data */
+        rc = fp_write_flush(fp);
+        if (rc == 0)
+            rc = sm_fwrite(handle, buf, len, 0, 0);
+        if (rc != 0) {
+write_fail:
+            printf("sm_fwrite(%x) got %d at pos=%llx, count=%x\n",
+                   handle, rc, fp->fp_pos_cur, count);
+            gpack->dp_Res2 = km_status_to_amiga_error(rc);
+            return (DOSFALSE);
+        }
+    } else {
+        /* Coalesce small writes; the buffer is sent when full */
+        if (fp->fp_wlen + len > FS_WBUF_SIZE)
+            fp_write_send(fp);
+        memcpy(fp->fp_wbuf + sizeof (hm_freadwrite_t) + fp->fp_wlen,
+               buf, len);
+        fp->fp_wlen += len;
+        if (fp->fp_wlen == FS_WBUF_SIZE)
+            fp_write_send(fp);
     }
     count = len;
     fp->fp_pos_cur += len;
@@ -1438,6 +1687,9 @@ handle_packet(void)
         case ACTION_COPY_DIR:
             res1 = action_copy_dir();
             break;
+        case ACTION_SMASH_COPY:
+            res1 = action_copy_object();
+            break;
         case ACTION_CREATE_DIR:
             res1 = action_create_dir();
             break;
@@ -29,6 +29,9 @@
 #define KM_OP_FSETPERMS       0x19  // File storage set permissions
 #define KM_OP_FSETOWN         0x1a  // File storage set owner / group
 #define KM_OP_FSETDATE        0x1b  // File storage set date
+#define KM_OP_FCOPY           0x1c  // File storage copy (performed on host)
+#define KM_OP_FSIGS           0x1d  // File storage get block signatures
+#define KM_OP_FCOPYRANGE      0x1e  // File storage copy range between files
 
 #define KM_OP_REPLY           0x80  // Reply message flag to remote request
 
@@ -70,9 +73,20 @@
 #define HM_MODE_NOFOLLOW    0x1000  // Do not follow symlink on READDIR
 #define HM_MODE_LINK        0x2000  // Symlink
 #define HM_MODE_READLINK    0x2001  // Read symlink (composite)
+#define HM_MODE_STAT        0x4000  // Return hm_fdirent_t in open reply
 
 #define HM_FLAG_SEEK0       0x0001  // Seek the start of file before read
 
+#define HM_COPY_RECURSIVE   0x0001  // Copy directory tree
+#define HM_COPY_NOCLOBBER   0x0002  // Do not replace existing files
+#define HM_COPY_MOVE        0x0004  // Remove source after copy (move)
+#define HM_COPY_ABORT       0x0008  // Abandon copy job in progress
+#define HM_COPY_DONE        0x0100  // Reply: copy job has completed
+
+#define HM_FSIGS_MAX        240     // Maximum signatures in one reply
+#define HM_FSIGS_BYTES_MAX  0x80000 // Maximum file bytes summed per request
+#define HM_FCOPYRANGE_MAX   0x100000 // Maximum bytes in one range copy
+
 typedef uint32_t handle_t;
 
 typedef struct {
@@ -86,7 +100,11 @@ typedef struct {
     uint16_t     hm_type;    // File or directory type (from USB host)
     uint16_t     hm_mode;    // File mode for open
     uint32_t     hm_aperms;  // Amiga file permissions for create
-    /* For open, the filename immediately follows this struct */
+    /*
+     * For open, the filename immediately follows this struct. If the
+     * open was requested with HM_MODE_STAT, a hm_fdirent_t (without
+     * name) immediately follows this struct in the reply.
+     */
 } hm_fopenhandle_t;
 
 typedef struct {
@@ -104,6 +122,65 @@ typedef struct {
     /* Source and destination filenames immediately follow this struct */
 } hm_frename_t;
 
+/*
+ * A copy is performed by the USB host in slices, so that no single
+ * request holds the message channel for long. The first request
+ * supplies names and hm_job=0. Each reply returns progress and the job
+ * number, which the next request must supply (without names) until
+ * the reply has HM_COPY_DONE set. The USB host runs a few jobs at
+ * once; a new copy gets KM_STATUS_UNAVAIL if all are busy. A job with
+ * no request for a minute is considered abandoned.
+ */
+typedef struct {
+    km_msg_hdr_t hm_hdr;      // Standard message header
+    handle_t     hm_shandle;  // Source parent dir handle
+    handle_t     hm_dhandle;  // Destination parent dir handle
+    uint32_t     hm_job;      // Copy job (0 to start a new copy)
+    uint16_t     hm_flags;    // Copy flags (HM_COPY_*)
+    uint16_t     hm_unused;   // Unused
+    uint32_t     hm_files;    // Reply: files copied so far
+    uint32_t     hm_files_total;  // Reply: total files to copy
+    uint32_t     hm_kbytes;       // Reply: KB copied so far
+    uint32_t     hm_kbytes_total; // Reply: total KB to copy
+    /* For a new copy, source and destination names follow this struct */
+} hm_fcopy_t;
+
+/*
+ * Block signatures are used for delta transfers. Each file block of
+ * hm_blksize bytes is summarized by a weak rolling checksum and a
+ * strong CRC-32 (initial value 0) of the block. The weak checksum of
+ * bytes x[0] to x[n-1] is a | (b << 16), where a is the sum of x[i]
+ * and b is the sum of (n - i) * x[i], both modulo 65536. Only complete
+ * blocks are summarized. The signatures follow hm_fsigs_t in the reply,
+ * and hm_count is updated to the number of signatures returned.
+ */
+typedef struct {
+    uint32_t     hs_weak;     // Rolling checksum of block
+    uint32_t     hs_strong;   // CRC-32 of block
+} hm_fsig_t;
+
+typedef struct {
+    km_msg_hdr_t hm_hdr;      // Standard message header
+    handle_t     hm_handle;   // File handle (opened for read)
+    uint32_t     hm_blksize;  // Block size
+    uint32_t     hm_block;    // First block number
+    uint32_t     hm_count;    // Number of blocks (reply: signatures sent)
+} hm_fsigs_t;
+
+/*
+ * Copies hm_length bytes from the source file at the specified offset
+ * to the current position of the destination file. Both files must
+ * be open, and the source file's position is not changed.
+ */
+typedef struct {
+    km_msg_hdr_t hm_hdr;      // Standard message header
+    handle_t     hm_shandle;  // Source file handle (opened for read)
+    handle_t     hm_dhandle;  // Destination file handle (opened for write)
+    uint32_t     hm_off_hi;   // Source offset upper 32 bits
+    uint32_t     hm_off_lo;   // Source offset lower 32 bits
+    uint32_t     hm_length;   // Length to copy
+} hm_fcopyrange_t;
+
 typedef struct {
     km_msg_hdr_t hm_hdr;     // Standard message header
     handle_t     hm_handle;  // File handle for request
@@ -227,6 +227,8 @@ static bank_info_t info;
 static bank_info_t info_saved;
 static smash_id_t id;
 static smash_id_t id_saved;
+static ks_snapshot_t snapshot;
+static uint          snapshot_valid;
 
 uint8_t flag_output;  // Global
 uint    flag_debug;  // Global
@@ -553,6 +555,27 @@ update_status(const char *fmt, ...)
     Text(rp, buf, sizeof (buf));
 }
 
+/*
+ * get_snapshot
+ * ------------
+ * Acquire ROM bank information, KickSmash ID, NV settings, and the
+ * Kickstart image in each bank from KickSmash with a single request.
+ * If the firmware is too old to support this, get_banks(), get_id(),
+ * and get_bank_timeout() will each fall back to an individual request.
+ */
+static void
+get_snapshot(void)
+{
+#ifndef UAE_SIM
+    int rc;
+    uint rlen;
+    rc = send_cmd_retry(KS_CMD_BANK_SNAPSHOT, NULL, 0,
+                        &snapshot, sizeof (snapshot), &rlen);
+    if ((rc == 0) && (rlen >= sizeof (snapshot)))
+        snapshot_valid = TRUE;
+#endif
+}
+
 /*
  * get_banks
  * ---------
@@ -582,6 +605,10 @@ get_banks(bank_info_t *bi)
 #else
     int rc;
     uint rlen;
+    if (snapshot_valid) {
+        memcpy(bi, &snapshot.kss_bi, sizeof (*bi));
+        return (0);
+    }
     rc = send_cmd_retry(KS_CMD_BANK_INFO, NULL, 0, bi, sizeof (*bi), &rlen);
     if (rc != 0)
         update_status("FAIL info %d", rc);
@@ -615,10 +642,15 @@ get_bank_timeout(uint *seconds, uint8_t *bank)
     *seconds = 0;
     *bank = 0;
 
-    buf[0] = 0;  // Start at NV0
-    buf[1] = 4;  // Also read NV1
-    rc = send_cmd_retry(KS_CMD_GET | KS_GET_NV,
-                        buf, sizeof (buf), rbuf, sizeof (rbuf), &rlen);
+    if (snapshot_valid) {
+        memcpy(rbuf, snapshot.kss_nv, sizeof (rbuf));
+        rc = 0;
+    } else {
+        buf[0] = 0;  // Start at NV0
+        buf[1] = 4;  // Also read NV1
+        rc = send_cmd_retry(KS_CMD_GET | KS_GET_NV,
+                            buf, sizeof (buf), rbuf, sizeof (rbuf), &rlen);
+    }
     if (rc == 0) {
         uint8_t data = rbuf[0];
         if (data & 0x80)
@@ -691,6 +723,10 @@ get_id(smash_id_t *id)
 #else
     int rc;
     uint rlen;
+    if (snapshot_valid) {
+        memcpy(id, &snapshot.kss_id, sizeof (*id));
+        return;
+    }
     rc = send_cmd_retry(KS_CMD_ID, NULL, 0, id, sizeof (*id), &rlen);
     if (rc != 0)
         update_status("FAIL id %d", rc);
@@ -948,6 +984,105 @@ show_bank_table_column(uint col)
     }
 }
 
+#ifdef STANDALONE
+static uint8_t longreset_shown[sizeof (info.bi_longreset_seq)];
+
+/*
+ * bank_cell_rect
+ * --------------
+ * Get the screen area of one cell of the ROM bank information table.
+ */
+static void
+bank_cell_rect(uint bank, uint col, Rectangle *rect)
+{
+    rect->MinX = banktable_pos[col];
+    rect->MaxX = banktable_pos[col] + banktable_widths[col] * 8 + 7;
+    rect->MinY = BANK_TABLE_YPOS + 2 + 14 + bank * 9;
+    rect->MaxY = rect->MinY + 8;
+}
+
+/*
+ * bank_table_redraw
+ * -----------------
+ * Redraw the cells of the ROM bank information table which intersect
+ * the dirty screen regions. This is called from gadget_poll() by way
+ * of intuition_redraw_hook.
+ */
+static void
+bank_table_redraw(const Rectangle *rects, uint count)
+{
+    uint bank;
+    uint col;
+    uint cur;
+    Rectangle cell;
+    struct RastPort *rp = &screen->RastPort;
+
+    for (col = 0; col < ARRAY_SIZE(banktable_widths); col++) {
+        for (bank = 0; bank < ROM_BANKS; bank++) {
+            bank_cell_rect(bank, col, &cell);
+            for (cur = 0; cur < count; cur++) {
+                if ((cell.MinX <= rects[cur].MaxX) &&
+                    (cell.MaxX >= rects[cur].MinX) &&
+                    (cell.MinY <= rects[cur].MaxY) &&
+                    (cell.MaxY >= rects[cur].MinY)) {
+                    break;
+                }
+            }
+            if (cur == count)
+                continue;  // Cell is not in a dirty region
+            SetBPen(rp, (bank == current_bank) ? 3 : 0);
+            show_bank_cell(bank, col);
+        }
+    }
+    SetBPen(rp, 0);
+}
+
+/*
+ * longreset_pos
+ * -------------
+ * Return the position of a bank in a LongReset sequence, or 0xff if the
+ * bank is not in the sequence.
+ */
+static uint
+longreset_pos(const uint8_t *seq, uint bank)
+{
+    uint pos;
+
+    for (pos = 0; pos < sizeof (info.bi_longreset_seq); pos++)
+        if (seq[pos] == bank)
+            return (pos);
+    return (0xff);
+}
+#endif
+
+/*
+ * show_bank_longreset
+ * -------------------
+ * Update the LongReset column after the sequence has changed. In the
+ * standalone ROM switcher, only the cells of banks whose position in the
+ * sequence changed are invalidated, to be redrawn once by gadget_poll().
+ */
+static void
+show_bank_longreset(void)
+{
+#ifdef STANDALONE
+    uint bank;
+    Rectangle cell;
+
+    for (bank = 0; bank < ROM_BANKS; bank++) {
+        if (longreset_pos(info.bi_longreset_seq, bank) ==
+            longreset_pos(longreset_shown, bank)) {
+            continue;
+        }
+        bank_cell_rect(bank, 3, &cell);
+        intuition_invalidate(cell.MinX, cell.MinY, cell.MaxX, cell.MaxY);
+    }
+    memcpy(longreset_shown, info.bi_longreset_seq, sizeof (longreset_shown));
+#else
+    show_bank_table_column(3);
+#endif
+}
+
 /*
  * set_initial_bank_switchto
  * -------------------------
@@ -1031,6 +1166,10 @@ show_banks(void)
 
         xoff += pwidth;
     }
+#ifdef STANDALONE
+    memcpy(longreset_shown, info.bi_longreset_seq, sizeof (longreset_shown));
+    intuition_redraw_hook = bank_table_redraw;
+#endif
 }
 
 #ifdef BANK_MOUSEBAR
@@ -1120,6 +1259,34 @@ update_switch_box(void)
     return (1);
 }
 
+/*
+ * show_switchto_ident
+ * -------------------
+ * Display the Kickstart version found in the SwitchTo bank, if known.
+ */
+static void
+show_switchto_ident(void)
+{
+    ks_bank_ident_t *kbi;
+
+    if (!snapshot_valid || (bank_switchto >= ROM_BANKS))
+        return;
+    kbi = &snapshot.kss_ident[bank_switchto];
+    if (kbi->kbi_state == KIX_STATE_STALE)
+        update_status("Bank %u: not yet identified", bank_switchto);
+    else if (kbi->kbi_state == KIX_STATE_EMPTY)
+        update_status("Bank %u: empty", bank_switchto);
+    else if ((kbi->kbi_state != KIX_STATE_KICKSTART) ||
+             (kbi->kbi_version == 0))
+        update_status("Bank %u: not Kickstart", bank_switchto);
+    else if (kbi->kbi_name[0] != '\0')
+        update_status("Bank %u: KS %.10s (%u.%u)", bank_switchto,
+                      kbi->kbi_name, kbi->kbi_version, kbi->kbi_revision);
+    else
+        update_status("Bank %u: KS %u.%u", bank_switchto,
+                      kbi->kbi_version, kbi->kbi_revision);
+}
+
 static void
 update_switchto(int bank)
 {
@@ -1129,6 +1296,7 @@ update_switchto(int bank)
     GT_SetGadgetAttrs(gadget_switchto, NULL, NULL,
                       GTMX_Active, (LONG) bank_switchto,
                       TAG_DONE);
+    show_switchto_ident();
 
     if (update_switch_box())
         RefreshGList(gadget_switchto_pre, window, NULL, -1);
@@ -1147,6 +1315,7 @@ update_switchto_updown(int incdec)
     GT_SetGadgetAttrs(gadget_switchto, NULL, NULL,
                       GTMX_Active, (LONG) bank_switchto,
                       TAG_DONE);
+    show_switchto_ident();
 
     if (update_switch_box())
         RefreshGList(gadget_switchto_pre, window, NULL, -1);
@@ -1501,12 +1670,14 @@ draw_page(void)
 
     draw_array(kicksmash_drawing, ARRAY_SIZE(kicksmash_drawing));
 
+    get_snapshot();
     get_banks(&info);
     memcpy(&info_saved, &info, sizeof (info));
     set_initial_bank_switchto();
     show_banks();
     show_id();
     show_bank_timeout();
+    show_switchto_ident();
 
     /* LongReset + and - buttons */
     ng.ng_Width = 14;
@@ -2125,7 +2296,7 @@ handle_longreset_change:
                                            sizeof (info.bi_longreset_seq));
                             if (updated_longreset != prev)
                                 update_save_box();
-                            show_bank_table_column(3);
+                            show_bank_longreset();
                             break;
                         }
                         case ID_LONGRESET_PLUS_0:
@@ -2193,6 +2364,9 @@ id_save:
 static void
 cleanup_screen(void)
 {
+#ifdef STANDALONE
+    intuition_redraw_hook = NULL;  // Bank table is going away
+#endif
     CloseWindow(window);
     FreeVisualInfo(visualInfo);
     CloseScreen(screen);
@@ -80,6 +80,9 @@ sm_fservice(void)
  *              information. See the hm_fdirent_t data structure for
  *              data format returned from reads.
  *      HM_MODE_READDIR is a short-hand for HM_MODE_READ and HM_MODE_DIR.
+ *      HM_MODE_STAT may be combined with any of the above to have the
+ *              USB host return file status with the open reply
+ *              (see sm_fopen_finish()).
  * hm_type is a pointer to the file type which was successfully opened. It
  *      will be one of HM_TYPE_*.
  * create_perms are the permissions to apply to the created file (see
@@ -91,15 +94,33 @@ sm_fservice(void)
 uint
 sm_fopen(handle_t parent_handle, const char *name, uint mode, uint *hm_type,
          uint create_perms, handle_t *handle)
+{
+    uint rc;
+    uint tag;
+
+    *handle = 0;
+    rc = sm_fopen_start(parent_handle, name, mode, create_perms, &tag);
+    if (rc != KM_STATUS_OK)
+        return (rc);
+    return (sm_fopen_finish(tag, hm_type, handle, NULL));
+}
+
+/*
+ * sm_fopen_start
+ * --------------
+ * Sends an open request to the USB host without waiting for the reply,
+ * so that other work may proceed while the host opens the file. See
+ * sm_fopen() for a description of arguments. The returned tag must
+ * be passed to sm_fopen_finish() to collect the new file handle.
+ */
+uint
+sm_fopen_start(handle_t parent_handle, const char *name, uint mode,
+               uint create_perms, uint *tag)
 {
     uint msglen;
     uint rc;
-    uint rlen;
     uint namelen = strlen(name) + 1;
     hm_fopenhandle_t *msg;
-    hm_fopenhandle_t *rdata;
-
-    *handle = 0;
 
     if ((sm_file_active == 0) && (sm_fservice() == 0))
         return (KM_STATUS_UNAVAIL);
@@ -125,15 +146,52 @@ sm_fopen(handle_t parent_handle, const char *name, uint mode, uint *hm_type,
 
     strcpy((char *)(msg + 1), name);  // Name follows message header
 
-    rc = host_msg(msg, msglen, (void **) &rdata, &rlen);
+    rc = host_send_msg(msg, msglen);
+    if (rc == KM_STATUS_OK)
+        *tag = msg->hm_hdr.km_tag;
+    else
+        host_tag_free(msg->hm_hdr.km_tag);
+    free(msg);
+
+    if (rc == KS_STATUS_NODATA)
+        sm_fservice();  // Check if file service is still active
+
+    return (rc);
+}
+
+/*
+ * sm_fopen_finish
+ * ---------------
+ * Waits for the reply to an open started by sm_fopen_start().
+ *
+ * tag is the message tag returned by sm_fopen_start().
+ * hm_type is a pointer to the opened file type (may be NULL).
+ * handle is a pointer to the new file handle.
+ * dent, if not NULL, is filled with file status when the open was
+ *     requested with HM_MODE_STAT. The name is not provided. If the USB
+ *     host did not supply status, dent->hmd_type will be HM_TYPE_UNKNOWN.
+ */
+uint
+sm_fopen_finish(uint tag, uint *hm_type, handle_t *handle, hm_fdirent_t *dent)
+{
+    uint rc;
+    uint rlen;
+    hm_fopenhandle_t *rdata;
+
+    *handle = 0;
+    if (dent != NULL)
+        memset(dent, 0, sizeof (*dent));
+
+    rc = host_recv_msg(tag, (void **) &rdata, &rlen);
     if (rc == KM_STATUS_OK) {
         *handle = rdata->hm_handle;
 
         if (hm_type != NULL)
             *hm_type = rdata->hm_type;
+        if ((dent != NULL) && (rlen >= sizeof (*rdata) + sizeof (*dent)))
+            memcpy(dent, rdata + 1, sizeof (*dent));
     }
-    host_tag_free(msg->hm_hdr.km_tag);
-    free(msg);
+    host_tag_free(tag);
 
     if (rc == KS_STATUS_NODATA)
         sm_fservice();  // Check if file service is still active
@@ -152,8 +210,31 @@ uint
 sm_fclose(handle_t handle)
 {
     uint rc;
-    uint rlen;
-    hm_fopenhandle_t *rdata;
+    uint tag;
+
+    rc = sm_fclose_start(handle, &tag);
+    if (rc == KM_STATUS_OK)
+        rc = sm_fclose_finish(tag);
+
+    if (sm_mbuf != NULL) {
+        free(sm_mbuf);
+        sm_mbuf = NULL;
+    }
+    return (rc);
+}
+
+/*
+ * sm_fclose_start
+ * ---------------
+ * Sends a close request to the USB host without waiting for the reply.
+ * The returned tag must be passed to sm_fclose_finish().
+ *
+ * handle is the remote file handle: see sm_fopen().
+ */
+uint
+sm_fclose_start(handle_t handle, uint *tag)
+{
+    uint rc;
     hm_fopenhandle_t msg;
 
     if ((sm_file_active == 0) && (sm_fservice() == 0))
@@ -164,13 +245,11 @@ sm_fclose(handle_t handle)
     msg.hm_hdr.km_tag    = host_tag_alloc();
     msg.hm_handle        = handle;
 
-    rc = host_msg(&msg, sizeof (msg), (void **) &rdata, &rlen);
-    host_tag_free(msg.hm_hdr.km_tag);
-
-    if (sm_mbuf != NULL) {
-        free(sm_mbuf);
-        sm_mbuf = NULL;
-    }
+    rc = host_send_msg(&msg, sizeof (msg));
+    if (rc == KM_STATUS_OK)
+        *tag = msg.hm_hdr.km_tag;
+    else
+        host_tag_free(msg.hm_hdr.km_tag);
 
     if (rc == KS_STATUS_NODATA)
         sm_fservice();  // Check if file service is still active
@@ -179,37 +258,42 @@ sm_fclose(handle_t handle)
 }
 
 /*
- * sm_fread
- * --------
- * Returns data contents from the USB host's file handle, which could
- * be from the contents of a file or directory entries.
+ * sm_fclose_finish
+ * ----------------
+ * Waits for the reply to a close started by sm_fclose_start().
  *
- * handle is the remote file handle: see sm_fopen().
- * readsize is the maximum size of data to acquire.
- * data is a pointer which is returned by this function.
- *      Note that data is from a static buffer not allocated by the caller.
- * rlen is the size of the received content (pointed to by data).
+ * tag is the message tag returned by sm_fclose_start().
  */
 uint
-sm_fread(handle_t handle, uint readsize, void **data, uint *rlen, uint flags)
+sm_fclose_finish(uint tag)
 {
     uint rc;
-    hm_freadwrite_t msg;
-    hm_freadwrite_t *rdata;
-    uint rcvlen;
+    uint rlen;
+    hm_fopenhandle_t *rdata;
 
-    if ((sm_file_active == 0) && (sm_fservice() == 0))
-        return (KM_STATUS_UNAVAIL);
+    rc = host_recv_msg(tag, (void **) &rdata, &rlen);
+    host_tag_free(tag);
 
-    msg.hm_hdr.km_op     = KM_OP_FREAD;
-    msg.hm_hdr.km_status = 0;
-    msg.hm_hdr.km_tag    = host_tag_alloc();
-    msg.hm_handle        = handle;
-    msg.hm_length        = readsize;
-    msg.hm_flag          = flags;
-    msg.hm_unused        = 0;
+    if (rc == KS_STATUS_NODATA)
+        sm_fservice();  // Check if file service is still active
 
-    rc = host_msg(&msg, sizeof (msg), (void **) &rdata, &rcvlen);
+    return (rc);
+}
+
+/*
+ * sm_fread_reply
+ * --------------
+ * Receives the reply to a KM_OP_FREAD request which was sent with the
+ * specified tag. See sm_fread() for a description of arguments.
+ */
+static uint
+sm_fread_reply(uint tag, void **data, uint *rlen)
+{
+    uint rc;
+    hm_freadwrite_t *rdata;
+    uint rcvlen;
+
+    rc = host_recv_msg(tag, (void **) &rdata, &rcvlen);
 
     if ((rc != KM_STATUS_OK) && (rc != KM_STATUS_EOF)) {
         rcvlen = 0;
@@ -233,7 +317,6 @@ sm_fread(handle_t handle, uint readsize, void **data, uint *rlen, uint flags)
     if (rcvlen != rdata->hm_length) {
         /* More packets are inbound */
         uint total_len = rdata->hm_length;
-        uint tag = msg.hm_hdr.km_tag;
 
         if ((sm_mbuf == NULL) || (total_len >= sm_mbuf_size))  {
             if (sm_mbuf != NULL)
@@ -257,13 +340,193 @@ sm_read_fail:
     if (rlen != NULL)
         *rlen = rcvlen;
 
-    host_tag_free(msg.hm_hdr.km_tag);
-
     if (rc == KS_STATUS_NODATA)
         sm_fservice();  // Check if file service is still active
     return (rc);
 }
 
+/*
+ * sm_fread
+ * --------
+ * Returns data contents from the USB host's file handle, which could
+ * be from the contents of a file or directory entries.
+ *
+ * handle is the remote file handle: see sm_fopen().
+ * readsize is the maximum size of data to acquire.
+ * data is a pointer which is returned by this function.
+ *      Note that data is from a static buffer not allocated by the caller.
+ * rlen is the size of the received content (pointed to by data).
+ */
+uint
+sm_fread(handle_t handle, uint readsize, void **data, uint *rlen, uint flags)
+{
+    uint rc;
+    hm_freadwrite_t msg;
+
+    if (rlen != NULL)
+        *rlen = 0;
+    if ((sm_file_active == 0) && (sm_fservice() == 0))
+        return (KM_STATUS_UNAVAIL);
+
+    msg.hm_hdr.km_op     = KM_OP_FREAD;
+    msg.hm_hdr.km_status = 0;
+    msg.hm_hdr.km_tag    = host_tag_alloc();
+    msg.hm_handle        = handle;
+    msg.hm_length        = readsize;
+    msg.hm_flag          = flags;
+    msg.hm_unused        = 0;
+
+    rc = host_send_msg(&msg, sizeof (msg));
+    if (rc == 0)
+        rc = sm_fread_reply(msg.hm_hdr.km_tag, data, rlen);
+
+    host_tag_free(msg.hm_hdr.km_tag);
+    return (rc);
+}
+
+/*
+ * sm_fread_pipe_fill
+ * ------------------
+ * Issues additional read requests until the pipeline depth is reached,
+ * the requested length has been covered, or the end of file was seen.
+ */
+static uint
+sm_fread_pipe_fill(sm_fread_pipe_t *rp)
+{
+    hm_freadwrite_t msg;
+    uint rc;
+
+    while ((rp->rp_count < rp->rp_depth) && (rp->rp_remaining > 0) &&
+           (rp->rp_stop == 0)) {
+        uint len = rp->rp_chunk;
+        if (len > rp->rp_remaining)
+            len = rp->rp_remaining;
+
+        msg.hm_hdr.km_op     = KM_OP_FREAD;
+        msg.hm_hdr.km_status = 0;
+        msg.hm_hdr.km_tag    = host_tag_alloc();
+        msg.hm_handle        = rp->rp_handle;
+        msg.hm_length        = len;
+        msg.hm_flag          = rp->rp_flags;
+        msg.hm_unused        = 0;
+
+        rc = host_send_msg(&msg, sizeof (msg));
+        if (rc != 0) {
+            host_tag_free(msg.hm_hdr.km_tag);
+            rp->rp_stop = 1;
+            rp->rp_rc   = rc;
+            return (rc);
+        }
+        rp->rp_tag[(rp->rp_head + rp->rp_count) % SM_FREAD_PIPE_MAX] =
+            msg.hm_hdr.km_tag;
+        rp->rp_count++;
+        rp->rp_remaining -= len;
+        rp->rp_flags = 0;  // HM_FLAG_SEEK0 only applies to first request
+    }
+    return (KM_STATUS_OK);
+}
+
+/*
+ * sm_fread_pipe_start
+ * -------------------
+ * Begins a pipelined read of a USB host file. Several read requests,
+ * each with its own tag, are kept outstanding so that the USB host
+ * can be reading ahead while the Amiga consumes earlier data. Replies
+ * are returned in request order by sm_fread_pipe_next().
+ *
+ * rp is the pipeline state, provided by the caller.
+ * handle is the remote file handle: see sm_fopen().
+ * chunk is the size of each read request.
+ * total is the total number of bytes to request.
+ * depth is the number of requests to keep outstanding.
+ * flags are applied to the first read request (HM_FLAG_SEEK0).
+ */
+uint
+sm_fread_pipe_start(sm_fread_pipe_t *rp, handle_t handle, uint chunk,
+                    uint64_t total, uint depth, uint flags)
+{
+    if (depth < 1)
+        depth = 1;
+    if (depth > SM_FREAD_PIPE_MAX)
+        depth = SM_FREAD_PIPE_MAX;
+
+    rp->rp_handle    = handle;
+    rp->rp_remaining = total;
+    rp->rp_chunk     = chunk;
+    rp->rp_depth     = depth;
+    rp->rp_flags     = flags;
+    rp->rp_head      = 0;
+    rp->rp_count     = 0;
+    rp->rp_stop      = 0;
+    rp->rp_rc        = KM_STATUS_OK;
+
+    if ((sm_file_active == 0) && (sm_fservice() == 0)) {
+        rp->rp_stop = 1;
+        rp->rp_rc   = KM_STATUS_UNAVAIL;
+        return (KM_STATUS_UNAVAIL);
+    }
+    return (sm_fread_pipe_fill(rp));
+}
+
+/*
+ * sm_fread_pipe_next
+ * ------------------
+ * Returns the data for the oldest outstanding pipelined read request,
+ * then issues another request to keep the pipeline full. Arguments and
+ * return values are as for sm_fread(). KM_STATUS_EOF is returned with no
+ * data once all requested data has been returned.
+ */
+uint
+sm_fread_pipe_next(sm_fread_pipe_t *rp, void **data, uint *rlen)
+{
+    uint rc;
+    uint tag;
+
+    *rlen = 0;
+    (void) sm_fread_pipe_fill(rp);
+    if (rp->rp_count == 0)
+        return ((rp->rp_rc != KM_STATUS_OK) ? rp->rp_rc : KM_STATUS_EOF);
+
+    tag = rp->rp_tag[rp->rp_head];
+    rp->rp_head = (rp->rp_head + 1) % SM_FREAD_PIPE_MAX;
+    rp->rp_count--;
+
+    rc = sm_fread_reply(tag, data, rlen);
+    host_tag_free(tag);
+    if (rc != KM_STATUS_OK) {
+        /* End of file or failure: no further requests */
+        rp->rp_stop = 1;
+        if (rc != KM_STATUS_EOF)
+            rp->rp_rc = rc;
+    } else {
+        /* Get the next request going before the caller consumes data */
+        (void) sm_fread_pipe_fill(rp);
+    }
+    return (rc);
+}
+
+/*
+ * sm_fread_pipe_end
+ * -----------------
+ * Completes a pipelined read, collecting and discarding the replies
+ * to any requests still outstanding.
+ */
+void
+sm_fread_pipe_end(sm_fread_pipe_t *rp)
+{
+    void *data;
+    uint  rlen;
+
+    rp->rp_stop = 1;
+    while (rp->rp_count > 0) {
+        uint tag = rp->rp_tag[rp->rp_head];
+        rp->rp_head = (rp->rp_head + 1) % SM_FREAD_PIPE_MAX;
+        rp->rp_count--;
+        (void) sm_fread_reply(tag, &data, &rlen);
+        host_tag_free(tag);
+    }
+}
+
 /*
  * sm_fwrite
  * ---------
@@ -345,6 +608,201 @@ sm_fwrite(handle_t handle, void *buf, uint writelen, uint padded_header,
     return (rc);
 }
 
+/*
+ * sm_fwrite_start
+ * ---------------
+ * Sends data to be written to the USB host's file handle, but does not
+ * wait for the reply. The buffer must begin with uninitialized space
+ * reserved for a hm_freadwrite_t message header, as with the
+ * padded_header option of sm_fwrite(). The buffer may be reused as soon
+ * as this function returns.
+ *
+ * handle is the remote file handle: see sm_fopen().
+ * buf is the header space followed by the data to be written.
+ * writelen is the number of data bytes to write (excluding header).
+ * tag is assigned the message tag which must be passed to
+ *     sm_fwrite_finish() to collect the write status.
+ */
+uint
+sm_fwrite_start(handle_t handle, void *buf, uint writelen, uint flags,
+                uint *tag)
+{
+    hm_freadwrite_t *msg = buf;
+    uint rc;
+
+    if ((sm_file_active == 0) && (sm_fservice() == 0))
+        return (KM_STATUS_UNAVAIL);
+
+    msg->hm_hdr.km_op     = KM_OP_FWRITE;
+    msg->hm_hdr.km_status = 0;
+    msg->hm_hdr.km_tag    = host_tag_alloc();
+    msg->hm_handle        = handle;
+    msg->hm_length        = writelen;
+    msg->hm_flag          = flags;
+    msg->hm_unused        = 0;
+
+    rc = host_send_msg(msg, sizeof (*msg) + writelen);
+    if (rc != 0) {
+        host_tag_free(msg->hm_hdr.km_tag);
+        if (rc == KS_STATUS_NODATA)
+            sm_fservice();  // Check if file service is still active
+        return (rc);
+    }
+    *tag = msg->hm_hdr.km_tag;
+    return (KM_STATUS_OK);
+}
+
+/*
+ * sm_fwrite_finish
+ * ----------------
+ * Waits for the reply to a write started by sm_fwrite_start(),
+ * returning the status of the write.
+ *
+ * tag is the message tag returned by sm_fwrite_start().
+ */
+uint
+sm_fwrite_finish(uint tag)
+{
+    void *rdata;
+    uint  rlen;
+    uint  rc;
+
+    rc = host_recv_msg(tag, &rdata, &rlen);
+    host_tag_free(tag);
+
+    if (rc == KS_STATUS_NODATA)
+        sm_fservice();  // Check if file service is still active
+    return (rc);
+}
+
+/*
+ * sm_fsigs
+ * --------
+ * Gets block signatures of a file on the USB host, for delta transfer.
+ * See hm_fsigs_t for the signature format. Signatures are only provided
+ * for complete blocks, so fewer than requested may be returned.
+ *
+ * handle is the remote file handle (opened for read): see sm_fopen().
+ * blksize is the block size to summarize.
+ * block is the first block number.
+ * count is the number of blocks requested.
+ * sigs is a buffer of count entries to receive the signatures.
+ * got is assigned the number of signatures received.
+ */
+uint
+sm_fsigs(handle_t handle, uint blksize, uint block, uint count,
+         hm_fsig_t *sigs, uint *got)
+{
+    uint rc = KM_STATUS_OK;
+    uint rlen;
+    uint want;
+    uint rcount;
+    uint maxcount = HM_FSIGS_BYTES_MAX / blksize;
+    hm_fsigs_t  msg;
+    hm_fsigs_t *rmsg;
+
+    if ((sm_file_active == 0) && (sm_fservice() == 0))
+        return (KM_STATUS_UNAVAIL);
+
+    if (maxcount > HM_FSIGS_MAX)
+        maxcount = HM_FSIGS_MAX;
+    if (maxcount == 0)
+        return (KM_STATUS_INVALID);
+
+    *got = 0;
+    while (*got < count) {
+        want = count - *got;
+        if (want > maxcount)
+            want = maxcount;
+        msg.hm_hdr.km_op     = KM_OP_FSIGS;
+        msg.hm_hdr.km_status = 0;
+        msg.hm_hdr.km_tag    = host_tag_alloc();
+        msg.hm_handle        = handle;
+        msg.hm_blksize       = blksize;
+        msg.hm_block         = block + *got;
+        msg.hm_count         = want;
+
+        rc = host_msg(&msg, sizeof (msg), (void **) &rmsg, &rlen);
+        if (rc == KM_STATUS_OK) {
+            rcount = rmsg->hm_count;
+            if ((rcount > want) ||
+                (rlen < sizeof (*rmsg) + rcount * sizeof (*sigs))) {
+                rc = MSG_STATUS_BAD_LENGTH;
+            } else {
+                memcpy(sigs + *got, rmsg + 1, rcount * sizeof (*sigs));
+                *got += rcount;
+            }
+        }
+        host_tag_free(msg.hm_hdr.km_tag);
+        if (rc != KM_STATUS_OK)
+            break;
+        if (rcount < want)
+            break;  // End of file
+    }
+
+    if (rc == KS_STATUS_NODATA)
+        sm_fservice();  // Check if file service is still active
+    return (rc);
+}
+
+/*
+ * sm_fcopyrange_start
+ * -------------------
+ * Requests the USB host to copy a range of one open file to the current
+ * position of another, but does not wait for the reply. This is used by
+ * delta transfers to reuse data which is already present on the host.
+ *
+ * shandle is the source file handle (opened for read).
+ * offset is the source file offset. The source position is not changed.
+ * dhandle is the destination file handle (opened for write).
+ * length is the number of bytes to copy (at most HM_FCOPYRANGE_MAX).
+ * tag is assigned the message tag which must be passed to
+ *     sm_fcopyrange_finish() to collect the copy status.
+ */
+uint
+sm_fcopyrange_start(handle_t shandle, uint64_t offset, handle_t dhandle,
+                    uint length, uint *tag)
+{
+    hm_fcopyrange_t msg;
+    uint rc;
+
+    if ((sm_file_active == 0) && (sm_fservice() == 0))
+        return (KM_STATUS_UNAVAIL);
+
+    msg.hm_hdr.km_op     = KM_OP_FCOPYRANGE;
+    msg.hm_hdr.km_status = 0;
+    msg.hm_hdr.km_tag    = host_tag_alloc();
+    msg.hm_shandle       = shandle;
+    msg.hm_dhandle       = dhandle;
+    msg.hm_off_hi        = offset >> 32;
+    msg.hm_off_lo        = offset;
+    msg.hm_length        = length;
+
+    rc = host_send_msg(&msg, sizeof (msg));
+    if (rc != 0) {
+        host_tag_free(msg.hm_hdr.km_tag);
+        if (rc == KS_STATUS_NODATA)
+            sm_fservice();  // Check if file service is still active
+        return (rc);
+    }
+    *tag = msg.hm_hdr.km_tag;
+    return (KM_STATUS_OK);
+}
+
+/*
+ * sm_fcopyrange_finish
+ * --------------------
+ * Waits for the reply to a copy started by sm_fcopyrange_start(),
+ * returning the status of the copy.
+ *
+ * tag is the message tag returned by sm_fcopyrange_start().
+ */
+uint
+sm_fcopyrange_finish(uint tag)
+{
+    return (sm_fwrite_finish(tag));
+}
+
 /*
  * sm_fpath
  * --------
@@ -480,6 +938,91 @@ sm_frename(handle_t shandle, const char *name_old,
     return (rc);
 }
 
+/*
+ * sm_fcopy
+ * --------
+ * Copy or move a file or directory tree on the USB Host. The data is
+ * copied entirely by the USB Host and does not pass through the Amiga.
+ * The USB Host performs the work in slices of limited time, so this
+ * function will send requests until the copy is complete.
+ *
+ * shandle is the remote parent directory handle for the source name.
+ * name_src is the file or directory to copy.
+ * dhandle is the remote parent directory handle for the destination name.
+ * name_dst is the destination name. If this is an existing directory,
+ *     the source will be copied into that directory.
+ * flags are HM_COPY_RECURSIVE to copy a directory tree, HM_COPY_NOCLOBBER
+ *     to not replace existing files, and HM_COPY_MOVE to remove the
+ *     source once it has been copied.
+ * progress, if not NULL, is called after each slice of work. If it
+ *     returns non-zero, the copy is abandoned.
+ */
+uint
+sm_fcopy(handle_t shandle, const char *name_src,
+         handle_t dhandle, const char *name_dst, uint flags,
+         sm_fcopy_progress_t progress)
+{
+    uint rc;
+    uint len_from  = strlen(name_src) + 1;
+    uint len_to    = strlen(name_dst) + 1;
+    uint len_total = len_from + len_to;
+    uint rlen;
+    uint msglen;
+    hm_fcopy_t *rdata;
+    hm_fcopy_t *msg;
+
+    if (len_total > 2000) {
+        printf("Path \"%s\" plus \"%s\" too long\n", name_src, name_dst);
+        return (MSG_STATUS_BAD_LENGTH);
+    }
+    msglen = sizeof (*msg) + len_total;
+    msg = malloc(msglen);
+    if (msg == NULL) {
+        printf("malloc(%u) fail\n", msglen);
+        return (MSG_STATUS_NO_MEM);
+    }
+
+    memset(msg, 0, sizeof (*msg));
+    msg->hm_hdr.km_op     = KM_OP_FCOPY;
+    msg->hm_hdr.km_tag    = host_tag_alloc();
+    msg->hm_shandle       = shandle;
+    msg->hm_dhandle       = dhandle;
+    msg->hm_flags         = flags;
+    strcpy((char *)(msg + 1), name_src);  // From name follows message header
+    strcpy((char *)(msg + 1) + len_from, name_dst);  // To name follows that
+
+    while (1) {
+        rc = host_msg(msg, msglen, (void **) &rdata, &rlen);
+        if (rc != KM_STATUS_OK)
+            break;
+        if (rlen < sizeof (*rdata)) {
+            rc = MSG_STATUS_BAD_LENGTH;
+            break;
+        }
+        if (progress != NULL) {
+            if (progress(rdata->hm_files, rdata->hm_files_total,
+                         rdata->hm_kbytes, rdata->hm_kbytes_total) &&
+                ((rdata->hm_flags & HM_COPY_DONE) == 0)) {
+                flags |= HM_COPY_ABORT;
+            }
+        }
+        if (rdata->hm_flags & HM_COPY_DONE)
+            break;
+
+        /* Continue the copy job (names are not sent again) */
+        msg->hm_hdr.km_status = 0;
+        msg->hm_job           = rdata->hm_job;
+        msg->hm_flags         = flags;
+        msglen = sizeof (*msg);
+    }
+
+    host_tag_free(msg->hm_hdr.km_tag);
+    free(msg);
+    if (rc == KS_STATUS_NODATA)
+        sm_fservice();  // Check if file service is still active
+    return (rc);
+}
+
 /*
  * sm_fcreate
  * ----------
@@ -12,17 +12,62 @@
 #ifndef _SM_FILE_H
 #define _SM_FILE_H
 
+#define SM_FREAD_PIPE_MAX     8  // Maximum outstanding pipelined reads
+#define SM_FREAD_PIPE_DEFAULT 3  // Default pipelined read depth
+
+/* Pipelined read state; see sm_fread_pipe_start() */
+typedef struct {
+    handle_t rp_handle;                    // Remote file handle
+    uint64_t rp_remaining;                 // Bytes not yet requested
+    uint     rp_chunk;                     // Size of each read request
+    uint     rp_depth;                     // Requests to keep outstanding
+    uint     rp_flags;                     // Flags for next read request
+    uint     rp_head;                      // Oldest outstanding request
+    uint     rp_count;                     // Outstanding request count
+    uint     rp_rc;                        // Deferred request failure
+    uint8_t  rp_stop;                      // No more requests to be issued
+    uint16_t rp_tag[SM_FREAD_PIPE_MAX];    // Tags of outstanding requests
+} sm_fread_pipe_t;
+
+/*
+ * Copy progress callback; see sm_fcopy(). Return non-zero to abandon
+ * the copy.
+ */
+typedef uint (*sm_fcopy_progress_t)(uint files, uint files_total,
+                                    uint kbytes, uint kbytes_total);
+
 uint sm_fservice(void);
 uint sm_fopen(handle_t parent_handle, const char *name, uint mode,
               uint *hm_type, uint create_perms, handle_t *handle);
+uint sm_fopen_start(handle_t parent_handle, const char *name, uint mode,
+                    uint create_perms, uint *tag);
+uint sm_fopen_finish(uint tag, uint *hm_type, handle_t *handle,
+                     hm_fdirent_t *dent);
 uint sm_fclose(handle_t handle);
+uint sm_fclose_start(handle_t handle, uint *tag);
+uint sm_fclose_finish(uint tag);
 uint sm_fread(handle_t handle, uint readsize, void **data, uint *rlen,
               uint flags);
+uint sm_fread_pipe_start(sm_fread_pipe_t *rp, handle_t handle, uint chunk,
+                         uint64_t total, uint depth, uint flags);
+uint sm_fread_pipe_next(sm_fread_pipe_t *rp, void **data, uint *rlen);
+void sm_fread_pipe_end(sm_fread_pipe_t *rp);
 uint sm_fwrite(handle_t handle, void *buf, uint writelen, uint padded_header,
                uint flags);
+uint sm_fwrite_start(handle_t handle, void *buf, uint writelen, uint flags,
+                     uint *tag);
+uint sm_fwrite_finish(uint tag);
+uint sm_fsigs(handle_t handle, uint blksize, uint block, uint count,
+              hm_fsig_t *sigs, uint *got);
+uint sm_fcopyrange_start(handle_t shandle, uint64_t offset, handle_t dhandle,
+                         uint length, uint *tag);
+uint sm_fcopyrange_finish(uint tag);
 uint sm_fpath(handle_t handle, char **name);
 uint sm_frename(handle_t shandle, const char *name_old,
                 handle_t dhandle, const char *name_new);
+uint sm_fcopy(handle_t shandle, const char *name_src,
+              handle_t dhandle, const char *name_dst, uint flags,
+              sm_fcopy_progress_t progress);
 uint sm_fcreate(handle_t parent_handle, const char *name, const char *tgt_name,
                 uint hm_type, uint create_perms);
 uint sm_fdelete(handle_t handle, const char *name);
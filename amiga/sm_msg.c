@@ -16,8 +16,12 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #ifndef STANDALONE
+#include <clib/exec_protos.h>
 #include <exec/execbase.h>
+#include <exec/memory.h>
+#include <exec/semaphores.h>
 #endif
 #include <memory.h>
 #include "crc32.h"
@@ -162,31 +166,160 @@ send_cmd_retry(uint16_t cmd, void *arg, uint16_t arglen,
     return (rc);
 }
 
+#define CAL_TRIES     8     // Messages sent per calibration step
+#define CAL_LOOPBACK  1024  // Payload size for measuring the delay slope
+#define CAL_SLOPE_MAX 1024  // Largest delay slope considered
+
+/*
+ * msg_cal_probe
+ * -------------
+ * Sends CAL_TRIES messages using the current reply delay model.
+ * An empty NOP is sent if len is zero, otherwise a loopback of len bytes.
+ * Returns non-zero if any reply failed or Kicksmash was not yet ready
+ * when the reply magic search began.
+ */
+static uint
+msg_cal_probe(void *buf, uint len)
+{
+    uint pass;
+    uint rc;
+
+    for (pass = 0; pass < CAL_TRIES; pass++) {
+        if (len == 0) {
+            rc = send_cmd(KS_CMD_NOP, NULL, 0, NULL, 0, NULL);
+        } else {
+            rc = send_cmd(KS_CMD_LOOPBACK, buf, len, buf, len, NULL);
+            if (rc == KS_CMD_LOOPBACK)
+                rc = KS_STATUS_OK;
+        }
+        if ((rc != KS_STATUS_OK) || (sm_wait_stats.sws_search_last > 1))
+            return (1);
+    }
+    return (0);
+}
+
+/*
+ * msg_cal_search
+ * --------------
+ * Finds the smallest value for one reply delay model parameter at which
+ * msg_cal_probe() is reliable. The value is first doubled from start
+ * until messages succeed, then binary searched back down.
+ */
+static uint
+msg_cal_search(uint *val, uint start, uint limit, void *buf, uint len)
+{
+    uint good;
+    uint step;
+
+    for (*val = start; msg_cal_probe(buf, len) != 0; *val *= 2) {
+        if (*val >= limit)
+            return (MSG_STATUS_NO_REPLY);
+    }
+    good = *val;
+
+    for (step = good / 2; step > 0; step /= 2) {
+        *val = good - step;
+        if (msg_cal_probe(buf, len) == 0)
+            good = *val;
+    }
+    *val = good;
+    return (0);
+}
+
+/*
+ * msg_calibrate
+ * -------------
+ * Measures how long Kicksmash takes to have a reply ready, and sets the
+ * send_cmd_core() handshake delay model from that. The fixed part of the
+ * delay is found using empty messages, and the per-byte part using
+ * loopback messages. Margin is then added for run-time variation.
+ * The previous model is kept if Kicksmash does not respond.
+ */
+uint
+msg_calibrate(void)
+{
+    sm_wait_t save = sm_wait;
+    uint8_t  *buf;
+    uint      rc;
+
+    /* Quick check that Kicksmash is there at all */
+    rc = send_cmd(KS_CMD_NOP, NULL, 0, NULL, 0, NULL);
+    if (rc != KS_STATUS_OK)
+        return (rc);
+
+    buf = AllocMem(CAL_LOOPBACK, MEMF_PUBLIC | MEMF_CLEAR);
+    if (buf == NULL)
+        return (MSG_STATUS_NO_MEM);
+
+    sm_wait.sw_flags |= SW_FLAG_FIXED;
+    sm_wait.sw_slope = 0;
+    rc = msg_cal_search(&sm_wait.sw_base, SW_BASE_DEFAULT, SW_BASE_MAX,
+                        NULL, 0);
+    if (rc == 0) {
+        rc = msg_cal_search(&sm_wait.sw_slope, SW_SLOPE_DEFAULT,
+                            CAL_SLOPE_MAX, buf, CAL_LOOPBACK);
+    }
+    FreeMem(buf, CAL_LOOPBACK);
+
+    if (rc != 0) {
+        sm_wait = save;
+        return (rc);
+    }
+
+    sm_wait.sw_min    = sm_wait.sw_base;
+    sm_wait.sw_base  += (sm_wait.sw_base >> 1) + 1;
+    sm_wait.sw_slope += (sm_wait.sw_slope >> 2) + 1;
+    sm_wait.sw_flags  = (save.sw_flags & ~SW_FLAG_FIXED) | SW_FLAG_CALIBRATED;
+    sm_wait.sw_streak = 0;
+    memset(&sm_wait_stats, 0, sizeof (sm_wait_stats));
+    return (0);
+}
+
+/*
+ * msg_wait_show
+ * -------------
+ * Displays the reply handshake delay model and reply magic search
+ * statistics.
+ */
+void
+msg_wait_show(void)
+{
+    sm_wait_stats_t *st = &sm_wait_stats;
+    uint msgs = st->sws_msgs ? st->sws_msgs : 1;
+
+    printf("Reply wait: base %u  slope %u/256  min %u%s\n",
+           sm_wait.sw_base, sm_wait.sw_slope, sm_wait.sw_min,
+           (sm_wait.sw_flags & SW_FLAG_CALIBRATED) ? "  (calibrated)" : "");
+    printf("  msgs %u  late %u  no reply %u  bad CRC %u\n",
+           st->sws_msgs, st->sws_late, st->sws_no_reply, st->sws_bad_crc);
+    printf("  search avg %u.%02u  max %u  raised %u  lowered %u\n",
+           st->sws_search_total / msgs,
+           st->sws_search_total % msgs * 100 / msgs,
+           st->sws_search_max, st->sws_raised, st->sws_lowered);
+}
+
 /*
  * msg_init
  * --------
- * Initializes the KickSmash message interface.
+ * Initializes the KickSmash message interface and calibrates the
+ * reply handshake delay.
  */
 void
 msg_init(void)
 {
     cpu_control_init();
+    (void) msg_calibrate();
 }
 
 /*
- * recv_msg
- * --------
- * Receives a message from the remote USB Host via KickSmash.
- * buf is a pointer to a buffer where the received message will be stored.
- * len is the length of the receive message buffer.
- * rlen is the actual received message length, filled in by this function.
- * timeout_ms is the number of milliseconds to wait for a message to
- *     arrive before returning with a timeout failure.
- *
- * This function will return KS_STATUS_NODATA on timeout.
+ * recv_msg_poll
+ * -------------
+ * Polls Kicksmash for a message from the remote USB Host, waiting up
+ * to the specified number of milliseconds. Unlike recv_msg(), errors
+ * are not reported.
  */
-uint
-recv_msg(void *buf, uint len, uint *rlen, uint timeout_ms)
+static uint
+recv_msg_poll(void *buf, uint len, uint *rlen, uint timeout_ms)
 {
     uint rc;
     rc = send_cmd_retry(KS_CMD_MSG_RECEIVE, NULL, 0, buf, len, rlen);
@@ -201,6 +334,25 @@ recv_msg(void *buf, uint len, uint *rlen, uint timeout_ms)
     }
     if (rc == KS_CMD_MSG_SEND)
         rc = KM_STATUS_OK;
+    return (rc);
+}
+
+/*
+ * recv_msg
+ * --------
+ * Receives a message from the remote USB Host via KickSmash.
+ * buf is a pointer to a buffer where the received message will be stored.
+ * len is the length of the receive message buffer.
+ * rlen is the actual received message length, filled in by this function.
+ * timeout_ms is the number of milliseconds to wait for a message to
+ *     arrive before returning with a timeout failure.
+ *
+ * This function will return KS_STATUS_NODATA on timeout.
+ */
+uint
+recv_msg(void *buf, uint len, uint *rlen, uint timeout_ms)
+{
+    uint rc = recv_msg_poll(buf, len, rlen, timeout_ms);
     if (rc != KM_STATUS_OK) {
         printf("Get message failed: (%s)\n", smash_err(rc));
 #ifndef ROMFS
@@ -212,31 +364,363 @@ recv_msg(void *buf, uint len, uint *rlen, uint timeout_ms)
 }
 
 
+#define HOST_TAG_MAX       32    // Maximum simultaneously allocated tags
+#define HOST_RQ_MAX        32    // Maximum held replies for other tags
+#define HOST_RECV_MSG_MAX  4200  // Maximum received message size
+#define HOST_RECV_POLL_MS  20    // Poll interval between reply queue checks
+#define HOST_RECV_WAIT_MS  500   // Time to wait for a reply to arrive
+#define HOST_SHARED_NAME   "KickSmash.msg"
+#define HOST_SHARED_MAGIC  0x4b534d53  // "KSMS"
+#define HOST_SHARED_VER    1           // Bump when host_shared_t changes
+
+/*
+ * Host message tags and replies which arrive for a tag other than the
+ * one being waited upon are shared between all Amiga tasks talking to
+ * Kicksmash (smashfs, smashftp, etc). The shared state is found by
+ * name as a public semaphore, which also serializes access to it.
+ * Programs built with a different layout of the shared state do not
+ * share it (see host_shared_get()).
+ */
+typedef struct {
+    uint8_t  *hq_buf;                     // Held message (NULL = unused)
+    uint      hq_len;                     // Held message length
+    uint      hq_rc;                      // Receive status of message
+    uint      hq_seq;                     // Arrival order
+    uint16_t  hq_tag;                     // Held message tag
+} host_rq_ent_t;
+
+typedef struct {
+#ifndef STANDALONE
+    struct SignalSemaphore hs_sem;        // Public semaphore (must be first)
+#endif
+    char          hs_name[16];            // Semaphore name
+    uint32_t      hs_magic;               // HOST_SHARED_MAGIC
+    uint16_t      hs_version;             // HOST_SHARED_VER
+    uint16_t      hs_size;                // sizeof (host_shared_t)
+    uint16_t      hs_tag_next;            // Next tag to try allocating
+    uint          hs_rq_seq;              // Arrival order of held replies
+    uint16_t      hs_tag[HOST_TAG_MAX];   // Allocated tags
+    uint8_t       hs_tag_used[HOST_TAG_MAX];
+    void         *hs_tag_owner[HOST_TAG_MAX];  // Task which allocated tag
+    host_rq_ent_t hs_rq[HOST_RQ_MAX];     // Replies held for other tags
+} host_shared_t;
+
+static host_shared_t *host_shared;
+
+/*
+ * host_shared_get
+ * ---------------
+ * Locates (or creates) the message state shared between Amiga tasks.
+ */
+static host_shared_t *
+host_shared_get(void)
+{
+    static host_shared_t host_local;  // Used if shared state not available
+    host_shared_t *hs;
+
+    if (host_shared != NULL)
+        return (host_shared);
+
+#ifdef STANDALONE
+    hs = &host_local;
+#else
+    Forbid();
+    hs = (host_shared_t *) FindSemaphore(HOST_SHARED_NAME);
+    if (hs == NULL) {
+        hs = AllocMem(sizeof (*hs), MEMF_PUBLIC | MEMF_CLEAR);
+        if (hs != NULL) {
+            strcpy(hs->hs_name, HOST_SHARED_NAME);
+            hs->hs_magic   = HOST_SHARED_MAGIC;
+            hs->hs_version = HOST_SHARED_VER;
+            hs->hs_size    = sizeof (*hs);
+            hs->hs_sem.ss_Link.ln_Name = hs->hs_name;
+            hs->hs_sem.ss_Link.ln_Pri  = 0;
+            AddSemaphore(&hs->hs_sem);
+        }
+    } else if ((hs->hs_magic != HOST_SHARED_MAGIC) ||
+               (hs->hs_version != HOST_SHARED_VER) ||
+               (hs->hs_size != sizeof (*hs))) {
+        /* Created by an incompatible program; do not touch it */
+        Permit();
+        printf("Shared message state is from an incompatible version; "
+               "not sharing\n");
+        hs = &host_local;
+        InitSemaphore(&hs->hs_sem);
+        host_shared = hs;
+        return (hs);
+    }
+    Permit();
+    if (hs == NULL) {
+        printf("Failed to allocate shared message state\n");
+        hs = &host_local;
+        InitSemaphore(&hs->hs_sem);
+    }
+#endif
+    host_shared = hs;
+    return (hs);
+}
+
+static void
+host_shared_lock(host_shared_t *hs)
+{
+#ifdef STANDALONE
+    (void) hs;
+#else
+    ObtainSemaphore(&hs->hs_sem);
+#endif
+}
+
+static void
+host_shared_unlock(host_shared_t *hs)
+{
+#ifdef STANDALONE
+    (void) hs;
+#else
+    ReleaseSemaphore(&hs->hs_sem);
+#endif
+}
+
+/*
+ * host_tag_slot
+ * -------------
+ * Returns the allocation slot of the specified tag, or HOST_TAG_MAX
+ * if the tag is not currently allocated. Shared state must be locked.
+ */
+static uint
+host_tag_slot(host_shared_t *hs, uint tag)
+{
+    uint slot;
+
+    for (slot = 0; slot < HOST_TAG_MAX; slot++)
+        if (hs->hs_tag_used[slot] && (hs->hs_tag[slot] == tag))
+            break;
+    return (slot);
+}
+
+/*
+ * host_rq_free
+ * ------------
+ * Releases a held reply queue entry. Shared state must be locked.
+ */
+static void
+host_rq_free(host_rq_ent_t *hq)
+{
+#ifndef STANDALONE
+    FreeMem(hq->hq_buf, hq->hq_len);
+#endif
+    hq->hq_buf = NULL;
+}
+
+/*
+ * host_rq_put
+ * -----------
+ * Holds a received message which belongs to another allocated tag so
+ * that its waiter may later pick it up. Returns 0 if the message was
+ * held and 1 if it should be discarded.
+ */
+static uint
+host_rq_put(host_shared_t *hs, km_msg_hdr_t *msg, uint len, uint rc)
+{
+    host_rq_ent_t *hq;
+    uint           pos;
+    uint           held = 1;
+
+    host_shared_lock(hs);
+    if (host_tag_slot(hs, msg->km_tag) == HOST_TAG_MAX)
+        goto rq_put_done;  // Stale reply for a tag nobody owns
+
+    for (pos = 0; pos < HOST_RQ_MAX; pos++) {
+        hq = &hs->hs_rq[pos];
+        if (hq->hq_buf == NULL)
+            break;
+    }
+    if (pos == HOST_RQ_MAX) {
+        printf("Reply queue full\n");
+        goto rq_put_done;
+    }
+#ifndef STANDALONE
+    hq->hq_buf = AllocMem(len, MEMF_PUBLIC);
+#endif
+    if (hq->hq_buf == NULL)
+        goto rq_put_done;
+
+    memcpy(hq->hq_buf, msg, len);
+    hq->hq_len = len;
+    hq->hq_rc  = rc;
+    hq->hq_seq = hs->hs_rq_seq++;
+    hq->hq_tag = msg->km_tag;
+    held = 0;
+
+rq_put_done:
+    host_shared_unlock(hs);
+    return (held);
+}
+
+/*
+ * host_rq_get
+ * -----------
+ * Retrieves the oldest held reply for the specified tag into the caller's
+ * buffer. Multi-part replies are thereby returned in arrival order.
+ * Returns 0 if a reply was found.
+ */
+static uint
+host_rq_get(host_shared_t *hs, uint tag, void *buf, uint *rlen, uint *rc)
+{
+    host_rq_ent_t *hq;
+    host_rq_ent_t *oldest = NULL;
+    uint           pos;
+
+    host_shared_lock(hs);
+    for (pos = 0; pos < HOST_RQ_MAX; pos++) {
+        hq = &hs->hs_rq[pos];
+        if ((hq->hq_buf != NULL) && (hq->hq_tag == tag) &&
+            ((oldest == NULL) ||
+             ((int) (hq->hq_seq - oldest->hq_seq) < 0))) {
+            oldest = hq;
+        }
+    }
+    if (oldest != NULL) {
+        memcpy(buf, oldest->hq_buf, oldest->hq_len);
+        *rlen = oldest->hq_len;
+        *rc   = oldest->hq_rc;
+        host_rq_free(oldest);
+    }
+    host_shared_unlock(hs);
+    return (oldest == NULL);
+}
+
+/*
+ * host_task_exists
+ * ----------------
+ * Returns non-zero if the specified task is still known to exec.
+ */
+static uint
+host_task_exists(void *task)
+{
+#ifdef STANDALONE
+    (void) task;
+    return (1);
+#else
+    struct Node *node;
+    uint         found = 0;
+
+    Disable();
+    if (task == SysBase->ThisTask) {
+        found = 1;
+    } else {
+        for (node = SysBase->TaskReady.lh_Head; node->ln_Succ != NULL;
+             node = node->ln_Succ) {
+            if (node == task) {
+                found = 1;
+                break;
+            }
+        }
+        for (node = SysBase->TaskWait.lh_Head; (found == 0) &&
+             (node->ln_Succ != NULL); node = node->ln_Succ) {
+            if (node == task)
+                found = 1;
+        }
+    }
+    Enable();
+    return (found);
+#endif
+}
+
+/*
+ * host_tag_reclaim
+ * ----------------
+ * Frees the tags (and any replies held for them) of tasks which exited
+ * without calling host_tag_free(). Shared state must be locked.
+ */
+static void
+host_tag_reclaim(host_shared_t *hs)
+{
+    uint slot;
+    uint pos;
+
+    for (slot = 0; slot < HOST_TAG_MAX; slot++) {
+        if ((hs->hs_tag_used[slot] == 0) ||
+            host_task_exists(hs->hs_tag_owner[slot]))
+            continue;
+        hs->hs_tag_used[slot] = 0;
+        for (pos = 0; pos < HOST_RQ_MAX; pos++) {
+            host_rq_ent_t *hq = &hs->hs_rq[pos];
+            if ((hq->hq_buf != NULL) && (hq->hq_tag == hs->hs_tag[slot]))
+                host_rq_free(hq);
+        }
+    }
+}
+
 /*
  * host_tag_alloc
  * --------------
  * Allocate and return a new host message tag. See host_tag_free().
+ * Tags are unique among all Amiga tasks communicating with the USB host,
+ * so replies can be routed to the correct waiter.
  */
 uint
 host_tag_alloc(void)
 {
-    /* XXX: Fake "allocator" for now */
-    static uint16_t tag = 0;
-    return (tag++);
+    host_shared_t *hs = host_shared_get();
+    uint           slot;
+    uint           tag;
+
+    host_shared_lock(hs);
+    do {
+        tag = hs->hs_tag_next++;
+    } while (host_tag_slot(hs, tag) != HOST_TAG_MAX);
+
+    for (slot = 0; slot < HOST_TAG_MAX; slot++)
+        if (hs->hs_tag_used[slot] == 0)
+            break;
+    if (slot == HOST_TAG_MAX) {
+        /* Table full: reclaim tags of tasks which have exited */
+        host_tag_reclaim(hs);
+        for (slot = 0; slot < HOST_TAG_MAX; slot++)
+            if (hs->hs_tag_used[slot] == 0)
+                break;
+    }
+    if (slot < HOST_TAG_MAX) {
+        hs->hs_tag[slot]       = tag;
+        hs->hs_tag_used[slot]  = 1;
+#ifdef STANDALONE
+        hs->hs_tag_owner[slot] = NULL;
+#else
+        hs->hs_tag_owner[slot] = FindTask(NULL);
+#endif
+    } else {
+        /* Tag will work, but replies for it can not be held for it */
+        printf("Host tag table full\n");
+    }
+    host_shared_unlock(hs);
+    return (tag);
 }
 
 /*
  * host_tag_free
  * -------------
- * Deallocate the specified host message tag.
+ * Deallocate the specified host message tag. Any replies still held
+ * for the tag are discarded.
  *
  * tag is the message tag to deallocate.
  */
 void
 host_tag_free(uint tag)
 {
-    /* XXX: Fake "allocator" for now */
-    (void) tag;
+    host_shared_t *hs = host_shared_get();
+    uint           slot;
+    uint           pos;
+
+    host_shared_lock(hs);
+    slot = host_tag_slot(hs, tag);
+    if (slot < HOST_TAG_MAX)
+        hs->hs_tag_used[slot] = 0;
+    for (pos = 0; pos < HOST_RQ_MAX; pos++) {
+        host_rq_ent_t *hq = &hs->hs_rq[pos];
+        if ((hq->hq_buf != NULL) && (hq->hq_tag == tag))
+            host_rq_free(hq);
+    }
+    host_shared_unlock(hs);
 }
 
 #define SEND_MSG_MAX 2000
@@ -322,7 +806,9 @@ host_send_msg(void *smsg, uint len)
  * host_recv_msg
  * -------------
  * Receive a single message from the USB host, returning a pointer to the
- * buffer containing the message content.
+ * buffer containing the message content. Messages received which belong
+ * to other allocated tags are held for their waiters, and replies already
+ * held for this tag are returned before Kicksmash is polled.
  *
  * tag is the unique message tag for this transaction; see host_tag_alloc().
  * rdata is a pointer which will be assigned the address where the received
@@ -332,35 +818,59 @@ host_send_msg(void *smsg, uint len)
 uint
 host_recv_msg(uint tag, void **rdata, uint *rlen)
 {
-    static uint8_t buf[4200];
+    static uint8_t buf[HOST_RECV_MSG_MAX];
+    host_shared_t *hs = host_shared_get();
     km_msg_hdr_t *msg = (km_msg_hdr_t *)buf;
-    uint rc;
+    uint rc = KS_STATUS_NODATA;
     uint rxlen;
-    uint count;
+    uint count = 0;
+    uint waited = 0;
 
-    for (count = 0; count < 50; count++) {
-        rc = recv_msg(buf, sizeof (buf), &rxlen, 500);  // 500 ms timeout
+    while ((count < 50) && (waited < HOST_RECV_WAIT_MS)) {
+        if (host_rq_get(hs, tag, buf, &rxlen, &rc) == 0)
+            goto got_message;
+
+        rc = recv_msg_poll(buf, sizeof (buf), &rxlen, HOST_RECV_POLL_MS);
+        if (rc == KS_STATUS_NODATA) {
+            waited += HOST_RECV_POLL_MS;
+            continue;
+        }
         if ((rc != KM_STATUS_OK) && (rc != KM_STATUS_EOF))
-            return (rc);
-        if (tag == msg->km_tag) {
-            /* Got desired message */
-            if (rxlen > sizeof (buf)) {
-                printf("BUG: Rx message op=%x stat=%x too large (%u > %u)\n",
-                       msg->km_op, msg->km_status, rxlen, sizeof (buf));
-                rxlen = sizeof (buf);
-            }
-            *rlen = rxlen;
-            *rdata = buf;
-            if (rc == KM_STATUS_OK)
-                rc = msg->km_status;
-            return (rc);
+            break;
+        if (rxlen > sizeof (buf)) {
+            printf("BUG: Rx message op=%x stat=%x too large (%u > %u)\n",
+                   msg->km_op, msg->km_status, rxlen, sizeof (buf));
+            rxlen = sizeof (buf);
+        }
+        if (tag == msg->km_tag)
+            goto got_message;
+
+        /* Message belongs to another waiter */
+        if (host_rq_put(hs, msg, rxlen, rc) != 0) {
+            printf("Discarded message op=%02x status=%02x tag=%04x "
+                   "(want %04x)\n",
+                   msg->km_op, msg->km_status, msg->km_tag, tag);
         }
-        // XXX: Need to save this message as it's not for the current caller
-        printf("Discarded message op=%02x status=%02x tag=%04x (want %04x)\n",
-               msg->km_op, msg->km_status, msg->km_tag, tag);
+        count++;
+        waited = 0;
+    }
+    if (count == 50) {
+        printf("Message receive timeout\n");
+        return (KM_STATUS_FAIL);
     }
-    printf("Message receive timeout\n");
-    return (KM_STATUS_FAIL);
+    printf("Get message failed: (%s)\n", smash_err(rc));
+#ifndef ROMFS
+    if (flag_debug > 2)
+        dump_memory(buf, 0x40, DUMP_VALUE_UNASSIGNED);
+#endif
+    return (rc);
+
+got_message:
+    *rlen = rxlen;
+    *rdata = buf;
+    if (rc == KM_STATUS_OK)
+        rc = msg->km_status;
+    return (rc);
 }
 
 /*
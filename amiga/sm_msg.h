@@ -29,11 +29,54 @@
 
 typedef unsigned int uint;
 
+/*
+ * Reply handshake delay model. After sending a message, send_cmd_core()
+ * spins for
+ *     sw_base + (((arglen + replymax / 4) * sw_slope) >> 8)
+ * CIA ticks before polling for reply magic. The model is measured by
+ * msg_calibrate() and then tuned at run time from the reply magic
+ * search length, unless SW_FLAG_FIXED is set.
+ */
+typedef struct {
+    uint sw_base;   // Fixed delay in CIA ticks
+    uint sw_slope;  // Delay in 1/256 CIA tick units per payload byte
+    uint sw_min;    // Lowest sw_base which run-time tuning may set;
+                    // only lowered by a successful msg_calibrate()
+    uint sw_flags;  // SW_FLAG_*
+    uint sw_streak; // Consecutive replies with an immediate magic match
+} sm_wait_t;
+
+#define SW_FLAG_FIXED       0x0001  // Do not tune at run time
+#define SW_FLAG_CALIBRATED  0x0002  // Model came from msg_calibrate()
+
+#define SW_BASE_DEFAULT     10
+#define SW_SLOPE_DEFAULT    32      // Same as (arglen >> 3) + (replymax >> 5)
+#define SW_BASE_MAX         2000
+#define SW_LOWER_STREAK     64      // Immediate matches before reducing base
+
+/* Reply magic search statistics; search counts words beyond the minimum */
+typedef struct {
+    uint sws_msgs;          // Replies where magic was found
+    uint sws_no_reply;      // Magic was never found
+    uint sws_bad_crc;       // Reply CRC mismatch
+    uint sws_search_last;   // Extra words searched, last reply
+    uint sws_search_max;    // Extra words searched, worst case
+    uint sws_search_total;  // Extra words searched, sum over sws_msgs
+    uint sws_late;          // Replies where firmware was not yet ready
+    uint sws_raised;        // Run-time increases of sw_base
+    uint sws_lowered;       // Run-time decreases of sw_base
+} sm_wait_stats_t;
+
+extern sm_wait_t       sm_wait;
+extern sm_wait_stats_t sm_wait_stats;
+
 void msg_init(void);
+uint msg_calibrate(void);
+void msg_wait_show(void);
 
-#ifdef ROMFS
 extern const uint32_t lcrc32_table[];
-#endif
+extern const uint32_t lcrc32_wtable[];
+uint32_t crc32_w(uint32_t crc, const void *buf, size_t len);
 extern uint (*esend_cmd_core)(uint16_t cmd, void *arg, uint16_t arglen,
                               void *reply, uint replymax, uint *replyalen);
 uint send_cmd_core(uint16_t cmd, void *arg, uint16_t arglen,
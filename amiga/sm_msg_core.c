@@ -35,6 +35,10 @@
 uint smash_cmd_shift = 2;
 extern uint flag_debug;
 
+sm_wait_t       sm_wait = { SW_BASE_DEFAULT, SW_SLOPE_DEFAULT,
+                            SW_BASE_DEFAULT, 0, 0 };
+sm_wait_stats_t sm_wait_stats;
+
 #ifdef ROMFS
 #define crc32 lcrc32
 #define cia_ticks lcia_ticks
@@ -44,10 +48,9 @@ extern uint flag_debug;
 #define CONST_TO_RAM const __attribute__((section(".data")))
 #else
 #define TEXT_TO_RAM
-#define CONST_TO_RAM
+#define CONST_TO_RAM const
 #endif
 
-#ifdef ROMFS
 /*
  * STM32 CRC polynomial (also used in ethernet, SATA, MPEG-2, and ZMODEM)
  *      x^32 + x^26 + x^23 + x^22 + x^16 + x^12 + x^11 + x^10 + x^8 +
@@ -126,6 +129,120 @@ lcrc32_table[] = {
     0xbcb4666d, 0xb8757bda, 0xb5365d03, 0xb1f740b4
 };
 
+/*
+ * Word-at-a-time companion to lcrc32_table. Entry x is the CRC of byte x
+ * followed by a zero byte, which allows two message bytes to be folded
+ * into the CRC with one shift and two table lookups. See crc32_wstep().
+ */
+CONST_TO_RAM uint32_t
+lcrc32_wtable[] = {
+    0x00000000, 0xd219c1dc, 0xa0f29e0f, 0x72eb5fd3,
+    0x452421a9, 0x973de075, 0xe5d6bfa6, 0x37cf7e7a,
+    0x8a484352, 0x5851828e, 0x2abadd5d, 0xf8a31c81,
+    0xcf6c62fb, 0x1d75a327, 0x6f9efcf4, 0xbd873d28,
+    0x10519b13, 0xc2485acf, 0xb0a3051c, 0x62bac4c0,
+    0x5575baba, 0x876c7b66, 0xf58724b5, 0x279ee569,
+    0x9a19d841, 0x4800199d, 0x3aeb464e, 0xe8f28792,
+    0xdf3df9e8, 0x0d243834, 0x7fcf67e7, 0xadd6a63b,
+    0x20a33626, 0xf2baf7fa, 0x8051a829, 0x524869f5,
+    0x6587178f, 0xb79ed653, 0xc5758980, 0x176c485c,
+    0xaaeb7574, 0x78f2b4a8, 0x0a19eb7b, 0xd8002aa7,
+    0xefcf54dd, 0x3dd69501, 0x4f3dcad2, 0x9d240b0e,
+    0x30f2ad35, 0xe2eb6ce9, 0x9000333a, 0x4219f2e6,
+    0x75d68c9c, 0xa7cf4d40, 0xd5241293, 0x073dd34f,
+    0xbabaee67, 0x68a32fbb, 0x1a487068, 0xc851b1b4,
+    0xff9ecfce, 0x2d870e12, 0x5f6c51c1, 0x8d75901d,
+    0x41466c4c, 0x935fad90, 0xe1b4f243, 0x33ad339f,
+    0x04624de5, 0xd67b8c39, 0xa490d3ea, 0x76891236,
+    0xcb0e2f1e, 0x1917eec2, 0x6bfcb111, 0xb9e570cd,
+    0x8e2a0eb7, 0x5c33cf6b, 0x2ed890b8, 0xfcc15164,
+    0x5117f75f, 0x830e3683, 0xf1e56950, 0x23fca88c,
+    0x1433d6f6, 0xc62a172a, 0xb4c148f9, 0x66d88925,
+    0xdb5fb40d, 0x094675d1, 0x7bad2a02, 0xa9b4ebde,
+    0x9e7b95a4, 0x4c625478, 0x3e890bab, 0xec90ca77,
+    0x61e55a6a, 0xb3fc9bb6, 0xc117c465, 0x130e05b9,
+    0x24c17bc3, 0xf6d8ba1f, 0x8433e5cc, 0x562a2410,
+    0xebad1938, 0x39b4d8e4, 0x4b5f8737, 0x994646eb,
+    0xae893891, 0x7c90f94d, 0x0e7ba69e, 0xdc626742,
+    0x71b4c179, 0xa3ad00a5, 0xd1465f76, 0x035f9eaa,
+    0x3490e0d0, 0xe689210c, 0x94627edf, 0x467bbf03,
+    0xfbfc822b, 0x29e543f7, 0x5b0e1c24, 0x8917ddf8,
+    0xbed8a382, 0x6cc1625e, 0x1e2a3d8d, 0xcc33fc51,
+    0x828cd898, 0x50951944, 0x227e4697, 0xf067874b,
+    0xc7a8f931, 0x15b138ed, 0x675a673e, 0xb543a6e2,
+    0x08c49bca, 0xdadd5a16, 0xa83605c5, 0x7a2fc419,
+    0x4de0ba63, 0x9ff97bbf, 0xed12246c, 0x3f0be5b0,
+    0x92dd438b, 0x40c48257, 0x322fdd84, 0xe0361c58,
+    0xd7f96222, 0x05e0a3fe, 0x770bfc2d, 0xa5123df1,
+    0x189500d9, 0xca8cc105, 0xb8679ed6, 0x6a7e5f0a,
+    0x5db12170, 0x8fa8e0ac, 0xfd43bf7f, 0x2f5a7ea3,
+    0xa22feebe, 0x70362f62, 0x02dd70b1, 0xd0c4b16d,
+    0xe70bcf17, 0x35120ecb, 0x47f95118, 0x95e090c4,
+    0x2867adec, 0xfa7e6c30, 0x889533e3, 0x5a8cf23f,
+    0x6d438c45, 0xbf5a4d99, 0xcdb1124a, 0x1fa8d396,
+    0xb27e75ad, 0x6067b471, 0x128ceba2, 0xc0952a7e,
+    0xf75a5404, 0x254395d8, 0x57a8ca0b, 0x85b10bd7,
+    0x383636ff, 0xea2ff723, 0x98c4a8f0, 0x4add692c,
+    0x7d121756, 0xaf0bd68a, 0xdde08959, 0x0ff94885,
+    0xc3cab4d4, 0x11d37508, 0x63382adb, 0xb121eb07,
+    0x86ee957d, 0x54f754a1, 0x261c0b72, 0xf405caae,
+    0x4982f786, 0x9b9b365a, 0xe9706989, 0x3b69a855,
+    0x0ca6d62f, 0xdebf17f3, 0xac544820, 0x7e4d89fc,
+    0xd39b2fc7, 0x0182ee1b, 0x7369b1c8, 0xa1707014,
+    0x96bf0e6e, 0x44a6cfb2, 0x364d9061, 0xe45451bd,
+    0x59d36c95, 0x8bcaad49, 0xf921f29a, 0x2b383346,
+    0x1cf74d3c, 0xceee8ce0, 0xbc05d333, 0x6e1c12ef,
+    0xe36982f2, 0x3170432e, 0x439b1cfd, 0x9182dd21,
+    0xa64da35b, 0x74546287, 0x06bf3d54, 0xd4a6fc88,
+    0x6921c1a0, 0xbb38007c, 0xc9d35faf, 0x1bca9e73,
+    0x2c05e009, 0xfe1c21d5, 0x8cf77e06, 0x5eeebfda,
+    0xf33819e1, 0x2121d83d, 0x53ca87ee, 0x81d34632,
+    0xb61c3848, 0x6405f994, 0x16eea647, 0xc4f7679b,
+    0x79705ab3, 0xab699b6f, 0xd982c4bc, 0x0b9b0560,
+    0x3c547b1a, 0xee4dbac6, 0x9ca6e515, 0x4ebf24c9
+};
+
+/*
+ * crc32_wstep
+ * -----------
+ * Fold one big-endian 16-bit word into the CRC. The result is identical
+ * to crc32() of the same two bytes in memory order.
+ */
+static inline uint32_t
+crc32_wstep(uint32_t crc, uint16_t val)
+{
+    return ((crc << 16) ^
+            lcrc32_wtable[(crc >> 24) ^ (val >> 8)] ^
+            lcrc32_table[((crc >> 16) ^ val) & 0xff]);
+}
+
+/*
+ * crc32_w() calculates the same CRC as crc32(), but two bytes per step.
+ *           The buffer must be 16-bit aligned. An odd trailing byte is
+ *           folded using the byte table.
+ *
+ * @param [in]  crc - Initial value which can be used for repeated calls
+ *                    or specify 0 to start new calculation.
+ * @param [in]  buf - pointer to 16-bit aligned buffer holding data.
+ * @param [in]  len - length of buffer in bytes.
+ *
+ * @return      CRC-32 value.
+ */
+TEXT_TO_RAM
+uint32_t
+crc32_w(uint32_t crc, const void *buf, size_t len)
+{
+    const uint16_t *ptr = (const uint16_t *) buf;
+
+    for (; len >= 2; len -= 2)
+        crc = crc32_wstep(crc, *(ptr++));
+    if (len != 0)
+        crc = (crc << 8) ^ lcrc32_table[(crc >> 24) ^ (*ptr >> 8)];
+
+    return (crc);
+}
+
+#ifdef ROMFS
 uint (*esend_cmd_core)(uint16_t cmd, void *arg, uint16_t arglen,
                        void *reply, uint replymax, uint *replyalen) =
                       &send_cmd_core;
@@ -249,6 +366,70 @@ rom_wait_normal(uint32_t romval)
     }
 }
 
+/*
+ * wait_adapt
+ * ----------
+ * Tune the reply handshake delay from the number of extra words which
+ * were polled before reply magic was seen. A late reply raises the
+ * delay right away. A long run of immediate replies lowers it a step.
+ */
+TEXT_TO_RAM
+static void
+wait_adapt(uint extra)
+{
+    sm_wait_stats.sws_msgs++;
+    sm_wait_stats.sws_search_last = extra;
+    sm_wait_stats.sws_search_total += extra;
+    if (sm_wait_stats.sws_search_max < extra)
+        sm_wait_stats.sws_search_max = extra;
+
+    /*
+     * A 16-bit reply may begin in the low half of the first long read,
+     * so one extra word still means Kicksmash was ready in time.
+     */
+    if (extra > 1)
+        sm_wait_stats.sws_late++;
+
+    if (sm_wait.sw_flags & SW_FLAG_FIXED)
+        return;
+
+    if (extra > 1) {
+        sm_wait.sw_streak = 0;
+        sm_wait.sw_base += extra;
+        if (sm_wait.sw_base > SW_BASE_MAX)
+            sm_wait.sw_base = SW_BASE_MAX;
+        sm_wait_stats.sws_raised++;
+    } else if (++sm_wait.sw_streak >= SW_LOWER_STREAK) {
+        sm_wait.sw_streak = 0;
+        if (sm_wait.sw_base > sm_wait.sw_min) {
+            uint step = (sm_wait.sw_base >> 4) + 1;
+            if (sm_wait.sw_base - sm_wait.sw_min < step)
+                step = sm_wait.sw_base - sm_wait.sw_min;
+            sm_wait.sw_base -= step;
+            sm_wait_stats.sws_lowered++;
+        }
+    }
+}
+
+/*
+ * wait_backoff
+ * ------------
+ * Back off the reply handshake delay after a missing or corrupt reply,
+ * either of which may be caused by polling before Kicksmash was ready.
+ */
+TEXT_TO_RAM
+static void
+wait_backoff(void)
+{
+    if (sm_wait.sw_flags & SW_FLAG_FIXED)
+        return;
+    sm_wait.sw_streak = 0;
+    sm_wait.sw_base += (sm_wait.sw_base >> 1) + 1;
+    if (sm_wait.sw_base > SW_BASE_MAX)
+        sm_wait.sw_base = SW_BASE_MAX;
+    sm_wait_stats.sws_raised++;
+}
+
 /*
  * send_cmd_core
  * -------------
@@ -299,14 +480,25 @@ send_cmd_core(uint16_t cmd, void *arg, uint16_t arglen,
 #endif
 
     (void) *VADDR32(ROM_BASE + (arglen << smash_cmd_shift));
-    crc = crc32(0, &arglen, sizeof (arglen));
-    crc = crc32(crc, &cmd, sizeof (cmd));
-    crc = crc32(crc, argbuf, arglen);
+    crc = crc32_wstep(0, arglen);
+    crc = crc32_wstep(crc, cmd);
     (void) *VADDR32(ROM_BASE + (cmd << smash_cmd_shift));
 
-    /* Send message payload */
-    for (pos = 0; pos < (arglen + 1) / sizeof (uint16_t); pos++) {
-        (void) *VADDR32(ROM_BASE + (argbuf[pos] << smash_cmd_shift));
+    /*
+     * Send message payload. The CRC is folded in a word at a time
+     * while the payload is being sent rather than in a separate pass
+     * over the buffer beforehand.
+     */
+    for (pos = 0; pos < arglen / sizeof (uint16_t); pos++) {
+        val = argbuf[pos];
+        (void) *VADDR32(ROM_BASE + (val << smash_cmd_shift));
+        crc = crc32_wstep(crc, val);
+    }
+    if (arglen & 1) {
+        /* Odd length: only the high byte of the last word is covered */
+        val = argbuf[pos++];
+        (void) *VADDR32(ROM_BASE + (val << smash_cmd_shift));
+        crc = (crc << 8) ^ lcrc32_table[(crc >> 24) ^ (val >> 8)];
     }
     if (pos & 1) {
         /* Pad to 32-bit alignment */
@@ -325,8 +517,13 @@ send_cmd_core(uint16_t cmd, void *arg, uint16_t arglen,
      *
      * A3000 68030-25:  10 spins minimum
      * A3000 A3660 50M: 30 spins minimum
+     *
+     * The delay comes from a model which is calibrated by msg_calibrate()
+     * and then tuned by the reply magic search below (see wait_adapt()).
+     * The default model is (arglen >> 3) + (replymax >> 5) + 10.
      */
-    cia_spin((arglen >> 3) + (replymax >> 5) + 10);
+    cia_spin(sm_wait.sw_base +
+             (((arglen + (replymax >> 2)) * sm_wait.sw_slope) >> 8));
 //  cia_spin(100);  // XXX Debug delay for brief KS output
 
     /*
@@ -364,10 +561,10 @@ send_cmd_core(uint16_t cmd, void *arg, uint16_t arglen,
             }
         } else if (magic < ARRAY_SIZE(sm_magic) + 1) {
             replylen = val;     // Reply length
-            crc = crc32(0, &val, sizeof (val));
+            crc = crc32_wstep(0, val);
         } else if (magic < ARRAY_SIZE(sm_magic) + 2) {
             replystatus = val;  // Reply status
-            crc = crc32(crc, &val, sizeof (val));
+            crc = crc32_wstep(crc, val);
             word++;
             break;
         }
@@ -377,6 +574,8 @@ send_cmd_core(uint16_t cmd, void *arg, uint16_t arglen,
     if (word >= WAIT_FOR_MAGIC_LOOPS) {
         /* Did not see reply magic */
         replystatus = MSG_STATUS_NO_REPLY;
+        sm_wait_stats.sws_no_reply++;
+        wait_backoff();
         if (replyalen != NULL) {
             *replyalen = word * 2;
             if (*replyalen > replymax)
@@ -389,6 +588,8 @@ send_cmd_core(uint16_t cmd, void *arg, uint16_t arglen,
     if (replyalen != NULL)
         *replyalen = replylen;
 
+    wait_adapt(word - (ARRAY_SIZE(sm_magic) + 2));
+
 #ifdef SM_MSG_DEBUG
     uint16_t *dptr = (uint16_t *) ADDR16(0x77700);
     for (pos = 0; pos < ARRAY_SIZE(sm_magic); pos++)
@@ -424,6 +625,10 @@ send_cmd_core(uint16_t cmd, void *arg, uint16_t arglen,
             *(dptr++) = val;
 #endif
             *(replybuf++) = val;
+            if (pos + 1 < replylen)
+                crc = crc32_wstep(crc, val);
+            else
+                crc = (crc << 8) ^ lcrc32_table[(crc >> 24) ^ (val >> 8)];
         }
     }
     if (pos < replylen) {
@@ -446,7 +651,8 @@ scc_cleanup:
     }
 
     if (((replystatus & 0xffff0000) == 0) && (replystatus != KS_STATUS_CRC)) {
-        crc = crc32(crc, reply, replylen);
+        if (reply == NULL)
+            crc = crc32(crc, reply, replylen);  // Not folded in above
         if (crc != replycrc) {
 #ifdef SM_MSG_DEBUG
             *VADDR32(0x7770000) = crc;
@@ -458,6 +664,8 @@ scc_cleanup:
             *(dptr++) = 0xdead;
             *(dptr++) = 0xdead;
 #endif
+            sm_wait_stats.sws_bad_crc++;
+            wait_backoff();
             rom_wait_normal(rombase_value);
             return (MSG_STATUS_BAD_CRC);
         }
@@ -82,6 +82,7 @@ static struct    timerequest TimeRequest;
 #define CIAA_PRA_LED     BIT(1)
 
 #define VALUE_UNASSIGNED 0xffffffff
+#define BANK_AUTO        0xfffffffe  // Select least worn unused bank
 
 #define TEST_LOOPBACK_BUF 4096
 #define TEST_LOOPBACK_MAX 64
@@ -105,7 +106,7 @@ static const char cmd_options[] =
     "   sr <addr>     spin loop reading address (-x)\n"
     "   srr <addr>    spin loop reading address with ROM OVL set (-Y)\n"
     "   term          open Kicksmash firmware terminal [-T]\n"
-    "   test[0123456] do interface test (-t)\n";
+    "   test[01234567] do interface test (-t)\n";
 
 static const char cmd_bank_options[] =
     "  show                       Display all ROM bank information (-s)\n"
@@ -138,6 +139,7 @@ static const char cmd_write_options[] =
     "smash write options\n"
     "   addr <hex>   starting address (-a)\n"
     "   bank <num>   flash bank on which to operate (-b)\n"
+    "   bank auto    choose the least worn unused bank (-b)\n"
     "   cons         conservative flash write timing mode (-C)\n"
 //  "   dump         save hex/ASCII instead of binary (-d)\n"
     "   file <name>  file from which to read (-f)\n"
@@ -454,6 +456,39 @@ static const chip_blocks_t chip_blocks[] = {
     { 0x0000,  0, 32, 4, 0x1d },  // Default to bottom boot
 };
 
+static flash_geometry_t flash_geom;
+static uint             flash_geom_valid;
+
+/*
+ * flash_geometry_get
+ * ------------------
+ * Acquires the flash CFI geometry which Kicksmash has cached. The geometry
+ * is only used if it is for the specified chip id (0 matches any chip).
+ * If Kicksmash firmware doesn't support this command, or it has not yet
+ * queried the flash, then the built-in chip_blocks table is used instead.
+ */
+static void
+flash_geometry_get(uint32_t chipid)
+{
+    uint rc;
+    uint rlen = 0;
+
+    flash_geom_valid = 0;
+    rc = send_cmd(KS_CMD_FLASH_GEOMETRY, NULL, 0, &flash_geom,
+                  sizeof (flash_geom), &rlen);
+    if ((rc == 0) && (rlen >= sizeof (flash_geom)) && flash_geom.fg_valid &&
+        (flash_geom.fg_regions != 0) &&
+        (flash_geom.fg_regions <= FG_MAX_REGIONS) &&
+        ((chipid == 0) || (flash_geom.fg_chipid == chipid))) {
+        flash_geom_valid = 1;
+    }
+    if (flag_debug) {
+        printf("Flash geometry %svalid (rc=%s chipid=%08x)\n",
+               flash_geom_valid ? "" : "in", smash_err(rc),
+               flash_geom.fg_chipid);
+    }
+}
+
 static const chip_blocks_t *
 get_chip_block_info(uint32_t chipid)
 {
@@ -837,6 +872,8 @@ smash_test_loopback_perf(void)
         perf = total * 1000 / diff;
         perf *= 2;  // Write data + Read (reply) data
         printf("PASS  %u KB/sec\n", perf);
+        if (flag_debug)
+            msg_wait_show();
     }
 
 cleanup:
@@ -845,6 +882,65 @@ cleanup:
     return (rc);
 }
 
+/*
+ * smash_test_crc_perf
+ * -------------------
+ * Compare message CRC throughput of the byte-wise crc32() against the
+ * word-wise crc32_w() used by send_cmd_core(). Both must produce the
+ * same result. Timing uses the Kicksmash uptime clock, so the numbers
+ * reflect the CPU and cache configuration of the running system.
+ */
+static int
+smash_test_crc_perf(void)
+{
+    const uint passes = 32;
+    const uint total  = passes * TEST_LOOPBACK_BUF;
+    uint       cur;
+    uint       usecs_b;
+    uint       usecs_w;
+    uint32_t   crc_b = 0;
+    uint32_t   crc_w = 0;
+    uint64_t   time_start;
+    uint64_t   time_end;
+
+    show_test_state("CRC perf", -1);
+
+    for (cur = 0; cur < TEST_LOOPBACK_BUF; cur++)
+        test_loopback_buf[cur] = (uint8_t) (rand32() >> 8);
+
+    time_start = smash_time();
+    for (cur = 0; cur < passes; cur++)
+        crc_b = crc32(crc_b, test_loopback_buf, TEST_LOOPBACK_BUF);
+    time_end = smash_time();
+    usecs_b = (uint) (time_end - time_start);
+
+    time_start = smash_time();
+    for (cur = 0; cur < passes; cur++)
+        crc_w = crc32_w(crc_w, test_loopback_buf, TEST_LOOPBACK_BUF);
+    time_end = smash_time();
+    usecs_w = (uint) (time_end - time_start);
+
+    /* Odd length must also match */
+    if ((crc_b != crc_w) ||
+        (crc32(0, test_loopback_buf, 777) !=
+         crc32_w(0, test_loopback_buf, 777))) {
+        printf("FAIL: byte CRC %08x != word CRC %08x\n", crc_b, crc_w);
+        return (1);
+    }
+
+    if (flag_quiet == 0) {
+        if (usecs_b == 0)
+            usecs_b = 1;
+        if (usecs_w == 0)
+            usecs_w = 1;
+        printf("PASS  byte %u KB/sec  word %u KB/sec  (%u.%02ux)\n",
+               total / 1024 * 1000000 / usecs_b,
+               total / 1024 * 1000000 / usecs_w,
+               usecs_b / usecs_w, (usecs_b % usecs_w) * 100 / usecs_w);
+    }
+    return (0);
+}
+
 #define DELAY_MS_PER_TICK (1000 / 50)  // 50 ticks per second = 20 ms/tick
 
 static uint
@@ -1769,6 +1865,15 @@ smash_test(uint mask)
             return (rc);
     }
 
+    if (is_user_abort())
+        return (1);
+
+    if (mask & BIT(7)) {
+        rc = smash_test_crc_perf();
+        if (rc != 0)
+            return (rc);
+    }
+
     return (0);
 }
 
@@ -2145,13 +2250,128 @@ flash_show_id(void)
     return (rc);
 }
 
+/*
+ * get_flash_wear
+ * --------------
+ * Acquires the flash sector wear counters maintained by Kicksmash.
+ */
+static uint
+get_flash_wear(flash_wear_t *wear)
+{
+    uint rc;
+    uint rlen = 0;
+
+    rc = send_cmd(KS_CMD_GET | KS_GET_WEAR, NULL, 0, wear, sizeof (*wear),
+                  &rlen);
+    if ((rc == 0) && (rlen < sizeof (*wear)))
+        rc = MSG_STATUS_BAD_LENGTH;
+    return (rc);
+}
+
+/*
+ * flash_wear_bank
+ * ---------------
+ * Returns the total erase count of the flash sectors making up the
+ * specified bank, along with the highest sector count and the time
+ * of the most recent erase.
+ */
+static uint
+flash_wear_bank(flash_wear_t *wear, uint bank, uint *max, uint *etime)
+{
+    uint sectors = FW_SECTORS / ROM_BANKS;
+    uint sector;
+    uint total = 0;
+
+    *max = 0;
+    *etime = 0;
+    for (sector = bank * sectors; sector < (bank + 1) * sectors; sector++) {
+        total += wear->fw_erase_count[sector];
+        if (*max < wear->fw_erase_count[sector])
+            *max = wear->fw_erase_count[sector];
+        if (*etime < wear->fw_erase_time[sector])
+            *etime = wear->fw_erase_time[sector];
+    }
+    return (total);
+}
+
+static void
+show_erase_time(uint sec)
+{
+    struct DateTime dtime;
+    char            datebuf[32];
+    char            timebuf[32];
+    uint            min = sec / 60;
+
+    dtime.dat_Stamp.ds_Days   = min / (24 * 60);
+    dtime.dat_Stamp.ds_Minute = min % (24 * 60);
+    dtime.dat_Stamp.ds_Tick   = (sec % 60) * TICKS_PER_SECOND;
+    dtime.dat_Format          = FORMAT_DOS;
+    dtime.dat_Flags           = 0x0;
+    dtime.dat_StrDay          = NULL;
+    dtime.dat_StrDate         = datebuf;
+    dtime.dat_StrTime         = timebuf;
+    DateToStr(&dtime);
+    printf("%s %s", datebuf, timebuf);
+}
+
+/*
+ * rom_bank_least_worn
+ * -------------------
+ * Selects the unused bank with the fewest flash erases. A bank is
+ * considered unused if it has no name, is not merged, and is not the
+ * current, power-on, next reset, or a long reset sequence bank.
+ * Returns ROM_BANKS if no bank is available.
+ */
+static uint
+rom_bank_least_worn(bank_info_t *info)
+{
+    flash_wear_t wear;
+    uint         bank;
+    uint         best = ROM_BANKS;
+    uint         best_total = 0;
+    uint         have_wear;
+    uint         pos;
+
+    have_wear = (get_flash_wear(&wear) == 0);
+    if (!have_wear)
+        printf("Flash wear counters unavailable; using first unused bank\n");
+
+    for (bank = 0; bank < ROM_BANKS; bank++) {
+        uint total = 0;
+        uint max;
+        uint etime;
+
+        if ((info->bi_name[bank][0] != '\0') || (info->bi_merge[bank] != 0) ||
+            (bank == info->bi_bank_current) ||
+            (bank == info->bi_bank_poweron) ||
+            (bank == info->bi_bank_nextreset))
+            continue;
+        for (pos = 0; pos < ARRAY_SIZE(info->bi_longreset_seq); pos++)
+            if (info->bi_longreset_seq[pos] == bank)
+                break;
+        if (pos < ARRAY_SIZE(info->bi_longreset_seq))
+            continue;
+
+        if (have_wear)
+            total = flash_wear_bank(&wear, bank, &max, &etime);
+        if ((best == ROM_BANKS) || (total < best_total)) {
+            best = bank;
+            best_total = total;
+        }
+    }
+    if (best != ROM_BANKS)
+        printf("Selected bank %u (%u sector erases)\n", best, best_total);
+    return (best);
+}
+
 static void
 rom_bank_show(void)
 {
-    bank_info_t info;
-    uint        rlen;
-    uint        rc;
-    uint        bank;
+    bank_info_t  info;
+    flash_wear_t wear;
+    uint         rlen;
+    uint         rc;
+    uint         bank;
 
     rc = send_cmd(KS_CMD_BANK_INFO, NULL, 0, &info, sizeof (info), &rlen);
     if (rc != 0) {
@@ -2213,6 +2433,53 @@ rom_bank_show(void)
         aspaces += 8;
         printf("\n");
     }
+
+    if (get_flash_wear(&wear) != 0)
+        return;  // Older Kicksmash firmware
+    printf("\nBank  Erases  MaxSector  LastErase\n");
+    for (bank = 0; bank < ROM_BANKS; bank++) {
+        uint max;
+        uint etime;
+        uint total = flash_wear_bank(&wear, bank, &max, &etime);
+        printf("%-5u %-7u %-10u ", bank, total, max);
+        if (etime == 0)
+            printf("-");
+        else
+            show_erase_time(etime);
+        printf("\n");
+    }
+
+    printf("\nBank  Version Release   Size  Checksum\n");
+    for (bank = 0; bank < ROM_BANKS; bank++) {
+        static ks_rom_index_t kix;
+        uint8_t arg[2];
+
+        arg[0] = bank;
+        arg[1] = 0;
+        rc = send_cmd(KS_CMD_GET | KS_GET_ROMINDEX, arg, sizeof (arg),
+                      &kix, sizeof (kix), &rlen);
+        if (rc != 0)
+            return;  // Older Kicksmash firmware
+        printf("%-5u ", bank);
+        switch (kix.kix_state) {
+            case KIX_STATE_EMPTY:
+                printf("Empty\n");
+                break;
+            case KIX_STATE_UNKNOWN:
+                printf("Not Kickstart\n");
+                break;
+            case KIX_STATE_KICKSTART:
+                kix.kix_release[sizeof (kix.kix_release) - 1] = '\0';
+                printf("%2u.%-4u %-8s %4uK  %08x %s\n",
+                       kix.kix_version, kix.kix_revision, kix.kix_release,
+                       kix.kix_size >> 10, kix.kix_checksum,
+                       (kix.kix_flags & KIX_FLAG_CHECKSUM) ? "" : "BAD");
+                break;
+            default:
+                printf("Not yet indexed\n");
+                break;
+        }
+    }
 }
 
 static int
@@ -2674,11 +2941,22 @@ wait_for_flash_done(uint addr, uint erase_mode, uint32_t expected)
     uint32_t status;
     uint32_t cstatus = 0;
     uint32_t lstatus;
-    uint     spins = erase_mode ? 1000000 : 50000; // 1 sec or 50ms
+    uint     spins = (erase_mode == 1) ? 1000000 : 50000; // 1 sec or 50ms
     uint     spin_count = 0;
     int      same_count = 0;
     int      see_fail_count = 0;
 
+    /* erase_mode: 0=word program, 1=block erase, 2=write buffer program */
+    if (flash_geom_valid) {
+        /* Use the maximum times reported by flash CFI */
+        if ((erase_mode == 1) && (flash_geom.fg_block_erase_max_msec != 0))
+            spins = flash_geom.fg_block_erase_max_msec * 1000;
+        else if ((erase_mode == 0) && (flash_geom.fg_word_prog_max_usec != 0))
+            spins = flash_geom.fg_word_prog_max_usec * 4;
+        else if ((erase_mode == 2) && (flash_geom.fg_buf_prog_max_usec != 0))
+            spins = flash_geom.fg_buf_prog_max_usec * 4;
+    }
+
     cia_spin(2);
     lstatus = *VADDR32(addr);
     while (spin_count < spins) {
@@ -2722,6 +3000,73 @@ wait_for_flash_done(uint addr, uint erase_mode, uint32_t expected)
     return (MSG_STATUS_PRG_TMOUT);
 }
 
+/*
+ * flash_wbuf_words
+ * ----------------
+ * Returns the number of flash words (32-bit or 16-bit, depending on the
+ * flash mode) in a write buffer page, limited to what one
+ * KS_CMD_FLASH_MWRITE may carry, or 0 if the flash parts do not report
+ * a write buffer.
+ */
+static uint
+flash_wbuf_words(void)
+{
+    uint words;
+
+    if ((flash_geom_valid == 0) || (flash_geom.fg_wbuf_shift < 2) ||
+        (flash_geom.fg_buf_prog_max_usec == 0))
+        return (0);
+
+    /* Write buffer size is in bytes per (16-bit) device */
+    words = BIT(flash_geom.fg_wbuf_shift - 1);
+    if (words > KS_MWRITE_MAX_WORDS)
+        words = KS_MWRITE_MAX_WORDS;
+    return (words);
+}
+
+/*
+ * write_flash_buffer
+ * ------------------
+ * Must be called with interrupts and cache disabled
+ *
+ * Programs a run of 32-bit Amiga words (not crossing a write buffer page)
+ * using the flash write buffer, then reads back each word to verify.
+ * In 16-bit flash mode, each Amiga word is two flash words.
+ */
+static uint
+write_flash_buffer(uint addr, uint8_t *xbuf, uint words)
+{
+    uint32_t arg[1 + KS_MWRITE_MAX_WORDS];
+    uint32_t last = addr + (words - 1) * 4;
+    uint     pos;
+    uint     rc;
+
+    /* Skip if destination already has all values */
+    for (pos = 0; pos < words; pos++)
+        if (*ADDR32(xbuf + pos * 4) != *VADDR32(ROM_BASE + addr + pos * 4))
+            break;
+    if (pos == words)
+        return (0);
+
+    arg[0] = addr >> smash_cmd_shift;
+    for (pos = 0; pos < words; pos++)
+        arg[pos + 1] = *ADDR32(xbuf + pos * 4);
+
+    rc = flash_cmd_core(KS_CMD_FLASH_MWRITE, arg, (words + 1) * 4);
+    if (rc != 0)
+        return (rc);
+
+    rc = wait_for_flash_done(ROM_BASE + last, 2, *ADDR32(xbuf + last - addr));
+    if (rc != 0)
+        return (rc);
+
+    /* Verify the entire buffer */
+    for (pos = 0; pos < words; pos++)
+        if (*VADDR32(ROM_BASE + addr + pos * 4) != *ADDR32(xbuf + pos * 4))
+            return (MSG_STATUS_MISMATCH);
+    return (0);
+}
+
 static uint
 write_to_flash(uint bank, uint addr, void *buf, uint len)
 {
@@ -2733,6 +3078,7 @@ write_to_flash(uint bank, uint addr, void *buf, uint len)
     uint8_t *xbuf = buf;
     uint16_t bankarg = bank;
     uint fail_data = 0;
+    uint wbuf_words = flash_wbuf_words();
 
     SUPERVISOR_STATE_ENTER();
     INTERRUPTS_DISABLE();
@@ -2749,6 +3095,28 @@ write_to_flash(uint bank, uint addr, void *buf, uint len)
 
     /* Write flash data */
     while (len > 0) {
+        if ((wbuf_words > 1) && (len >= 8)) {
+            /*
+             * Program up to the end of the current write buffer page.
+             * The page is in flash words, while xlen is in 32-bit
+             * Amiga words (two flash words each in 16-bit mode).
+             */
+            xlen = (wbuf_words -
+                    ((addr >> smash_cmd_shift) & (wbuf_words - 1))) >>
+                   (2 - smash_cmd_shift);
+            if (xlen > len / 4)
+                xlen = len / 4;
+            if (xlen > 1) {
+                rc = write_flash_buffer(addr, xbuf, xlen);
+                if (rc == 0) {
+                    xlen *= 4;
+                    goto skip_write;
+                }
+                /* Fall back to single word program for the remainder */
+                flash_read_mode(1);
+                wbuf_words = 0;
+            }
+        }
         xlen = len;
         if (xlen > 4)
             xlen = 4;
@@ -2854,6 +3222,8 @@ erase_flash_block(uint bank, uint addr)
     uint cmd_tries = 0;
     uint erase_tries = 0;
     uint16_t bankarg = bank;
+    uint32_t waddr = addr >> smash_cmd_shift;
+    static uint8_t erase_noaddr;  // Firmware does not accept erase address
 
     SUPERVISOR_STATE_ENTER();
     INTERRUPTS_DISABLE();
@@ -2868,7 +3238,16 @@ erase_flash_block(uint bank, uint addr)
     /* Send erase command */
 try_erase_again:
     while (cmd_tries++ < 5) {
-        rc = flash_cmd_core(KS_CMD_FLASH_ERASE, NULL, 0);
+        if (erase_noaddr) {
+            rc = flash_cmd_core(KS_CMD_FLASH_ERASE, NULL, 0);
+        } else {
+            /* Sector address lets Kicksmash track flash wear */
+            rc = flash_cmd_core(KS_CMD_FLASH_ERASE, &waddr, sizeof (waddr));
+            if (rc == KS_STATUS_BADLEN) {
+                erase_noaddr = 1;  // Older firmware
+                rc = flash_cmd_core(KS_CMD_FLASH_ERASE, NULL, 0);
+            }
+        }
         if (rc == 0)
             break;
         uint count;
@@ -2918,8 +3297,38 @@ try_erase_again:
 static uint
 get_flash_bsize(const chip_blocks_t *cb, uint flash_addr)
 {
-    uint flash_bsize = cb->cb_bsize << (10 + smash_cmd_shift);
-    uint flash_bnum  = flash_addr / flash_bsize;
+    uint flash_bsize;
+    uint flash_bnum;
+
+    if (flash_geom_valid) {
+        /* CFI erase regions are in 256-byte units of a 16-bit device */
+        uint pos;
+        uint base = 0;
+        uint total = 0;
+
+        for (pos = 0; pos < flash_geom.fg_regions; pos++) {
+            total += flash_geom.fg_region[pos].er_blocks *
+                     (flash_geom.fg_region[pos].er_size <<
+                      (7 + smash_cmd_shift));
+        }
+        if (total != 0)
+            flash_addr %= total;  // Smaller devices wrap
+        for (pos = 0; pos < flash_geom.fg_regions; pos++) {
+            flash_bsize = flash_geom.fg_region[pos].er_size <<
+                          (7 + smash_cmd_shift);
+            base += flash_geom.fg_region[pos].er_blocks * flash_bsize;
+            if (flash_addr < base) {
+                if (flag_debug) {
+                    printf("Erase at %x region %u: flash_bsize=%x\n",
+                           flash_addr, pos, flash_bsize);
+                }
+                return (flash_bsize);
+            }
+        }
+    }
+
+    flash_bsize = cb->cb_bsize << (10 + smash_cmd_shift);
+    flash_bnum  = flash_addr / flash_bsize;
     if (flag_debug) {
         printf("Erase at %x bnum=%x: flash_bsize=%x flash_bbnum=%x\n",
                flash_addr, flash_bnum, flash_bsize, cb->cb_bbnum);
@@ -3052,6 +3461,7 @@ erase_flash(uint bank, uint addr, uint len, uint flag_yes)
                flash_dev1);
         return (MSG_STATUS_BAD_DATA);
     }
+    flash_geometry_get(flash_dev1);
     if (mode == 32) {
         cb2 = get_chip_block_info(flash_dev1);
         if (cb2 == NULL) {
@@ -3240,6 +3650,10 @@ cmd_readwrite(int argc, char *argv[])
                             goto usage;
                         }
                         pos = 0;
+                        if (writemode && (strcmp(argv[arg], "auto") == 0)) {
+                            bank = BANK_AUTO;
+                            break;
+                        }
                         if ((sscanf(argv[arg], "%x%n", &bank, &pos) != 1) ||
                             (pos == 0) || (argv[arg][pos] != '\0') ||
                             (bank >= ROM_BANKS)) {
@@ -3371,6 +3785,13 @@ usage:
                rc, smash_err(rc));
         return (rc);
     }
+    if (bank == BANK_AUTO) {
+        bank = rom_bank_least_worn(&info);
+        if (bank == ROM_BANKS) {
+            printf("No unused bank is available\n");
+            return (1);
+        }
+    }
     bank_sub  = info.bi_merge[bank] & 0x0f;
     bank_size = ((info.bi_merge[bank] + 0x10) & 0xf0) << 15;  // size in bytes
     if (bank_sub != 0) {
@@ -3489,6 +3910,8 @@ usage:
         if (flag_yes || are_you_sure("Erase area before write")) {
             if (erase_flash(bank, addr, len, 1))
                 return (1);
+        } else {
+            flash_geometry_get(0);  // Program timing for write_to_flash()
         }
     }
     if (readmode || writemode) {
@@ -4328,6 +4751,7 @@ main(int argc, char *argv[])
                     case '4':  // Remote USB host message loopback test
                     case '5':  // Flash ID
                     case '6':  // Commands
+                    case '7':  // CRC perf
                         flag_test_mask |= BIT(*ptr - '0');
                         flag_test++;
                         break;
@@ -4382,7 +4806,7 @@ main(int argc, char *argv[])
                         exit(1);
                 }
             }
-        } else if ((*ptr >= '0') && (*ptr <= '6') && (ptr[1] == '\0')) {
+        } else if ((*ptr >= '0') && (*ptr <= '7') && (ptr[1] == '\0')) {
             flag_test_mask |= BIT(*ptr - '0');
             flag_test++;
         } else {
@@ -4401,6 +4825,7 @@ main(int argc, char *argv[])
         flag_test_mask = ~0;
     if (flag_test) {
         srand32(time(NULL));
+        (void) msg_calibrate();
         test_loopback_buf = AllocMem(TEST_LOOPBACK_BUF * 2, MEMF_PUBLIC);
         if (flag_test_mask & (flag_test_mask - 1))
             do_multiple = 1;
@@ -69,6 +69,10 @@ static handle_t cwd_handle = 0xffffffff;
 BOOL __check_abort_enabled = 0;       // Disable gcc clib2 ^C break handling
 uint flag_debug = 0;
 uint8_t sm_file_active = 0;
+static uint get_depth = SM_FREAD_PIPE_DEFAULT;  // Outstanding reads for get
+static uint xfer_delta = 0;  // Use delta transfer for get and put
+static uint xfer_continue = 0;  // Resume partial files of get and put
+static uint xfer_journal_active = 0;  // Tree transfer journal is in use
 
 static const char cmd_get_help[] =
 "Usage:\n"
@@ -76,6 +80,10 @@ static const char cmd_get_help[] =
 "    get [path/]<name> <localname>   - get file from remote & rename locally\n"
 "    get [path/]<name> <localdir>    - get file from remote to local dir\n"
 "    get <name1> <name2> <name3...>  - get multiple files from remote\n"
+"    get -d <depth> ...              - keep <depth> reads outstanding (1-8)\n"
+"    get -D ...                      - delta transfer against local file\n"
+"    get -c ...                      - continue interrupted get\n"
+"    get -r <dir> [<localdir>]       - get directory tree from remote\n"
 ;
 
 static const char cmd_put_help[] =
@@ -84,6 +92,9 @@ static const char cmd_put_help[] =
 "    put [path/]<name> <remotename>  - send file to remote & rename\n"
 "    put [path/]<name> <remotedir>   - send file from local to remote dir\n"
 "    put <name1> <name2> <name3...>  - send multiple files to remote dir\n"
+"    put -r <dir> [<remotedir>]      - send directory tree to remote\n"
+"    put -D ...                      - delta transfer against remote file\n"
+"    put -c ...                      - continue interrupted put\n"
 ;
 
 const char cmd_time_help[] =
@@ -882,48 +893,962 @@ get_file_fib(const char *filename, struct FileInfoBlock *fib)
     return (0);
 }
 
+#define XFER_LOOKAHEAD 4  // Upcoming file opens to keep in flight
+
+/*
+ * xfer_ent_t describes one file of a multi-file transfer. The source
+ * and destination paths are stored immediately following the structure.
+ */
+typedef struct xfer_ent {
+    struct xfer_ent *xe_next;
+    char            *xe_src;    // Source path
+    char            *xe_dst;    // Destination path
+    uint             xe_perms;  // Amiga protection bits (put only)
+    uint             xe_size;   // File size in bytes (put only)
+} xfer_ent_t;
+
+typedef struct {
+    xfer_ent_t *xl_head;
+    xfer_ent_t *xl_tail;
+    uint        xl_count;
+} xfer_list_t;
+
+static void
+path_join(char *buf, const char *dir, const char *name)
+{
+    uint dirlen = strlen(dir);
+
+    strcpy(buf, dir);
+    if ((dirlen > 0) && (buf[dirlen - 1] != '/') && (buf[dirlen - 1] != ':'))
+        buf[dirlen++] = '/';
+    strcpy(buf + dirlen, name);
+}
+
+/*
+ * path_tail
+ * ---------
+ * Returns a pointer to the final element of the specified path.
+ */
+static const char *
+path_tail(const char *path)
+{
+    const char *ptr;
+
+    for (ptr = path; *ptr != '\0'; ptr++)
+        ;
+    for (; ptr > path; ptr--)
+        if ((ptr[-1] == '/') || (ptr[-1] == ':'))
+            break;
+    return (ptr);
+}
+
+/*
+ * xfer_add
+ * --------
+ * Appends <src_dir>/<name> -> <dst_dir>/<name> to the transfer list.
+ */
 static rc_t
-get_file(const char *src, const char *dst)
+xfer_add(xfer_list_t *xl, const char *src_dir, const char *dst_dir,
+         const char *name, uint perms, uint size)
+{
+    uint namelen = strlen(name);
+    uint srclen  = strlen(src_dir) + namelen + 2;
+    uint dstlen  = strlen(dst_dir) + namelen + 2;
+    xfer_ent_t *ent = malloc(sizeof (*ent) + srclen + dstlen);
+
+    if (ent == NULL) {
+        printf("malloc(%u) failure\n", sizeof (*ent) + srclen + dstlen);
+        return (RC_FAILURE);
+    }
+    ent->xe_next  = NULL;
+    ent->xe_src   = (char *) (ent + 1);
+    ent->xe_dst   = ent->xe_src + srclen;
+    ent->xe_perms = perms;
+    ent->xe_size  = size;
+    path_join(ent->xe_src, src_dir, name);
+    path_join(ent->xe_dst, dst_dir, name);
+
+    if (xl->xl_tail == NULL)
+        xl->xl_head = ent;
+    else
+        xl->xl_tail->xe_next = ent;
+    xl->xl_tail = ent;
+    xl->xl_count++;
+    return (RC_SUCCESS);
+}
+
+static void
+xfer_free(xfer_list_t *xl)
+{
+    xfer_ent_t *ent;
+
+    while ((ent = xl->xl_head) != NULL) {
+        xl->xl_head = ent->xe_next;
+        free(ent);
+    }
+    xl->xl_tail = NULL;
+    xl->xl_count = 0;
+}
+
+static void
+xfer_summary(uint count, uint64_t bytes, uint64_t time_start)
+{
+    uint diff = (uint) (smash_time() - time_start);
+
+    printf("%u file%s, ", count, (count == 1) ? "" : "s");
+    if (bytes < 1000000)
+        printf("%u bytes", (uint) bytes);
+    else
+        printf("%u KB", (uint) ((bytes + 512) >> 10));
+    printf(" in %u.%02u sec (%u KB/sec)\n", diff / 1000000,
+           (diff / 10000) % 100, calc_kb_sec(diff, bytes));
+}
+
+#define XFER_JOURNAL         "smashftp.journal"  // Tree transfer journal
+#define XFER_JOURNAL_LINEMAX 1024  // Longest journal line
+#define XFER_RESUME_BLKSIZE  4096  // Block compared before resuming a file
+
+/*
+ * xfer_remove
+ * -----------
+ * Removes the entry with the specified destination from the transfer
+ * list. Returns 1 if an entry was removed.
+ */
+static uint
+xfer_remove(xfer_list_t *xl, const char *dst)
+{
+    xfer_ent_t *ent;
+    xfer_ent_t *prev = NULL;
+
+    for (ent = xl->xl_head; ent != NULL; prev = ent, ent = ent->xe_next) {
+        if (strcmp(ent->xe_dst, dst) != 0)
+            continue;
+        if (prev == NULL)
+            xl->xl_head = ent->xe_next;
+        else
+            prev->xe_next = ent->xe_next;
+        if (xl->xl_tail == ent)
+            xl->xl_tail = prev;
+        xl->xl_count--;
+        free(ent);
+        return (1);
+    }
+    return (0);
+}
+
+/*
+ * xfer_journal_start
+ * ------------------
+ * Begins the journal of a directory tree transfer. The journal is kept
+ * in the current directory, and records each file as it completes, so
+ * that an interrupted transfer may be continued with the -c option.
+ * In that case, files which the journal shows were already completed
+ * by the same transfer are removed from the transfer list.
+ */
+static void
+xfer_journal_start(xfer_list_t *xl, const char *op, const char *src,
+                   const char *dst)
+{
+    FILE *fp;
+    char *line;
+    char *header;
+    uint  len;
+    uint  resume = 0;
+    uint  skipped = 0;
+
+    len = strlen(op) + strlen(src) + strlen(dst) + 4;
+    header = malloc(len);
+    line = malloc(XFER_JOURNAL_LINEMAX);
+    if ((header == NULL) || (line == NULL))
+        goto journal_start_done;
+    sprintf(header, "%s %s %s\n", op, src, dst);
+
+    if (xfer_continue && ((fp = fopen(XFER_JOURNAL, "r")) != NULL)) {
+        if ((fgets(line, XFER_JOURNAL_LINEMAX, fp) != NULL) &&
+            (strcmp(line, header) == 0)) {
+            resume = 1;
+            while (fgets(line, XFER_JOURNAL_LINEMAX, fp) != NULL) {
+                len = strlen(line);
+                if ((len > 0) && (line[len - 1] == '\n'))
+                    line[len - 1] = '\0';
+                skipped += xfer_remove(xl, line);
+            }
+        }
+        fclose(fp);
+    }
+    if (resume == 0) {
+        /* Start a new journal */
+        fp = fopen(XFER_JOURNAL, "w");
+        if (fp == NULL) {
+            printf("Failed to create %s\n", XFER_JOURNAL);
+            goto journal_start_done;
+        }
+        fputs(header, fp);
+        fclose(fp);
+    }
+    if (skipped > 0) {
+        printf("Skipping %u file%s completed earlier\n",
+               skipped, (skipped == 1) ? "" : "s");
+    }
+    xfer_journal_active = 1;
+
+journal_start_done:
+    free(header);
+    free(line);
+}
+
+/*
+ * xfer_journal_add
+ * ----------------
+ * Records a completed file in the journal. The journal is closed after
+ * each record so that it survives the Amiga being reset.
+ */
+static void
+xfer_journal_add(const char *dst)
+{
+    FILE *fp;
+
+    if (xfer_journal_active == 0)
+        return;
+    fp = fopen(XFER_JOURNAL, "a");
+    if (fp == NULL)
+        return;
+    fprintf(fp, "%s\n", dst);
+    fclose(fp);
+}
+
+/*
+ * xfer_journal_end
+ * ----------------
+ * Ends the journal of a directory tree transfer. The journal is only
+ * removed if all files were transferred.
+ */
+static void
+xfer_journal_end(rc_t rc)
+{
+    if (xfer_journal_active == 0)
+        return;
+    xfer_journal_active = 0;
+    if (rc == RC_SUCCESS)
+        (void) DeleteFile(XFER_JOURNAL);
+}
+
+/*
+ * xfer_resume_offset
+ * ------------------
+ * Determines where an interrupted transfer may continue, given the size
+ * of the partial destination file and the size of the source file. The
+ * offset is rounded down to a whole block, and the block preceding it
+ * is compared between the local file and the remote file using a hash
+ * computed by the USB host. Returns 0 if the transfer must start over.
+ *
+ * handle is the remote file, opened for read.
+ * local is the local file name.
+ */
+static uint
+xfer_resume_offset(handle_t handle, const char *local, uint64_t partial,
+                   uint64_t total)
+{
+    uint      resume;
+    uint      got;
+    uint      match = 0;
+    uint8_t  *buf;
+    FILE     *fp;
+    hm_fsig_t sig;
+
+    if ((partial > total) || (partial < XFER_RESUME_BLKSIZE))
+        return (0);
+    resume = (uint) partial & ~(XFER_RESUME_BLKSIZE - 1);
+    if ((sm_fsigs(handle, XFER_RESUME_BLKSIZE,
+                  resume / XFER_RESUME_BLKSIZE - 1, 1, &sig, &got) !=
+         KM_STATUS_OK) || (got != 1)) {
+        return (0);
+    }
+    buf = malloc(XFER_RESUME_BLKSIZE);
+    fp = fopen(local, "r");
+    if ((buf != NULL) && (fp != NULL) &&
+        (fseek(fp, resume - XFER_RESUME_BLKSIZE, SEEK_SET) == 0) &&
+        (fread(buf, 1, XFER_RESUME_BLKSIZE, fp) == XFER_RESUME_BLKSIZE) &&
+        (crc32(0, buf, XFER_RESUME_BLKSIZE) == sig.hs_strong)) {
+        match = 1;
+    }
+    if (fp != NULL)
+        fclose(fp);
+    free(buf);
+    if (match == 0) {
+        printf("%s differs from remote; starting over\n", local);
+        return (0);
+    }
+    return (resume);
+}
+
+/*
+ * remote_stat
+ * -----------
+ * Gets the directory entry of the specified remote file. This is only
+ * needed when the USB host does not return status with the open reply.
+ */
+static rc_t
+remote_stat(const char *name, hm_fdirent_t *dent)
 {
-    int      bytes;
-    uint     diff;
-    uint     type;
     uint     rc;
     uint     rlen;
-    uint     fileperms;
-    uint     filemtime;
-    uint     buflen = 32768;
+    uint     type;
     handle_t handle;
+    void    *data;
+
+    rc = sm_fopen(cwd_handle, name, HM_MODE_READDIR, &type, 0, &handle);
+    if (rc != KM_STATUS_OK) {
+        printf("Failed to open %s for stat: %s\n", name, smash_err(rc));
+        return (RC_FAILURE);
+    }
+    rc = sm_fread(handle, DIRBUF_SIZE, &data, &rlen, 0);
+    if (rlen < sizeof (*dent)) {
+        printf("Failed to stat remote file %s: %s\n", name, smash_err(rc));
+        sm_fclose(handle);
+        return (RC_FAILURE);
+    }
+    memcpy(dent, data, sizeof (*dent));
+    sm_fclose(handle);
+    return (RC_SUCCESS);
+}
+
+#define DELTA_BLKSIZE_MIN  2048    // Smallest delta transfer block size
+#define DELTA_BLKSIZE_MAX  32768   // Largest delta transfer block size
+#define DELTA_BLOCKS_MAX   4096    // Preferred maximum block signatures
+#define DELTA_LITERAL_MAX  32768   // Largest literal data sent at once
+#define DELTA_NOT_FOUND    0xffffffff
+#define DELTA_TMP_SUFFIX   ".smtmp"
+
+/*
+ * delta_sigs_t holds the block signatures of a remote file, indexed by
+ * weak checksum. Hash chain entries are block numbers plus one, so
+ * that zero terminates a chain.
+ */
+typedef struct {
+    uint       ds_blksize;   // Block size
+    uint       ds_count;     // Number of block signatures
+    uint       ds_hmask;     // Hash bucket index mask
+    hm_fsig_t *ds_sig;       // Block signatures
+    uint32_t  *ds_next;      // Next block in hash chain
+    uint32_t  *ds_bucket;    // First block in hash chain
+} delta_sigs_t;
+
+/*
+ * delta_xfer_t is the state of a delta transfer. For get, the local
+ * file offset of each matching remote block is recorded in dx_found.
+ * For put, literal data is written to the remote file and matching
+ * blocks are copied by the USB host from the existing remote file.
+ */
+typedef struct {
+    delta_sigs_t dx_sigs;       // Remote file block signatures
+    uint32_t    *dx_found;      // get: local offset of each remote block
+    handle_t     dx_shandle;    // put: existing remote file
+    handle_t     dx_dhandle;    // put: new remote file
+    char        *dx_buf;        // put: literal data with header space
+    uint         dx_tag;        // put: tag of outstanding request
+    uint         dx_pending;    // put: request outstanding
+    uint         dx_run_block;  // put: first block of pending copy
+    uint         dx_run_count;  // put: blocks in pending copy
+    uint64_t     dx_matched;    // Bytes reused from existing file
+    uint64_t     dx_literal;    // Bytes transferred
+} delta_xfer_t;
+
+/*
+ * delta_blksize
+ * -------------
+ * Picks the delta block size for a file, balancing the number of
+ * signatures to fetch against the granularity of matches.
+ */
+static uint
+delta_blksize(uint64_t filesize)
+{
+    uint blksize = DELTA_BLKSIZE_MIN;
+
+    while ((blksize < DELTA_BLKSIZE_MAX) &&
+           (filesize / blksize > DELTA_BLOCKS_MAX)) {
+        blksize <<= 1;
+    }
+    return (blksize);
+}
+
+static uint
+delta_hash(uint32_t weak)
+{
+    return (weak ^ (weak >> 16));
+}
+
+static void
+delta_sigs_free(delta_sigs_t *ds)
+{
+    free(ds->ds_sig);
+    free(ds->ds_next);
+    free(ds->ds_bucket);
+    memset(ds, 0, sizeof (*ds));
+}
+
+/*
+ * delta_sigs_load
+ * ---------------
+ * Fetches the block signatures of an open remote file and builds the
+ * weak checksum hash table.
+ */
+static rc_t
+delta_sigs_load(delta_sigs_t *ds, handle_t handle, uint64_t filesize,
+                uint blksize)
+{
+    uint count = (uint) (filesize / blksize);
+    uint hsize;
+    uint got;
+    uint pos;
+    uint rc;
+
+    memset(ds, 0, sizeof (*ds));
+    for (hsize = 64; hsize < count; hsize <<= 1)
+        ;
+    ds->ds_blksize = blksize;
+    ds->ds_hmask   = hsize - 1;
+    ds->ds_sig     = malloc(count * sizeof (*ds->ds_sig));
+    ds->ds_next    = malloc(count * sizeof (*ds->ds_next));
+    ds->ds_bucket  = malloc(hsize * sizeof (*ds->ds_bucket));
+    if ((ds->ds_sig == NULL) || (ds->ds_next == NULL) ||
+        (ds->ds_bucket == NULL)) {
+        printf("Failed to allocate %u block signatures\n", count);
+        delta_sigs_free(ds);
+        return (RC_FAILURE);
+    }
+    memset(ds->ds_bucket, 0, hsize * sizeof (*ds->ds_bucket));
+
+    rc = sm_fsigs(handle, blksize, 0, count, ds->ds_sig, &got);
+    if (rc != KM_STATUS_OK) {
+        printf("Failed to get block signatures: %s\n", smash_err(rc));
+        delta_sigs_free(ds);
+        return (RC_FAILURE);
+    }
+    ds->ds_count = got;
+
+    /* Insert in reverse, so the lowest matching block is found first */
+    for (pos = got; pos-- > 0; ) {
+        uint bucket = delta_hash(ds->ds_sig[pos].hs_weak) & ds->ds_hmask;
+        ds->ds_next[pos] = ds->ds_bucket[bucket];
+        ds->ds_bucket[bucket] = pos + 1;
+    }
+    return (RC_SUCCESS);
+}
+
+/*
+ * delta_find
+ * ----------
+ * Returns the remote block matching the data, or -1 if there is none.
+ * The strong checksum is only computed if the weak checksum matches.
+ */
+static int
+delta_find(delta_sigs_t *ds, uint32_t weak, const uint8_t *data)
+{
+    uint32_t ent;
+    uint32_t strong = 0;
+    uint     have_strong = 0;
+
+    for (ent = ds->ds_bucket[delta_hash(weak) & ds->ds_hmask]; ent != 0;
+         ent = ds->ds_next[ent - 1]) {
+        hm_fsig_t *sig = &ds->ds_sig[ent - 1];
+        if (sig->hs_weak != weak)
+            continue;
+        if (have_strong == 0) {
+            strong = crc32(0, data, ds->ds_blksize);
+            have_strong = 1;
+        }
+        if (sig->hs_strong == strong)
+            return (ent - 1);
+    }
+    return (-1);
+}
+
+/*
+ * delta_put_wait
+ * --------------
+ * Collects the status of the outstanding remote write or copy.
+ */
+static rc_t
+delta_put_wait(delta_xfer_t *dx)
+{
+    uint rc;
+
+    if (dx->dx_pending == 0)
+        return (RC_SUCCESS);
+    dx->dx_pending = 0;
+    rc = sm_fwrite_finish(dx->dx_tag);
+    if (rc != KM_STATUS_OK) {
+        printf("Remote delta write failed: %s\n", smash_err(rc));
+        return (RC_FAILURE);
+    }
+    return (RC_SUCCESS);
+}
+
+/*
+ * delta_put_run
+ * -------------
+ * Sends the pending run of matching blocks as remote range copies.
+ */
+static rc_t
+delta_put_run(delta_xfer_t *dx)
+{
+    uint blksize = dx->dx_sigs.ds_blksize;
+    uint rc;
+
+    while (dx->dx_run_count > 0) {
+        uint count = HM_FCOPYRANGE_MAX / blksize;
+        if (count > dx->dx_run_count)
+            count = dx->dx_run_count;
+        if (delta_put_wait(dx) != RC_SUCCESS)
+            return (RC_FAILURE);
+        rc = sm_fcopyrange_start(dx->dx_shandle,
+                                 (uint64_t) dx->dx_run_block * blksize,
+                                 dx->dx_dhandle, count * blksize,
+                                 &dx->dx_tag);
+        if (rc != KM_STATUS_OK) {
+            printf("Remote range copy failed: %s\n", smash_err(rc));
+            return (RC_FAILURE);
+        }
+        dx->dx_pending = 1;
+        dx->dx_run_block += count;
+        dx->dx_run_count -= count;
+    }
+    return (RC_SUCCESS);
+}
+
+/*
+ * delta_literal
+ * -------------
+ * Handles data of the local file which does not match any remote
+ * block. For put, the data is written to the new remote file.
+ */
+static rc_t
+delta_literal(delta_xfer_t *dx, const uint8_t *data, uint len)
+{
+    uint rc;
+
+    if (dx->dx_found != NULL)
+        return (RC_SUCCESS);  // get: only matches are of interest
+
+    if (delta_put_run(dx) != RC_SUCCESS)
+        return (RC_FAILURE);
+    while (len > 0) {
+        uint wlen = (len < DELTA_LITERAL_MAX) ? len : DELTA_LITERAL_MAX;
+        if (delta_put_wait(dx) != RC_SUCCESS)
+            return (RC_FAILURE);
+        memcpy(dx->dx_buf + sizeof (hm_freadwrite_t), data, wlen);
+        rc = sm_fwrite_start(dx->dx_dhandle, dx->dx_buf, wlen, 0,
+                             &dx->dx_tag);
+        if (rc != KM_STATUS_OK) {
+            printf("Remote write failed: %s\n", smash_err(rc));
+            return (RC_FAILURE);
+        }
+        dx->dx_pending = 1;
+        dx->dx_literal += wlen;
+        data += wlen;
+        len  -= wlen;
+    }
+    return (RC_SUCCESS);
+}
+
+/*
+ * delta_match
+ * -----------
+ * Handles a block of the local file at the specified offset which
+ * matches a remote block. For put, consecutive remote blocks are
+ * collected into a single range copy.
+ */
+static rc_t
+delta_match(delta_xfer_t *dx, uint block, uint64_t pos)
+{
+    if (dx->dx_found != NULL) {
+        if (dx->dx_found[block] == DELTA_NOT_FOUND)
+            dx->dx_found[block] = (uint32_t) pos;
+        return (RC_SUCCESS);
+    }
+
+    dx->dx_matched += dx->dx_sigs.ds_blksize;
+    if ((dx->dx_run_count > 0) &&
+        (block == dx->dx_run_block + dx->dx_run_count)) {
+        dx->dx_run_count++;
+        return (RC_SUCCESS);
+    }
+    if (delta_put_run(dx) != RC_SUCCESS)
+        return (RC_FAILURE);
+    dx->dx_run_block = block;
+    dx->dx_run_count = 1;
+    return (RC_SUCCESS);
+}
+
+/*
+ * delta_scan
+ * ----------
+ * Scans a local file for blocks matching the remote signatures, using
+ * a checksum which is rolled forward one byte at a time until a block
+ * matches. Each match and each run of unmatched data is passed on to
+ * delta_match() or delta_literal().
+ */
+static rc_t
+delta_scan(delta_xfer_t *dx, FILE *fp)
+{
+    uint      blksize  = dx->dx_sigs.ds_blksize;
+    uint      buflen   = DELTA_LITERAL_MAX + 2 * blksize;
+    uint      start    = 0;  // Start of checksum window
+    uint      end      = 0;  // End of valid data
+    uint      lit      = 0;  // Start of unmatched data
+    uint      have_sum = 0;
+    uint      at_eof   = 0;
+    uint      pos;
+    uint32_t  a = 0;
+    uint32_t  b = 0;
+    uint64_t  base = 0;      // File offset of buf[0]
+    uint8_t  *buf;
+    rc_t      rc = RC_SUCCESS;
+    int       block;
+
+    buf = malloc(buflen);
+    if (buf == NULL) {
+        printf("Failed to allocate %u bytes\n", buflen);
+        return (RC_FAILURE);
+    }
+    while (rc == RC_SUCCESS) {
+        if ((end - start <= blksize) && (at_eof == 0)) {
+            /* Move the window to the start of the buffer and refill */
+            uint len;
+            if (start > lit)
+                rc = delta_literal(dx, buf + lit, start - lit);
+            memmove(buf, buf + start, end - start);
+            base += start;
+            end  -= start;
+            start = 0;
+            lit   = 0;
+            len = fread(buf + end, 1, buflen - end, fp);
+            if (len < buflen - end) {
+                if (ferror(fp)) {
+                    printf("Local file read failed\n");
+                    rc = RC_FAILURE;
+                }
+                at_eof = 1;
+            }
+            end += len;
+            if (is_user_abort()) {
+                printf("^C\n");
+                rc = RC_USR_ABORT;
+            }
+            continue;
+        }
+        if (end - start < blksize)
+            break;
+        if (have_sum == 0) {
+            a = 0;
+            b = 0;
+            for (pos = 0; pos < blksize; pos++) {
+                a += buf[start + pos];
+                b += (blksize - pos) * buf[start + pos];
+            }
+            have_sum = 1;
+        }
+        block = delta_find(&dx->dx_sigs, (a & 0xffff) | (b << 16),
+                           buf + start);
+        if (block >= 0) {
+            if (start > lit)
+                rc = delta_literal(dx, buf + lit, start - lit);
+            if (rc == RC_SUCCESS)
+                rc = delta_match(dx, block, base + start);
+            start += blksize;
+            lit = start;
+            have_sum = 0;
+            continue;
+        }
+        if (end - start == blksize)
+            break;  // No more data to roll into the window
+
+        /* Roll the window forward by one byte */
+        a += buf[start + blksize] - buf[start];
+        b += a - blksize * buf[start];
+        start++;
+        if (start - lit >= DELTA_LITERAL_MAX) {
+            rc = delta_literal(dx, buf + lit, start - lit);
+            lit = start;
+        }
+    }
+    if ((rc == RC_SUCCESS) && (end > lit))
+        rc = delta_literal(dx, buf + lit, end - lit);
+    free(buf);
+    return (rc);
+}
+
+/*
+ * delta_report
+ * ------------
+ * Shows the transfer rate and how much of the file was reused from
+ * the existing copy.
+ */
+static void
+delta_report(delta_xfer_t *dx, uint64_t filesize, uint64_t time_start)
+{
+    uint diff     = (uint) (smash_time() - time_start);
+    uint kb_total = (uint) ((filesize + 512) >> 10);
+    uint kb_reuse = (uint) ((dx->dx_matched + 512) >> 10);
+    uint kb_xfer  = (uint) ((dx->dx_literal + 512) >> 10);
+
+    if (flag_debug)
+        printf("%u usec  ", diff);
+    printf(" %u KB/sec\n", calc_kb_sec(diff, filesize));
+    printf("  delta: %u KB reused, %u KB transferred, %u%% saved\n",
+           kb_reuse, kb_xfer, (kb_total == 0) ? 0 : kb_reuse * 100 / kb_total);
+}
+
+/*
+ * get_file_attrs
+ * --------------
+ * Applies the remote file's protection and date to a local file.
+ */
+static void
+get_file_attrs(const char *dst, hm_fdirent_t *dent)
+{
+    struct DateStamp datestamp;
+
+    if (SetProtection(dst, dent->hmd_aperms) == 0)
+        printf("Failed to set protection on %s\n", dst);
+    unix_time_to_amiga_datestamp(dent->hmd_mtime, &datestamp);
+    if (SetFileDate(dst, &datestamp) == 0)
+        printf("Failed to set date on %s\n", dst);
+}
+
+/*
+ * get_delta_build
+ * ---------------
+ * Writes the new local file from blocks of the old local file which
+ * match the remote file, and data read from the remote file for the
+ * ranges which did not match.
+ */
+static rc_t
+get_delta_build(delta_xfer_t *dx, const char *src, handle_t handle,
+                FILE *fp_old, FILE *fp_new, uint64_t filesize)
+{
+    uint     blksize = dx->dx_sigs.ds_blksize;
+    uint     count   = dx->dx_sigs.ds_count;
+    uint     block   = 0;
+    uint     end;
+    uint     rc;
+    uint     rlen;
     uint8_t *data;
+    uint8_t *buf;
     uint64_t pos = 0;
-    uint64_t filesize = 0;
+    uint64_t runlen;
+    uint64_t got;
+    rc_t     rrc = RC_SUCCESS;
+    sm_fread_pipe_t rpipe;
+
+    buf = malloc(blksize);
+    if (buf == NULL) {
+        printf("Failed to allocate %u bytes\n", blksize);
+        return (RC_FAILURE);
+    }
+    while ((pos < filesize) && (rrc == RC_SUCCESS)) {
+        if (is_user_abort()) {
+            printf("^C\n");
+            rrc = RC_USR_ABORT;
+            break;
+        }
+        if ((block < count) && (dx->dx_found[block] != DELTA_NOT_FOUND)) {
+            /* Block is already present in the old local file */
+            if ((fseek(fp_old, dx->dx_found[block], SEEK_SET) != 0) ||
+                (fread(buf, 1, blksize, fp_old) != blksize) ||
+                (fwrite(buf, 1, blksize, fp_new) != blksize)) {
+                printf("Local copy failed at pos %x\n", (uint) pos);
+                rrc = RC_FAILURE;
+                break;
+            }
+            dx->dx_matched += blksize;
+            pos += blksize;
+            block++;
+            continue;
+        }
+
+        /* Read the run of unmatched blocks (and any partial tail) */
+        for (end = block + 1; end < count; end++)
+            if (dx->dx_found[end] != DELTA_NOT_FOUND)
+                break;
+        if (end >= count) {
+            runlen = filesize - pos;
+            end = count;
+        } else {
+            runlen = (uint64_t) (end - block) * blksize;
+        }
+        rc = sm_fseek(handle, OFFSET_BEGINNING, pos, NULL, NULL);
+        if (rc != KM_STATUS_OK) {
+            rrc = RC_FAILURE;
+            break;
+        }
+        (void) sm_fread_pipe_start(&rpipe, handle, 32768, runlen, get_depth,
+                                   0);
+        for (got = 0; got < runlen; got += rlen) {
+            rc = sm_fread_pipe_next(&rpipe, (void **) &data, &rlen);
+            if (rlen == 0) {
+                printf("Failed to read %s at pos %x: %s\n",
+                       src, (uint) (pos + got), smash_err(rc));
+                rrc = RC_FAILURE;
+                break;
+            }
+            if (fwrite(data, 1, rlen, fp_new) != rlen) {
+                printf("Failed to write local file at pos %x\n",
+                       (uint) (pos + got));
+                rrc = RC_FAILURE;
+                break;
+            }
+        }
+        sm_fread_pipe_end(&rpipe);
+        dx->dx_literal += got;
+        pos += runlen;
+        block = end;
+    }
+    free(buf);
+    return (rrc);
+}
+
+/*
+ * get_file_delta
+ * --------------
+ * Gets a remote file by delta transfer against an existing local file
+ * of the same name. Blocks of the remote file which are found anywhere
+ * in the local file are copied locally, and only the remainder is read
+ * from the remote. Returns RC_NO_DATA if there is no local file which
+ * is suitable, in which case a normal transfer should be done.
+ */
+static rc_t
+get_file_delta(const char *src, const char *dst, handle_t handle,
+               hm_fdirent_t *dent)
+{
+    uint     blksize;
+    uint     count;
+    uint64_t filesize;
     uint64_t time_start;
-    uint64_t time_end;
-    FILE    *fp;
-    hm_fdirent_t *dent;
-    struct DateStamp datestamp;
+    char    *tmpname;
+    FILE    *fp_old;
+    FILE    *fp_new;
+    BPTR     lock;
+    rc_t     rc;
+    delta_xfer_t dx;
+    struct FileInfoBlock fib;
 
-    rc = sm_fopen(cwd_handle, src, HM_MODE_READDIR, &type, 0, &handle);
-    if (rc != KM_STATUS_OK) {
-        printf("Failed to open %s for stat: %s\n", src, smash_err(rc));
-        return (RC_FAILURE);
+    filesize = ((uint64_t) dent->hmd_size_hi << 32) | dent->hmd_size_lo;
+    lock = Lock(dst, ACCESS_READ);
+    if (lock == 0)
+        return (RC_NO_DATA);
+    if ((Examine(lock, &fib) == 0) || (fib.fib_DirEntryType >= 0) ||
+        (fib.fib_Size < DELTA_BLKSIZE_MIN) ||
+        (filesize < DELTA_BLKSIZE_MIN)) {
+        UnLock(lock);
+        return (RC_NO_DATA);
     }
+    UnLock(lock);
+
+    printf("Get %s as %s ", src, dst);
+    if (filesize < 1000000)
+        printf("(%u bytes) ", (uint) filesize);
+    else
+        printf("(%u KB) ", (uint) ((filesize + 512) >> 10));
+    fflush(stdout);
 
-    rc = sm_fread(handle, DIRBUF_SIZE, (void **) &dent, &rlen, 0);
-    if (rlen == 0) {
-        printf("Failed to stat remote file %s: %s\n", src, smash_err(rc));
+    time_start = smash_time();
+    memset(&dx, 0, sizeof (dx));
+    blksize = delta_blksize(filesize);
+    if (delta_sigs_load(&dx.dx_sigs, handle, filesize, blksize) !=
+        RC_SUCCESS) {
         return (RC_FAILURE);
     }
+    count = dx.dx_sigs.ds_count;
+    tmpname = malloc(strlen(dst) + sizeof (DELTA_TMP_SUFFIX));
+    dx.dx_found = malloc(count * sizeof (*dx.dx_found) + 1);
+    if ((tmpname == NULL) || (dx.dx_found == NULL)) {
+        printf("malloc failure\n");
+        rc = RC_FAILURE;
+        goto get_delta_free;
+    }
+    memset(dx.dx_found, 0xff, count * sizeof (*dx.dx_found));
+    sprintf(tmpname, "%s%s", dst, DELTA_TMP_SUFFIX);
+
+    fp_old = fopen(dst, "r");
+    if (fp_old == NULL) {
+        printf("Failed to open %s for read\n", dst);
+        rc = RC_FAILURE;
+        goto get_delta_free;
+    }
+    fp_new = fopen(tmpname, "w");
+    if (fp_new == NULL) {
+        printf("Failed to open %s for write\n", tmpname);
+        fclose(fp_old);
+        rc = RC_FAILURE;
+        goto get_delta_free;
+    }
+
+    rc = delta_scan(&dx, fp_old);
+    if (rc == RC_SUCCESS)
+        rc = get_delta_build(&dx, src, handle, fp_old, fp_new, filesize);
+    fclose(fp_old);
+    if (fclose(fp_new) != 0)
+        rc = RC_FAILURE;
+
+    if (rc == RC_SUCCESS) {
+        if ((DeleteFile(dst) == 0) || (Rename(tmpname, dst) == 0)) {
+            printf("Failed to replace %s with %s\n", dst, tmpname);
+            rc = RC_FAILURE;
+        } else {
+            delta_report(&dx, filesize, time_start);
+            get_file_attrs(dst, dent);
+        }
+    } else {
+        (void) DeleteFile(tmpname);
+    }
+
+get_delta_free:
+    free(tmpname);
+    free(dx.dx_found);
+    delta_sigs_free(&dx.dx_sigs);
+    return (rc);
+}
+
+/*
+ * get_file_data
+ * -------------
+ * Reads the contents of an open remote file into the specified local
+ * file, then applies the remote file's protection and date. The remote
+ * handle is not closed.
+ */
+static rc_t
+get_file_data(const char *src, const char *dst, handle_t handle,
+              hm_fdirent_t *dent)
+{
+    int      bytes;
+    uint     diff;
+    uint     rc;
+    uint     rlen;
+    uint     buflen = 32768;
+    uint8_t *data;
+    uint64_t pos = 0;
+    uint64_t start;
+    uint64_t filesize;
+    uint64_t time_start;
+    uint64_t time_end;
+    FILE    *fp;
+    BPTR     lock;
+    sm_fread_pipe_t rpipe;
+    struct FileInfoBlock fib;
 
     filesize = ((uint64_t) dent->hmd_size_hi << 32) | dent->hmd_size_lo;
-    fileperms = dent->hmd_aperms;
-    filemtime = dent->hmd_mtime;
-    sm_fclose(handle);
 
     if (is_user_abort()) {
         printf("^C\n");
         return (RC_USR_ABORT);
     }
+    if (xfer_delta) {
+        rc = get_file_delta(src, dst, handle, dent);
+        if (rc != RC_NO_DATA)
+            return (rc);
+    }
     printf("Get %s as %s ", src, dst);
     if (filesize < 1000000)
         printf("(%u bytes) ", (uint) filesize);
@@ -931,28 +1856,43 @@ get_file(const char *src, const char *dst)
         printf("(%u KB) ", (uint) ((filesize + 512) >> 10));
     fflush(stdout);
 
-    rc = sm_fopen(cwd_handle, src, HM_MODE_READ, &type, 0, &handle);
-    if (rc != KM_STATUS_OK) {
-        printf("Failed to open %s for read: %s\n", src, smash_err(rc));
-        return (RC_FAILURE);
+    if (xfer_continue && ((lock = Lock(dst, ACCESS_READ)) != 0)) {
+        /* Continue from the end of a partial local file */
+        if (Examine(lock, &fib) && (fib.fib_DirEntryType < 0))
+            pos = xfer_resume_offset(handle, dst, fib.fib_Size, filesize);
+        UnLock(lock);
     }
-    fp = fopen(dst, "w");
+
+    fp = fopen(dst, (pos != 0) ? "r+" : "w");
     if (fp == NULL) {
         printf("Failed to open %s for write\n", dst);
-        sm_fclose(handle);
         return (RC_FAILURE);
     }
+    if (pos != 0) {
+        printf("from %u KB ", (uint) (pos >> 10));
+        fflush(stdout);
+        if ((fseek(fp, pos, SEEK_SET) != 0) ||
+            (sm_fseek(handle, OFFSET_BEGINNING, pos, NULL, NULL) !=
+             KM_STATUS_OK)) {
+            printf("Failed to seek to %u\n", (uint) pos);
+            fclose(fp);
+            return (RC_FAILURE);
+        }
+    }
 
     rc = RC_SUCCESS;
+    start = pos;
     time_start = smash_time();
+    (void) sm_fread_pipe_start(&rpipe, handle, buflen, filesize - pos,
+                               get_depth, 0);
     while (pos < filesize) {
         if (is_user_abort()) {
             printf("^C\n");
+            sm_fread_pipe_end(&rpipe);
             fclose(fp);
-            sm_fclose(handle);
             return (RC_USR_ABORT);
         }
-        rc = sm_fread(handle, buflen, (void **) &data, &rlen, 0);
+        rc = sm_fread_pipe_next(&rpipe, (void **) &data, &rlen);
         if (rlen == 0) {
 failed_to_read:
             printf("Failed to read %s at pos %x: %s\n",
@@ -972,19 +1912,14 @@ failed_to_read:
         if (rc != RC_SUCCESS)
             goto failed_to_read;
     }
+    sm_fread_pipe_end(&rpipe);
     time_end = smash_time();
     diff = (uint) (time_end - time_start);
     if (flag_debug)
         printf("%u usec  ", diff);
-    printf(" %u KB/sec\n", calc_kb_sec(diff, filesize));
+    printf(" %u KB/sec\n", calc_kb_sec(diff, filesize - start));
     fclose(fp);
-    sm_fclose(handle);
-
-    if (SetProtection(dst, fileperms) == 0)
-        printf("Failed to set protection on %s\n", dst);
-    unix_time_to_amiga_datestamp(filemtime, &datestamp);
-    if (SetFileDate(dst, &datestamp) == 0)
-        printf("Failed to set date on %s\n", dst);
+    get_file_attrs(dst, dent);
 
     if (rc == KM_STATUS_EOF)
         rc = 0;
@@ -992,107 +1927,309 @@ failed_to_read:
 }
 
 static rc_t
-get_files(const char *src, const char *dst)
+get_file(const char *src, const char *dst)
+{
+    uint     rc;
+    uint     tag;
+    uint     type;
+    handle_t handle;
+    hm_fdirent_t dent;
+
+    /* File status comes back with the open reply */
+    rc = sm_fopen_start(cwd_handle, src, HM_MODE_READ | HM_MODE_STAT, 0, &tag);
+    if (rc == KM_STATUS_OK)
+        rc = sm_fopen_finish(tag, &type, &handle, &dent);
+    if (rc != KM_STATUS_OK) {
+        printf("Failed to open %s for read: %s\n", src, smash_err(rc));
+        return (RC_FAILURE);
+    }
+    if ((dent.hmd_type == HM_TYPE_UNKNOWN) &&
+        (remote_stat(src, &dent) != RC_SUCCESS)) {
+        sm_fclose(handle);
+        return (RC_FAILURE);
+    }
+    rc = get_file_data(src, dst, handle, &dent);
+    sm_fclose(handle);
+    return (rc);
+}
+
+/*
+ * get_collect
+ * -----------
+ * Walks a remote directory tree, creating matching local directories
+ * and adding all regular files found to the transfer list.
+ */
+static rc_t
+get_collect(xfer_list_t *xl, const char *src, const char *dst)
+{
+    uint     rc;
+    uint     rlen;
+    uint     pos;
+    uint     type;
+    uint     entlen;
+    uint8_t *data;
+    handle_t handle;
+    rc_t     rrc = RC_SUCCESS;
+    xfer_ent_t   *ent;
+    xfer_list_t   subdirs;
+    hm_fdirent_t *dent;
+
+    if (!is_dir(dst) && (lmkdir_work(dst, 0) != RC_SUCCESS))
+        return (RC_FAILURE);
+
+    rc = sm_fopen(cwd_handle, src, HM_MODE_READ, &type, 0, &handle);
+    if (rc != KM_STATUS_OK) {
+        printf("Failed to open %s: %s\n", src, smash_err(rc));
+        return (RC_FAILURE);
+    }
+    if (type != HM_TYPE_DIR) {
+        printf("%s is not a directory (%x)\n", src, type);
+        sm_fclose(handle);
+        return (RC_FAILURE);
+    }
+
+    /*
+     * Subdirectories are walked only after this directory is closed,
+     * as the directory read buffer is reused by each sm_fread().
+     */
+    memset(&subdirs, 0, sizeof (subdirs));
+    do {
+        rc = sm_fread(handle, DIRBUF_SIZE, (void **) &data, &rlen, 0);
+        if ((rlen == 0) && (rc != KM_STATUS_EOF)) {
+            printf("Dir read %s failed: %s\n", src, smash_err(rc));
+            rrc = RC_FAILURE;
+            break;
+        }
+        for (pos = 0; pos < rlen; pos += sizeof (*dent) + entlen) {
+            char *dname;
+            dent = (hm_fdirent_t *)(((uintptr_t) data) + pos);
+            dname = (char *) (dent + 1);
+            entlen = dent->hmd_elen;
+            if (entlen > 256) {
+                printf("Corrupt entlen=%x for %.20s\n", entlen, dname);
+                break;
+            }
+            if ((dname[0] == '.') &&
+                (dname[1] == '\0' || (dname[1] == '.' && dname[2] == '\0')))
+                continue;
+            if (dent->hmd_type == HM_TYPE_FILE) {
+                rrc = xfer_add(xl, src, dst, dname, 0, 0);
+            } else if (dent->hmd_type == HM_TYPE_DIR) {
+                rrc = xfer_add(&subdirs, src, dst, dname, 0, 0);
+            } else {
+                printf("Skipping %s/%s (%s)\n", src, dname,
+                       (dent->hmd_type < ARRAY_SIZE(hmd_types)) ?
+                       hmd_types[dent->hmd_type] : "?");
+            }
+            if (rrc != RC_SUCCESS)
+                break;
+        }
+    } while ((rc != KM_STATUS_EOF) && (rrc == RC_SUCCESS));
+    sm_fclose(handle);
+
+    for (ent = subdirs.xl_head; ent != NULL; ent = ent->xe_next) {
+        if (rrc != RC_SUCCESS)
+            break;
+        if (is_user_abort()) {
+            printf("^C\n");
+            rrc = RC_USR_ABORT;
+            break;
+        }
+        rrc = get_collect(xl, ent->xe_src, ent->xe_dst);
+    }
+    xfer_free(&subdirs);
+    return (rrc);
+}
+
+/*
+ * get_xfer
+ * --------
+ * Transfers all files in the list from the remote. Opens of upcoming
+ * files are kept in flight, each returning file status with its reply,
+ * while the current file's data is being read. Closes are collected
+ * one file later. This hides most of the per-file round trips when
+ * getting many small files.
+ */
+static rc_t
+get_xfer(xfer_list_t *xl)
+{
+    uint         otag[XFER_LOOKAHEAD];
+    uint         orc[XFER_LOOKAHEAD];
+    uint         ohead = 0;
+    uint         ocount = 0;
+    uint         ctag = 0;
+    uint         cpending = 0;
+    uint         count = 0;
+    uint         type;
+    uint         rc;
+    rc_t         rrc = RC_SUCCESS;
+    handle_t     handle;
+    uint64_t     bytes = 0;
+    uint64_t     time_start = smash_time();
+    xfer_ent_t  *cur;
+    xfer_ent_t  *ahead = xl->xl_head;
+    hm_fdirent_t dent;
+
+    for (cur = xl->xl_head; cur != NULL; cur = cur->xe_next) {
+        if (is_user_abort()) {
+            printf("^C\n");
+            rrc = RC_USR_ABORT;
+            break;
+        }
+        while ((ahead != NULL) && (ocount < XFER_LOOKAHEAD)) {
+            uint slot = (ohead + ocount) % XFER_LOOKAHEAD;
+            orc[slot] = sm_fopen_start(cwd_handle, ahead->xe_src,
+                                       HM_MODE_READ | HM_MODE_STAT, 0,
+                                       &otag[slot]);
+            ahead = ahead->xe_next;
+            ocount++;
+        }
+        rc = orc[ohead];
+        if (rc == KM_STATUS_OK)
+            rc = sm_fopen_finish(otag[ohead], &type, &handle, &dent);
+        ohead = (ohead + 1) % XFER_LOOKAHEAD;
+        ocount--;
+        if (rc != KM_STATUS_OK) {
+            printf("Failed to open %s for read: %s\n",
+                   cur->xe_src, smash_err(rc));
+            rrc = RC_FAILURE;
+            continue;
+        }
+
+        if ((dent.hmd_type == HM_TYPE_UNKNOWN) &&
+            (remote_stat(cur->xe_src, &dent) != RC_SUCCESS)) {
+            rc = RC_FAILURE;
+        } else {
+            rc = get_file_data(cur->xe_src, cur->xe_dst, handle, &dent);
+        }
+
+        /* Collect the previous file's close before issuing this one */
+        if (cpending)
+            (void) sm_fclose_finish(ctag);
+        cpending = (sm_fclose_start(handle, &ctag) == KM_STATUS_OK);
+
+        if (rc == RC_USR_ABORT) {
+            rrc = rc;
+            break;
+        }
+        if (rc != RC_SUCCESS) {
+            rrc = RC_FAILURE;
+            continue;
+        }
+        bytes += ((uint64_t) dent.hmd_size_hi << 32) | dent.hmd_size_lo;
+        count++;
+        xfer_journal_add(cur->xe_dst);
+    }
+
+    /* Close files opened ahead which will not be transferred */
+    for (; ocount > 0; ocount--) {
+        if ((orc[ohead] == KM_STATUS_OK) &&
+            (sm_fopen_finish(otag[ohead], &type, &handle, NULL) ==
+             KM_STATUS_OK)) {
+            sm_fclose(handle);
+        }
+        ohead = (ohead + 1) % XFER_LOOKAHEAD;
+    }
+    if (cpending)
+        (void) sm_fclose_finish(ctag);
+
+    xfer_summary(count, bytes, time_start);
+    return (rrc);
+}
+
+static rc_t
+get_tree(const char *src, const char *dst)
+{
+    rc_t        rc;
+    xfer_list_t xl;
+
+    memset(&xl, 0, sizeof (xl));
+    rc = get_collect(&xl, src, dst);
+    if (rc == RC_SUCCESS) {
+        xfer_journal_start(&xl, "get", src, dst);
+        rc = get_xfer(&xl);
+        xfer_journal_end(rc);
+    }
+    xfer_free(&xl);
+    return (rc);
+}
+
+static rc_t
+get_files(const char *src, const char *dst, uint recursive)
 {
     rc_t     rc;
     handle_t handle;
     uint     type;
-    uint     recursive = 0;
-
+    char    *srcbuf = NULL;
+
+    if (recursive) {
+        /* Trailing slash on a directory name is not significant */
+        uint srclen = strlen(src);
+        if ((srclen > 1) && (src[srclen - 1] == '/')) {
+            srcbuf = strdup(src);
+            if (srcbuf == NULL)
+                return (RC_FAILURE);
+            srcbuf[srclen - 1] = '\0';
+            src = srcbuf;
+        }
+    }
     if ((dst == NULL) || (strcmp(dst, ".") == 0)) {
         /* Need to trim dst file name from src name */
-        for (dst = src; *dst != '\0'; dst++)
-            ;
-        if (dst > src)
-            dst--;
-        if (*dst == '/') {
-            printf("Can not yet get remote directory: %s\n", src);
-            // XXX: This would be a nice feature to add.
-            //      Recursive is too much work, however.
-            //
-            //      Would also be nice to be able to support wildcards
+        dst = path_tail(src);
+        if (*dst == '\0') {
+            printf("Can not get remote directory without -r: %s\n", src);
+            // XXX: Would be nice to be able to support wildcards
             //      that could be implemented on top of remote directory
             //      support.
             return (RC_FAILURE);
         }
-        for (; dst > src; dst--)
-            if ((dst[-1] == '/') || (dst[-1] == ':'))
-                break;
     }
 
     rc = sm_fopen(cwd_handle, src, HM_MODE_READ, &type, 0, &handle);
     if (rc != KM_STATUS_OK) {
         printf("Failed to open %s: %s\n", src, smash_err(rc));
-        return (RC_FAILURE);
+        rc = RC_FAILURE;
+        goto get_files_done;
+    }
+    sm_fclose(handle);
+    if ((type == HM_TYPE_DIR) && !recursive) {
+        printf("Can not get remote directory without -r: %s\n", src);
+        rc = RC_FAILURE;
+        goto get_files_done;
     }
-    if (type != HM_TYPE_FILE) {
+    if ((type != HM_TYPE_FILE) && (type != HM_TYPE_DIR)) {
         printf("Can not yet get non-file: %s (%x)\n", src, type);
-        sm_fclose(handle);
-        return (RC_FAILURE);
+        rc = RC_FAILURE;
+        goto get_files_done;
     }
 
     if (is_dir(dst) || (strcmp(dst, ".") == 0)) {
         /* Single or multiple file get */
-        uint  dstlen  = strlen(dst);
-        char *dstpath = malloc(dstlen + 256);
-        uint  srclen  = strlen(src);
-        char *srcpath = malloc(srclen + 256);
-        char *srcname = (char *)src;
-        if ((dstpath == NULL) || (srcpath == NULL)) {
-            printf("malloc(%u) failure\n", dstlen + 256);
-            if (dstpath != NULL)
-                free(dstpath);
-            if (srcpath != NULL)
-                free(srcpath);
-            return (RC_FAILURE);
-        }
-        memcpy(dstpath, dst, dstlen);
-        if (dstlen > 0) {
-            if ((dstpath[dstlen - 1] != ':') && (dstpath[dstlen - 1] != '/'))
-                dstpath[dstlen++] = '/';
-        }
-        dstpath[dstlen] = '\0';
-
-        memcpy(srcpath, src, srclen);
-        srcpath[srclen] = '\0';
-#if 0
-        if (src_is_dir) {
-            srcpath[srclen++] = '/';
-            srcpath[srclen] = '\0';
-
-            srcname = dir_next(handle, dirbuf);
-            strcpy(srcpath + srclen, srcname);
-        } else
-#endif
-        // Assume single file for now
-        if (!recursive) {
-            char *ptr;
-            for (ptr = srcname; *ptr != '\0'; ptr++)
-                ;
-            for (--ptr; ptr > srcname; ptr--) {
-                if ((ptr[-1] == '/') || (ptr[-1] == ':'))
-                    break;
-            }
-            if (srcname < ptr)
-                srcname = ptr;
-            strcpy(dstpath + dstlen, srcname);
+        const char *srcname = path_tail(src);
+        uint  alloclen = strlen(dst) + strlen(srcname) + 2;
+        char *dstpath = malloc(alloclen);
+        if (dstpath == NULL) {
+            printf("malloc(%u) failure\n", alloclen);
+            rc = RC_FAILURE;
+            goto get_files_done;
         }
-        strcpy(dstpath + dstlen, srcname);
+        path_join(dstpath, dst, srcname);
 
-        rc = get_file(srcpath, dstpath);
+        if (type == HM_TYPE_DIR)
+            rc = get_tree(src, dstpath);
+        else
+            rc = get_file(src, dstpath);
         free(dstpath);
-        free(srcpath);
-        sm_fclose(handle);
+    } else if (type == HM_TYPE_DIR) {
+        /* Recursive get to new local directory */
+        rc = get_tree(src, dst);
     } else {
         /* Simple file get */
-        sm_fclose(handle);
-        if ((type == HM_TYPE_DIR) || (type == HM_TYPE_VOLDIR)) {
-            printf("Source %s is a directory but destination %s "
-                   "does not exist\n", src, dst);
-            return (RC_FAILURE);
-        }
         rc = get_file(src, dst);
     }
+get_files_done:
+    if (srcbuf != NULL)
+        free(srcbuf);
     return (rc);
 }
 
@@ -1101,14 +2238,36 @@ cmd_get(int argc, char * const *argv)
 {
     int arg;
     rc_t rc = RC_SUCCESS;
+    uint flag_recursive = 0;
     const char *getas = NULL;
     const char *saveas = NULL;
 
+    xfer_delta = 0;
+    xfer_continue = 0;
     for (arg = 1; arg < argc; arg++) {
         const char *ptr = argv[arg];
         if (*ptr == '-') {
             while (*(++ptr) != '\0') {
                 switch (*ptr) {
+                    case 'c':
+                        xfer_continue = 1;
+                        break;
+                    case 'D':
+                        xfer_delta = 1;
+                        break;
+                    case 'd':
+                        if ((++arg >= argc) ||
+                            (sscanf(argv[arg], "%u", &get_depth) != 1) ||
+                            (get_depth < 1) ||
+                            (get_depth > SM_FREAD_PIPE_MAX)) {
+                            printf("Invalid read depth\n");
+                            get_depth = SM_FREAD_PIPE_DEFAULT;
+                            return (RC_BAD_PARAM);
+                        }
+                        break;  // Remaining flags of this argument follow
+                    case 'r':
+                        flag_recursive = 1;
+                        break;
                     default:
                         printf("Unknown argument -%s\n", ptr);
                         printf(cmd_get_help);
@@ -1119,6 +2278,10 @@ cmd_get(int argc, char * const *argv)
     }
     for (arg = 1; arg < argc; arg++) {
         const char *ptr = argv[arg];
+        if ((*ptr == '-') && (strchr(ptr, 'd') != NULL)) {
+            arg++;  // Skip depth value
+            continue;
+        }
         if (*ptr != '-') {
             if (getas == NULL) {
                 getas = ptr;
@@ -1134,14 +2297,14 @@ cmd_get(int argc, char * const *argv)
                     dst = final;
                     argc--;
                 }
-                rc = get_files(getas, dst);
+                rc = get_files(getas, dst, flag_recursive);
                 if (rc != RC_SUCCESS)
                     return (rc);
-                rc = get_files(saveas, dst);
+                rc = get_files(saveas, dst, flag_recursive);
                 if (rc != RC_SUCCESS)
                     return (rc);
                 for (; arg < argc; arg++) {
-                    rc = get_files(argv[arg], dst);
+                    rc = get_files(argv[arg], dst, flag_recursive);
                     if (rc != RC_SUCCESS)
                         return (rc);
                 }
@@ -1150,7 +2313,7 @@ cmd_get(int argc, char * const *argv)
         }
     }
     if (getas != NULL) {
-        rc = get_files(getas, saveas);
+        rc = get_files(getas, saveas, flag_recursive);
     } else {
         printf(cmd_get_help);
         return (RC_BAD_PARAM);
@@ -2331,43 +3494,37 @@ diff_dstamp(struct DateStamp *ds1, struct DateStamp *ds2)
             (uint64_t) ds_val.ds_Days * 24 * 60 * 60 * 1000);
 }
 
+/*
+ * put_file_data
+ * -------------
+ * Sends the contents of a local file to an open remote file. Each block
+ * is read from the local file while the previous block's write is still
+ * outstanding at the remote. The remote handle is not closed. If start
+ * is not zero, the transfer continues from that offset, to which the
+ * remote file must already be positioned.
+ */
 static rc_t
-put_file(const char *src, const char *dst)
+put_file_data(const char *src, const char *dst, handle_t handle,
+              uint filesize, uint start)
 {
     int      bytes;
     uint     diff;
-    uint     filesize;
     uint     rc;
     uint     rlen;
-    uint     type;
+    uint     tag = 0;
+    uint     wpending = 0;
     uint     buflen = 32768;
     char    *bufptr;
     char    *bufdata;
     FILE    *fp;
-    handle_t handle;
-    uint64_t pos = 0;
+    uint64_t pos = start;
+    uint64_t wpos = 0;
     uint64_t time_start;
     uint64_t time_end;
-    struct FileInfoBlock fib;
-
-    if (get_file_fib(src, &fib)) {
-        printf("Failed to open %s for STAT\n", src);
-        return (RC_FAILURE);
-    }
-
-    filesize = fib.fib_Size;
 
     fp = fopen(src, "r");
     if (fp == NULL) {
-        printf("Failed to open %s for read\n", dst);
-        return (RC_FAILURE);
-    }
-
-    rc = sm_fopen(cwd_handle, dst, HM_MODE_WRITE | HM_MODE_CREATE,
-                 &type, fib.fib_Protection, &handle);
-    if (rc != KM_STATUS_OK) {
-        printf("Failed to open %s for write: %s\n", src, smash_err(rc));
-        fclose(fp);
+        printf("Failed to open %s for read\n", src);
         return (RC_FAILURE);
     }
     bufptr = malloc(buflen + sizeof (hm_freadwrite_t));
@@ -2375,7 +3532,6 @@ put_file(const char *src, const char *dst)
         printf("Failed to allocate %u bytes\n",
                buflen + sizeof (hm_freadwrite_t));
         fclose(fp);
-        sm_fclose(handle);
         return (RC_FAILURE);
     }
     printf("Put %s as %s ", src, dst);
@@ -2384,14 +3540,26 @@ put_file(const char *src, const char *dst)
         printf("(%u bytes) ", (uint) filesize);
     else
         printf("(%u KB) ", (uint) ((filesize + 512) >> 10));
+    if (start != 0) {
+        printf("from %u KB ", start >> 10);
+        if (fseek(fp, start, SEEK_SET) != 0) {
+            printf("Failed to seek %s to %u\n", src, start);
+            fclose(fp);
+            free(bufptr);
+            return (RC_FAILURE);
+        }
+    }
+    fflush(stdout);
 
     rc = RC_SUCCESS;
     time_start = smash_time();
     while (pos < filesize) {
         if (is_user_abort()) {
             printf("^C\n");
+            if (wpending)
+                (void) sm_fwrite_finish(tag);
             fclose(fp);
-            sm_fclose(handle);
+            free(bufptr);
             return (RC_USR_ABORT);
         }
         rlen = buflen;
@@ -2404,80 +3572,635 @@ put_file(const char *src, const char *dst)
             rc = RC_FAILURE;
             break;
         }
-        rc = sm_fwrite(handle, bufptr, bytes, 1, 0);
-        if (rc != KM_STATUS_OK) {
+        if (wpending) {
+            wpending = 0;
+            rc = sm_fwrite_finish(tag);
+            if (rc != KM_STATUS_OK)
+                goto remote_write_failed;
+        }
+        wpos = pos;
+        rc = sm_fwrite_start(handle, bufptr, bytes, 0, &tag);
+        if (rc != KM_STATUS_OK)
+            goto remote_write_failed;
+        wpending = 1;
+        pos += bytes;
+    }
+    if (wpending) {
+        uint wrc = sm_fwrite_finish(tag);
+        if ((wrc != KM_STATUS_OK) && (rc == RC_SUCCESS)) {
+            rc = wrc;
+remote_write_failed:
             printf("Remote write %s failed at pos %x: %s\n",
-                   dst, (uint) pos, smash_err(rc));
+                   dst, (uint) wpos, smash_err(rc));
             rc = RC_FAILURE;
+        }
+    }
+
+    time_end = smash_time();
+    diff = (uint) (time_end - time_start);
+    if (flag_debug)
+        printf("%u usec  ", diff);
+    printf(" %u KB/sec\n", calc_kb_sec(diff, filesize - start));
+    fclose(fp);
+    free(bufptr);
+    return (rc);
+}
+
+/*
+ * put_delta_verify
+ * ----------------
+ * Compares a remote file assembled by delta transfer against the local
+ * file. The size must match, and each whole block must match by CRC.
+ * The tail which does not fill a block is read back and compared.
+ */
+static rc_t
+put_delta_verify(const char *name, FILE *fp, uint64_t filesize)
+{
+    uint      rc;
+    uint      type;
+    uint      got;
+    uint      pos;
+    uint      count;
+    uint      rlen;
+    uint      block  = 0;
+    uint      blocks = (uint) (filesize / DELTA_BLKSIZE_MAX);
+    uint      tail   = (uint) (filesize % DELTA_BLKSIZE_MAX);
+    uint64_t  size;
+    uint8_t  *buf;
+    void     *data;
+    handle_t  handle;
+    rc_t      rrc = RC_FAILURE;
+    hm_fsig_t sigs[16];
+
+    rc = sm_fopen(cwd_handle, name, HM_MODE_READ, &type, 0, &handle);
+    if (rc != KM_STATUS_OK) {
+        printf("Failed to open %s for verify: %s\n", name, smash_err(rc));
+        return (RC_FAILURE);
+    }
+    buf = malloc(DELTA_BLKSIZE_MAX);
+    if (buf == NULL) {
+        printf("malloc failure\n");
+        goto put_verify_close;
+    }
+    rc = sm_fseek(handle, OFFSET_END, 0, &size, NULL);
+    if ((rc != KM_STATUS_OK) || (size != filesize)) {
+        printf("%s size mismatch after delta put\n", name);
+        goto put_verify_close;
+    }
+    (void) sm_fseek(handle, OFFSET_BEGINNING, 0, NULL, NULL);
+    rewind(fp);
+
+    while (block < blocks) {
+        count = blocks - block;
+        if (count > ARRAY_SIZE(sigs))
+            count = ARRAY_SIZE(sigs);
+        rc = sm_fsigs(handle, DELTA_BLKSIZE_MAX, block, count, sigs, &got);
+        if ((rc != KM_STATUS_OK) || (got != count))
+            goto put_verify_mismatch;
+        for (pos = 0; pos < count; pos++) {
+            if ((fread(buf, 1, DELTA_BLKSIZE_MAX, fp) != DELTA_BLKSIZE_MAX) ||
+                (crc32(0, buf, DELTA_BLKSIZE_MAX) != sigs[pos].hs_strong)) {
+                goto put_verify_mismatch;
+            }
+        }
+        block += count;
+    }
+    if (tail != 0) {
+        rc = sm_fseek(handle, OFFSET_BEGINNING, filesize - tail, NULL, NULL);
+        if (rc == KM_STATUS_OK)
+            rc = sm_fread(handle, tail, &data, &rlen, 0);
+        if ((rc != KM_STATUS_OK) || (rlen != tail) ||
+            (fread(buf, 1, tail, fp) != tail) ||
+            (memcmp(buf, data, tail) != 0)) {
+            goto put_verify_mismatch;
+        }
+    }
+    rrc = RC_SUCCESS;
+    goto put_verify_close;
+
+put_verify_mismatch:
+    printf("%s does not match local file after delta put\n", name);
+put_verify_close:
+    sm_fclose(handle);
+    free(buf);
+    return (rrc);
+}
+
+/*
+ * put_file_delta
+ * --------------
+ * Sends a local file by delta transfer against an existing remote file
+ * of the same name. The new file is assembled on the USB host from
+ * range copies of matching blocks in the existing remote file and the
+ * local data which did not match, then renamed over the existing file.
+ * Returns RC_NO_DATA if there is no remote file which is suitable, in
+ * which case a normal transfer should be done.
+ */
+static rc_t
+put_file_delta(const char *src, const char *dst, struct FileInfoBlock *fib)
+{
+    uint     rc;
+    uint     tag;
+    uint     type;
+    uint     sopen = 1;
+    uint     tmpkeep = 0;
+    uint64_t oldsize;
+    uint64_t time_start;
+    char    *tmpname = NULL;
+    FILE    *fp;
+    rc_t     rrc;
+    delta_xfer_t dx;
+    hm_fdirent_t dent;
+
+    memset(&dx, 0, sizeof (dx));
+    rc = sm_fopen_start(cwd_handle, dst, HM_MODE_READ | HM_MODE_STAT, 0, &tag);
+    if (rc == KM_STATUS_OK)
+        rc = sm_fopen_finish(tag, &type, &dx.dx_shandle, &dent);
+    if (rc != KM_STATUS_OK)
+        return (RC_NO_DATA);  // Nothing to compare against
+    if ((dent.hmd_type == HM_TYPE_UNKNOWN) &&
+        (remote_stat(dst, &dent) != RC_SUCCESS)) {
+        sm_fclose(dx.dx_shandle);
+        return (RC_NO_DATA);
+    }
+    oldsize = ((uint64_t) dent.hmd_size_hi << 32) | dent.hmd_size_lo;
+    if ((dent.hmd_type != HM_TYPE_FILE) || (oldsize < DELTA_BLKSIZE_MIN) ||
+        (fib->fib_Size < DELTA_BLKSIZE_MIN)) {
+        sm_fclose(dx.dx_shandle);
+        return (RC_NO_DATA);
+    }
+
+    fp = fopen(src, "r");
+    if (fp == NULL) {
+        printf("Failed to open %s for read\n", src);
+        sm_fclose(dx.dx_shandle);
+        return (RC_FAILURE);
+    }
+    printf("Put %s as %s ", src, dst);
+    if (fib->fib_Size < 1000000)
+        printf("(%u bytes) ", (uint) fib->fib_Size);
+    else
+        printf("(%u KB) ", (uint) ((fib->fib_Size + 512) >> 10));
+    fflush(stdout);
+
+    time_start = smash_time();
+    rrc = delta_sigs_load(&dx.dx_sigs, dx.dx_shandle, oldsize,
+                          delta_blksize(oldsize));
+    if (rrc != RC_SUCCESS)
+        goto put_delta_close;
+
+    tmpname = malloc(strlen(dst) + sizeof (DELTA_TMP_SUFFIX));
+    dx.dx_buf = malloc(DELTA_LITERAL_MAX + sizeof (hm_freadwrite_t));
+    if ((tmpname == NULL) || (dx.dx_buf == NULL)) {
+        printf("malloc failure\n");
+        rrc = RC_FAILURE;
+        goto put_delta_close;
+    }
+    sprintf(tmpname, "%s%s", dst, DELTA_TMP_SUFFIX);
+    rc = sm_fopen(cwd_handle, tmpname,
+                  HM_MODE_WRITE | HM_MODE_CREATE | HM_MODE_TRUNC,
+                  &type, fib->fib_Protection, &dx.dx_dhandle);
+    if (rc != KM_STATUS_OK) {
+        printf("Failed to open %s for write: %s\n", tmpname, smash_err(rc));
+        rrc = RC_FAILURE;
+        goto put_delta_close;
+    }
+
+    rrc = delta_scan(&dx, fp);
+    if (rrc == RC_SUCCESS)
+        rrc = delta_put_run(&dx);
+    if ((delta_put_wait(&dx) != RC_SUCCESS) && (rrc == RC_SUCCESS))
+        rrc = RC_FAILURE;
+    sm_fclose(dx.dx_dhandle);
+    sm_fclose(dx.dx_shandle);  // Close before replacing the file
+    sopen = 0;
+
+    if (rrc == RC_SUCCESS)
+        rrc = put_delta_verify(tmpname, fp, fib->fib_Size);
+    if (rrc == RC_SUCCESS) {
+        /*
+         * Not every USB host replaces an existing file on rename
+         * (Windows does not), so remove the old file and retry.
+         */
+        rc = sm_frename(cwd_handle, tmpname, cwd_handle, dst);
+        if ((rc != KM_STATUS_OK) &&
+            (sm_fdelete(cwd_handle, dst) == KM_STATUS_OK)) {
+            rc = sm_frename(cwd_handle, tmpname, cwd_handle, dst);
+            if (rc != KM_STATUS_OK) {
+                /* The new file is now the only copy, so keep it */
+                printf("Failed to rename %s to %s: %s\n",
+                       tmpname, dst, smash_err(rc));
+                tmpkeep = 1;
+            }
+        }
+        if (rc != KM_STATUS_OK) {
+            if (tmpkeep == 0)
+                printf("Failed to replace %s: %s\n", dst, smash_err(rc));
+            rrc = RC_FAILURE;
+        } else {
+            delta_report(&dx, fib->fib_Size, time_start);
+        }
+    }
+    if ((rrc != RC_SUCCESS) && (tmpkeep == 0))
+        (void) sm_fdelete(cwd_handle, tmpname);
+
+put_delta_close:
+    if (sopen)
+        sm_fclose(dx.dx_shandle);
+    fclose(fp);
+    free(tmpname);
+    free(dx.dx_buf);
+    delta_sigs_free(&dx.dx_sigs);
+    return (rrc);
+}
+
+/*
+ * put_file_resume
+ * ---------------
+ * Continues an interrupted put of a local file, if the partial remote
+ * file matches the local file. Returns RC_NO_DATA if there is no
+ * partial remote file to continue, in which case a normal transfer
+ * should be done.
+ */
+static rc_t
+put_file_resume(const char *src, const char *dst, struct FileInfoBlock *fib)
+{
+    uint     rc;
+    uint     tag;
+    uint     type;
+    uint     resume = 0;
+    handle_t handle;
+    hm_fdirent_t dent;
+
+    rc = sm_fopen_start(cwd_handle, dst, HM_MODE_READ | HM_MODE_STAT, 0, &tag);
+    if (rc == KM_STATUS_OK)
+        rc = sm_fopen_finish(tag, &type, &handle, &dent);
+    if (rc != KM_STATUS_OK)
+        return (RC_NO_DATA);
+    if ((dent.hmd_type != HM_TYPE_UNKNOWN) ||
+        (remote_stat(dst, &dent) == RC_SUCCESS)) {
+        if (dent.hmd_type == HM_TYPE_FILE) {
+            resume = xfer_resume_offset(handle, src,
+                                        ((uint64_t) dent.hmd_size_hi << 32) |
+                                        dent.hmd_size_lo, fib->fib_Size);
+        }
+    }
+    sm_fclose(handle);
+    if (resume == 0)
+        return (RC_NO_DATA);
+
+    rc = sm_fopen(cwd_handle, dst, HM_MODE_WRITE, &type, 0, &handle);
+    if (rc != KM_STATUS_OK) {
+        printf("Failed to open %s for write: %s\n", dst, smash_err(rc));
+        return (RC_FAILURE);
+    }
+    rc = sm_fseek(handle, OFFSET_BEGINNING, resume, NULL, NULL);
+    if (rc == KM_STATUS_OK)
+        rc = put_file_data(src, dst, handle, fib->fib_Size, resume);
+    else
+        rc = RC_FAILURE;
+    sm_fclose(handle);
+    return (rc);
+}
+
+static rc_t
+put_file(const char *src, const char *dst)
+{
+    uint     rc;
+    uint     type;
+    handle_t handle;
+    struct FileInfoBlock fib;
+
+    if (get_file_fib(src, &fib)) {
+        printf("Failed to open %s for STAT\n", src);
+        return (RC_FAILURE);
+    }
+    if (xfer_delta) {
+        rc = put_file_delta(src, dst, &fib);
+        if (rc != RC_NO_DATA)
+            return (rc);
+    }
+    if (xfer_continue) {
+        rc = put_file_resume(src, dst, &fib);
+        if (rc != RC_NO_DATA)
+            return (rc);
+    }
+
+    rc = sm_fopen(cwd_handle, dst, HM_MODE_WRITE | HM_MODE_CREATE,
+                 &type, fib.fib_Protection, &handle);
+    if (rc != KM_STATUS_OK) {
+        printf("Failed to open %s for write: %s\n", dst, smash_err(rc));
+        return (RC_FAILURE);
+    }
+    rc = put_file_data(src, dst, handle, fib.fib_Size, 0);
+    sm_fclose(handle);
+    return (rc);
+}
+
+/*
+ * put_collect
+ * -----------
+ * Walks a local directory tree, creating matching remote directories
+ * and adding all files found to the transfer list.
+ */
+static rc_t
+put_collect(xfer_list_t *xl, const char *src, const char *dst)
+{
+    BPTR        lock;
+    rc_t        rrc = RC_SUCCESS;
+    xfer_ent_t *ent;
+    xfer_list_t subdirs;
+    struct FileInfoBlock fib;
+
+    if (!is_remote_dir(dst) && (mkdir_work(dst, 0) != RC_SUCCESS))
+        return (RC_FAILURE);
+
+    lock = Lock(src, ACCESS_READ);
+    if (lock == 0) {
+        printf("Lock %s failed\n", src);
+        return (RC_FAILURE);
+    }
+    if (Examine(lock, &fib) == 0) {
+        printf("Examine %s failed\n", src);
+        UnLock(lock);
+        return (RC_FAILURE);
+    }
+    memset(&subdirs, 0, sizeof (subdirs));
+    while (ExNext(lock, &fib)) {
+        if (fib.fib_DirEntryType < 0) {
+            rrc = xfer_add(xl, src, dst, fib.fib_FileName,
+                           fib.fib_Protection, fib.fib_Size);
+        } else if ((fib.fib_DirEntryType == ST_USERDIR) ||
+                   (fib.fib_DirEntryType == ST_LINKDIR)) {
+            rrc = xfer_add(&subdirs, src, dst, fib.fib_FileName, 0, 0);
+        } else {
+            printf("Skipping %s (type %d)\n", fib.fib_FileName,
+                   (int) fib.fib_DirEntryType);
+        }
+        if (rrc != RC_SUCCESS)
+            break;
+    }
+    UnLock(lock);
+
+    for (ent = subdirs.xl_head; ent != NULL; ent = ent->xe_next) {
+        if (rrc != RC_SUCCESS)
+            break;
+        if (is_user_abort()) {
+            printf("^C\n");
+            rrc = RC_USR_ABORT;
             break;
         }
+        rrc = put_collect(xl, ent->xe_src, ent->xe_dst);
+    }
+    xfer_free(&subdirs);
+    return (rrc);
+}
 
-        pos += bytes;
+/*
+ * put_existed
+ * -----------
+ * Collects the reply to a stat open started ahead of a create open by
+ * put_xfer(), returning TRUE if the remote file already existed. Where
+ * the answer is not known, the file is assumed to have existed.
+ */
+static uint
+put_existed(uint prc, uint ptag)
+{
+    handle_t handle;
+
+    if (prc != KM_STATUS_OK)
+        return (TRUE);
+    prc = sm_fopen_finish(ptag, NULL, &handle, NULL);
+    if (prc == KM_STATUS_OK)
+        sm_fclose(handle);
+    return (prc != KM_STATUS_NOEXIST);
+}
+
+/*
+ * put_xfer
+ * --------
+ * Transfers all files in the list to the remote. Create opens of
+ * upcoming files are kept in flight while the current file's data is
+ * being written, and closes are collected one file later. Each create
+ * open is preceded by a stat open, so that files created ahead of an
+ * abort can be told apart from files which were already present.
+ */
+static rc_t
+put_xfer(xfer_list_t *xl)
+{
+    uint        otag[XFER_LOOKAHEAD];
+    uint        orc[XFER_LOOKAHEAD];
+    uint        ptag[XFER_LOOKAHEAD];
+    uint        prc[XFER_LOOKAHEAD];
+    xfer_ent_t *oent[XFER_LOOKAHEAD];
+    uint        ohead = 0;
+    uint        ocount = 0;
+    uint        ctag = 0;
+    uint        cpending = 0;
+    uint        count = 0;
+    uint        type;
+    uint        rc;
+    rc_t        rrc = RC_SUCCESS;
+    handle_t    handle;
+    uint64_t    bytes = 0;
+    uint64_t    time_start = smash_time();
+    xfer_ent_t *cur;
+    xfer_ent_t *ahead = xl->xl_head;
+
+    for (cur = xl->xl_head; cur != NULL; cur = cur->xe_next) {
+        if (is_user_abort()) {
+            printf("^C\n");
+            rrc = RC_USR_ABORT;
+            break;
+        }
+        while ((ahead != NULL) && (ocount < XFER_LOOKAHEAD)) {
+            uint slot = (ohead + ocount) % XFER_LOOKAHEAD;
+            prc[slot] = sm_fopen_start(cwd_handle, ahead->xe_dst,
+                                       HM_MODE_READDIR, 0, &ptag[slot]);
+            orc[slot] = sm_fopen_start(cwd_handle, ahead->xe_dst,
+                                       HM_MODE_WRITE | HM_MODE_CREATE,
+                                       ahead->xe_perms, &otag[slot]);
+            oent[slot] = ahead;
+            ahead = ahead->xe_next;
+            ocount++;
+        }
+        (void) put_existed(prc[ohead], ptag[ohead]);
+        rc = orc[ohead];
+        if (rc == KM_STATUS_OK)
+            rc = sm_fopen_finish(otag[ohead], &type, &handle, NULL);
+        ohead = (ohead + 1) % XFER_LOOKAHEAD;
+        ocount--;
+        if (rc != KM_STATUS_OK) {
+            printf("Failed to open %s for write: %s\n",
+                   cur->xe_dst, smash_err(rc));
+            rrc = RC_FAILURE;
+            continue;
+        }
+
+        rc = put_file_data(cur->xe_src, cur->xe_dst, handle, cur->xe_size,
+                           0);
+
+        /* Collect the previous file's close before issuing this one */
+        if (cpending)
+            (void) sm_fclose_finish(ctag);
+        cpending = (sm_fclose_start(handle, &ctag) == KM_STATUS_OK);
+
+        if (rc == RC_USR_ABORT) {
+            rrc = rc;
+            break;
+        }
+        if (rc != RC_SUCCESS) {
+            rrc = RC_FAILURE;
+            continue;
+        }
+        bytes += cur->xe_size;
+        count++;
+        xfer_journal_add(cur->xe_dst);
+    }
+
+    /*
+     * Close files opened ahead which will not be transferred. Those
+     * which did not exist before and are still empty were created by
+     * the open, so they are removed again rather than being left behind
+     * on the remote.
+     */
+    for (; ocount > 0; ocount--) {
+        uint existed = put_existed(prc[ohead], ptag[ohead]);
+        if ((orc[ohead] == KM_STATUS_OK) &&
+            (sm_fopen_finish(otag[ohead], &type, &handle, NULL) ==
+             KM_STATUS_OK)) {
+            uint64_t size = 0;
+            rc = sm_fseek(handle, OFFSET_END, 0, &size, NULL);
+            sm_fclose(handle);
+            if ((rc == KM_STATUS_OK) && (size == 0) && !existed)
+                (void) sm_fdelete(cwd_handle, oent[ohead]->xe_dst);
+        }
+        ohead = (ohead + 1) % XFER_LOOKAHEAD;
+    }
+    if (cpending)
+        (void) sm_fclose_finish(ctag);
+
+    xfer_summary(count, bytes, time_start);
+    return (rrc);
+}
+
+/*
+ * put_xfer_each
+ * -------------
+ * Transfers all files in the list to the remote, one at a time. This
+ * is used for delta and continued transfers, which must examine any
+ * existing remote file before it is opened for write.
+ */
+static rc_t
+put_xfer_each(xfer_list_t *xl)
+{
+    uint        count = 0;
+    rc_t        rc;
+    rc_t        rrc = RC_SUCCESS;
+    uint64_t    bytes = 0;
+    uint64_t    time_start = smash_time();
+    xfer_ent_t *cur;
+
+    for (cur = xl->xl_head; cur != NULL; cur = cur->xe_next) {
+        if (is_user_abort()) {
+            printf("^C\n");
+            rrc = RC_USR_ABORT;
+            break;
+        }
+        rc = put_file(cur->xe_src, cur->xe_dst);
+        if (rc == RC_USR_ABORT) {
+            rrc = rc;
+            break;
+        }
+        if (rc != RC_SUCCESS) {
+            rrc = RC_FAILURE;
+            continue;
+        }
+        bytes += cur->xe_size;
+        count++;
+        xfer_journal_add(cur->xe_dst);
     }
+    xfer_summary(count, bytes, time_start);
+    return (rrc);
+}
 
-    time_end = smash_time();
-    diff = (uint) (time_end - time_start);
-    if (flag_debug)
-        printf("%u usec  ", diff);
-    printf(" %u KB/sec\n", calc_kb_sec(diff, filesize));
-    fclose(fp);
-    sm_fclose(handle);
+static rc_t
+put_tree(const char *src, const char *dst)
+{
+    rc_t        rc;
+    xfer_list_t xl;
+
+    memset(&xl, 0, sizeof (xl));
+    rc = put_collect(&xl, src, dst);
+    if (rc == RC_SUCCESS) {
+        xfer_journal_start(&xl, "put", src, dst);
+        if (xfer_delta || xfer_continue)
+            rc = put_xfer_each(&xl);
+        else
+            rc = put_xfer(&xl);
+        xfer_journal_end(rc);
+    }
+    xfer_free(&xl);
     return (rc);
 }
 
 static rc_t
-put_files(const char *src, const char *dst)
+put_files(const char *src, const char *dst, uint recursive)
 {
     rc_t     rc;
+    uint     src_is_dir = is_dir(src);
+    uint     dst_given = (dst != NULL);
     char    *dstbuf = NULL;
+    char    *srcbuf = NULL;
 
+    if (src_is_dir && !recursive) {
+        printf("Can not put directory without -r: %s\n", src);
+        return (RC_FAILURE);
+    }
+    if (src_is_dir) {
+        /* Trailing slash on a directory name is not significant */
+        uint srclen = strlen(src);
+        if ((srclen > 1) && (src[srclen - 1] == '/')) {
+            srcbuf = strdup(src);
+            if (srcbuf == NULL)
+                return (RC_FAILURE);
+            srcbuf[srclen - 1] = '\0';
+            src = srcbuf;
+        }
+    }
     if (dst == NULL) {
         /* Need to trim dst file name from src name */
-        for (dst = src; *dst != '\0'; dst++)
-            ;
-        if (dst > src)
-            dst--;
-        if (*dst == '/') {
-            printf("Can not yet put directory: %s\n", src);
-            // XXX: This would be a nice feature to add.
-            //      Recursive is too much work, however.
-            //
-            //      Would also be nice to be able to support wildcards
-            //      that could be implemented on top of remote directory
-            //      support.
-            return (RC_FAILURE);
+        dst = path_tail(src);
+        if (*dst == '\0') {
+            printf("Can not put directory without -r: %s\n", src);
+            rc = RC_FAILURE;
+            goto put_files_done;
         }
-        for (; dst > src; dst--)
-            if ((dst[-1] == '/') || (dst[-1] == ':'))
-                break;
     }
 //  printf("src='%s' dst='%s'\n", src, dst);
-    if (is_dir(src)) {
-        printf("Can not yet put directory\n");
-        return (RC_FAILURE);
-    }
-    if (is_remote_dir(dst)) {
-        uint dstlen = strlen(dst);
-        uint alloclen = dstlen + strlen(src) + 2;
+    if ((dst_given || !src_is_dir) && is_remote_dir(dst)) {
+        const char *srcname = path_tail(src);
+        uint alloclen = strlen(dst) + strlen(srcname) + 2;
         dstbuf = malloc(alloclen);
         if (dstbuf == NULL) {
             printf("malloc(%u) failure\n", alloclen);
-            return (RC_FAILURE);
-        }
-        strcpy(dstbuf, dst);
-        if ((dstlen > 0) && (dstbuf[dstlen - 1] != '/') &&
-                            (dstbuf[dstlen - 1] != ':')) {
-            dstbuf[dstlen++] = '/';
+            rc = RC_FAILURE;
+            goto put_files_done;
         }
-        strcpy(dstbuf + dstlen, src);
+        path_join(dstbuf, dst, srcname);
         dst = dstbuf;
     }
 
-    /* Simple file put (for now) */
-    rc = put_file(src, dst);
+    if (src_is_dir)
+        rc = put_tree(src, dst);
+    else
+        rc = put_file(src, dst);
 
+put_files_done:
     if (dstbuf != NULL)
         free(dstbuf);
+    if (srcbuf != NULL)
+        free(srcbuf);
 
     return (rc);
 }
@@ -2487,14 +4210,26 @@ cmd_put(int argc, char * const *argv)
 {
     int         arg;
     uint        rc;
+    uint        flag_recursive = 0;
     const char *readas = NULL;
     const char *putas = NULL;
 
+    xfer_delta = 0;
+    xfer_continue = 0;
     for (arg = 1; arg < argc; arg++) {
         const char *ptr = argv[arg];
         if (*ptr == '-') {
             while (*(++ptr) != '\0') {
                 switch (*ptr) {
+                    case 'c':
+                        xfer_continue = 1;
+                        break;
+                    case 'D':
+                        xfer_delta = 1;
+                        break;
+                    case 'r':
+                        flag_recursive = 1;
+                        break;
                     default:
                         printf("Unknown argument -%s\n", ptr);
                         printf(cmd_put_help);
@@ -2522,14 +4257,14 @@ cmd_put(int argc, char * const *argv)
                     argc--;
                 }
 
-                rc = put_files(readas, dst);
+                rc = put_files(readas, dst, flag_recursive);
                 if (rc != RC_SUCCESS)
                     return (rc);
-                rc = put_files(putas, dst);
+                rc = put_files(putas, dst, flag_recursive);
                 if (rc != RC_SUCCESS)
                     return (rc);
                 for (; arg < argc; arg++) {
-                    rc = put_files(argv[arg], dst);
+                    rc = put_files(argv[arg], dst, flag_recursive);
                     if (rc != RC_SUCCESS)
                         return (rc);
                 }
@@ -2544,7 +4279,7 @@ cmd_put(int argc, char * const *argv)
     }
 
     if (readas != NULL) {
-        rc = put_files(readas, putas);
+        rc = put_files(readas, putas, flag_recursive);
     } else {
         printf(cmd_put_help);
         return (RC_BAD_PARAM);
@@ -2552,6 +4287,86 @@ cmd_put(int argc, char * const *argv)
     return (rc);
 }
 
+static uint
+rcp_progress(uint files, uint files_total, uint kbytes, uint kbytes_total)
+{
+    printf("\r  %u of %u files, %u of %u KB ",
+           files, files_total, kbytes, kbytes_total);
+    fflush(stdout);
+    return (is_user_abort());
+}
+
+/*
+ * cmd_rcp
+ * -------
+ * Copy files on the remote. The copy is performed entirely by the
+ * USB host, so file data does not pass through the Amiga.
+ */
+rc_t
+cmd_rcp(int argc, char * const *argv)
+{
+    int         arg;
+    uint        rc;
+    uint        flags = 0;
+    const char *name_src = NULL;
+    const char *name_dst = NULL;
+
+    for (arg = 1; arg < argc; arg++) {
+        const char *ptr = argv[arg];
+        if (*ptr == '-') {
+            while (*(++ptr) != '\0') {
+                switch (*ptr) {
+                    case 'm':
+                        flags |= HM_COPY_MOVE;
+                        break;
+                    case 'n':
+                        flags |= HM_COPY_NOCLOBBER;
+                        break;
+                    case 'r':
+                        flags |= HM_COPY_RECURSIVE;
+                        break;
+                    default:
+                        printf("Unknown argument -%s\n"
+                               "Usage:\n", ptr);
+                        printf("    %s [-mnr] <src> <dst>\n"
+                               "        -m  move (remove source after "
+                               "copy)\n"
+                               "        -n  do not replace existing files\n"
+                               "        -r  copy directory tree\n",
+                               argv[0]);
+                        return (RC_BAD_PARAM);
+                }
+            }
+        } else if (name_src == NULL) {
+            name_src = ptr;
+        } else if (name_dst == NULL) {
+            name_dst = ptr;
+        } else {
+            printf("Too many arguments to %s: '%s' '%s' and '%s'\n",
+                   argv[0], name_src, name_dst, ptr);
+            return (RC_FAILURE);
+        }
+    }
+    if (name_dst == NULL) {
+        printf("Need to supply a source and destination\n");
+        return (RC_USER_HELP);
+    }
+
+    rc = sm_fcopy(cwd_handle, name_src, cwd_handle, name_dst, flags,
+                  rcp_progress);
+    printf("\n");
+    if (is_user_abort()) {
+        printf("^C\n");
+        return (RC_USR_ABORT);
+    }
+    if (rc != KM_STATUS_OK) {
+        printf("Failed to copy %s to %s: %s\n",
+               name_src, name_dst, smash_err(rc));
+        return (RC_FAILURE);
+    }
+    return (RC_SUCCESS);
+}
+
 rc_t
 cmd_pwd(int argc, char * const *argv)
 {
@@ -2644,6 +4459,502 @@ cmd_rm(int argc, char * const *argv)
     return (rc);
 }
 
+#define BENCH_RUNS_DEFAULT 50            // Samples per latency / meta test
+#define BENCH_RESULTS_MAX  32            // Maximum tests in one report
+#define BENCH_XFER_TOTAL   (256 << 10)   // Bytes per throughput test
+#define BENCH_XFER_MAX     (64 << 10)    // Largest throughput buffer size
+#define BENCH_FILE         "smashftp.bench"  // Remote scratch file
+
+const char cmd_bench_help[] =
+"bench [-n <count>] [-s <file>] [-b <file>] [<dir>]\n"
+"    -n <count>  number of samples for latency and metadata tests\n"
+"    -s <file>   save results to local file for use as a baseline\n"
+"    -b <file>   compare results against a saved baseline\n"
+"    <dir>       remote directory for scratch file (default current)\n"
+;
+
+/*
+ * bench_result_t is one line of a bench report. Sample times are
+ * in microseconds. The rate is operations, KB, or directory entries
+ * per second, depending on the test.
+ */
+typedef struct {
+    char br_name[16];  // Test name
+    uint br_runs;      // Number of samples
+    uint br_p50;       // Median sample time
+    uint br_p90;       // 90th percentile sample time
+    uint br_p99;       // 99th percentile sample time
+    uint br_max;       // Slowest sample time
+    uint br_rate;      // Rate per second
+} bench_result_t;
+
+typedef struct {
+    uint           *bt_sample;     // Sample times of current test
+    uint            bt_count;      // Samples taken
+    uint            bt_size;       // Sample array size
+    uint64_t        bt_total;      // Total time of current test
+    bench_result_t  bt_result[BENCH_RESULTS_MAX];
+    uint            bt_results;    // Results in report
+    bench_result_t *bt_base;       // Baseline results
+    uint            bt_bases;      // Results in baseline
+} bench_t;
+
+static int
+bench_compare_uint(const void *a, const void *b)
+{
+    uint ua = *(const uint *) a;
+    uint ub = *(const uint *) b;
+    return ((ua < ub) ? -1 : (ua > ub));
+}
+
+static void
+bench_sample(bench_t *bt, uint64_t time_start)
+{
+    uint usec = (uint) (smash_time() - time_start);
+
+    if (bt->bt_count < bt->bt_size)
+        bt->bt_sample[bt->bt_count++] = usec;
+    bt->bt_total += usec;
+}
+
+static uint
+bench_pct(bench_t *bt, uint pct)
+{
+    uint pos = (bt->bt_count * pct + 99) / 100;
+
+    if (pos > 0)
+        pos--;
+    return (bt->bt_sample[pos]);
+}
+
+/*
+ * bench_done
+ * ----------
+ * Completes a test, computing percentiles from the samples taken and
+ * adding a line to the report. The amount is the number of operations,
+ * KB, or entries processed, from which the rate is computed.
+ */
+static void
+bench_done(bench_t *bt, const char *name, uint amount, const char *unit)
+{
+    bench_result_t *br;
+    uint pos;
+
+    if ((bt->bt_count == 0) || (bt->bt_results >= BENCH_RESULTS_MAX)) {
+        bt->bt_count = 0;
+        bt->bt_total = 0;
+        return;
+    }
+    br = &bt->bt_result[bt->bt_results++];
+    qsort(bt->bt_sample, bt->bt_count, sizeof (uint), bench_compare_uint);
+    strncpy(br->br_name, name, sizeof (br->br_name) - 1);
+    br->br_name[sizeof (br->br_name) - 1] = '\0';
+    br->br_runs = bt->bt_count;
+    br->br_p50  = bench_pct(bt, 50);
+    br->br_p90  = bench_pct(bt, 90);
+    br->br_p99  = bench_pct(bt, 99);
+    br->br_max  = bt->bt_sample[bt->bt_count - 1];
+    if (bt->bt_total == 0)
+        bt->bt_total = 1;
+    br->br_rate = (uint) ((uint64_t) amount * 1000000 / bt->bt_total);
+
+    printf("%-12s %5u %8u %8u %8u %8u %7u %s",
+           br->br_name, br->br_runs, br->br_p50, br->br_p90, br->br_p99,
+           br->br_max, br->br_rate, unit);
+    for (pos = 0; pos < bt->bt_bases; pos++) {
+        bench_result_t *bb = &bt->bt_base[pos];
+        if (strcmp(bb->br_name, br->br_name) != 0)
+            continue;
+        if ((bb->br_p50 != 0) && (bb->br_rate != 0)) {
+            printf("  p50 %+d%% rate %+d%%",
+                   (int) (((int64_t) br->br_p50 - bb->br_p50) * 100 /
+                          bb->br_p50),
+                   (int) (((int64_t) br->br_rate - bb->br_rate) * 100 /
+                          bb->br_rate));
+        }
+        break;
+    }
+    printf("\n");
+    bt->bt_count = 0;
+    bt->bt_total = 0;
+}
+
+/*
+ * bench_load
+ * ----------
+ * Loads a baseline report previously saved with "bench -s".
+ */
+static rc_t
+bench_load(bench_t *bt, const char *filename)
+{
+    FILE *fp;
+    char  line[128];
+    bench_result_t br;
+
+    fp = fopen(filename, "r");
+    if (fp == NULL) {
+        printf("Failed to open %s\n", filename);
+        return (RC_FAILURE);
+    }
+    bt->bt_base = malloc(BENCH_RESULTS_MAX * sizeof (*bt->bt_base));
+    if (bt->bt_base == NULL) {
+        fclose(fp);
+        return (RC_FAILURE);
+    }
+    while ((bt->bt_bases < BENCH_RESULTS_MAX) &&
+           (fgets(line, sizeof (line), fp) != NULL)) {
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%15s %u %u %u %u %u %u", br.br_name, &br.br_runs,
+                   &br.br_p50, &br.br_p90, &br.br_p99, &br.br_max,
+                   &br.br_rate) == 7) {
+            bt->bt_base[bt->bt_bases++] = br;
+        }
+    }
+    fclose(fp);
+    return (RC_SUCCESS);
+}
+
+/*
+ * bench_save
+ * ----------
+ * Saves the report in a form which "bench -b" can use as a baseline.
+ */
+static rc_t
+bench_save(bench_t *bt, const char *filename)
+{
+    FILE *fp;
+    uint  pos;
+
+    fp = fopen(filename, "w");
+    if (fp == NULL) {
+        printf("Failed to open %s for write\n", filename);
+        return (RC_FAILURE);
+    }
+    fprintf(fp, "# smashftp %s bench: name runs p50 p90 p99 max rate\n",
+            VERSION);
+    for (pos = 0; pos < bt->bt_results; pos++) {
+        bench_result_t *br = &bt->bt_result[pos];
+        fprintf(fp, "%s %u %u %u %u %u %u\n", br->br_name, br->br_runs,
+                br->br_p50, br->br_p90, br->br_p99, br->br_max, br->br_rate);
+    }
+    fclose(fp);
+    return (RC_SUCCESS);
+}
+
+/*
+ * bench_latency
+ * -------------
+ * Measures round trip time of messages which the USB host answers
+ * without any file system access.
+ */
+static rc_t
+bench_latency(bench_t *bt, uint runs)
+{
+    static const struct {
+        const char *name;
+        uint8_t     op;
+        uint16_t    len;
+    } tests[] = {
+        { "nop",      KM_OP_NOP,      0 },
+        { "id",       KM_OP_ID,       0 },
+        { "loop-64",  KM_OP_LOOPBACK, 64 },
+        { "loop-1k",  KM_OP_LOOPBACK, 1024 },
+    };
+    km_msg_hdr_t *msg;
+    uint64_t      time_start;
+    uint          test;
+    uint          run;
+    uint          rc;
+    uint          rlen;
+    void         *rdata;
+
+    msg = malloc(sizeof (*msg) + 1024);
+    if (msg == NULL)
+        return (RC_FAILURE);
+    memset(msg + 1, 0x5a, 1024);
+    for (test = 0; test < ARRAY_SIZE(tests); test++) {
+        for (run = 0; run < runs; run++) {
+            if (is_user_abort()) {
+                free(msg);
+                return (RC_USR_ABORT);
+            }
+            msg->km_op     = tests[test].op;
+            msg->km_status = 0;
+            msg->km_tag    = host_tag_alloc();
+            time_start = smash_time();
+            rc = host_msg(msg, sizeof (*msg) + tests[test].len, &rdata, &rlen);
+            bench_sample(bt, time_start);
+            host_tag_free(msg->km_tag);
+            if (rc != KM_STATUS_OK) {
+                printf("%s failed: %s\n", tests[test].name, smash_err(rc));
+                free(msg);
+                return (RC_FAILURE);
+            }
+        }
+        bench_done(bt, tests[test].name, runs, "op/s");
+    }
+    free(msg);
+    return (RC_SUCCESS);
+}
+
+/*
+ * bench_xfer
+ * ----------
+ * Measures sequential write and then read throughput of the scratch
+ * file, with each request size from 512 bytes to 64 KB.
+ */
+static rc_t
+bench_xfer(bench_t *bt, const char *name)
+{
+    uint     size;
+    uint     count;
+    uint     run;
+    uint     rc;
+    uint     type;
+    uint     rlen;
+    void    *rdata;
+    char    *bufptr;
+    char     tname[16];
+    handle_t handle;
+    uint64_t time_start;
+
+    bufptr = malloc(BENCH_XFER_MAX + sizeof (hm_freadwrite_t));
+    if (bufptr == NULL)
+        return (RC_FAILURE);
+    memset(bufptr, 0xa5, BENCH_XFER_MAX + sizeof (hm_freadwrite_t));
+
+    rc = sm_fopen(cwd_handle, name, HM_MODE_RDWR | HM_MODE_CREATE |
+                  HM_MODE_TRUNC, &type, 0, &handle);
+    if (rc != KM_STATUS_OK) {
+        printf("Failed to create %s: %s\n", name, smash_err(rc));
+        free(bufptr);
+        return (RC_FAILURE);
+    }
+    for (size = 512; size <= BENCH_XFER_MAX; size <<= 1) {
+        count = BENCH_XFER_TOTAL / size;
+        if (count < 16)
+            count = 16;
+        (void) sm_fseek(handle, OFFSET_BEGINNING, 0, NULL, NULL);
+        for (run = 0; run < count; run++) {
+            if (is_user_abort())
+                goto bench_xfer_abort;
+            time_start = smash_time();
+            rc = sm_fwrite(handle, bufptr, size, 1, 0);
+            bench_sample(bt, time_start);
+            if (rc != KM_STATUS_OK) {
+                printf("Write failed: %s\n", smash_err(rc));
+                goto bench_xfer_fail;
+            }
+        }
+        sprintf(tname, "write-%u%s", (size < 1024) ? size : size >> 10,
+                (size < 1024) ? "" : "k");
+        bench_done(bt, tname, count * size >> 10, "KB/s");
+
+        (void) sm_fseek(handle, OFFSET_BEGINNING, 0, NULL, NULL);
+        for (run = 0; run < count; run++) {
+            if (is_user_abort())
+                goto bench_xfer_abort;
+            time_start = smash_time();
+            rc = sm_fread(handle, size, &rdata, &rlen, 0);
+            bench_sample(bt, time_start);
+            if ((rc != KM_STATUS_OK) || (rlen != size)) {
+                printf("Read failed: %s\n", smash_err(rc));
+                goto bench_xfer_fail;
+            }
+        }
+        sprintf(tname, "read-%u%s", (size < 1024) ? size : size >> 10,
+                (size < 1024) ? "" : "k");
+        bench_done(bt, tname, count * size >> 10, "KB/s");
+    }
+    sm_fclose(handle);
+    free(bufptr);
+    return (RC_SUCCESS);
+
+bench_xfer_abort:
+    rc = RC_USR_ABORT;
+    goto bench_xfer_done;
+bench_xfer_fail:
+    rc = RC_FAILURE;
+bench_xfer_done:
+    sm_fclose(handle);
+    free(bufptr);
+    return (rc);
+}
+
+/*
+ * bench_meta
+ * ----------
+ * Measures file open / close and stat rate on the scratch file, and
+ * directory listing rate of the directory which contains it.
+ */
+static rc_t
+bench_meta(bench_t *bt, const char *name, const char *dir, uint runs)
+{
+    uint     run;
+    uint     rc;
+    uint     type;
+    uint     rlen;
+    uint     pos;
+    uint     entlen;
+    uint     entries = 0;
+    uint8_t *data;
+    handle_t handle;
+    uint64_t time_start;
+    hm_fdirent_t dent;
+    hm_fdirent_t *ent;
+
+    for (run = 0; run < runs; run++) {
+        if (is_user_abort())
+            return (RC_USR_ABORT);
+        time_start = smash_time();
+        rc = sm_fopen(cwd_handle, name, HM_MODE_READ, &type, 0, &handle);
+        if (rc == KM_STATUS_OK)
+            rc = sm_fclose(handle);
+        bench_sample(bt, time_start);
+        if (rc != KM_STATUS_OK) {
+            printf("Open %s failed: %s\n", name, smash_err(rc));
+            return (RC_FAILURE);
+        }
+    }
+    bench_done(bt, "open-close", runs, "op/s");
+
+    for (run = 0; run < runs; run++) {
+        if (is_user_abort())
+            return (RC_USR_ABORT);
+        time_start = smash_time();
+        rc = remote_stat(name, &dent);
+        bench_sample(bt, time_start);
+        if (rc != RC_SUCCESS)
+            return (RC_FAILURE);
+    }
+    bench_done(bt, "stat", runs, "op/s");
+
+    for (run = 0; run < runs; run++) {
+        if (is_user_abort())
+            return (RC_USR_ABORT);
+        time_start = smash_time();
+        rc = sm_fopen(cwd_handle, dir, HM_MODE_READ, &type, 0, &handle);
+        if (rc != KM_STATUS_OK) {
+            printf("Open %s failed: %s\n", dir, smash_err(rc));
+            return (RC_FAILURE);
+        }
+        do {
+            rc = sm_fread(handle, DIRBUF_SIZE, (void **) &data, &rlen, 0);
+            if ((rc != KM_STATUS_OK) && (rc != KM_STATUS_EOF)) {
+                printf("Dir read %s failed: %s\n", dir, smash_err(rc));
+                sm_fclose(handle);
+                return (RC_FAILURE);
+            }
+            for (pos = 0; pos < rlen; pos += sizeof (*ent) + entlen) {
+                ent = (hm_fdirent_t *)(((uintptr_t) data) + pos);
+                entlen = ent->hmd_elen;
+                if ((entlen > 256) || (pos + sizeof (*ent) + entlen > rlen)) {
+                    printf("Corrupt entlen=%x in %s\n", entlen, dir);
+                    sm_fclose(handle);
+                    return (RC_FAILURE);
+                }
+                entries++;
+            }
+        } while ((rc == KM_STATUS_OK) && (rlen != 0));
+        sm_fclose(handle);
+        bench_sample(bt, time_start);
+    }
+    bench_done(bt, "dir-list", entries, "ent/s");
+    return (RC_SUCCESS);
+}
+
+/*
+ * cmd_bench
+ * ---------
+ * Measures performance of the USB host file service. Each test reports
+ * sample time percentiles and a rate. The report may be saved and
+ * later compared against, so that changes to Kicksmash firmware or
+ * hostsmash can be checked for regressions.
+ */
+rc_t
+cmd_bench(int argc, char * const *argv)
+{
+    int         arg;
+    uint        runs = BENCH_RUNS_DEFAULT;
+    const char *dir = NULL;
+    const char *save = NULL;
+    const char *base = NULL;
+    char       *name;
+    rc_t        rc;
+    bench_t     bt;
+
+    for (arg = 1; arg < argc; arg++) {
+        const char *ptr = argv[arg];
+        if (*ptr != '-') {
+            if (dir != NULL) {
+                printf("Unexpected argument: %s\n", ptr);
+                return (RC_USER_HELP);
+            }
+            dir = ptr;
+            continue;
+        }
+        if ((ptr[1] == '\0') || (ptr[2] != '\0') || (++arg >= argc)) {
+            printf(cmd_bench_help);
+            return (RC_BAD_PARAM);
+        }
+        switch (ptr[1]) {
+            case 'n':
+                if ((sscanf(argv[arg], "%u", &runs) != 1) || (runs == 0)) {
+                    printf("Invalid count %s\n", argv[arg]);
+                    return (RC_BAD_PARAM);
+                }
+                break;
+            case 's':
+                save = argv[arg];
+                break;
+            case 'b':
+                base = argv[arg];
+                break;
+            default:
+                printf("Unknown argument %s\n", ptr);
+                printf(cmd_bench_help);
+                return (RC_BAD_PARAM);
+        }
+    }
+    if (dir == NULL)
+        dir = "";
+
+    memset(&bt, 0, sizeof (bt));
+    bt.bt_size = (runs > BENCH_XFER_TOTAL / 512) ? runs :
+                 BENCH_XFER_TOTAL / 512;
+    bt.bt_sample = malloc(bt.bt_size * sizeof (uint));
+    name = malloc(strlen(dir) + sizeof (BENCH_FILE) + 1);
+    if ((bt.bt_sample == NULL) || (name == NULL)) {
+        printf("malloc failure\n");
+        rc = RC_FAILURE;
+        goto bench_done_free;
+    }
+    path_join(name, dir, BENCH_FILE);
+    if ((base != NULL) && ((rc = bench_load(&bt, base)) != RC_SUCCESS))
+        goto bench_done_free;
+
+    printf("%-12s %5s %8s %8s %8s %8s %12s\n",
+           "Test", "Runs", "p50 us", "p90 us", "p99 us", "max us", "Rate");
+    rc = bench_latency(&bt, runs);
+    if (rc == RC_SUCCESS) {
+        rc = bench_xfer(&bt, name);
+        if (rc == RC_SUCCESS)
+            rc = bench_meta(&bt, name, (*dir == '\0') ? "." : dir, runs);
+        (void) sm_fdelete(cwd_handle, name);
+    }
+    if (rc == RC_USR_ABORT)
+        printf("^C\n");
+    if ((rc == RC_SUCCESS) && (save != NULL))
+        rc = bench_save(&bt, save);
+
+bench_done_free:
+    free(name);
+    free(bt.bt_sample);
+    free(bt.bt_base);
+    return (rc);
+}
+
 rc_t
 cmd_time(int argc, char * const *argv)
 {
@@ -2691,7 +5002,7 @@ main(int argc, char *argv[])
 #pragma GCC diagnostic pop
 
 
-    cpu_control_init();  // cpu_type, SysBase
+    msg_init();  // cpu_type, SysBase, reply handshake calibration
 
     cmdbuf = cmd_string_from_argv(argc - 1, argv + 1);
 
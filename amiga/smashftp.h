@@ -12,6 +12,7 @@
 #ifndef _SMASHFTP_H
 #define _SMASHFTP_H
 
+rc_t cmd_bench(int argc, char * const *argv);
 rc_t cmd_cd(int argc, char * const *argv);
 rc_t cmd_chmod(int argc, char * const *argv);
 rc_t cmd_debug(int argc, char * const *argv);
@@ -32,13 +33,17 @@ rc_t cmd_mkdir(int argc, char * const *argv);
 rc_t cmd_mv(int argc, char * const *argv);
 rc_t cmd_put(int argc, char * const *argv);
 rc_t cmd_pwd(int argc, char * const *argv);
+rc_t cmd_rcp(int argc, char * const *argv);
 rc_t cmd_rm(int argc, char * const *argv);
 rc_t cmd_time(int argc, char * const *argv);
 rc_t cmd_version(int argc, char * const *argv);
+rc_t lmkdir_work(const char *name, uint flag_path);
+rc_t mkdir_work(const char *name, uint flag_path);
 rc_t parse_value(const char *arg, uint8_t *value, uint width);
 rc_t parse_addr(char * const **arg, int *argc, uint64_t *space, uint64_t *addr);
 void clear_user_abort(void);
 
+extern const char cmd_bench_help[];
 extern const char cmd_time_help[];
 extern const char cmd_version_help[];
 
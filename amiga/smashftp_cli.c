@@ -49,6 +49,8 @@ static rc_t cmd_help(int argc, char * const *argv);
 
 static const cmd_t cmd_list[] = {
     { cmd_help,    "?",       0, NULL, " [<cmd>]", "display help" },
+    { cmd_bench,   "bench",   0, cmd_bench_help, " [-n <count>] [<dir>]",
+                                       "measure file service performance" },
     { cmd_cd,      "cd",      0, NULL, " [<dir>]", "change current directory" },
     { cmd_chmod,   "chmod",   0, NULL, " [ugoa][+-=][hsparwed] <file>",
                                        "set remote file protection" },
@@ -104,6 +106,8 @@ static const cmd_t cmd_list[] = {
 #ifndef EMBEDDED_CMD
     { cmd_echo,    "quit",    1, NULL, "", "exit program" },
 #endif
+    { cmd_rcp,     "rcp",     0, NULL, " [-mnr] <src> <dst>",
+                                       "copy file or directory on remote" },
     { cmd_mv,      "rename",  3, NULL, NULL, NULL },
     { cmd_rm,      "rm",      0, NULL, " <file>", "remove file" },
     { cmd_rm,      "rmdir",   0, NULL, " <file>", "remove directory" },
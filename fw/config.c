@@ -21,13 +21,16 @@
 #include "stm32flash.h"
 #include "utils.h"
 #include "m29f160xt.h"
+#include "msg.h"
 
 #define CONFIG_MAGIC     0x19460602
-#define CONFIG_VERSION   0x02
+#define CONFIG_VERSION   0x04
 #define CONFIG_AREA_BASE 0x3e000
 #define CONFIG_AREA_SIZE 0x02000
 #define CONFIG_AREA_END  (CONFIG_AREA_BASE + CONFIG_AREA_SIZE)
 
+#define CONFIG_WEAR_FLUSH_MSEC 5000  // Delay to coalesce wear counter writes
+
 uint64_t config_timer = 0;
 uint8_t  cold_poweron = 0;
 
@@ -136,6 +139,14 @@ config_read(void)
                     /* Structure expanded for this new field */
                     memset(config.nv_mem, 0, sizeof (config.nv_mem));
                 }
+                if (config.version < 3) {
+                    /* Structure expanded for cached flash geometry */
+                    memset(&config.flash_geom, 0, sizeof (config.flash_geom));
+                }
+                if (config.version < 4) {
+                    /* Structure expanded for flash wear counters */
+                    memset(&config.flash_wear, 0, sizeof (config.flash_wear));
+                }
                 config.version = CONFIG_VERSION;
                 return;
             }
@@ -169,6 +180,8 @@ config_read(void)
 void
 config_poll(void)
 {
+    if (ee_erase_busy())
+        return;  // Coalesce config (wear counter) updates until erase is done
     if ((config_timer != 0) && timer_tick_has_elapsed(config_timer)) {
         config_timer = 0;
         config_write();
@@ -351,3 +364,83 @@ config_set_led(uint value)
     config.led_level = value;
     config_updated();
 }
+
+/*
+ * config_wear_erase
+ * -----------------
+ * Records an erase of the flash sectors covering the specified range of
+ * device word addresses. The config area write is deferred so that the
+ * many sector erases of a bank or image update are coalesced.
+ */
+void
+config_wear_erase(uint32_t addr, uint32_t len)
+{
+    flash_wear_t *fw = &config.flash_wear;
+    uint32_t      now = msg_amiga_time_sec();
+    uint          sector = addr >> FW_SECTOR_SHIFT;
+    uint          last;
+
+    if (len == 0)
+        len = 1;
+    last = (addr + len - 1) >> FW_SECTOR_SHIFT;
+    if (last >= FW_SECTORS)
+        last = FW_SECTORS - 1;
+
+    for (; sector <= last; sector++) {
+        if (fw->fw_erase_count[sector] != 0xffff)
+            fw->fw_erase_count[sector]++;
+        if (now != 0)
+            fw->fw_erase_time[sector] = now;
+    }
+    config_timer = timer_tick_plus_msec(CONFIG_WEAR_FLUSH_MSEC);
+}
+
+/*
+ * config_wear_bank
+ * ----------------
+ * Reports the highest sector erase count and most recent erase time of
+ * the sectors making up the specified ROM bank. Returns the total erase
+ * count of all sectors in the bank.
+ */
+int
+config_wear_bank(uint bank, uint *count, uint32_t *etime)
+{
+    flash_wear_t *fw = &config.flash_wear;
+    uint          sectors = FW_SECTORS / ROM_BANKS;
+    uint          sector;
+    uint          total = 0;
+
+    *count = 0;
+    *etime = 0;
+    for (sector = bank * sectors; sector < (bank + 1) * sectors; sector++) {
+        total += fw->fw_erase_count[sector];
+        if (*count < fw->fw_erase_count[sector])
+            *count = fw->fw_erase_count[sector];
+        if (*etime < fw->fw_erase_time[sector])
+            *etime = fw->fw_erase_time[sector];
+    }
+    return (total);
+}
+
+void
+config_wear_show(void)
+{
+    flash_wear_t *fw = &config.flash_wear;
+    uint32_t      now = msg_amiga_time_sec();
+    uint          sector;
+
+    printf("Sector  Bank  WordAddr  Erases  LastErase\n");
+    for (sector = 0; sector < FW_SECTORS; sector++) {
+        uint32_t etime = fw->fw_erase_time[sector];
+        printf("%-6u  %-4u  %06lx  %6u  ", sector,
+               sector / (FW_SECTORS / ROM_BANKS),
+               (uint32_t) sector << FW_SECTOR_SHIFT,
+               fw->fw_erase_count[sector]);
+        if (etime == 0)
+            printf("-\n");
+        else if ((now == 0) || (now < etime))
+            printf("%lu\n", etime);  // Amiga time not yet known
+        else
+            printf("%lu hours ago\n", (now - etime) / 3600);
+    }
+}
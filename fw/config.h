@@ -31,6 +31,8 @@ typedef struct {
     uint8_t     unused[29]; // Unused
     uint32_t    flags;      // Runtime flags
     uint8_t     nv_mem[32]; // Non-volatile storage for Amiga
+    flash_geometry_t flash_geom;  // Cached flash CFI geometry
+    flash_wear_t flash_wear;      // Flash sector erase counters
 } config_t;
 
 extern config_t config;
@@ -46,6 +48,9 @@ int  config_set_bank(uint bank, uint set_cur, uint set_poweron, uint set_reset);
 void config_bank_show(void);
 void config_name(const char *name);
 void config_set_led(uint value);
+void config_wear_erase(uint32_t addr, uint32_t len);
+void config_wear_show(void);
+int  config_wear_bank(uint bank, uint *count, uint32_t *etime);
 
 #define STM32FLASH_FLAG_AUTOERASE 1
 
@@ -26,6 +26,7 @@
 #include "config.h"
 #include "kbrst.h"
 #include "msg.h"
+#include "romindex.h"
 #include <libopencm3/stm32/dma.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/timer.h>
@@ -35,6 +36,8 @@
 
 #define EE_DEVICE_SIZE          (1 << 20)   // 1M words (16-bit words)
 #define MX_ERASE_SECTOR_SIZE    (32 << 10)  // 32K-word blocks
+#define EE_READ_BURST_WORDS     256         // Max words per IRQ-off burst
+#define EE_WBUF_MAX_WORDS       32          // Largest write buffer used
 
 #define MX_STATUS_FAIL_PROGRAM  0x10  // Status code - failed to program
 #define MX_STATUS_FAIL_ERASE    0x20  // Status code - failed to erase
@@ -49,6 +52,17 @@
 #define EE_STATUS_ERASE_FAILURE 3     // Erase failure
 #define EE_STATUS_PROG_FAILURE  4     // Program failure
 
+#define EE_ERASE_IDLE           0     // No background erase active
+#define EE_ERASE_RUNNING        1     // Background erase in progress
+#define EE_ERASE_SUSPENDED      2     // Background erase suspended
+
+#define EE_ERASE_READ_HOLD_MSEC 20    // Erase stays suspended for reads
+#define EE_ERASE_MIN_RUN_USEC   20000 // Erase runs at least this long
+
+#define EE_ERASE_CHECK_DONE     0     // Device not toggling (erase complete)
+#define EE_ERASE_CHECK_BUSY     1     // Device still erasing
+#define EE_ERASE_CHECK_FAILURE  2     // Device reports erase failure
+
 /*
  * EE_MODE_32      = 32-bit flash
  * EE_MODE_32_SWAP = 32-bit flash low / high flash swapped
@@ -64,9 +78,33 @@ static uint32_t ee_status = EE_STATUS_NORMAL;  // Status from program/erase
 static uint32_t ticks_per_20_nsec;
 static uint32_t ticks_per_30_nsec;
 static uint32_t ticks_per_35_nsec;
+static uint32_t ticks_per_70_nsec;
 static uint64_t ee_last_access = 0;
 static bool     ee_enabled = false;
 static bool     ee_write_bug = true;
+static uint32_t ee_prog_timeout_usec = 360;       // Word program timeout
+static uint32_t ee_block_erase_timeout_usec = 1000000; // Per block timeout
+static uint32_t ee_chip_erase_timeout_usec = 32000000; // Chip erase timeout
+static uint32_t ee_buf_prog_timeout_usec = 0;      // Buffer program timeout
+static uint     ee_wbuf_words = 0;  // Write buffer size (0=word program only)
+
+/* Background erase state */
+static uint8_t  ee_erase_state = EE_ERASE_IDLE;
+static uint8_t  ee_erase_mode;          // MX_ERASE_MODE_CHIP or SECTOR
+static bool     ee_erase_auto;          // Suspended by firmware (Amiga running)
+static bool     ee_erase_report;        // Report completion on console
+static int      ee_erase_rc;            // Result of last erase
+static uint32_t ee_erase_addr;          // Word address of block being erased
+static uint32_t ee_erase_bsize;         // Size (in words) of current block
+static uint32_t ee_erase_end;           // End word address of erase range
+static uint     ee_erase_blocks_done;
+static uint     ee_erase_blocks_total;
+static uint32_t ee_erase_timeout;       // Per block timeout (usec)
+static uint64_t ee_erase_tick;          // Tick when block was (re)started
+static uint64_t ee_erase_usec;          // Block run time before last suspend
+static uint64_t ee_erase_read_timer;    // Resume time of erase held for reads
+
+static void ee_erase_finish(int rc);
 
 /*
  * address_output
@@ -382,7 +420,8 @@ ee_enable(void)
     oe_output_enable();
     data_output_disable();
     ee_enabled = true;
-    ee_read_mode();
+    if (ee_erase_state == EE_ERASE_IDLE)
+        ee_read_mode();
     ee_last_access = timer_tick_get();
     ee_set_mode(ee_mode);
 }
@@ -397,6 +436,17 @@ ee_disable(void)
 {
     if (ee_enabled == false)
         return;
+    if ((ee_erase_state == EE_ERASE_RUNNING) &&
+        (ee_erase_mode != MX_ERASE_MODE_CHIP)) {
+        /* Block erase continues after the bus is again owned */
+        ee_erase_suspend();
+        ee_erase_auto = true;
+    }
+    /*
+     * A chip erase can not be suspended. The device keeps erasing with
+     * the bus released, and ee_erase_poll() checks on it again once the
+     * bus may be driven.
+     */
     we_output(1);
     oe_output_disable();
     address_output_disable();
@@ -458,39 +508,130 @@ ee_read_word(uint32_t addr, uint32_t *data)
 #endif
 }
 
+/*
+ * ee_read_burst
+ * -------------
+ * Reads a run of sequential words from the EEPROM device with OE# held
+ * low for the entire burst. Only the address pins are toggled between
+ * words, so each word costs one address port write, the tACC delay, and
+ * the data port read. A13-A19 are only rewritten when they change.
+ * The caller must have interrupts disabled.
+ *
+ * shift = 0  Store 32-bit words
+ * shift = 1  Store low 16 bits of each word
+ * shift = 2  Store high 16 bits of each word
+ */
+static void
+ee_read_burst(uint32_t addr, void *datap, uint count, uint shift)
+{
+    uint32_t *data32 = datap;
+    uint16_t *data16 = datap;
+    uint32_t  value;
+
+    address_output(addr);
+    address_output_enable();
+    oe_output(0);
+    oe_output_enable();
+    timer_delay_ticks(ticks_per_70_nsec);  // Wait for tACC
+
+    while (count-- > 0) {
+        value = data_input();
+        if (count != 0) {
+            /* Present next address while the current word is stored */
+            addr++;
+            if ((addr & 0x1fff) == 0)
+                address_output(addr);
+            else
+                GPIO_ODR(SOCKET_A0_PORT) = addr & 0xffff;  // Set A0-A12
+        }
+        if (shift == 0)
+            *(data32++) = value;
+        else if (shift == 1)
+            *(data16++) = (uint16_t) value;
+        else
+            *(data16++) = value >> 16;
+        if (count != 0)
+            timer_delay_ticks(ticks_per_70_nsec);  // Wait for tACC
+    }
+    oe_output(1);
+    oe_output_disable();
+    timer_delay_ticks(ticks_per_20_nsec);  // Wait for tDF
+}
+
 /*
  * ee_read
  * -------
  * Reads the specified number of words from the EEPROM device.
+ * The read is performed as a sequence of bursts, with interrupts only
+ * disabled for the duration of each burst.
  */
 int
 ee_read(uint32_t addr, void *datap, uint count)
 {
+    uint shift;
+    uint wsize;
+
     if (addr + count > EE_DEVICE_SIZE)
         return (1);
 
-    if ((ee_mode == EE_MODE_32) || (ee_mode == EE_MODE_32_SWAP)) {
-        uint32_t *data = datap;
+    if (ee_erase_state != EE_ERASE_IDLE) {
+        /*
+         * Only blocks not being erased may be read while suspended.
+         * Blocks in the erase range would return status, not data.
+         */
+        if ((addr < ee_erase_end) && (addr + count > ee_erase_addr))
+            return (1);
+        if (ee_erase_state == EE_ERASE_RUNNING) {
+            /*
+             * Let the erase run for a minimum time between suspends,
+             * then hold it suspended for a while so that a stream of
+             * reads is batched rather than suspending the erase for
+             * each one. ee_erase_poll() resumes the erase.
+             */
+            uint64_t usec = timer_tick_to_usec(timer_tick_get() -
+                                               ee_erase_tick);
+            if (usec < EE_ERASE_MIN_RUN_USEC)
+                timer_delay_usec(EE_ERASE_MIN_RUN_USEC - usec);
+            if (ee_erase_suspend() != 0)
+                return (1);
+            ee_erase_read_timer = timer_tick_plus_msec(EE_ERASE_READ_HOLD_MSEC);
+        }
+    }
 
-        disable_irq();
-        while (count-- > 0)
-            ee_read_word(addr++, data++);
-        enable_irq();
+    if ((ee_mode == EE_MODE_32) || (ee_mode == EE_MODE_32_SWAP)) {
+        shift = 0;
+        wsize = 4;
+    } else if (ee_mode == EE_MODE_16_LOW) {
+        shift = 1;
+        wsize = 2;
     } else {
-        uint16_t *data = datap;
+        shift = 2;
+        wsize = 2;
+    }
+
+    while (count > 0) {
+        uint tcount = count;
+        if (tcount > EE_READ_BURST_WORDS)
+            tcount = EE_READ_BURST_WORDS;
 
         disable_irq();
-        while (count-- > 0) {
-            uint32_t value;
-            ee_read_word(addr++, &value);
-            if (ee_mode == EE_MODE_16_LOW)
-                (*data++) = (uint16_t) value;
-            else
-                (*data++) = value >> 16;
-        }
+        ee_read_burst(addr, datap, tcount, shift);
         enable_irq();
-    }
+#ifdef DEBUG_SIGNALS
+        {
+            uint pos;
+            for (pos = 0; pos < tcount; pos++) {
+                uint32_t value = (shift == 0) ? ((uint32_t *) datap)[pos] :
+                                                ((uint16_t *) datap)[pos];
+                printf(" RWord[%lx]=%08lx", addr + pos, value);
+            }
+        }
+#endif
 
+        addr  += tcount;
+        count -= tcount;
+        datap  = (uint8_t *) datap + tcount * wsize;
+    }
     return (0);
 }
 
@@ -745,14 +886,121 @@ ee_program_word(uint32_t addr, uint32_t word)
         ee_read_mode();  // Prevent bug where data gets interpreted as command
     enable_irq();
 
-    return (ee_wait_for_done_status(360, 0, EE_MODE_PROGRAM));
+    return (ee_wait_for_done_status(ee_prog_timeout_usec, 0, EE_MODE_PROGRAM));
+}
+
+/*
+ * ee_program_buffer
+ * -----------------
+ * Writes a run of words to the EEPROM using the Write to Buffer and
+ * Program command sequence. All words must be within the same write
+ * buffer page of the device.
+ */
+static int
+ee_program_buffer(uint32_t addr, const uint32_t *words, uint count)
+{
+    uint pos;
+    int  rc;
+
+    disable_irq();
+    ee_write_word(0x00555, 0x00aa00aa);
+    ee_write_word(0x002aa, 0x00550055);
+    ee_write_word(addr, 0x00250025);
+    ee_write_word(addr, (count - 1) * 0x00010001);
+    for (pos = 0; pos < count; pos++)
+        ee_write_word(addr + pos, words[pos]);
+    ee_write_word(addr, 0x00290029);
+    enable_irq();
+
+    rc = ee_wait_for_done_status(ee_buf_prog_timeout_usec, 0,
+                                 EE_MODE_PROGRAM);
+    if (rc != 0) {
+        /* Write to Buffer Abort Reset */
+        disable_irq();
+        ee_write_word(0x00555, 0x00aa00aa);
+        ee_write_word(0x002aa, 0x00550055);
+        ee_write_word(0x00555, 0x00f000f0);
+        enable_irq();
+    }
+    return (rc);
+}
+
+/*
+ * ee_write_value
+ * --------------
+ * Fetches the next word to be programmed from a caller's buffer,
+ * positioned for the current EEPROM mode.
+ */
+static uint32_t
+ee_write_value(const uint8_t *data)
+{
+    switch (ee_mode) {
+        default:
+        case EE_MODE_32:
+        case EE_MODE_32_SWAP:
+            return (*(uint32_t *) data);
+        case EE_MODE_16_LOW:
+            return (*(uint16_t *) data);
+        case EE_MODE_16_HIGH:
+            return ((*(uint16_t *) data) << 16);
+    }
+}
+
+/*
+ * ee_write_buffer
+ * ---------------
+ * Programs a run of words (not crossing a write buffer page) using the
+ * device write buffer, then reads back each word to verify. A mismatch
+ * is retried if only bits which are still 1 need to be cleared.
+ *
+ * Return values
+ *  0 = Success
+ *  3 = Buffer program failed (device may not support write buffer)
+ *  4 = Verify mismatch
+ */
+static int
+ee_write_buffer(uint32_t addr, const uint8_t *data, uint count, uint wordsize)
+{
+    uint32_t values[EE_WBUF_MAX_WORDS];
+    uint32_t rvalue;
+    uint32_t xvalue;
+    uint     try_count = 0;
+    uint     pos;
+
+    for (pos = 0; pos < count; pos++)
+        values[pos] = ee_write_value(data + pos * wordsize);
+
+try_again:
+    if (ee_program_buffer(addr, values, count) != 0)
+        return (3);
+
+    /* Verify write was successful */
+    for (pos = 0; pos < count; pos++) {
+        ee_read_word(addr + pos, &rvalue);
+        xvalue = (values[pos] ^ rvalue) & ee_cmd_mask;
+        if (xvalue == 0)
+            continue;
+        if ((try_count++ < 2) && ((xvalue & ~rvalue) == 0)) {
+            /* Can try again -- bits are not 0 which need to be 1 */
+#ifdef DEBUG_SIGNALS
+            printf("Buffer mismatch -- trying again at 0x%lx\n",
+                   (addr + pos) << ee_addr_shift);
+#endif
+            goto try_again;
+        }
+        printf("  Program mismatch at 0x%lx\n", (addr + pos) << ee_addr_shift);
+        printf("      wrote=%08lx read=%08lx\n", values[pos], rvalue);
+        return (4);
+    }
+    return (0);
 }
 
 /*
  * ee_write() will program <count> words to EEPROM, starting at the
- *            specified address. It automatically uses page program
- *            to speed up programming. After each page is written,
- *            it is read back to verify that programming was successful.
+ *            specified address. If the device reports a write buffer
+ *            (CFI), runs of words within a buffer page are programmed
+ *            together and then read back to verify. Otherwise each word
+ *            is programmed and verified individually.
  */
 int
 ee_write(uint32_t addr, void *datap, uint count)
@@ -772,22 +1020,36 @@ ee_write(uint32_t addr, void *datap, uint count)
     if (addr + count > EE_DEVICE_SIZE)
         return (1);
 
+    if (ee_erase_state != EE_ERASE_IDLE) {
+        printf("Erase in progress\n");
+        return (1);
+    }
+    romindex_invalidate(addr, count);
+
     while (count > 0) {
         int try_count = 0;
-try_again:
-        switch (ee_mode) {
-            default:
-            case EE_MODE_32:
-            case EE_MODE_32_SWAP:
-                value = *(uint32_t *) data;
-                break;
-            case EE_MODE_16_LOW:
-                value = *(uint16_t *) data;
-                break;
-            case EE_MODE_16_HIGH:
-                value = (*(uint16_t *) data) << 16;
-                break;
+
+        if ((ee_wbuf_words > 1) && (count > 1)) {
+            uint wcount = ee_wbuf_words - (addr & (ee_wbuf_words - 1));
+            if (wcount > count)
+                wcount = count;
+            if (wcount > 1) {
+                rc = ee_write_buffer(addr, data, wcount, wordsize);
+                if (rc == 0) {
+                    count -= wcount;
+                    addr  += wcount;
+                    data  += wcount * wordsize;
+                    continue;
+                }
+                if (rc != 3)
+                    return (rc);
+                printf("  Buffer program failed at 0x%lx; "
+                       "using word program\n", addr << ee_addr_shift);
+                ee_wbuf_words = 0;
+            }
         }
+try_again:
+        value = ee_write_value(data);
         rc = ee_program_word(addr, value);
         if (rc != 0) {
             if (try_count++ < 2) {
@@ -895,6 +1157,9 @@ static const chip_blocks_t chip_blocks[] = {
     { 0x0000,  0, 32, 4, 0x1d },  // Default to bottom boot
 };
 
+static const chip_blocks_t    *ee_erase_cb;  // Block map of erasing part
+static const flash_geometry_t *ee_erase_fg;  // CFI geometry of erasing part
+
 /*
  * get_chip_block_info
  * -------------------
@@ -930,25 +1195,686 @@ get_chip_block_info(uint32_t chipid)
 }
 
 /*
- * ee_erase
+ * ee_cfi_byte
+ * -----------
+ * Returns the CFI query byte at the specified word offset from the first
+ * (or only) flash device. The flash must already be in CFI query mode.
+ */
+static uint8_t
+ee_cfi_byte(uint offset)
+{
+    uint32_t value;
+
+    ee_read_word(offset, &value);
+    if (ee_mode == EE_MODE_16_HIGH)
+        return (value >> 16);
+    return ((uint8_t) value);
+}
+
+/*
+ * ee_cfi_word
+ * -----------
+ * Returns a 16-bit little endian CFI query value at the specified offset.
+ */
+static uint16_t
+ee_cfi_word(uint offset)
+{
+    return (ee_cfi_byte(offset) | (ee_cfi_byte(offset + 1) << 8));
+}
+
+/*
+ * cfi_time
  * --------
- * Will erase the entire chip, individual blocks, or sequential groups
- * of blocks.
+ * Converts a CFI 2^n typical time value and 2^n maximum multiplier
+ * into a value which fits in 16 bits. A zero typical value means the
+ * operation is not supported, in which case 0 is returned.
+ */
+static uint16_t
+cfi_time(uint8_t typ, uint8_t max)
+{
+    uint32_t value;
+
+    if ((typ == 0) || (typ >= 16))
+        return (0);
+    value = BIT(typ);
+    if (max < 16)
+        value <<= max;
+    if (value > 0xffff)
+        value = 0xffff;
+    return (value);
+}
+
+/*
+ * ee_geometry_apply
+ * -----------------
+ * Updates the program and erase timeouts from the specified flash
+ * geometry. Timeouts revert to the MX29F800 datasheet maximums if the
+ * geometry did not come from CFI.
+ */
+static void
+ee_geometry_apply(const flash_geometry_t *fg)
+{
+    ee_prog_timeout_usec        = 360;
+    ee_block_erase_timeout_usec = 1000000;
+    ee_chip_erase_timeout_usec  = 32000000;
+    ee_wbuf_words               = 0;
+    if (fg->fg_valid == 0)
+        return;
+    if (fg->fg_word_prog_max_usec != 0)
+        ee_prog_timeout_usec = fg->fg_word_prog_max_usec;
+    if (fg->fg_block_erase_max_msec != 0)
+        ee_block_erase_timeout_usec = fg->fg_block_erase_max_msec * 1000;
+    if (fg->fg_chip_erase_max_msec != 0)
+        ee_chip_erase_timeout_usec = fg->fg_chip_erase_max_msec * 1000;
+    if ((fg->fg_wbuf_shift > 1) && (fg->fg_buf_prog_max_usec != 0)) {
+        /* Write buffer size is in bytes per (16-bit) device */
+        ee_wbuf_words = BIT(fg->fg_wbuf_shift - 1);
+        if (ee_wbuf_words > EE_WBUF_MAX_WORDS)
+            ee_wbuf_words = EE_WBUF_MAX_WORDS;
+        ee_buf_prog_timeout_usec = fg->fg_buf_prog_max_usec;
+    }
+}
+
+/*
+ * ee_cfi_query
+ * ------------
+ * Reads the CFI query table from the flash and fills in the specified
+ * geometry structure. The erase block regions are always reported in
+ * ascending address order, even for top boot parts which report them
+ * in reverse order.
+ *
+ * @return      0 - CFI information was read.
+ * @return      1 - The flash did not respond to CFI query.
+ */
+int
+ee_cfi_query(flash_geometry_t *fg)
+{
+    uint32_t part1;
+    uint32_t part2;
+    uint     pri;
+    uint     pos;
+    uint     count;
+    uint8_t  boot_flag = 0;
+    uint8_t  tm[8];
+
+    memset(fg, 0, sizeof (*fg));
+    ee_id(&part1, &part2);
+    fg->fg_chipid = part1;
+
+    ee_cmd(0x00055, 0x00980098);
+    if ((ee_cfi_byte(0x10) != 'Q') || (ee_cfi_byte(0x11) != 'R') ||
+        (ee_cfi_byte(0x12) != 'Y')) {
+        ee_read_mode();
+        return (1);
+    }
+
+    for (pos = 0; pos < ARRAY_SIZE(tm); pos++)
+        tm[pos] = ee_cfi_byte(0x1f + pos);
+    fg->fg_word_prog_usec       = cfi_time(tm[0], 0);
+    fg->fg_buf_prog_usec        = cfi_time(tm[1], 0);
+    fg->fg_block_erase_msec     = cfi_time(tm[2], 0);
+    fg->fg_chip_erase_msec      = cfi_time(tm[3], 0);
+    fg->fg_word_prog_max_usec   = cfi_time(tm[0], tm[4]);
+    fg->fg_buf_prog_max_usec    = cfi_time(tm[1], tm[5]);
+    fg->fg_block_erase_max_msec = cfi_time(tm[2], tm[6]);
+    fg->fg_chip_erase_max_msec  = cfi_time(tm[3], tm[7]);
+
+    fg->fg_size_shift = ee_cfi_byte(0x27);
+    if (fg->fg_buf_prog_usec != 0)
+        fg->fg_wbuf_shift = ee_cfi_word(0x2a);
+
+    count = ee_cfi_byte(0x2c);
+    if (count > FG_MAX_REGIONS)
+        count = FG_MAX_REGIONS;
+    for (pos = 0; pos < count; pos++) {
+        fg->fg_region[pos].er_blocks = ee_cfi_word(0x2d + pos * 4) + 1;
+        fg->fg_region[pos].er_size   = ee_cfi_word(0x2f + pos * 4);
+    }
+    fg->fg_regions = count;
+
+    /* AMD primary extended table reports top or bottom boot */
+    pri = ee_cfi_word(0x15);
+    if ((pri != 0) && (pri < 0x100) &&
+        (ee_cfi_byte(pri + 0) == 'P') && (ee_cfi_byte(pri + 1) == 'R') &&
+        (ee_cfi_byte(pri + 2) == 'I')) {
+        boot_flag = ee_cfi_byte(pri + 0xf);
+    }
+    ee_read_mode();
+
+    /*
+     * Top boot parts must have their small blocks at the end. Some
+     * (CFI 1.0) parts list regions in reverse order for top boot.
+     */
+    if ((boot_flag == 3) && (count > 1) &&
+        (fg->fg_region[0].er_size < fg->fg_region[count - 1].er_size)) {
+        for (pos = 0; pos < count / 2; pos++) {
+            flash_erase_region_t tmp = fg->fg_region[pos];
+            fg->fg_region[pos] = fg->fg_region[count - 1 - pos];
+            fg->fg_region[count - 1 - pos] = tmp;
+        }
+    }
+
+    fg->fg_valid = 1;
+    return (0);
+}
+
+/*
+ * ee_geometry
+ * -----------
+ * Returns the flash geometry for the specified chip id. If the geometry
+ * cached in config is for a different chip, the flash is queried again
+ * and the new geometry is saved in config.
+ */
+const flash_geometry_t *
+ee_geometry(uint32_t chipid)
+{
+    flash_geometry_t fg;
+
+    if ((config.flash_geom.fg_chipid == chipid) && (chipid != 0))
+        return (&config.flash_geom);
+
+    (void) ee_cfi_query(&fg);
+    fg.fg_chipid = chipid;
+    if (memcmp(&fg, &config.flash_geom, sizeof (fg)) != 0) {
+        config.flash_geom = fg;
+        config_updated();
+    }
+    ee_geometry_apply(&config.flash_geom);
+    return (&config.flash_geom);
+}
+
+/*
+ * ee_geometry_show
+ * ----------------
+ * Displays the specified flash geometry.
+ */
+void
+ee_geometry_show(const flash_geometry_t *fg)
+{
+    uint     pos;
+    uint32_t addr = 0;
+
+    printf("Flash %08lx %s", fg->fg_chipid, ee_id_string(fg->fg_chipid));
+    if (fg->fg_valid == 0) {
+        printf(" (no CFI geometry)\n");
+        return;
+    }
+    printf(" %u KB", BIT(fg->fg_size_shift) >> 10);
+    if (fg->fg_wbuf_shift != 0)
+        printf(", %u byte write buffer", BIT(fg->fg_wbuf_shift));
+    printf("\n"
+           "  Word program  %6u us typ  %6u us max\n",
+           fg->fg_word_prog_usec, fg->fg_word_prog_max_usec);
+    if (fg->fg_buf_prog_usec != 0) {
+        printf("  Buf program   %6u us typ  %6u us max\n",
+               fg->fg_buf_prog_usec, fg->fg_buf_prog_max_usec);
+    }
+    printf("  Block erase   %6u ms typ  %6u ms max\n",
+           fg->fg_block_erase_msec, fg->fg_block_erase_max_msec);
+    if (fg->fg_chip_erase_msec != 0) {
+        printf("  Chip erase    %6u ms typ  %6u ms max\n",
+               fg->fg_chip_erase_msec, fg->fg_chip_erase_max_msec);
+    }
+    for (pos = 0; pos < fg->fg_regions; pos++) {
+        const flash_erase_region_t *er = &fg->fg_region[pos];
+        uint32_t bsize = er->er_size << 7;  // Size in 16-bit words
+        printf("  Region %u  %05lx  %3u x %2lu K-words\n",
+               pos, addr, er->er_blocks, bsize >> 10);
+        addr += er->er_blocks * bsize;
+    }
+}
+
+/*
+ * ee_erase_block_size
+ * -------------------
+ * Returns the size (in words) of the erase block which contains the
+ * specified word address. The CFI geometry is used if available,
+ * otherwise the built-in chip block table is used.
+ */
+static uint32_t
+ee_erase_block_size(const flash_geometry_t *fg, const chip_blocks_t *cb,
+                    uint32_t addr)
+{
+    uint32_t bsize;
+    uint     bnum;
+
+    if ((fg != NULL) && fg->fg_valid && (fg->fg_regions != 0)) {
+        uint32_t base = 0;
+        uint     pos;
+
+        if (fg->fg_size_shift > 1)
+            addr &= (BIT(fg->fg_size_shift - 1) - 1);  // Device wraps
+        for (pos = 0; pos < fg->fg_regions; pos++) {
+            const flash_erase_region_t *er = &fg->fg_region[pos];
+            bsize = er->er_size << 7;  // 256-byte units to words
+            base += er->er_blocks * bsize;
+            if (addr < base)
+                return (bsize);
+        }
+        /* Past the end of reported regions; fall back to the table */
+    }
+
+    bsize = cb->cb_bsize << 10;
+    bnum  = addr / bsize;
+    if (bnum == cb->cb_bbnum) {
+        /* Boot block has variable block size */
+        uint soff = addr - bnum * bsize;
+        uint snum = soff / (cb->cb_ssize << 10);
+        uint smap = cb->cb_map;
+#ifdef ERASE_DEBUG
+        printf("bblock soff=%x snum=%x s_map=%x\n", soff, snum, smap);
+#endif
+        bsize = 0;
+        do {
+            bsize += (cb->cb_ssize << 10);
+            snum++;
+            if (smap & BIT(snum))
+                break; // At next block
+#ifdef ERASE_DEBUG
+            printf("   smap=%x bsize=%lx\n", smap, bsize);
+#endif
+        } while (snum < 8);
+#ifdef ERASE_DEBUG
+        printf(" bb sector %lx\n", bsize);
+#endif
+    }
+#ifdef ERASE_DEBUG
+    else {
+        printf(" normal block %lx\n", bsize);
+    }
+#endif
+    return (bsize);
+}
+
+/*
+ * ee_erase_check
+ * --------------
+ * Samples erase status of the EEPROM part(s) without blocking. Two
+ * successive reads are compared. If Q6 is toggling in either device, the
+ * erase is still in progress. If Q5 is also set in a device which is still
+ * toggling, the status is read again to confirm the device has given up.
  *
- * A non-zero length erases all sectors making up the address range
+ * @return      EE_ERASE_CHECK_DONE    - Erase is not running (complete)
+ *              EE_ERASE_CHECK_BUSY    - Erase is still in progress
+ *              EE_ERASE_CHECK_FAILURE - Device reports erase failure
+ */
+static int
+ee_erase_check(void)
+{
+    uint32_t status1;
+    uint32_t status2;
+    uint32_t busy;
+
+    ee_read_word(ee_erase_addr, &status1);
+    ee_read_word(ee_erase_addr, &status2);
+    busy = (status1 ^ status2) & ee_cmd_mask & (BIT(6) | BIT(6 + 16));
+    if (busy == 0)
+        return (EE_ERASE_CHECK_DONE);
+
+    if ((status2 & (busy >> 1)) == 0)  // Q5 of toggling device(s)
+        return (EE_ERASE_CHECK_BUSY);
+
+    /* Q5 set: device has exceeded its internal limit if Q6 still toggles */
+    ee_read_word(ee_erase_addr, &status1);
+    ee_read_word(ee_erase_addr, &status2);
+    if ((status1 ^ status2) & busy)
+        return (EE_ERASE_CHECK_FAILURE);
+    return (EE_ERASE_CHECK_DONE);
+}
+
+/*
+ * ee_erase_elapsed
+ * ----------------
+ * Returns the number of microseconds the current erase block has been
+ * running, not counting time spent in Erase Suspend.
+ */
+static uint64_t
+ee_erase_elapsed(void)
+{
+    if (ee_erase_state != EE_ERASE_RUNNING)
+        return (ee_erase_usec);
+    return (ee_erase_usec +
+            timer_tick_to_usec(timer_tick_get() - ee_erase_tick));
+}
+
+/*
+ * ee_erase_issue
+ * --------------
+ * Issues the erase command sequence for the entire chip or for the next
+ * block of a block erase. Only one block is erased at a time so that the
+ * erase may be suspended and progress may be reported.
+ */
+static void
+ee_erase_issue(void)
+{
+    disable_irq();
+    ee_write_word(0x00555, 0x00aa00aa);
+    ee_write_word(0x002aa, 0x00550055);
+    ee_write_word(0x00555, 0x00800080);
+    ee_write_word(0x00555, 0x00aa00aa);
+    ee_write_word(0x002aa, 0x00550055);
+    if (ee_erase_mode == MX_ERASE_MODE_CHIP) {
+        ee_write_word(0x00555, 0x00100010);
+    } else {
+#ifdef ERASE_DEBUG
+        printf("->ee_erase %lx %lx\n", ee_erase_addr, ee_erase_bsize);
+#else
+        ee_write_word(ee_erase_addr, 0x00300030);
+#endif
+    }
+    enable_irq();
+
+    timer_delay_usec(100);  // tBAL (Word Access Load Time)
+
+    ee_erase_usec = 0;
+    ee_erase_tick = timer_tick_get();
+    ee_last_access = ee_erase_tick;
+}
+
+/*
+ * ee_erase_finish
+ * ---------------
+ * Completes the current erase operation, recording the final status and
+ * returning the flash to read mode.
+ */
+static void
+ee_erase_finish(int rc)
+{
+    ee_erase_state = EE_ERASE_IDLE;
+    ee_erase_auto = false;
+    ee_erase_read_timer = 0;
+    ee_erase_rc = rc;
+    switch (rc) {
+        case 0:
+            ee_status = EE_STATUS_NORMAL;
+            break;
+        case 2:
+            ee_status = EE_STATUS_ERASE_FAILURE;
+            break;
+        default:
+            ee_status = EE_STATUS_ERASE_TIMEOUT;
+            break;
+    }
+    if (ee_enabled) {
+        if (rc != 0)
+            ee_status_clear();
+        else
+            ee_read_mode();
+    }
+    gpio_setv(FLASH_OEWE_PORT, FLASH_OEWE_PIN, 0);
+
+    if (ee_erase_report) {
+        if (rc == 0) {
+            printf("Erase complete: %u block%s\n", ee_erase_blocks_done,
+                   (ee_erase_blocks_done == 1) ? "" : "s");
+        } else {
+            printf("Erase %s at %lx\n",
+                   (rc == 2) ? "failure" : (rc == 1) ? "timeout" : "aborted",
+                   ee_erase_addr << ee_addr_shift);
+        }
+    }
+}
+
+/*
+ * ee_erase_start
+ * --------------
+ * Starts an erase of the entire chip, an individual block, or a sequential
+ * group of blocks. The erase proceeds in the background, advanced by
+ * ee_erase_poll() from the main loop.
+ *
+ * A non-zero length erases all blocks making up the address range
  * of addr to addr + length - 1. This means that it's possible that
  * more than the specified length will be erased, but that never too
- * few sectors will be erased. A minimum of one sector will always
+ * few blocks will be erased. A minimum of one block will always
  * be erased.
  *
- * EEPROM erase MX_ERASE_MODE_CHIP erases the entire device.
- * EEPROM erase MX_ERASE_MODE_SECTOR erases a 32K-word (64KB) sector.
+ * @param [in]  mode    - MX_ERASE_MODE_CHIP or MX_ERASE_MODE_SECTOR.
+ * @param [in]  addr    - The word address to erase (if MX_ERASE_MODE_SECTOR).
+ * @param [in]  len     - The length in words to erase.
+ * @param [in]  report  - Report completion status on the console.
+ *
+ * @return      0 = Erase started
+ *              1 = Address beyond end of device
+ *              4 = Another erase is already in progress
+ */
+int
+ee_erase_start(uint mode, uint32_t addr, uint32_t len, int report)
+{
+    uint32_t part1;
+    uint32_t part2;
+    uint32_t bsize;
+    uint32_t cur;
+
+    if (mode > MX_ERASE_MODE_SECTOR) {
+        printf("BUG: Invalid erase mode %d\n", mode);
+        return (1);
+    }
+    if (ee_erase_state != EE_ERASE_IDLE) {
+        printf("Erase already in progress\n");
+        return (4);
+    }
+    if (addr >= EE_DEVICE_SIZE)
+        return (1);  // Exceeded the address range of the EEPROM
+    if (len == 0)
+        len = 1;
+    if (len > EE_DEVICE_SIZE - addr)
+        len = EE_DEVICE_SIZE - addr;
+
+    /* Figure out if this is a top boot or bottom boot part */
+    ee_id(&part1, &part2);
+    ee_erase_cb = get_chip_block_info(part1);
+    ee_erase_fg = ee_geometry(part1);
+
+    ee_erase_mode = mode;
+    ee_erase_report = report;
+    ee_erase_blocks_done = 0;
+    if (mode == MX_ERASE_MODE_CHIP) {
+        ee_erase_addr = 0;
+        ee_erase_end = EE_DEVICE_SIZE;
+        ee_erase_bsize = EE_DEVICE_SIZE;
+        ee_erase_blocks_total = 1;
+        ee_erase_timeout = ee_chip_erase_timeout_usec;
+    } else {
+        bsize = ee_erase_block_size(ee_erase_fg, ee_erase_cb, addr);
+        ee_erase_addr = addr & ~(bsize - 1);
+        ee_erase_bsize = bsize;
+        ee_erase_end = addr + len;
+        ee_erase_blocks_total = 0;
+        for (cur = ee_erase_addr; cur < ee_erase_end; cur += bsize) {
+            bsize = ee_erase_block_size(ee_erase_fg, ee_erase_cb, cur);
+            cur &= ~(bsize - 1);
+            ee_erase_blocks_total++;
+        }
+        ee_erase_timeout = ee_block_erase_timeout_usec * 2;
+    }
+
+    config_wear_erase(ee_erase_addr, ee_erase_end - ee_erase_addr);
+    romindex_invalidate(ee_erase_addr, ee_erase_end - ee_erase_addr);
+    ee_status_clear();
+    gpio_setv(FLASH_OEWE_PORT, FLASH_OEWE_PIN, 1);
+    ee_erase_state = EE_ERASE_RUNNING;
+    ee_erase_issue();
+    return (0);
+}
+
+/*
+ * ee_erase_suspend
+ * ----------------
+ * Issues Erase Suspend to the EEPROM and waits for the device(s) to
+ * enter erase suspend read mode. Blocks which are not being erased may
+ * then be read. Chip erase can not be suspended.
+ *
+ * @return      0 = Erase suspended (or already complete)
+ *              1 = No erase in progress or erase can not be suspended
+ */
+int
+ee_erase_suspend(void)
+{
+    uint64_t start;
+
+    if ((ee_erase_state != EE_ERASE_RUNNING) ||
+        (ee_erase_mode == MX_ERASE_MODE_CHIP))
+        return (1);
+
+    ee_cmd(ee_erase_addr, 0x00b000b0);
+    ee_erase_usec = ee_erase_elapsed();
+    ee_erase_state = EE_ERASE_SUSPENDED;
+
+    /* Wait for tESL (Erase Suspend Latency) */
+    start = timer_tick_get();
+    while (ee_erase_check() != EE_ERASE_CHECK_DONE) {
+        if (timer_tick_to_usec(timer_tick_get() - start) > 1000) {
+            printf("Erase suspend timeout\n");
+            break;
+        }
+    }
+    return (0);
+}
+
+/*
+ * ee_erase_resume
+ * ---------------
+ * Resumes a previously suspended erase.
+ *
+ * @return      0 = Erase resumed
+ *              1 = No erase is suspended
+ */
+int
+ee_erase_resume(void)
+{
+    if (ee_erase_state != EE_ERASE_SUSPENDED)
+        return (1);
+
+    ee_enable();
+    ee_cmd(ee_erase_addr, 0x00300030);
+    ee_erase_state = EE_ERASE_RUNNING;
+    ee_erase_auto = false;
+    ee_erase_read_timer = 0;
+    ee_erase_tick = timer_tick_get();
+    ee_last_access = ee_erase_tick;
+    return (0);
+}
+
+/*
+ * ee_erase_busy
+ * -------------
+ * Returns non-zero if an erase is running or suspended.
+ */
+int
+ee_erase_busy(void)
+{
+    return (ee_erase_state != EE_ERASE_IDLE);
+}
+
+/*
+ * ee_erase_show
+ * -------------
+ * Reports the state and progress of the background erase.
+ */
+void
+ee_erase_show(void)
+{
+    uint64_t usecs = ee_erase_elapsed();
+
+    switch (ee_erase_state) {
+        case EE_ERASE_IDLE:
+            printf("No erase in progress; last erase %s\n",
+                   (ee_erase_rc == 0) ? "succeeded" :
+                   (ee_erase_rc == 1) ? "timed out" :
+                   (ee_erase_rc == 2) ? "failed" : "was aborted");
+            return;
+        case EE_ERASE_RUNNING:
+            printf("Erase running");
+            break;
+        case EE_ERASE_SUSPENDED:
+            printf("Erase suspended%s", ee_erase_auto ? " (Amiga running)" : "");
+            break;
+    }
+    printf(": %s %lx, block %u of %u, %u.%03u sec\n",
+           (ee_erase_mode == MX_ERASE_MODE_CHIP) ? "chip" : "block",
+           ee_erase_addr << ee_addr_shift, ee_erase_blocks_done + 1,
+           ee_erase_blocks_total, (uint) (usecs / 1000000),
+           (uint) (usecs % 1000000 / 1000));
+}
+
+/*
+ * ee_erase_poll
+ * -------------
+ * Advances the background erase. This is called from ee_poll() while an
+ * erase is active. When one block completes, the next block is started.
+ * If the Amiga leaves reset while a block erase is running, the erase is
+ * suspended and the bus released so the Amiga may run from another bank.
+ * The erase is resumed once the Amiga is again held in reset.
+ */
+void
+ee_erase_poll(void)
+{
+    int amiga_running = !board_is_standalone && amiga_not_in_reset;
+
+    if (ee_erase_state == EE_ERASE_SUSPENDED) {
+        if ((ee_erase_read_timer != 0) &&
+            timer_tick_has_elapsed(ee_erase_read_timer)) {
+            /* Suspended for reads; continue once the hold has passed */
+            ee_erase_read_timer = 0;
+            if (amiga_running)
+                ee_erase_auto = true;
+            else
+                ee_erase_resume();
+        } else if (ee_erase_auto && !amiga_running) {
+            ee_erase_resume();
+        }
+        return;
+    }
+    if (ee_erase_state != EE_ERASE_RUNNING)
+        return;
+
+    if (amiga_running) {
+        if (ee_enabled && (ee_erase_mode == MX_ERASE_MODE_CHIP))
+            printf("Amiga left reset during chip erase\n");
+        ee_disable();  // Suspends block erase; chip erase continues
+        return;
+    }
+
+    ee_enable();
+    ee_last_access = timer_tick_get();
+    switch (ee_erase_check()) {
+        case EE_ERASE_CHECK_BUSY:
+            if (ee_erase_elapsed() > ee_erase_timeout)
+                ee_erase_finish(1);
+            return;
+        case EE_ERASE_CHECK_FAILURE:
+            ee_erase_finish(2);
+            return;
+    }
+
+    ee_erase_blocks_done++;
+    ee_erase_addr += ee_erase_bsize;
+    if (ee_erase_addr >= ee_erase_end) {
+        ee_erase_finish(0);
+        return;
+    }
+    ee_erase_bsize = ee_erase_block_size(ee_erase_fg, ee_erase_cb,
+                                         ee_erase_addr);
+    ee_erase_issue();
+}
+
+/*
+ * ee_erase
+ * --------
+ * Will erase the entire chip, individual blocks, or sequential groups
+ * of blocks, waiting for the erase to complete. The main loop continues
+ * to be polled while waiting, so USB and message service are not stalled.
+ * If the Amiga leaves reset, the erase is suspended (or a chip erase left
+ * running with the bus released) and this function keeps waiting until
+ * the erase completes after the Amiga is again in reset.
+ * See ee_erase_start() for a description of how the range is rounded.
  *
  * Return values
  *  0 = Success
  *  1 = Erase Timeout
  *  2 = Erase failure
  *  3 = Erase rejected by device (low VPP?)
+ *  4 = Another erase already in progress
  *
  * M29F160
  *     Block erase time:      8 sec max
@@ -975,114 +1901,50 @@ get_chip_block_info(uint32_t chipid)
 int
 ee_erase(uint mode, uint32_t addr, uint32_t len, int verbose)
 {
-    int rc = 0;
-    int timeout;
-    uint32_t part1;
-    uint32_t part2;
-    const chip_blocks_t *cb;
-
-    if (mode > MX_ERASE_MODE_SECTOR) {
-        printf("BUG: Invalid erase mode %d\n", mode);
-        return (1);
-    }
-    if ((len == 0) || (mode == MX_ERASE_MODE_CHIP))
-        len = 1;
+    int      rc;
+    uint     report_time = 0;
+    bool     waiting = false;
+    uint64_t start;
+    uint64_t usecs;
 
-    /* Figure out if this is a top boot or bottom boot part */
-    ee_id(&part1, &part2);
-    cb = get_chip_block_info(part1);
+    rc = ee_erase_start(mode, addr, len, 0);
+    if (rc != 0)
+        return (rc);
 
-    ee_status_clear();
-    while (len > 0) {
-        if (addr >= EE_DEVICE_SIZE) {
-            /* Exceeded the address range of the EEPROM */
-            rc = 1;
-            break;
+    start = timer_tick_get();
+    while (ee_erase_state != EE_ERASE_IDLE) {
+        main_poll();
+        if (ee_erase_auto && !waiting) {
+            /* Amiga left reset; the erase continues when it is in reset */
+            printf("\nErase suspended until Amiga is in reset\n");
+            waiting = true;
+        } else if (!ee_erase_auto) {
+            waiting = false;
         }
-
-        disable_irq();
-        ee_write_word(0x00555, 0x00aa00aa);
-        ee_write_word(0x002aa, 0x00550055);
-        ee_write_word(0x00555, 0x00800080);
-        ee_write_word(0x00555, 0x00aa00aa);
-        ee_write_word(0x002aa, 0x00550055);
-
-        if (mode == MX_ERASE_MODE_CHIP) {
-            ee_write_word(0x00555, 0x00100010);
-            usb_mask_interrupts();
-            enable_irq();
-            timeout = 32000000;  // 32 seconds
-            len = 0;
-        } else {
-            /* Block erase (supports multiple blocks) */
-//          int bcount = 0;
-            timeout = 1000000;  // 1 second
-            enable_irq();
-            while (len > 0) {
-                uint32_t addr_mask;
-                uint32_t bsize = cb->cb_bsize << 10;
-                uint     bnum  = addr / bsize;
-                if (bnum == cb->cb_bbnum) {
-                    /* Boot block has variable block size */
-                    uint soff = addr - bnum * bsize;
-                    uint snum = soff / (cb->cb_ssize << 10);
-                    uint smap = cb->cb_map;
-#ifdef ERASE_DEBUG
-                    printf("bblock soff=%x snum=%x s_map=%x\n", soff, snum, smap);
-#endif
-                    bsize = 0;
-                    do {
-                        bsize += (cb->cb_ssize << 10);
-                        snum++;
-                        if (smap & BIT(snum))
-                            break; // At next block
-#ifdef ERASE_DEBUG
-                        printf("   smap=%x bsize=%lx\n", smap, bsize);
-#endif
-                    } while (snum < 8);
-#ifdef ERASE_DEBUG
-                    printf(" bb sector %lx\n", bsize);
-#endif
-                }
-#ifdef ERASE_DEBUG
-                else {
-                    printf(" normal block %lx\n", bsize);
-                }
-#endif
-
-                addr_mask = ~(bsize - 1);
-#ifdef ERASE_DEBUG
-                printf("->ee_erase %lx %x\n", addr & addr_mask, bsize);
-#else
-                ee_write_word(addr & addr_mask, 0x00300030);
-#endif
-
-                timeout += 1000000;  // Add 1 second per block
-
-                if (len < bsize) {
-                    /* Nothing left to do -- allow erase to start */
-                    len = 0;
-                    break;
-                }
-                len  -= bsize;
-                addr += bsize;  // Advance to the next sector
-#if 0
-                if (bcount++ > 8)  // Limit count of simultaneous block erases
-                    break;
-#endif
-            }
+        usecs = timer_tick_to_usec(timer_tick_get() - start);
+        if (verbose && (report_time < usecs / 1000000)) {
+            /* Update once a second */
+            report_time = usecs / 1000000;
+            printf("\r%08lx %u/%u %u sec", ee_erase_addr << ee_addr_shift,
+                   ee_erase_blocks_done, ee_erase_blocks_total, report_time);
         }
-        usb_unmask_interrupts();
-
-        timer_delay_usec(100);  // tBAL (Word Access Load Time)
-
-        rc = ee_wait_for_done_status(timeout, verbose, EE_MODE_ERASE);
-        if (rc != 0)
-            break;
     }
-
-    ee_read_mode();
-    return (rc);
+    if (verbose) {
+        usecs = timer_tick_to_usec(timer_tick_get() - start);
+        report_time = usecs / 1000000;
+        printf("\r%08lx %u/%u %u.%03u sec", ee_erase_addr << ee_addr_shift,
+               ee_erase_blocks_done, ee_erase_blocks_total, report_time,
+               (uint) ((usecs - report_time * 1000000ULL) / 1000));
+        if (ee_erase_rc == 0)
+            printf("    Done\n");
+        else if (ee_erase_rc == 2)
+            printf("    Erase Failure\n");
+        else if (ee_erase_rc == 1)
+            printf("    Erase Timeout\n");
+        else
+            printf("    Erase Aborted\n");
+    }
+    return (ee_erase_rc);
 }
 
 /*
@@ -1170,6 +2032,11 @@ ee_id_string(uint32_t id)
 void
 ee_poll(void)
 {
+    if ((ee_erase_state == EE_ERASE_RUNNING) || ee_erase_auto ||
+        (ee_erase_read_timer != 0)) {
+        ee_erase_poll();
+        return;
+    }
     if (ee_last_access != 0) {
         uint64_t usec = timer_tick_to_usec(timer_tick_get() - ee_last_access);
         if (usec > 100000) {  // 100 ms
@@ -1419,6 +2286,8 @@ ee_init(void)
     ticks_per_20_nsec  = timer_nsec_to_tick(20);
     ticks_per_30_nsec  = timer_nsec_to_tick(30);
     ticks_per_35_nsec  = timer_nsec_to_tick(35);
+    ticks_per_70_nsec  = timer_nsec_to_tick(70);
 
     ee_set_mode(ee_mode);
+    ee_geometry_apply(&config.flash_geom);
 }
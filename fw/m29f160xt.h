@@ -12,6 +12,8 @@
 #ifndef __MX29F1615_H
 #define __MX29F1615_H
 
+#include "smash_cmd.h"
+
 void     ee_enable(void);
 void     ee_disable(void);
 int      ee_read(uint32_t addr, void *data, uint count);
@@ -20,6 +22,12 @@ void     ee_id(uint32_t *part1, uint32_t *part2);
 void     ee_init(void);
 void     ee_read_mode(void);
 int      ee_erase(uint mode, uint32_t addr, uint32_t len, int verbose);
+int      ee_erase_start(uint mode, uint32_t addr, uint32_t len, int report);
+int      ee_erase_suspend(void);
+int      ee_erase_resume(void);
+int      ee_erase_busy(void);
+void     ee_erase_show(void);
+void     ee_erase_poll(void);
 void     ee_status_clear(void);
 void     ee_cmd(uint32_t addr, uint32_t cmd);
 void     ee_poll(void);
@@ -28,6 +36,9 @@ int      ee_test(void);
 void     ee_address_override(uint8_t bits, uint override);
 void     ee_set_mode(uint new_mode);
 void     ee_set_bank(uint8_t bank);
+int      ee_cfi_query(flash_geometry_t *fg);
+const flash_geometry_t *ee_geometry(uint32_t chipid);
+void     ee_geometry_show(const flash_geometry_t *fg);
 
 const char *ee_id_string(uint32_t id);
 const char *ee_vendor_string(uint32_t id);
@@ -30,6 +30,7 @@
 #include "pin_tests.h"
 #include "config.h"
 #include "msg.h"
+#include "romindex.h"
 #include "version.h"
 
 static void
@@ -50,6 +51,7 @@ main_poll(void)
     ee_poll();
     kbrst_poll();
     config_poll();
+    romindex_poll();
     msg_poll();
     led_poll();
 }
@@ -81,6 +83,7 @@ main(void)
 
     adc_init();
     ee_init();
+    romindex_init();
     msg_init();
 
     if (board_is_standalone) {
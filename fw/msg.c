@@ -21,6 +21,7 @@
 #include "main.h"
 #include "msg.h"
 #include "m29f160xt.h"
+#include "romindex.h"
 #include "timer.h"
 #include "utils.h"
 #include "gpio.h"
@@ -123,6 +124,7 @@ static uint     consumer_wrap;
 static uint     consumer_wrap_last_poll;
 static uint     rx_consumer = 0;
 uint64_t        amiga_time = 0;           // Seconds and microseconds
+static uint8_t  ks_bank_temp = 0xff;      // Bank of KS_BANK_SETTEMP
 static uint64_t expire_update_amiga_app;  // Expiration time for last Amiga app
 static uint64_t expire_update_usb_app;    // Expiration time for last USB app
 static uint16_t state_amiga_app;          // Amiga app state
@@ -142,6 +144,28 @@ static uint     fail_crc_u;     // CRC message failures from USB Host
 static uint     fail_cmd_a;     // Invalid command failures from Amiga
 static uint     fail_cmd_u;     // Invalid command failures from USB Host
 
+/* Bus trigger engine (evaluated in the capture DMA consumer) */
+static ks_trig_capture_t trig_cap;            // Trigger capture buffer
+static bus_trig_step_t   trig_steps[BUS_TRIG_STEPS];
+static uint              trig_nsteps;         // Steps in trigger sequence
+static uint              trig_step;           // Next step to match
+static uint              trig_gap;            // Accesses since last step
+static uint              trig_window;         // Max accesses between steps
+static uint              trig_pre;            // Pre-trigger depth
+static uint              trig_post;           // Post-trigger depth
+static uint              trig_end;            // Capture count when complete
+static uint              trig_cons;           // Trigger scan ring position
+static uint              trig_hist;           // Valid history in ring
+
+/* ROM fetch profiler (also evaluated in the capture DMA consumer) */
+static ks_profile_t      prof;                // Profile histogram
+static uint              prof_cons;           // Profile scan ring position
+static uint              prof_span;           // Producer at last lap check
+static uint              prof_oprod;          // Producer at last scan
+static uint              prof_pending;        // Entries not yet scanned
+static uint              prof_shift;          // ROM word address to bin shift
+static uint32_t          prof_base;           // ROM word address of bin 0
+
 /* Buffers for DMA from/to GPIOs and Timer event generation registers */
 #define ADDR_BUF_COUNT 1024
 #define ALIGN  __attribute__((aligned(16)))
@@ -652,6 +676,12 @@ configure_oe_capture_rx(bool verbose)
 {
     consumer_wrap = 0;
     rx_consumer = 0;
+    trig_cons = 0;
+    trig_hist = 0;  // Ring restarts; earlier entries are not contiguous
+    prof_cons = 0;
+    prof_span = 0;
+    prof_oprod = 0;
+    prof_pending = 0;
     config_tim2_ch1_dma(verbose);
     config_tim5_ch1_dma(verbose);
 
@@ -1010,6 +1040,154 @@ oe_reply_end:
 #endif
 }
 
+/*
+ * flash_geometry_reply
+ * --------------------
+ * Builds a big endian copy of the cached flash geometry, suitable for
+ * sending to the Amiga or USB host.
+ */
+static void
+flash_geometry_reply(flash_geometry_t *reply)
+{
+    uint pos;
+
+    *reply = config.flash_geom;
+    reply->fg_chipid               = SWAP32(reply->fg_chipid);
+    reply->fg_word_prog_usec       = SWAP16(reply->fg_word_prog_usec);
+    reply->fg_word_prog_max_usec   = SWAP16(reply->fg_word_prog_max_usec);
+    reply->fg_buf_prog_usec        = SWAP16(reply->fg_buf_prog_usec);
+    reply->fg_buf_prog_max_usec    = SWAP16(reply->fg_buf_prog_max_usec);
+    reply->fg_block_erase_msec     = SWAP16(reply->fg_block_erase_msec);
+    reply->fg_block_erase_max_msec = SWAP16(reply->fg_block_erase_max_msec);
+    reply->fg_chip_erase_msec      = SWAP16(reply->fg_chip_erase_msec);
+    reply->fg_chip_erase_max_msec  = SWAP16(reply->fg_chip_erase_max_msec);
+    for (pos = 0; pos < ARRAY_SIZE(reply->fg_region); pos++) {
+        reply->fg_region[pos].er_blocks =
+                                SWAP16(reply->fg_region[pos].er_blocks);
+        reply->fg_region[pos].er_size = SWAP16(reply->fg_region[pos].er_size);
+    }
+}
+
+/*
+ * msg_amiga_time_sec
+ * ------------------
+ * Returns the current Amiga time in seconds, or 0 if the Amiga has not
+ * yet provided the time (KS_CMD_CLOCK).
+ */
+uint32_t
+msg_amiga_time_sec(void)
+{
+    if (amiga_time == 0)
+        return (0);
+    return ((timer_tick_to_usec(timer_tick_get()) + amiga_time) / 1000000);
+}
+
+/*
+ * flash_wear_reply
+ * ----------------
+ * Build a big endian copy of the flash wear counters for the Amiga.
+ */
+static void
+flash_wear_reply(flash_wear_t *reply)
+{
+    uint pos;
+
+    for (pos = 0; pos < FW_SECTORS; pos++) {
+        reply->fw_erase_count[pos] =
+                            SWAP16(config.flash_wear.fw_erase_count[pos]);
+        reply->fw_erase_time[pos] =
+                            SWAP32(config.flash_wear.fw_erase_time[pos]);
+    }
+}
+
+/*
+ * trig_capture_reply
+ * ------------------
+ * Build a big endian copy of the triggered bus capture for the Amiga.
+ */
+static void
+trig_capture_reply(ks_trig_capture_t *reply)
+{
+    uint pos;
+
+    reply->ktc_state   = trig_cap.ktc_state;
+    reply->ktc_mode    = trig_cap.ktc_mode;
+    reply->ktc_count   = SWAP16(trig_cap.ktc_count);
+    reply->ktc_trigger = SWAP16(trig_cap.ktc_trigger);
+    reply->ktc_unused  = 0;
+    reply->ktc_when    = SWAP32(trig_cap.ktc_when);
+    for (pos = 0; pos < KS_TRIG_MAX; pos++) {
+        reply->ktc_addr[pos] = SWAP16(trig_cap.ktc_addr[pos]);
+        reply->ktc_data[pos] = SWAP16(trig_cap.ktc_data[pos]);
+    }
+}
+
+/*
+ * smash_id_reply
+ * --------------
+ * Build the KickSmash identification and configuration (KS_CMD_ID) reply.
+ */
+static void
+smash_id_reply(smash_id_t *reply)
+{
+    uint temp[3];
+    int  pos = 0;
+
+    memset(reply, 0, sizeof (*reply));
+    sscanf(version_str + 8, "%u.%u%n", &temp[0], &temp[1], &pos);
+    reply->si_ks_version[0] = SWAP16(temp[0]);
+    reply->si_ks_version[1] = SWAP16(temp[1]);
+    if (pos == 0)
+        pos = 18;
+    else
+        pos += 8 + 7;
+    sscanf(version_str + pos, "%04u-%02u-%02u",
+           &temp[0], &temp[1], &temp[2]);
+    reply->si_ks_date[0] = temp[0] / 100;
+    reply->si_ks_date[1] = temp[0] % 100;
+    reply->si_ks_date[2] = temp[1];
+    reply->si_ks_date[3] = temp[2];
+    pos += 11;
+    sscanf(version_str + pos, "%02u:%02u:%02u",
+           &temp[0], &temp[1], &temp[2]);
+    reply->si_ks_time[0] = temp[0];
+    reply->si_ks_time[1] = temp[1];
+    reply->si_ks_time[2] = temp[2];
+    reply->si_ks_time[3] = 0;
+    strcpy(reply->si_serial, (const char *)usb_serial_str);
+    reply->si_rev      = SWAP16(0x0001);     // Protocol version 0.1
+    reply->si_features = SWAP16(0x0001);     // Features
+    reply->si_usbid    = SWAP32(0x12091610); // Matches USB ID
+    reply->si_mode     = ee_mode;
+    reply->si_unused1  = 0;
+    reply->si_usbdev   = usb_current_address();
+    strcpy(reply->si_name, config.name);
+    memset(reply->si_unused, 0, sizeof (reply->si_unused));
+}
+
+/*
+ * bank_snapshot_reply
+ * -------------------
+ * Build the KS_CMD_BANK_SNAPSHOT reply: identification, bank information,
+ * NV bytes, and the Kickstart image found in each bank (from the
+ * Kickstart index, so this is valid even while the Amiga is running).
+ */
+static void
+bank_snapshot_reply(ks_snapshot_t *reply)
+{
+    uint bank;
+
+    smash_id_reply(&reply->kss_id);
+    memcpy(&reply->kss_bi, &config.bi, sizeof (reply->kss_bi));
+    memcpy(reply->kss_nv, config.nv_mem, sizeof (reply->kss_nv));
+    for (bank = 0; bank < ROM_BANKS; bank++) {
+        ks_bank_ident_t *kbi = &reply->kss_ident[bank];
+        romindex_ident(bank, kbi);
+        kbi->kbi_version  = SWAP16(kbi->kbi_version);
+        kbi->kbi_revision = SWAP16(kbi->kbi_revision);
+    }
+}
+
 static void
 execute_cmd(uint16_t cmd, uint16_t cmd_len)
 {
@@ -1026,38 +1204,7 @@ execute_cmd(uint16_t cmd, uint16_t cmd_len)
         case KS_CMD_ID: {
             /* Send KickSmash identification and configuration */
             smash_id_t reply;
-            uint temp[3];
-            uint pos = 0;
-            memset(&reply, 0, sizeof (reply));
-            sscanf(version_str + 8, "%u.%u%n", &temp[0], &temp[1], &pos);
-            reply.si_ks_version[0] = SWAP16(temp[0]);
-            reply.si_ks_version[1] = SWAP16(temp[1]);
-            if (pos == 0)
-                pos = 18;
-            else
-                pos += 8 + 7;
-            sscanf(version_str + pos, "%04u-%02u-%02u",
-                   &temp[0], &temp[1], &temp[2]);
-            reply.si_ks_date[0] = temp[0] / 100;
-            reply.si_ks_date[1] = temp[0] % 100;
-            reply.si_ks_date[2] = temp[1];
-            reply.si_ks_date[3] = temp[2];
-            pos += 11;
-            sscanf(version_str + pos, "%02u:%02u:%02u",
-                   &temp[0], &temp[1], &temp[2]);
-            reply.si_ks_time[0] = temp[0];
-            reply.si_ks_time[1] = temp[1];
-            reply.si_ks_time[2] = temp[2];
-            reply.si_ks_time[3] = 0;
-            strcpy(reply.si_serial, (const char *)usb_serial_str);
-            reply.si_rev      = SWAP16(0x0001);     // Protocol version 0.1
-            reply.si_features = SWAP16(0x0001);     // Features
-            reply.si_usbid    = SWAP32(0x12091610); // Matches USB ID
-            reply.si_mode     = ee_mode;
-            reply.si_unused1  = 0;
-            reply.si_usbdev   = usb_current_address();
-            strcpy(reply.si_name, config.name);
-            memset(reply.si_unused, 0, sizeof (reply.si_unused));
+            smash_id_reply(&reply);
             ks_reply(0, KS_STATUS_OK, sizeof (reply), &reply, 0, NULL);
             break;
         }
@@ -1225,6 +1372,8 @@ execute_cmd(uint16_t cmd, uint16_t cmd_len)
                 }
                 wdata = buffer_rxa_lo[cons_s];
             }
+            romindex_invalidate_bank((ks_bank_temp != 0xff) ? ks_bank_temp :
+                                     config.bi.bi_bank_current);
 
             ks_reply(0, KS_STATUS_OK, sizeof (addr), &addr, 0, NULL);
             if ((ee_mode == EE_MODE_32) || (ee_mode == EE_MODE_32_SWAP)) {
@@ -1242,15 +1391,117 @@ execute_cmd(uint16_t cmd, uint16_t cmd_len)
             }
             break;
         }
+        case KS_CMD_FLASH_MWRITE: {
+            /* Send command sequence to perform flash write buffer program */
+            uint32_t addr[KS_MWRITE_MAX_WORDS + 5];
+            uint32_t data[KS_MWRITE_MAX_WORDS + 5];
+            uint16_t data16[KS_MWRITE_MAX_WORDS + 5];
+            uint32_t waddr;
+            uint     wordsize;
+            uint     count;
+            uint     pos;
+
+            if ((ee_mode == EE_MODE_32) || (ee_mode == EE_MODE_32_SWAP))
+                wordsize = 4;
+            else
+                wordsize = 2;
+            count = (cmd_len - 4) / wordsize;
+            if ((cmd_len < 4 + wordsize * 2) ||
+                (count * wordsize + 4 != cmd_len) ||
+                (count > KS_MWRITE_MAX_WORDS)) {
+                ks_reply(0, KS_STATUS_BADLEN, 0, NULL, 0, NULL);
+                break;
+            }
+            if ((config.flash_geom.fg_valid == 0) ||
+                (config.flash_geom.fg_wbuf_shift < 2) ||
+                (count > BIT(config.flash_geom.fg_wbuf_shift - 1))) {
+                /* Flash parts do not have a (large enough) write buffer */
+                ks_reply(0, KS_STATUS_BADARG, 0, NULL, 0, NULL);
+                break;
+            }
+
+            /* Compute start of message payload */
+            cons_s = rx_consumer - (cmd_len + 3) / 4 * 2 - 1;
+            if ((int) cons_s < 0)
+                cons_s += ARRAY_SIZE(buffer_rxa_lo);
+
+            /* Word address of first word to write (big endian) */
+            waddr = buffer_rxa_lo[cons_s] << 16;
+            if (++cons_s == ARRAY_SIZE(buffer_rxa_lo))
+                cons_s = 0;
+            waddr |= buffer_rxa_lo[cons_s];
+            if (++cons_s == ARRAY_SIZE(buffer_rxa_lo))
+                cons_s = 0;
+
+            /* All words must fall within the same write buffer page */
+            if ((waddr & (BIT(config.flash_geom.fg_wbuf_shift - 1) - 1)) +
+                count > BIT(config.flash_geom.fg_wbuf_shift - 1)) {
+                ks_reply(0, KS_STATUS_BADARG, 0, NULL, 0, NULL);
+                break;
+            }
+
+            /* Unlock, Write to Buffer, word count, data, Program */
+            addr[0] = SWAP32(0x00555);
+            addr[1] = SWAP32(0x002aa);
+            addr[2] = SWAP32(waddr);
+            addr[3] = SWAP32(waddr);
+            data[0] = 0x00aa00aa;
+            data[1] = 0x00550055;
+            data[2] = 0x00250025;
+            data[3] = (count - 1) * 0x00010001;
+            for (pos = 0; pos < count; pos++) {
+                uint32_t wdata = buffer_rxa_lo[cons_s];
+                if (++cons_s == ARRAY_SIZE(buffer_rxa_lo))
+                    cons_s = 0;
+                if (wordsize == 4) {
+                    wdata |= (buffer_rxa_lo[cons_s] << 16);
+                    if (++cons_s == ARRAY_SIZE(buffer_rxa_lo))
+                        cons_s = 0;
+                }
+                addr[pos + 4] = SWAP32(waddr + pos);
+                data[pos + 4] = wdata;
+            }
+            addr[count + 4] = SWAP32(waddr);
+            data[count + 4] = 0x00290029;
+            romindex_invalidate_bank((ks_bank_temp != 0xff) ? ks_bank_temp :
+                                     config.bi.bi_bank_current);
+
+            ks_reply(0, KS_STATUS_OK, (count + 5) * 4, addr, 0, NULL);
+            if (wordsize == 4) {
+                ks_reply(KS_REPLY_WE_RAW, 0, (count + 5) * 4, data, 0, NULL);
+            } else {
+                for (pos = 0; pos < count + 5; pos++)
+                    data16[pos] = data[pos];
+                ks_reply(KS_REPLY_WE_RAW, 0, (count + 5) * 2, data16, 0, NULL);
+            }
+            break;
+        }
         case KS_CMD_FLASH_ERASE: {
             static const uint32_t addr[] = {
                 SWAP32(0x00555), SWAP32(0x002aa), SWAP32(0x00555),
                 SWAP32(0x00555), SWAP32(0x002aa),
             };
-            if (cmd_len != 0) {
+            if ((cmd_len != 0) && (cmd_len != 4)) {
                 ks_reply(0, KS_STATUS_BADLEN, 0, NULL, 0, NULL);
                 break;
             }
+            if (cmd_len == 4) {
+                /* Sector word address within bank (for wear counters) */
+                uint32_t waddr;
+                uint     bank = (ks_bank_temp != 0xff) ? ks_bank_temp :
+                                config.bi.bi_bank_current;
+
+                cons_s = rx_consumer - (cmd_len + 3) / 4 * 2 - 1;
+                if ((int) cons_s < 0)
+                    cons_s += ARRAY_SIZE(buffer_rxa_lo);
+                waddr = buffer_rxa_lo[cons_s] << 16;
+                if (++cons_s == ARRAY_SIZE(buffer_rxa_lo))
+                    cons_s = 0;
+                waddr |= buffer_rxa_lo[cons_s];
+                config_wear_erase((bank << 17) | (waddr & 0x1ffff), 1);
+            }
+            romindex_invalidate_bank((ks_bank_temp != 0xff) ? ks_bank_temp :
+                                     config.bi.bi_bank_current);
             ks_reply(0, KS_STATUS_OK, sizeof (addr), &addr, 0, NULL);
             if ((ee_mode == EE_MODE_32) || (ee_mode == EE_MODE_32_SWAP)) {
                 static const uint32_t data[] = {
@@ -1267,6 +1518,13 @@ execute_cmd(uint16_t cmd, uint16_t cmd_len)
             }
             break;
         }
+        case KS_CMD_FLASH_GEOMETRY: {
+            /* Report cached flash CFI geometry */
+            flash_geometry_t reply;
+            flash_geometry_reply(&reply);
+            ks_reply(0, KS_STATUS_OK, sizeof (reply), &reply, 0, NULL);
+            break;
+        }
         case KS_CMD_SET: {
             if (cmd & KS_SET_NAME) {
                 uint pos;
@@ -1352,6 +1610,29 @@ execute_cmd(uint16_t cmd, uint16_t cmd_len)
                        config.nv_mem[pos], config.nv_mem[pos + 1],
                        buffer_rxa_lo[cons_s]);
 #endif
+            } else if (cmd & KS_GET_WEAR) {
+                flash_wear_t reply;
+                flash_wear_reply(&reply);
+                ks_reply(0, KS_STATUS_OK, sizeof (reply), &reply, 0, NULL);
+            } else if (cmd & KS_GET_TRIGGER) {
+                static ks_trig_capture_t reply;
+                trig_capture_reply(&reply);
+                ks_reply(0, KS_STATUS_OK, sizeof (reply), &reply, 0, NULL);
+            } else if (cmd & KS_GET_ROMINDEX) {
+                /* First byte is the bank number */
+                static ks_rom_index_t reply;
+                uint8_t bank;
+
+                cons_s = rx_consumer - (cmd_len + 3) / 4 * 2 - 1;
+                if ((int) cons_s < 0)
+                    cons_s += ARRAY_SIZE(buffer_rxa_lo);
+                bank = buffer_rxa_lo[cons_s] >> 8;
+                if ((cmd_len < 1) || (bank >= ROM_BANKS)) {
+                    ks_reply(0, KS_STATUS_BADARG, 0, NULL, 0, NULL);
+                    break;
+                }
+                romindex_reply(bank, &reply, 1);
+                ks_reply(0, KS_STATUS_OK, sizeof (reply), &reply, 0, NULL);
             } else {
                 ks_reply(0, KS_STATUS_BADARG, 0, NULL, 0, NULL);
             }
@@ -1395,6 +1676,13 @@ execute_cmd(uint16_t cmd, uint16_t cmd_len)
             /* Get bank info */
             ks_reply(0, KS_STATUS_OK, sizeof (config.bi), &config.bi, 0, NULL);
             break;
+        case KS_CMD_BANK_SNAPSHOT: {
+            /* Get everything needed by the ROM switcher in one reply */
+            static ks_snapshot_t reply;
+            bank_snapshot_reply(&reply);
+            ks_reply(0, KS_STATUS_OK, sizeof (reply), &reply, 0, NULL);
+            break;
+        }
         case KS_CMD_BANK_SET: {
             /* Set ROM bank (options in high bits of command) */
             uint16_t bank;
@@ -1422,9 +1710,11 @@ execute_cmd(uint16_t cmd, uint16_t cmd_len)
             }
             if (cmd & KS_BANK_SETTEMP) {
                 ee_address_override((bank << 4) | 0x7, 0);
+                ks_bank_temp = bank;
             }
             if (cmd & KS_BANK_UNSETTEMP) {
                 ee_set_bank(config.bi.bi_bank_current);
+                ks_bank_temp = 0xff;
             }
             if (cmd & KS_BANK_SETRESET) {
                 config.bi.bi_bank_nextreset = bank;
@@ -1881,6 +2171,214 @@ execute_cmd(uint16_t cmd, uint16_t cmd_len)
     }
 }
 
+/*
+ * snoop_prod
+ * ----------
+ * Returns the capture DMA producer index in the address ring.
+ */
+static uint
+snoop_prod(void)
+{
+    uint prod = ARRAY_SIZE(buffer_rxa_lo) -
+                dma_get_number_of_data(LOG_DMA_CONTROLLER, LOG_DMA_CHANNEL);
+    if (prod >= ARRAY_SIZE(buffer_rxa_lo))
+        prod = 0;
+    return (prod);
+}
+
+/*
+ * snoop_crossed
+ * -------------
+ * Returns true if the DMA producer moving forward from start to end
+ * passes ring index pos.
+ */
+static bool
+snoop_crossed(uint start, uint end, uint pos)
+{
+    uint mask = ARRAY_SIZE(buffer_rxa_lo) - 1;
+    uint dist = (pos - start) & mask;
+
+    return ((dist != 0) && (dist <= ((end - start) & mask)));
+}
+
+/*
+ * snoop_update
+ * ------------
+ * Account for capture ring entries produced since the last call. Returns
+ * true if unread entries were overwritten, either because the producer
+ * caught up to the consumer, or because it lapped the entire ring between
+ * calls. A full lap is seen from the DMA half and full transfer flags:
+ * a flag set for a boundary outside of the span the producer is known
+ * to have moved through can only have come from a lap.
+ */
+static bool
+snoop_update(uint *span, uint *oprod, uint *pending)
+{
+    uint before = snoop_prod();
+    uint ht     = dma_get_interrupt_flag(LOG_DMA_CONTROLLER, LOG_DMA_CHANNEL,
+                                         DMA_HTIF);
+    uint tc     = dma_get_interrupt_flag(LOG_DMA_CONTROLLER, LOG_DMA_CHANNEL,
+                                         DMA_TCIF);
+    uint prod;
+    bool lapped = false;
+
+    if (ht)
+        dma_clear_interrupt_flags(LOG_DMA_CONTROLLER, LOG_DMA_CHANNEL,
+                                  DMA_HTIF);
+    if (tc)
+        dma_clear_interrupt_flags(LOG_DMA_CONTROLLER, LOG_DMA_CHANNEL,
+                                  DMA_TCIF);
+    prod = snoop_prod();
+
+    /* Flags were cleared between before and prod last time */
+    if ((ht && !snoop_crossed(*span, prod, ARRAY_SIZE(buffer_rxa_lo) / 2)) ||
+        (tc && !snoop_crossed(*span, prod, 0)))
+        lapped = true;
+    *span = before;
+
+    *pending += (prod - *oprod) & (ARRAY_SIZE(buffer_rxa_lo) - 1);
+    *oprod = prod;
+    if (lapped || (*pending >= ARRAY_SIZE(buffer_rxa_lo))) {
+        *pending = 0;
+        return (true);
+    }
+    return (false);
+}
+
+/*
+ * bus_trigger_match
+ * -----------------
+ * Returns true if a captured ROM access satisfies a trigger step.
+ */
+static inline bool
+bus_trigger_match(const bus_trig_step_t *step, uint addr, uint data)
+{
+    if (trig_cap.ktc_mode == CAPTURE_ADDR)
+        addr |= ((data & 0xf0) << (16 - 4));
+    else if ((data & step->bts_data_mask) != step->bts_data)
+        return (false);
+    return ((addr >= step->bts_addr_lo) && (addr <= step->bts_addr_hi));
+}
+
+/*
+ * bus_trigger_fire
+ * ----------------
+ * The trigger sequence completed at capture ring position trig_cons.
+ * Pre-trigger accesses are still in the capture ring, so they are copied
+ * out now. Post-trigger accesses are collected as they are scanned.
+ */
+static void
+bus_trigger_fire(void)
+{
+    uint mask = ARRAY_SIZE(buffer_rxa_lo) - 1;
+    uint pre  = (trig_pre < trig_hist) ? trig_pre : trig_hist;
+    uint cons = (trig_cons - pre) & mask;
+    uint pos;
+
+    for (pos = 0; pos <= pre; pos++) {
+        trig_cap.ktc_addr[pos] = buffer_rxa_lo[cons];
+        trig_cap.ktc_data[pos] = buffer_rxd[cons];
+        cons = (cons + 1) & mask;
+    }
+    trig_cap.ktc_count   = pre + 1;
+    trig_cap.ktc_trigger = pre;
+    trig_cap.ktc_when    = timer_tick_to_usec(timer_tick_get()) / 1000;
+    trig_end             = pre + 1 + trig_post;
+    trig_cap.ktc_state   = (trig_post == 0) ? KS_TRIG_STATE_DONE :
+                                              KS_TRIG_STATE_POST;
+}
+
+/*
+ * bus_trigger_scan
+ * ----------------
+ * Evaluate the armed trigger against capture ring entries up to the DMA
+ * producer, or collect post-trigger entries once it has fired. Steps of
+ * a trigger sequence must match in order, each within trig_window
+ * accesses of the previous step. This routine is called from interrupt
+ * context.
+ */
+static void
+bus_trigger_scan(uint prod)
+{
+    uint mask = ARRAY_SIZE(buffer_rxa_lo) - 1;
+
+    prod &= mask;
+    while (trig_cons != prod) {
+        uint addr = buffer_rxa_lo[trig_cons];
+        uint data = buffer_rxd[trig_cons];
+
+        if (trig_cap.ktc_state == KS_TRIG_STATE_POST) {
+            trig_cap.ktc_addr[trig_cap.ktc_count] = addr;
+            trig_cap.ktc_data[trig_cap.ktc_count] = data;
+            if (++trig_cap.ktc_count >= trig_end) {
+                trig_cap.ktc_state = KS_TRIG_STATE_DONE;
+                return;
+            }
+        } else if (bus_trigger_match(&trig_steps[trig_step], addr, data)) {
+            trig_gap = 0;
+            if (++trig_step == trig_nsteps) {
+                bus_trigger_fire();
+                if (trig_cap.ktc_state == KS_TRIG_STATE_DONE)
+                    return;
+            }
+        } else if ((trig_step != 0) && (++trig_gap > trig_window)) {
+            /* Sequence broken; this access may start a new one */
+            trig_gap  = 0;
+            trig_step = bus_trigger_match(&trig_steps[0], addr, data);
+        }
+
+        /* Keep clear of entries which the DMA engine will soon overwrite */
+        if (trig_hist < ARRAY_SIZE(buffer_rxa_lo) - 64)
+            trig_hist++;
+        trig_cons = (trig_cons + 1) & mask;
+    }
+}
+
+/*
+ * bus_profile_scan
+ * ----------------
+ * Count capture ring entries up to the DMA producer in the ROM fetch
+ * profile. This routine is called from interrupt context, so the work
+ * per entry is kept to a subtract, shift, and increment. If the scan
+ * fell a full ring behind (the interrupt was held off), the entries
+ * were overwritten, so they are skipped and counted as an overrun.
+ */
+static void
+bus_profile_scan(void)
+{
+    uint mask = ARRAY_SIZE(buffer_rxa_lo) - 1;
+    uint prod;
+    uint bin;
+
+    if (snoop_update(&prof_span, &prof_oprod, &prof_pending)) {
+        prof.kp_overruns++;
+        prof_cons = prof_oprod;
+    }
+    prod = prof_oprod;
+    prof_pending = 0;
+    if (capture_mode == CAPTURE_ADDR) {
+        while (prof_cons != prod) {
+            uint addr = buffer_rxa_lo[prof_cons] |
+                        ((buffer_rxd[prof_cons] & 0xf0) << (16 - 4));
+            bin = (addr - prof_base) >> prof_shift;
+            if (likely(bin < ARRAY_SIZE(prof.kp_count)))
+                prof.kp_count[bin]++;
+            else
+                prof.kp_other++;
+            prof_cons = (prof_cons + 1) & mask;
+        }
+    } else {
+        while (prof_cons != prod) {
+            bin = (buffer_rxa_lo[prof_cons] - prof_base) >> prof_shift;
+            if (likely(bin < ARRAY_SIZE(prof.kp_count)))
+                prof.kp_count[bin]++;
+            else
+                prof.kp_other++;
+            prof_cons = (prof_cons + 1) & mask;
+        }
+    }
+}
+
 /*
  * fast_magic_search() looks for the next occurrence of the start of the
  *                     magic address sequence for when an Amiga program
@@ -1962,8 +2460,13 @@ process_addresses(void)
 new_cmd:
     dma_left = dma_get_number_of_data(LOG_DMA_CONTROLLER, LOG_DMA_CHANNEL);
     prod     = ARRAY_SIZE(buffer_rxa_lo) - dma_left;
+    if (unlikely(trig_cap.ktc_state == KS_TRIG_STATE_ARMED) ||
+        unlikely(trig_cap.ktc_state == KS_TRIG_STATE_POST))
+        bus_trigger_scan(prod);
 
 new_cmd_post:
+    if (unlikely(prof.kp_active))
+        bus_profile_scan();
     while (rx_consumer != prod) {
         switch (magic_pos) {
             case 0:
@@ -2242,6 +2745,112 @@ end_snoop:
     return (rc);
 }
 
+/*
+ * bus_trigger_restore
+ * -------------------
+ * Return the capture DMA to address capture, as set up by msg_init().
+ * A data capture mode used by the trigger or by snoop prevents Amiga
+ * messages from being seen. This must be called with the capture
+ * interrupt disabled.
+ */
+static void
+bus_trigger_restore(void)
+{
+    if (capture_mode != CAPTURE_ADDR) {
+        capture_mode = CAPTURE_ADDR;
+        configure_oe_capture_rx(false);
+    }
+}
+
+/*
+ * bus_snoop_binary
+ * ----------------
+ * Stream DMA-captured ROM bus activity to the USB host as binary frames
+ * (ks_snoop_frame_t) rather than formatted text, so that the capture
+ * ring can be drained at USB speed. When capture data is overwritten
+ * before it could be sent, the overrun is counted and the next frame is
+ * flagged. Streaming stops when any input arrives from the host, after
+ * which a final frame with no entries and KS_SNOOP_FLAG_END is sent.
+ */
+static void
+bus_snoop_binary(uint mode)
+{
+    static uint16_t  snoop_addr[KS_SNOOP_MAX];
+    static uint16_t  snoop_data[KS_SNOOP_MAX];
+    ks_snoop_frame_t hdr;
+    uint             count = 0;
+    uint             cons;
+    uint             oprod;
+    uint             span;
+    uint             pending = 0;
+    uint             pos;
+    uint32_t         crc;
+
+    memset(&hdr, 0, sizeof (hdr));
+    hdr.ksf_magic = KS_SNOOP_MAGIC;
+    hdr.ksf_mode  = mode;
+
+    capture_mode = mode;
+    configure_oe_capture_rx(false);
+    TIM_CCER(TIM2) |= TIM_CCER_CC1E;  // timer_enable_oc_output()
+    dma_clear_interrupt_flags(LOG_DMA_CONTROLLER, LOG_DMA_CHANNEL,
+                              DMA_HTIF | DMA_TCIF);
+    cons = oprod = span = snoop_prod();
+
+    while (1) {
+        if ((count++ & 0xff) == 0) {
+            usb_poll();
+            if (getchar() > 0)
+                break;
+        }
+        if (snoop_update(&span, &oprod, &pending)) {
+            hdr.ksf_overruns++;
+            hdr.ksf_flags |= KS_SNOOP_FLAG_OVERRUN;
+            cons = oprod;
+        }
+        if (pending == 0)
+            continue;
+
+        /* Copy out a frame, then verify it was not overwritten meanwhile */
+        hdr.ksf_count = (pending > KS_SNOOP_MAX) ? KS_SNOOP_MAX : pending;
+        for (pos = 0; pos < hdr.ksf_count; pos++) {
+            snoop_addr[pos] = buffer_rxa_lo[cons];
+            snoop_data[pos] = buffer_rxd[cons];
+            cons = (cons + 1) & (ARRAY_SIZE(buffer_rxa_lo) - 1);
+        }
+        if (snoop_update(&span, &oprod, &pending)) {
+            hdr.ksf_overruns++;
+            hdr.ksf_flags |= KS_SNOOP_FLAG_OVERRUN;
+            cons = oprod;
+            continue;
+        }
+        pending -= hdr.ksf_count;
+
+        crc = crc32(0, &hdr, sizeof (hdr));
+        crc = crc32(crc, snoop_addr, hdr.ksf_count * sizeof (uint16_t));
+        crc = crc32(crc, snoop_data, hdr.ksf_count * sizeof (uint16_t));
+        if (puts_binary(&hdr, sizeof (hdr)) ||
+            puts_binary(snoop_addr, hdr.ksf_count * sizeof (uint16_t)) ||
+            puts_binary(snoop_data, hdr.ksf_count * sizeof (uint16_t)) ||
+            puts_binary(&crc, sizeof (crc))) {
+            goto snoop_bin_restore;  // Host is no longer receiving
+        }
+        hdr.ksf_seq++;
+        hdr.ksf_flags = 0;
+    }
+
+    hdr.ksf_count  = 0;
+    hdr.ksf_flags |= KS_SNOOP_FLAG_END;
+    crc = crc32(0, &hdr, sizeof (hdr));
+    (void) puts_binary(&hdr, sizeof (hdr));
+    (void) puts_binary(&crc, sizeof (crc));
+
+snoop_bin_restore:
+    nvic_disable_irq(LOG_DMA_NVIC_IRQ);
+    bus_trigger_restore();
+    nvic_enable_irq(LOG_DMA_NVIC_IRQ);
+}
+
 /*
  * bus_snoop
  * ---------
@@ -2254,7 +2863,7 @@ end_snoop:
  * multiple fast accesses can be missed by software.
  */
 void
-bus_snoop(uint mode)
+bus_snoop(uint mode, uint binary)
 {
     uint     last_oe = 1;
     uint     count = 0;
@@ -2265,6 +2874,12 @@ bus_snoop(uint mode)
     uint32_t cap_addr[32];
     uint32_t cap_data[32];
 
+    if (binary && (mode != CAPTURE_SW)) {
+        address_output_disable();
+        bus_snoop_binary(mode);
+        return;
+    }
+
     if (mode != CAPTURE_SW)
         printf("Press any key to exit\n");
 
@@ -2315,6 +2930,9 @@ bus_snoop(uint mode)
             }
         }
 snoop_abort:
+        nvic_disable_irq(LOG_DMA_NVIC_IRQ);
+        bus_trigger_restore();
+        nvic_enable_irq(LOG_DMA_NVIC_IRQ);
         return;
     }
 
@@ -2363,6 +2981,223 @@ snoop_abort:
     printf("\n");
 }
 
+/*
+ * bus_trigger_arm
+ * ---------------
+ * Arm the bus trigger engine with a sequence of trigger steps. When the
+ * sequence is seen, up to pre accesses before the trigger and post
+ * accesses after it are captured and then frozen for later retrieval
+ * (bus_trigger_show() or KS_CMD_GET | KS_GET_TRIGGER). Arming discards
+ * any previous capture.
+ */
+int
+bus_trigger_arm(uint mode, const bus_trig_step_t *steps, uint nsteps,
+                uint pre, uint post, uint window)
+{
+    uint step;
+
+    if ((nsteps == 0) || (nsteps > ARRAY_SIZE(trig_steps))) {
+        printf("Trigger must have 1 to %u steps\n", ARRAY_SIZE(trig_steps));
+        return (1);
+    }
+    if (pre + 1 + post > KS_TRIG_MAX) {
+        printf("Pre + post depth may not exceed %u\n", KS_TRIG_MAX - 1);
+        return (1);
+    }
+    for (step = 0; step < nsteps; step++) {
+        if ((mode == CAPTURE_ADDR) && (steps[step].bts_data_mask != 0)) {
+            printf("Data trigger requires lo or hi capture mode\n");
+            return (1);
+        }
+    }
+
+    nvic_disable_irq(LOG_DMA_NVIC_IRQ);
+    memcpy(trig_steps, steps, nsteps * sizeof (*steps));
+    memset(&trig_cap, 0, sizeof (trig_cap));
+    trig_nsteps = nsteps;
+    trig_step   = 0;
+    trig_gap    = 0;
+    trig_window = window;
+    trig_pre    = pre;
+    trig_post   = post;
+    if (mode != capture_mode) {
+        capture_mode = mode;
+        configure_oe_capture_rx(false);
+        TIM_CCER(TIM2) |= TIM_CCER_CC1E;  // timer_enable_oc_output()
+    }
+    trig_cons = snoop_prod();
+    trig_hist = 0;
+    trig_cap.ktc_mode  = mode;
+    trig_cap.ktc_state = KS_TRIG_STATE_ARMED;
+    nvic_enable_irq(LOG_DMA_NVIC_IRQ);
+    return (0);
+}
+
+/*
+ * bus_trigger_disarm
+ * ------------------
+ * Stop the bus trigger engine. A completed capture is retained.
+ */
+void
+bus_trigger_disarm(void)
+{
+    nvic_disable_irq(LOG_DMA_NVIC_IRQ);
+    if (trig_cap.ktc_state != KS_TRIG_STATE_DONE)
+        trig_cap.ktc_state = KS_TRIG_STATE_IDLE;
+    bus_trigger_restore();
+    nvic_enable_irq(LOG_DMA_NVIC_IRQ);
+}
+
+/*
+ * bus_trigger_show
+ * ----------------
+ * Display bus trigger state and any triggered capture, in the same
+ * format as the "prom log" command.
+ */
+void
+bus_trigger_show(void)
+{
+    static const char * const state_name[] = {
+        "idle", "armed", "capturing post-trigger", "complete"
+    };
+    uint is_32bit = (ee_mode == EE_MODE_32) || (ee_mode == EE_MODE_32_SWAP);
+    uint mode = trig_cap.ktc_mode;
+    uint count;
+    uint pos;
+
+    printf("Trigger %s", state_name[trig_cap.ktc_state & 3]);
+    if (trig_cap.ktc_state == KS_TRIG_STATE_ARMED) {
+        printf(" (%u step%s, pre %u, post %u)\n", trig_nsteps,
+               (trig_nsteps == 1) ? "" : "s", trig_pre, trig_post);
+        return;
+    }
+    printf("\n");
+    if (trig_cap.ktc_state != KS_TRIG_STATE_DONE)
+        return;
+    printf("Triggered at %lu.%03lu sec\n",
+           trig_cap.ktc_when / 1000, trig_cap.ktc_when % 1000);
+
+    printf("Ent ROMAddr AmigaAddr");
+    if (mode == CAPTURE_DATA_LO)
+        printf(" DataLo");
+    else if (mode == CAPTURE_DATA_HI)
+        printf(" DataHi");
+    printf("\n");
+
+    count = trig_cap.ktc_count;
+    for (pos = 0; pos < count; pos++) {
+        uint addr = trig_cap.ktc_addr[pos];
+        uint data = trig_cap.ktc_data[pos];
+        uint amigaaddr;
+        int  ent = (int) pos - trig_cap.ktc_trigger;
+        if (mode == CAPTURE_ADDR) {
+            addr |= ((data & 0xf0) << (16 - 4));
+            amigaaddr = is_32bit ? (addr << 2) : (addr << 1);
+            if (addr & BIT(16))
+                amigaaddr |= 0x00e00000;
+            else
+                amigaaddr |= 0x00f80000;
+            printf("%4d %05x   %05x", ent, addr, amigaaddr);
+        } else {
+            amigaaddr = is_32bit ? (addr << 2) : (addr << 1);
+            amigaaddr |= 0x00f80000;
+            printf("%4d _%04x   %05x     %04x", ent, addr, amigaaddr, data);
+        }
+        printf("%s\n", (ent == 0) ? "  <- trigger" : "");
+    }
+}
+
+/*
+ * bus_profile_start
+ * -----------------
+ * Clear and start the ROM fetch profile. Each bin counts ROM accesses
+ * in bin_size bytes of ROM, starting at ROM byte offset base.
+ */
+int
+bus_profile_start(uint bin_size, uint32_t base)
+{
+    uint is_32bit = (ee_mode == EE_MODE_32) || (ee_mode == EE_MODE_32_SWAP);
+    uint word_shift = is_32bit ? 2 : 1;
+    uint bin_shift;
+
+    for (bin_shift = word_shift; bin_shift < 20; bin_shift++)
+        if ((1U << bin_shift) == bin_size)
+            break;
+    if (bin_shift == 20) {
+        printf("Bin size must be a power of 2 from %u to 0x80000\n",
+               1U << word_shift);
+        return (1);
+    }
+    if ((base & ((1U << word_shift) - 1)) != 0) {
+        printf("Base must be a multiple of %u\n", 1U << word_shift);
+        return (1);
+    }
+
+    nvic_disable_irq(LOG_DMA_NVIC_IRQ);
+    memset(&prof, 0, sizeof (prof));
+    prof.kp_bin_shift  = bin_shift;
+    prof.kp_word_shift = word_shift;
+    prof.kp_mode       = capture_mode;
+    prof.kp_base       = base;
+    prof_base          = base >> word_shift;
+    prof_shift         = bin_shift - word_shift;
+    prof_cons          = snoop_prod();
+    prof_span          = prof_cons;
+    prof_oprod         = prof_cons;
+    prof_pending       = 0;
+    prof.kp_active     = 1;
+    nvic_enable_irq(LOG_DMA_NVIC_IRQ);
+    return (0);
+}
+
+/*
+ * bus_profile_stop
+ * ----------------
+ * Stop the ROM fetch profile. The histogram is retained.
+ */
+void
+bus_profile_stop(void)
+{
+    prof.kp_active = 0;
+}
+
+/*
+ * bus_profile_show
+ * ----------------
+ * Display the non-empty bins of the ROM fetch profile.
+ */
+void
+bus_profile_show(void)
+{
+    uint64_t total = prof.kp_other;
+    uint     bin;
+
+    for (bin = 0; bin < ARRAY_SIZE(prof.kp_count); bin++)
+        total += prof.kp_count[bin];
+    printf("Profile %s, %u byte bins from %lx, %llu accesses\n",
+           prof.kp_active ? "running" : "stopped", 1U << prof.kp_bin_shift,
+           prof.kp_base, total);
+    if (total == 0)
+        return;
+
+    printf("ROMOffset      Count   Pct\n");
+    for (bin = 0; bin < ARRAY_SIZE(prof.kp_count); bin++) {
+        uint32_t count = prof.kp_count[bin];
+        uint     pct;
+        if (count == 0)
+            continue;
+        pct = (uint) (count * 1000ULL / total);
+        printf("%06lx %13lu %3u.%u\n",
+               prof.kp_base + (bin << prof.kp_bin_shift), count,
+               pct / 10, pct % 10);
+    }
+    if (prof.kp_other != 0)
+        printf("other  %13lu\n", prof.kp_other);
+    if (prof.kp_overruns != 0)
+        printf("Overruns %lu (ring lapped; accesses not counted)\n",
+               prof.kp_overruns);
+}
+
 void
 msg_poll(void)
 {
@@ -2374,6 +3209,13 @@ msg_poll(void)
          */
         nvic_enable_irq(LOG_DMA_NVIC_IRQ);
     }
+    if ((trig_cap.ktc_state == KS_TRIG_STATE_DONE) &&
+        (capture_mode != CAPTURE_ADDR)) {
+        /* Post-trigger capture is complete; resume message capture */
+        nvic_disable_irq(LOG_DMA_NVIC_IRQ);
+        bus_trigger_restore();
+        nvic_enable_irq(LOG_DMA_NVIC_IRQ);
+    }
 }
 
 void
@@ -2445,38 +3287,7 @@ execute_usb_cmd(uint16_t cmd, uint16_t cmd_len, uint8_t *rawbuf)
         case KS_CMD_ID: {
             /* Send KickSmash identification and configuration */
             smash_id_t reply;
-            uint temp[3];
-            int  pos = 0;
-            memset(&reply, 0, sizeof (reply));
-            sscanf(version_str + 8, "%u.%u%n", &temp[0], &temp[1], &pos);
-            reply.si_ks_version[0] = SWAP16(temp[0]);
-            reply.si_ks_version[1] = SWAP16(temp[1]);
-            if (pos == 0)
-                pos = 18;
-            else
-                pos += 8 + 7;
-            sscanf(version_str + pos, "%04u-%02u-%02u",
-                   &temp[0], &temp[1], &temp[2]);
-            reply.si_ks_date[0] = temp[0] / 100;
-            reply.si_ks_date[1] = temp[0] % 100;
-            reply.si_ks_date[2] = temp[1];
-            reply.si_ks_date[3] = temp[2];
-            pos += 11;
-            sscanf(version_str + pos, "%02u:%02u:%02u",
-                   &temp[0], &temp[1], &temp[2]);
-            reply.si_ks_time[0] = temp[0];
-            reply.si_ks_time[1] = temp[1];
-            reply.si_ks_time[2] = temp[2];
-            reply.si_ks_time[3] = 0;
-            strcpy(reply.si_serial, (const char *)usb_serial_str);
-            reply.si_rev      = SWAP16(0x0001);     // Protocol version 0.1
-            reply.si_features = SWAP16(0x0001);     // Features
-            reply.si_usbid    = SWAP32(0x12091610); // Matches USB ID
-            reply.si_mode     = ee_mode;
-            reply.si_unused1  = 0;
-            reply.si_usbdev   = usb_current_address();
-            strcpy(reply.si_name, config.name);
-            memset(reply.si_unused, 0, sizeof (reply.si_unused));
+            smash_id_reply(&reply);
             usb_msg_reply(0, KS_STATUS_OK, sizeof (reply), &reply, 0, NULL);
             break;
         }
@@ -2515,6 +3326,42 @@ execute_usb_cmd(uint16_t cmd, uint16_t cmd_len, uint8_t *rawbuf)
             usb_msg_reply(0, KS_STATUS_OK, sizeof (config.bi),
                           &config.bi, 0, NULL);
             break;
+        case KS_CMD_BANK_SNAPSHOT: {
+            /* Get everything needed by the ROM switcher in one reply */
+            static ks_snapshot_t reply;
+            bank_snapshot_reply(&reply);
+            usb_msg_reply(0, KS_STATUS_OK, sizeof (reply), &reply, 0, NULL);
+            break;
+        }
+        case KS_CMD_GET:
+            if (cmd & KS_GET_WEAR) {
+                usb_msg_reply(0, KS_STATUS_OK, sizeof (config.flash_wear),
+                              &config.flash_wear, 0, NULL);
+            } else if (cmd & KS_GET_TRIGGER) {
+                usb_msg_reply(0, KS_STATUS_OK, sizeof (trig_cap),
+                              &trig_cap, 0, NULL);
+            } else if (cmd & KS_GET_PROFILE) {
+                usb_msg_reply(0, KS_STATUS_OK, sizeof (prof), &prof, 0, NULL);
+            } else if (cmd & KS_GET_ROMINDEX) {
+                /* First byte is the bank number */
+                static ks_rom_index_t reply;
+                if ((cmd_len < 1) || (buf[0] >= ROM_BANKS)) {
+                    usb_msg_reply(0, KS_STATUS_BADARG, 0, NULL, 0, NULL);
+                    break;
+                }
+                romindex_reply(buf[0], &reply, 0);
+                usb_msg_reply(0, KS_STATUS_OK, sizeof (reply), &reply, 0, NULL);
+            } else {
+                usb_msg_reply(0, KS_STATUS_BADARG, 0, NULL, 0, NULL);
+            }
+            break;
+        case KS_CMD_FLASH_GEOMETRY: {
+            /* Report cached flash CFI geometry */
+            flash_geometry_t reply;
+            flash_geometry_reply(&reply);
+            usb_msg_reply(0, KS_STATUS_OK, sizeof (reply), &reply, 0, NULL);
+            break;
+        }
         case KS_CMD_MSG_STATE: {
             uint16_t reply[2];
             if (cmd & KS_MSG_STATE_SET) {
@@ -12,12 +12,30 @@
 #ifndef __MSG_H
 #define __MSG_H
 
+#define BUS_TRIG_STEPS 4  // Maximum steps in a trigger sequence
+
+/* One step of a bus trigger sequence */
+typedef struct {
+    uint32_t bts_addr_lo;    // Lowest matching ROM word address
+    uint32_t bts_addr_hi;    // Highest matching ROM word address
+    uint16_t bts_data;       // Data value to match (after mask)
+    uint16_t bts_data_mask;  // Data bits to compare (0 = ignore data)
+} bus_trig_step_t;
+
 int      address_log_replay(uint max);
-void     bus_snoop(uint mode);
+void     bus_snoop(uint mode, uint binary);
+int      bus_trigger_arm(uint mode, const bus_trig_step_t *steps,
+                         uint nsteps, uint pre, uint post, uint window);
+void     bus_trigger_disarm(void);
+void     bus_trigger_show(void);
+int      bus_profile_start(uint bin_size, uint32_t base);
+void     bus_profile_stop(void);
+void     bus_profile_show(void);
 void     msg_poll(void);
 void     msg_init(void);
 void     msg_shutdown(void);
 void     msg_mode(uint mode);
 void     msg_usb_service(void);
+uint32_t msg_amiga_time_sec(void);
 
 #endif /* __MSG_H */
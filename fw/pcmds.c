@@ -31,6 +31,7 @@
 #include "m29f160xt.h"
 #include "msg.h"
 #include "config.h"
+#include "romindex.h"
 #include "pin_tests.h"
 #include "led.h"
 
@@ -62,15 +63,22 @@ const char cmd_gpio_help[] =
 
 const char cmd_prom_help[] =
 "prom bank <cmd>         - show or set PROM bank for AmigaOS\n"
+"prom cfi                - query and show EEPROM CFI geometry\n"
 "prom cmd <cmd> [<addr>] - send a 32-bit command to both flash chips\n"
 "prom id                 - report EEPROM chip vendor and id\n"
+"prom index [<bank>]     - show Kickstart index of ROM banks\n"
 "prom erase chip|<addr>  - erase EEPROM chip or 128K sector; <len> optional\n"
+"prom erase bg ...       - erase EEPROM in the background\n"
+"prom erase status       - show background erase progress\n"
+"prom erase suspend      - suspend background erase (allows reads)\n"
+"prom erase resume       - resume suspended background erase\n"
 "prom log [<count>]      - show log of Amiga address accesses\n"
 "prom mode 0|1|2|3       - set EEPROM access mode (0=32, 1=16lo, 2=16hi)\n"
 "prom name [<name>]      - set or show name of this board\n"
 "prom read <addr> <len>  - read binary data from EEPROM (to terminal)\n"
 "prom service            - enter Amiga/USB message service mode\n"
 "prom temp               - show STM32 die temperature\n"
+"prom wear               - show flash sector erase counters\n"
 "prom write <addr> <len> - write binary data to EEPROM (from terminal)\n"
 "prom test               - test pins (standalone board only)";
 
@@ -96,7 +104,15 @@ const char cmd_snoop_help[] =
 "snoop        - capture and report ROM transactions\n"
 "snoop addr   - hardware capture A0-A19\n"
 "snoop lo     - hardware capture A0-A15 D0-D15\n"
-"snoop hi     - hardware capture A0-A15 D16-D31";
+"snoop hi     - hardware capture A0-A15 D16-D31\n"
+"snoop <mode> bin - binary stream capture to USB host (hostsmash)\n"
+"snoop trig [<mode>] <step>... [pre <n>] [post <n>] [window <n>]\n"
+"             - arm trigger; step is <addr>[-<addr>][=<data>[/<mask>]]\n"
+"snoop trig show - show trigger state and triggered capture\n"
+"snoop trig off  - disarm trigger\n"
+"snoop prof start [<binsize> [<base>]] - start ROM fetch profile (hex)\n"
+"snoop prof stop - stop ROM fetch profile\n"
+"snoop prof show - show ROM fetch profile histogram";
 
 const char cmd_usb_help[] =
 "usb disable - reset and disable USB\n"
@@ -511,6 +527,7 @@ cmd_prom(int argc, char * const *argv)
     char       *temp_cmd;
     uint32_t    addr = 0;
     uint32_t    len = 0;
+    uint        background = 0;
 
     if (strcmp(arg, "set") == 0)
         this_cmd = "set";
@@ -532,6 +549,8 @@ cmd_prom(int argc, char * const *argv)
     }
     if (strcmp("bank", arg) == 0) {
         return (cmd_prom_bank(argc, argv));
+    } else if (strcmp("cfi", arg) == 0) {
+        return (prom_cfi());
     } else if (strcmp("cmd", arg) == 0) {
         uint32_t cmd;
         if ((argc < 2) || (argc > 3)) {
@@ -558,6 +577,17 @@ cmd_prom(int argc, char * const *argv)
                    "<addr> argument\n");
             return (RC_USER_HELP);
         }
+        if (strcmp(argv[1], "status") == 0)
+            return (prom_erase_status());
+        if (strcmp(argv[1], "suspend") == 0)
+            return (prom_erase_suspend());
+        if (strcmp(argv[1], "resume") == 0)
+            return (prom_erase_resume());
+        if ((strcmp(argv[1], "bg") == 0) && (argc > 2)) {
+            background = 1;
+            argc--;
+            argv++;
+        }
         if (strcmp(argv[1], "chip") == 0) {
             op_mode = OP_ERASE_CHIP;
             argc--;
@@ -567,6 +597,21 @@ cmd_prom(int argc, char * const *argv)
         }
     } else if (strcmp("id", arg) == 0) {
         return (prom_id());
+    } else if (strcmp("index", arg) == 0) {
+        uint bank = 0;
+        if (argc > 1) {
+            rc = parse_value(argv[1], (uint8_t *) &bank, 1);
+            if (rc != RC_SUCCESS)
+                return (rc);
+            if (bank >= ROM_BANKS) {
+                printf("Invalid bank %u\n", bank);
+                return (RC_BAD_PARAM);
+            }
+            romindex_show(bank);
+        } else {
+            romindex_show(-1);
+        }
+        return (RC_SUCCESS);
     } else if (strcmp("log", arg) == 0) {
         uint max = 0;
         if (argc > 1) {
@@ -607,6 +652,9 @@ cmd_prom(int argc, char * const *argv)
         op_mode = OP_SERVICE;
     } else if (strcmp("temp", arg) == 0) {
         return (cmd_prom_temp(argc - 1, argv + 1));
+    } else if (strcmp("wear", arg) == 0) {
+        config_wear_show();
+        return (RC_SUCCESS);
     } else if (strcmp("write", arg) == 0) {
         op_mode = OP_WRITE;
     } else if (strcmp("test", arg) == 0) {
@@ -657,7 +705,10 @@ cmd_prom(int argc, char * const *argv)
                 printf("error: prom erase chip does not have arguments\n");
                 return (RC_USER_HELP);
             }
-            rc = prom_erase(ERASE_MODE_CHIP, 0, 0);
+            if (background)
+                rc = prom_erase_start(ERASE_MODE_CHIP, 0, 0);
+            else
+                rc = prom_erase(ERASE_MODE_CHIP, 0, 0);
             break;
         case OP_ERASE_SECTOR:
             printf("Sector erase %lx", addr);
@@ -669,7 +720,10 @@ cmd_prom(int argc, char * const *argv)
                        "allows optional <len>\n");
                 return (RC_USER_HELP);
             }
-            rc = prom_erase(ERASE_MODE_SECTOR, addr, len);
+            if (background)
+                rc = prom_erase_start(ERASE_MODE_SECTOR, addr, len);
+            else
+                rc = prom_erase(ERASE_MODE_SECTOR, addr, len);
             break;
         case OP_SERVICE:
             msg_usb_service();
@@ -1212,23 +1266,177 @@ cmd_set(int argc, char * const *argv)
 }
 
 
+/*
+ * parse_trig_step
+ * ---------------
+ * Parse a trigger step of the form <addr>[-<addr>][=<data>[/<mask>]].
+ * Addresses are ROM word addresses, as shown by "prom log". An address
+ * of "*" matches any address.
+ */
+static rc_t
+parse_trig_step(const char *arg, bus_trig_step_t *step)
+{
+    uint lo = 0;
+    uint hi = 0xfffff;
+    uint data = 0;
+    uint mask = 0;
+    int  pos = 0;
+    int  len;
+
+    if (*arg == '*') {
+        pos = 1;
+    } else {
+        if (sscanf(arg, "%x%n", &lo, &pos) != 1)
+            goto invalid;
+        hi = lo;
+        if ((arg[pos] == '-') &&
+            (sscanf(arg + pos + 1, "%x%n", &hi, &len) == 1))
+            pos += len + 1;
+    }
+    if (arg[pos] == '=') {
+        if (sscanf(arg + pos + 1, "%x%n", &data, &len) != 1)
+            goto invalid;
+        pos += len + 1;
+        mask = 0xffff;
+        if ((arg[pos] == '/') &&
+            (sscanf(arg + pos + 1, "%x%n", &mask, &len) == 1))
+            pos += len + 1;
+    }
+    if ((arg[pos] != '\0') || (lo > hi) || (hi > 0xfffff) ||
+        (data > 0xffff) || (mask > 0xffff))
+        goto invalid;
+
+    step->bts_addr_lo   = lo;
+    step->bts_addr_hi   = hi;
+    step->bts_data      = data & mask;
+    step->bts_data_mask = mask;
+    return (RC_SUCCESS);
+
+invalid:
+    printf("Invalid trigger step \"%s\"\n", arg);
+    return (RC_USER_HELP);
+}
+
+/*
+ * cmd_snoop_trig
+ * --------------
+ * Arm, disarm, or show the bus trigger engine.
+ */
+static rc_t
+cmd_snoop_trig(int argc, char * const *argv)
+{
+    bus_trig_step_t steps[BUS_TRIG_STEPS];
+    uint nsteps = 0;
+    uint mode = CAPTURE_ADDR;
+    uint pre = 16;
+    uint post = 64;
+    uint window = 16;
+    uint *valp;
+    int  arg;
+    rc_t rc;
+
+    if ((argc < 2) || (strcmp(argv[1], "show") == 0)) {
+        bus_trigger_show();
+        return (RC_SUCCESS);
+    }
+    if (strcmp(argv[1], "off") == 0) {
+        bus_trigger_disarm();
+        return (RC_SUCCESS);
+    }
+    for (arg = 1; arg < argc; arg++) {
+        if (strcmp(argv[arg], "addr") == 0) {
+            mode = CAPTURE_ADDR;
+        } else if (strncmp(argv[arg], "low", 2) == 0) {
+            mode = CAPTURE_DATA_LO;
+        } else if (strncmp(argv[arg], "high", 2) == 0) {
+            mode = CAPTURE_DATA_HI;
+        } else if ((strcmp(argv[arg], "pre") == 0) ||
+                   (strcmp(argv[arg], "post") == 0) ||
+                   (strcmp(argv[arg], "window") == 0)) {
+            valp = (argv[arg][1] == 'r') ? &pre :
+                   (argv[arg][1] == 'o') ? &post : &window;
+            if ((++arg >= argc) || (sscanf(argv[arg], "%u", valp) != 1)) {
+                printf("snoop trig %s requires a count\n", argv[arg - 1]);
+                return (RC_USER_HELP);
+            }
+        } else {
+            if (nsteps >= ARRAY_SIZE(steps)) {
+                printf("Too many trigger steps (max %u)\n", ARRAY_SIZE(steps));
+                return (RC_FAILURE);
+            }
+            rc = parse_trig_step(argv[arg], &steps[nsteps++]);
+            if (rc != RC_SUCCESS)
+                return (rc);
+        }
+    }
+    if (bus_trigger_arm(mode, steps, nsteps, pre, post, window))
+        return (RC_FAILURE);
+    printf("Trigger armed\n");
+    return (RC_SUCCESS);
+}
+
+/*
+ * cmd_snoop_prof
+ * --------------
+ * Start, stop, or show the ROM fetch profile.
+ */
+static rc_t
+cmd_snoop_prof(int argc, char * const *argv)
+{
+    uint bin_size = 0x100;
+    uint base = 0;
+
+    if ((argc < 2) || (strcmp(argv[1], "show") == 0)) {
+        bus_profile_show();
+    } else if (strcmp(argv[1], "stop") == 0) {
+        bus_profile_stop();
+    } else if (strcmp(argv[1], "start") == 0) {
+        if ((argc > 2) && (sscanf(argv[2], "%x", &bin_size) != 1)) {
+            printf("Invalid bin size \"%s\"\n", argv[2]);
+            return (RC_USER_HELP);
+        }
+        if ((argc > 3) && (sscanf(argv[3], "%x", &base) != 1)) {
+            printf("Invalid base \"%s\"\n", argv[3]);
+            return (RC_USER_HELP);
+        }
+        if (bus_profile_start(bin_size, base))
+            return (RC_FAILURE);
+    } else {
+        printf("snoop prof \"%s\" unknown argument\n", argv[1]);
+        return (RC_USER_HELP);
+    }
+    return (RC_SUCCESS);
+}
+
 rc_t
 cmd_snoop(int argc, char * const *argv)
 {
     uint mode = CAPTURE_SW;
-    if (argc > 1) {
-        if (strcmp(argv[1], "addr") == 0) {
+    uint binary = 0;
+    int  arg;
+
+    if ((argc > 1) && (strncmp(argv[1], "trigger", 4) == 0))
+        return (cmd_snoop_trig(argc - 1, argv + 1));
+    if ((argc > 1) && (strncmp(argv[1], "profile", 4) == 0))
+        return (cmd_snoop_prof(argc - 1, argv + 1));
+
+    for (arg = 1; arg < argc; arg++) {
+        if (strcmp(argv[arg], "addr") == 0) {
             mode = CAPTURE_ADDR;
-        } else if (strncmp(argv[1], "low", 2) == 0) {
+        } else if (strncmp(argv[arg], "low", 2) == 0) {
             mode = CAPTURE_DATA_LO;
-        } else if (strncmp(argv[1], "high", 2) == 0) {
+        } else if (strncmp(argv[arg], "high", 2) == 0) {
             mode = CAPTURE_DATA_HI;
+        } else if (strcmp(argv[arg], "bin") == 0) {
+            binary = 1;
         } else {
-            printf("snoop \"%s\" unknown argument\n", argv[1]);
+            printf("snoop \"%s\" unknown argument\n", argv[arg]);
             return (RC_USER_HELP);
         }
     }
-    bus_snoop(mode);
+    if (binary && (mode == CAPTURE_SW))
+        mode = CAPTURE_ADDR;  // Binary stream requires hardware capture
+    bus_snoop(mode, binary);
 
     return (RC_SUCCESS);
 }
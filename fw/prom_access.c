@@ -27,6 +27,7 @@
 #include "adc.h"
 
 #define DATA_CRC_INTERVAL 256
+#define PROM_READ_BURST   2048  // Bytes read from EEPROM per burst
 
 static int
 warn_amiga_not_in_reset(void)
@@ -46,6 +47,16 @@ warn_amiga_not_in_reset(void)
     return (0);
 }
 
+static int
+warn_erase_in_progress(void)
+{
+    if (ee_erase_busy()) {
+        printf("Fail: Erase in progress\n");
+        return (1);
+    }
+    return (0);
+}
+
 static rc_t
 prom_read_32(uint32_t addr, uint width, uint8_t *buf)
 {
@@ -243,19 +254,64 @@ rc_t
 prom_erase(uint mode, uint32_t addr, uint32_t len)
 {
     rc_t rc;
-    if (warn_amiga_not_in_reset())
+    if (warn_amiga_not_in_reset() || warn_erase_in_progress())
         return (RC_BUSY);
 
     ee_enable();
-    gpio_setv(FLASH_OEWE_PORT, FLASH_OEWE_PIN, 1);
     if ((ee_mode == EE_MODE_32) || (ee_mode == EE_MODE_32_SWAP))
         rc = ee_erase(mode, addr >> 2, len >> 2, 1);
     else
         rc = ee_erase(mode, addr >> 1, len >> 1, 1);
-    gpio_setv(FLASH_OEWE_PORT, FLASH_OEWE_PIN, 0);
     return (rc);
 }
 
+/*
+ * prom_erase_start() starts an erase which runs in the background. Progress
+ *                    may be checked with prom_erase_status().
+ */
+rc_t
+prom_erase_start(uint mode, uint32_t addr, uint32_t len)
+{
+    if (warn_amiga_not_in_reset() || warn_erase_in_progress())
+        return (RC_BUSY);
+
+    ee_enable();
+    if ((ee_mode == EE_MODE_32) || (ee_mode == EE_MODE_32_SWAP))
+        return (ee_erase_start(mode, addr >> 2, len >> 2, 1));
+    else
+        return (ee_erase_start(mode, addr >> 1, len >> 1, 1));
+}
+
+rc_t
+prom_erase_suspend(void)
+{
+    if (ee_erase_suspend() != 0) {
+        printf("No block erase running\n");
+        return (RC_FAILURE);
+    }
+    return (RC_SUCCESS);
+}
+
+rc_t
+prom_erase_resume(void)
+{
+    if (warn_amiga_not_in_reset())
+        return (RC_BUSY);
+
+    if (ee_erase_resume() != 0) {
+        printf("No erase suspended\n");
+        return (RC_FAILURE);
+    }
+    return (RC_SUCCESS);
+}
+
+rc_t
+prom_erase_status(void)
+{
+    ee_erase_show();
+    return (RC_SUCCESS);
+}
+
 void
 prom_cmd(uint32_t addr, uint32_t cmd)
 {
@@ -272,7 +328,7 @@ prom_id(void)
     uint32_t part1;
     uint32_t part2;
 
-    if (warn_amiga_not_in_reset())
+    if (warn_amiga_not_in_reset() || warn_erase_in_progress())
         return (RC_BUSY);
 
     ee_enable();
@@ -292,6 +348,26 @@ prom_id(void)
     return (RC_SUCCESS);
 }
 
+/*
+ * prom_cfi() queries the flash CFI table, updating the geometry cached
+ *            in config, and then displays the geometry.
+ */
+rc_t
+prom_cfi(void)
+{
+    uint32_t part1;
+    uint32_t part2;
+
+    if (warn_amiga_not_in_reset() || warn_erase_in_progress())
+        return (RC_BUSY);
+
+    ee_enable();
+    ee_id(&part1, &part2);
+    config.flash_geom.fg_chipid = 0;  // Force cache refresh
+    ee_geometry_show(ee_geometry(part1));
+    return (RC_SUCCESS);
+}
+
 static int
 getchar_wait(uint pos)
 {
@@ -347,14 +423,19 @@ check_rc(uint pos)
 /*
  * prom_read_binary() reads data from an EEPROM and writes it to the host.
  *                    Every 256 bytes, a rolling CRC value is expected back
- *                    from the host.
+ *                    from the host. The EEPROM is read in bursts of
+ *                    PROM_READ_BURST bytes, alternating between two buffers
+ *                    so that the USB controller may still be transmitting
+ *                    the previous burst while the next one is being read.
  */
 rc_t
 prom_read_binary(uint32_t addr, uint32_t len)
 {
     rc_t     rc;
     __attribute__((aligned(16)))
-    uint8_t  buf[256];
+    static uint8_t bufs[2][PROM_READ_BURST];
+    uint8_t *buf;
+    uint     cur = 0;
     uint32_t crc = 0;
     uint     crc_next = DATA_CRC_INTERVAL;
     uint32_t cap_pos[4];
@@ -368,50 +449,63 @@ prom_read_binary(uint32_t addr, uint32_t len)
 
     ee_enable();
     while (len > 0) {
-        uint32_t tlen = sizeof (buf);
-        if (tlen > len)
-            tlen = len;
-        if (tlen > crc_next)
-            tlen = crc_next;
-        rc = prom_read(addr, tlen, buf);
-        if (puts_binary(&rc, 1)) {
-            printf("Status send timeout at %lx\n", addr + pos);
-            return (RC_TIMEOUT);
-        }
-        if (rc != RC_SUCCESS)
+        uint32_t blen = PROM_READ_BURST;
+        uint32_t boff;
+        if (blen > len)
+            blen = len;
+        buf = bufs[cur];
+        cur ^= 1;
+        rc = prom_read(addr, blen, buf);
+        if (rc != RC_SUCCESS) {
+            /* The whole burst failed: report it once and stop */
+            if (puts_binary(&rc, 1))
+                printf("Status send timeout at %lx\n", addr + pos);
             return (rc);
-        if (puts_binary(buf, tlen)) {
-            printf("Data send timeout at %lx\n", addr + pos);
-            return (RC_TIMEOUT);
-        }
-
-        crc = crc32(crc, buf, tlen);
-        crc_next -= tlen;
-        addr     += tlen;
-        len      -= tlen;
-        pos      += tlen;
-
-        if (cap_count >= ARRAY_SIZE(cap_pos)) {
-            /* Verify received RC */
-            cap_count--;
-            if (check_rc(cap_pos[cap_cons]))
-                return (RC_FAILURE);
-            if (++cap_cons >= ARRAY_SIZE(cap_pos))
-                cap_cons = 0;
         }
 
-        if (crc_next == 0) {
-            /* Send and record the current CRC value */
-            if (puts_binary(&crc, sizeof (crc))) {
-                printf("Data send CRC timeout at %lx\n", addr + pos);
+        for (boff = 0; boff < blen; ) {
+            uint32_t tlen = blen - boff;
+            if (tlen > crc_next)
+                tlen = crc_next;
+            /* Host expects a status byte ahead of every chunk */
+            if (puts_binary(&rc, 1)) {
+                printf("Status send timeout at %lx\n", addr + pos);
                 return (RC_TIMEOUT);
             }
-            cap_pos[cap_prod] = pos;
-            if (++cap_prod >= ARRAY_SIZE(cap_pos))
-                cap_prod = 0;
-            cap_count++;
-            crc_next = DATA_CRC_INTERVAL;
+            if (puts_binary(buf + boff, tlen)) {
+                printf("Data send timeout at %lx\n", addr + pos);
+                return (RC_TIMEOUT);
+            }
+
+            crc = crc32(crc, buf + boff, tlen);
+            crc_next -= tlen;
+            boff     += tlen;
+            pos      += tlen;
+
+            if (cap_count >= ARRAY_SIZE(cap_pos)) {
+                /* Verify received RC */
+                cap_count--;
+                if (check_rc(cap_pos[cap_cons]))
+                    return (RC_FAILURE);
+                if (++cap_cons >= ARRAY_SIZE(cap_pos))
+                    cap_cons = 0;
+            }
+
+            if (crc_next == 0) {
+                /* Send and record the current CRC value */
+                if (puts_binary(&crc, sizeof (crc))) {
+                    printf("Data send CRC timeout at %lx\n", addr + pos);
+                    return (RC_TIMEOUT);
+                }
+                cap_pos[cap_prod] = pos;
+                if (++cap_prod >= ARRAY_SIZE(cap_pos))
+                    cap_prod = 0;
+                cap_count++;
+                crc_next = DATA_CRC_INTERVAL;
+            }
         }
+        addr += blen;
+        len  -= blen;
         led_poll();  // Blink power LED if it needs to be blinked
     }
     if (crc_next != DATA_CRC_INTERVAL) {
@@ -584,6 +678,8 @@ prom_show_mode(void)
 void
 prom_mode(uint mode)
 {
+    if (warn_erase_in_progress())
+        return;
     ee_disable();
     if (mode != EE_MODE_AUTO)
         ee_set_mode(mode);
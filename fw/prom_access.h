@@ -15,10 +15,15 @@
 rc_t prom_read(uint32_t addr, uint width, void *bufp);
 rc_t prom_write(uint32_t addr, uint width, void *bufp);
 rc_t prom_erase(uint mode, uint32_t addr, uint32_t len);
+rc_t prom_erase_start(uint mode, uint32_t addr, uint32_t len);
+rc_t prom_erase_suspend(void);
+rc_t prom_erase_resume(void);
+rc_t prom_erase_status(void);
 rc_t prom_read_binary(uint32_t addr, uint32_t len);
 rc_t prom_write_binary(uint32_t addr, uint32_t len);
 void prom_cmd(uint32_t addr, uint32_t cmd);
 rc_t prom_id(void);
+rc_t prom_cfi(void);
 rc_t prom_status(void);
 rc_t prom_status_clear(void);
 rc_t prom_test(void);
@@ -0,0 +1,690 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ * See the LICENSE file for additional details.
+ *
+ * Designed by Chris Hooper in 2024.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Kickstart image index of ROM banks
+ *
+ * Each ROM bank is scanned for a Kickstart ROM header, its resident
+ * modules (ROMTags), and a valid checksum. Kicksmash may only drive the
+ * flash bus while the Amiga is held in reset, so the scan is performed
+ * a piece at a time from the main poll loop whenever that is the case.
+ * The resulting index is kept in STM32 flash just below the config area
+ * so that it is immediately available after power-on.
+ */
+
+#include "printf.h"
+#include "main.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "timer.h"
+#include "smash_cmd.h"
+#include "config.h"
+#include "crc32.h"
+#include "stm32flash.h"
+#include "utils.h"
+#include "m29f160xt.h"
+#include "gpio.h"
+#include "kbrst.h"
+#include "pin_tests.h"
+#include "adc.h"
+#include "romindex.h"
+
+#define ROMINDEX_MAGIC       0x4b534958  // "KSIX"
+#define ROMINDEX_VERSION     0x01
+#define ROMINDEX_AREA_BASE   0x3c000
+#define ROMINDEX_AREA_SIZE   0x02000
+#define ROMINDEX_AREA_END    (ROMINDEX_AREA_BASE + ROMINDEX_AREA_SIZE)
+
+#define ROMINDEX_CHUNK       512    // Bytes of image scanned per poll
+#define ROMINDEX_TAIL        24     // Bytes of previous chunk kept for ROMTag
+#define ROMINDEX_MAX_TAGS    48     // Maximum resident modules recorded
+#define ROMINDEX_SETTLE_MSEC 1000   // Quiet time after a flash change
+#define ROMINDEX_FP_LEN      64     // Bytes at bank start and end to CRC
+
+#define RTC_MATCHWORD        0x4afc  // ROMTag rt_MatchWord
+
+typedef struct {
+    uint32_t       ri_magic;    // Structure magic
+    uint32_t       ri_crc;      // Structure CRC
+    uint16_t       ri_size;     // Structure size in bytes
+    uint8_t        ri_valid;    // Structure record is valid
+    uint8_t        ri_version;  // Structure version
+    uint8_t        ri_ee_mode;  // Flash mode when index was built
+    uint8_t        ri_unused[3];
+    ks_rom_index_t ri_entry[ROM_BANKS];
+} romindex_t;
+
+static romindex_t romindex;
+static uint8_t    romindex_dirty;        // Index must be written to flash
+static uint8_t    romindex_verify;       // Banks to fingerprint since boot
+static uint64_t   romindex_timer;        // Settle time after flash change
+
+/* State of the bank currently being scanned */
+static struct {
+    uint8_t  bank;                       // Bank number (ROM_BANKS = idle)
+    uint8_t  order;                      // Flash word order of the image
+    uint8_t  ntags;                      // Resident modules found
+    uint32_t base;                       // Amiga address of image
+    uint32_t offset;                     // Next image byte offset to scan
+    uint32_t sum;                        // Running Kickstart checksum
+    uint8_t  buf[ROMINDEX_TAIL + ROMINDEX_CHUNK];
+    uint32_t tag_name[ROMINDEX_MAX_TAGS];  // Image offset of rt_Name
+    uint32_t tag_id[ROMINDEX_MAX_TAGS];    // Image offset of rt_IdString
+} scan = { .bank = ROM_BANKS };
+
+/*
+ * Kickstart release names, by Kickstart version number.
+ */
+static const struct {
+    uint8_t     version;
+    const char *name;
+} ks_release_names[] = {
+    { 33, "1.2" },
+    { 34, "1.3" },
+    { 36, "2.0" },
+    { 37, "2.04" },
+    { 39, "3.0" },
+    { 40, "3.1" },
+    { 45, "3.9" },
+    { 46, "3.1.4" },
+    { 47, "3.2" },
+};
+
+static const char * const kix_state_names[] = {
+    "stale", "empty", "unknown", "Kickstart"
+};
+
+/*
+ * romindex_order
+ * --------------
+ * Rearranges a 32-bit value read from the flash into Amiga big endian
+ * order. Which of the four orders applies depends on how the flash
+ * image was written, so the ROM header is tried against each.
+ */
+static uint32_t
+romindex_order(uint32_t value, uint order)
+{
+    if (order & 1)
+        value = (value << 16) | (value >> 16);
+    if (order & 2)
+        value = __builtin_bswap32(value);
+    return (value);
+}
+
+static uint32_t
+get_be32(const uint8_t *ptr)
+{
+    return ((ptr[0] << 24) | (ptr[1] << 16) | (ptr[2] << 8) | ptr[3]);
+}
+
+/*
+ * romindex_read
+ * -------------
+ * Reads len bytes at the specified byte offset from the start of a ROM
+ * bank, in Amiga byte order. Both offset and len must be a multiple
+ * of 4, and len may not exceed ROMINDEX_CHUNK.
+ */
+static int
+romindex_read(uint bank, uint32_t offset, void *bufp, uint len, uint order)
+{
+    uint8_t  *buf = bufp;
+    uint32_t  raw[ROMINDEX_CHUNK / 4];
+    uint      count = len / 4;
+    uint      pos;
+
+    if ((ee_mode == EE_MODE_32) || (ee_mode == EE_MODE_32_SWAP)) {
+        if (ee_read((bank << 17) + offset / 4, raw, count))
+            return (1);
+    } else {
+        uint16_t *raw16 = (uint16_t *) raw;
+        if (ee_read((bank << 17) + offset / 2, raw16, count * 2))
+            return (1);
+        for (pos = 0; pos < count; pos++)
+            raw[pos] = (raw16[pos * 2] << 16) | raw16[pos * 2 + 1];
+    }
+    for (pos = 0; pos < count; pos++) {
+        uint32_t value = romindex_order(raw[pos], order);
+        *(buf++) = value >> 24;
+        *(buf++) = value >> 16;
+        *(buf++) = value >> 8;
+        *(buf++) = value;
+    }
+    return (0);
+}
+
+/*
+ * romindex_fingerprint
+ * --------------------
+ * Computes a CRC over the start and end of a ROM bank. This is used to
+ * detect flash changes which were not made through Kicksmash (such as
+ * by older firmware or an external programmer).
+ */
+static uint32_t
+romindex_fingerprint(uint bank)
+{
+    uint8_t  buf[ROMINDEX_FP_LEN];
+    uint32_t bank_bytes;
+    uint32_t crc;
+
+    if ((ee_mode == EE_MODE_32) || (ee_mode == EE_MODE_32_SWAP))
+        bank_bytes = 4 << 17;
+    else
+        bank_bytes = 2 << 17;
+
+    if (romindex_read(bank, 0, buf, sizeof (buf), 0))
+        return (0);
+    crc = crc32(0, buf, sizeof (buf));
+    if (romindex_read(bank, bank_bytes - sizeof (buf), buf, sizeof (buf), 0))
+        return (0);
+    return (crc32(crc, buf, sizeof (buf)));
+}
+
+/*
+ * romindex_string
+ * ---------------
+ * Copies a string from the image being scanned. Control characters
+ * (such as the CR LF which ends most ID strings) end the copy.
+ */
+static void
+romindex_string(uint32_t offset, char *str, uint maxlen)
+{
+    uint8_t buf[36];
+    uint    skip = offset & 3;
+    uint    pos;
+
+    str[0] = '\0';
+    if (offset + sizeof (buf) > romindex.ri_entry[scan.bank].kix_size)
+        return;
+    if (romindex_read(scan.bank, offset & ~3, buf, sizeof (buf), scan.order))
+        return;
+    for (pos = 0; pos < maxlen - 1; pos++) {
+        uint8_t ch;
+        if (skip + pos >= sizeof (buf))
+            break;
+        ch = buf[skip + pos];
+        if ((ch < ' ') || (ch > '~'))
+            break;
+        str[pos] = ch;
+    }
+    str[pos] = '\0';
+}
+
+/*
+ * romindex_start
+ * --------------
+ * Begins indexing a bank by examining its ROM header. Banks which do
+ * not hold a Kickstart image are completed immediately.
+ */
+static void
+romindex_start(uint bank)
+{
+    ks_rom_index_t *kix = &romindex.ri_entry[bank];
+    uint32_t hdr[4];
+    uint32_t ver;
+    uint     order;
+    uint     pos;
+
+    memset(kix, 0, sizeof (*kix));
+    kix->kix_fingerprint = romindex_fingerprint(bank);
+    kix->kix_state = KIX_STATE_UNKNOWN;
+    romindex_dirty = 1;
+
+    /*
+     * The ROM header starts with 0x1114 (512K) or 0x1111 (256K) followed
+     * by a JMP instruction (0x4ef9). The Kickstart version and revision
+     * are the 16-bit values at offset 0x0c.
+     */
+    for (order = 0; order < 4; order++) {
+        if (romindex_read(bank, 0, hdr, sizeof (hdr), order))
+            return;
+        hdr[0] = get_be32((uint8_t *) &hdr[0]);
+        if ((hdr[0] == 0x11144ef9) || (hdr[0] == 0x11114ef9))
+            break;
+    }
+    if (order == 4) {
+        if (hdr[0] == 0xffffffff)
+            kix->kix_state = KIX_STATE_EMPTY;
+        return;  // Not a Kickstart ROM header
+    }
+    ver = get_be32((uint8_t *) &hdr[3]);
+    if (((ver >> 16) < 30) || ((ver >> 16) > 99))
+        return;  // Implausible version
+
+    kix->kix_version  = ver >> 16;
+    kix->kix_revision = (uint16_t) ver;
+    kix->kix_size     = (hdr[0] == 0x11144ef9) ? (512 << 10) : (256 << 10);
+    for (pos = 0; pos < ARRAY_SIZE(ks_release_names); pos++) {
+        if (ks_release_names[pos].version == kix->kix_version) {
+            strcpy(kix->kix_release, ks_release_names[pos].name);
+            break;
+        }
+    }
+
+    /* Checksum and ROMTag scan of the image proceeds in the background */
+    scan.bank   = bank;
+    scan.order  = order;
+    scan.ntags  = 0;
+    scan.base   = 0x01000000 - kix->kix_size;
+    scan.offset = 0;
+    scan.sum    = 0;
+    memset(scan.buf, 0, ROMINDEX_TAIL);
+}
+
+/*
+ * romindex_finish
+ * ---------------
+ * Completes indexing of the bank being scanned. The names of the
+ * resident modules found are collected, along with the exec.library
+ * ID string.
+ */
+static void
+romindex_finish(void)
+{
+    ks_rom_index_t *kix = &romindex.ri_entry[scan.bank];
+    uint8_t  buf[4];
+    uint     names_pos = 0;
+    uint     tag;
+
+    if (scan.sum == 0xffffffff)
+        kix->kix_flags |= KIX_FLAG_CHECKSUM;
+    if (romindex_read(scan.bank, kix->kix_size - 0x18, buf, sizeof (buf),
+                      scan.order) == 0) {
+        kix->kix_checksum = get_be32(buf);
+    }
+
+    kix->kix_modules = scan.ntags;
+    for (tag = 0; tag < scan.ntags; tag++) {
+        char name[32];
+        uint len;
+
+        romindex_string(scan.tag_name[tag], name, sizeof (name));
+        len = strlen(name) + 1;
+        if (names_pos + len > sizeof (kix->kix_names)) {
+            kix->kix_flags |= KIX_FLAG_TRUNCATED;
+        } else {
+            memcpy(kix->kix_names + names_pos, name, len);
+            names_pos += len;
+        }
+        if (strcmp(name, "exec.library") == 0)
+            romindex_string(scan.tag_id[tag], kix->kix_id,
+                            sizeof (kix->kix_id));
+    }
+    kix->kix_state = KIX_STATE_KICKSTART;
+    scan.bank = ROM_BANKS;
+    romindex_dirty = 1;
+}
+
+/*
+ * romindex_scan
+ * -------------
+ * Scans the next chunk of the image, accumulating the Kickstart checksum
+ * (32-bit sum with end-around carry, which totals 0xffffffff for a valid
+ * image) and recording each ROMTag. A ROMTag is identified by its match
+ * word followed by a pointer to itself. The last ROMINDEX_TAIL bytes of
+ * the previous chunk are kept at the front of the buffer so that a
+ * ROMTag spanning two chunks is still found.
+ */
+static void
+romindex_scan(void)
+{
+    ks_rom_index_t *kix = &romindex.ri_entry[scan.bank];
+    uint8_t *data = scan.buf + ROMINDEX_TAIL;
+    uint     pos;
+
+    if (romindex_read(scan.bank, scan.offset, data, ROMINDEX_CHUNK,
+                      scan.order)) {
+        kix->kix_state = KIX_STATE_UNKNOWN;
+        scan.bank = ROM_BANKS;
+        return;
+    }
+    for (pos = 0; pos < ROMINDEX_CHUNK; pos += 4) {
+        uint32_t value = get_be32(data + pos);
+        scan.sum += value;
+        if (scan.sum < value)
+            scan.sum++;  // Carry
+    }
+    for (pos = 4; pos <= ROMINDEX_CHUNK + 2; pos += 2) {
+        uint8_t *rt = scan.buf + pos;
+        uint32_t addr = scan.base + scan.offset - ROMINDEX_TAIL + pos;
+        if ((rt[0] != (RTC_MATCHWORD >> 8)) ||
+            (rt[1] != (uint8_t) RTC_MATCHWORD) ||
+            (get_be32(rt + 2) != addr) ||
+            (scan.ntags >= ROMINDEX_MAX_TAGS)) {
+            continue;
+        }
+        scan.tag_name[scan.ntags] = get_be32(rt + 14) - scan.base;
+        scan.tag_id[scan.ntags]   = get_be32(rt + 18) - scan.base;
+        scan.ntags++;
+    }
+    memcpy(scan.buf, scan.buf + ROMINDEX_CHUNK, ROMINDEX_TAIL);
+
+    scan.offset += ROMINDEX_CHUNK;
+    if (scan.offset >= kix->kix_size)
+        romindex_finish();
+}
+
+/*
+ * romindex_write
+ * --------------
+ * Write the index to the STM32 flash index area. Records are appended
+ * until the area is full, at which point it is erased.
+ */
+static void
+romindex_write(void)
+{
+    romindex_t *ptr;
+    uint32_t    addr;
+    uint        crcpos;
+
+    romindex.ri_magic   = ROMINDEX_MAGIC;
+    romindex.ri_size    = sizeof (romindex);
+    romindex.ri_valid   = 0x01;
+    romindex.ri_version = ROMINDEX_VERSION;
+    crcpos = offsetof(romindex_t, ri_crc) + sizeof (romindex.ri_crc);
+    romindex.ri_crc = crc32(0, &romindex.ri_crc + 1, sizeof (romindex) - crcpos);
+
+    /* Invalidate previous record */
+    for (addr = ROMINDEX_AREA_BASE; addr < ROMINDEX_AREA_END; addr += 4) {
+        ptr = (romindex_t *) addr;
+        if ((ptr->ri_magic == ROMINDEX_MAGIC) && (ptr->ri_valid)) {
+            uint16_t buf = 0;
+            if (memcmp(ptr, &romindex, sizeof (romindex)) == 0)
+                return;  // Written record already matches
+            stm32flash_write((uint32_t) &ptr->ri_valid, sizeof (buf), &buf, 0);
+        }
+    }
+
+    /* Locate space for new record */
+    for (addr = ROMINDEX_AREA_BASE; addr < ROMINDEX_AREA_END; addr += 4) {
+        ptr = (romindex_t *) addr;
+        if (ptr->ri_magic == ROMINDEX_MAGIC)
+            addr += ptr->ri_size - 4;  // quickly skip to next record
+        else if (ptr->ri_magic == 0xffffffff)
+            break;
+    }
+    if (addr + sizeof (romindex) > ROMINDEX_AREA_END) {
+        addr = ROMINDEX_AREA_BASE;
+        if (stm32flash_erase(ROMINDEX_AREA_BASE, ROMINDEX_AREA_SIZE) != 0)
+            stm32flash_erase(ROMINDEX_AREA_BASE, ROMINDEX_AREA_SIZE);
+    }
+    if (stm32flash_write(addr, sizeof (romindex), &romindex, 0) != 0)
+        printf("ROM index update failed at %lx\n", addr);
+}
+
+/*
+ * romindex_init
+ * -------------
+ * Locates and reads the valid Kickstart index in STM32 internal flash.
+ * If none is found, every bank will be indexed at the next Amiga reset.
+ * Banks of a cached index are checked against their fingerprint at the
+ * first opportunity, in case the flash was changed behind our back.
+ */
+void
+romindex_init(void)
+{
+    uint32_t    addr;
+    romindex_t *ptr;
+
+    romindex_verify = BIT(ROM_BANKS) - 1;
+    for (addr = ROMINDEX_AREA_BASE; addr < ROMINDEX_AREA_END; addr += 4) {
+        ptr = (romindex_t *) addr;
+        if ((ptr->ri_magic == ROMINDEX_MAGIC) && (ptr->ri_valid) &&
+            (ptr->ri_version == ROMINDEX_VERSION) &&
+            (ptr->ri_size == sizeof (romindex))) {
+            uint crcpos = offsetof(romindex_t, ri_crc) + sizeof (ptr->ri_crc);
+            uint32_t crc = crc32(0, &ptr->ri_crc + 1,
+                                 sizeof (romindex) - crcpos);
+            if (crc == ptr->ri_crc) {
+                memcpy(&romindex, ptr, sizeof (romindex));
+                return;
+            }
+        }
+    }
+    memset(&romindex, 0, sizeof (romindex));
+    romindex.ri_ee_mode = ee_mode;
+}
+
+/*
+ * romindex_invalidate
+ * -------------------
+ * Marks the index entry of every bank overlapping the specified range
+ * of flash word addresses as stale. This is called whenever the flash
+ * is erased or programmed.
+ */
+void
+romindex_invalidate(uint32_t addr, uint32_t len)
+{
+    uint bank = addr >> 17;
+    uint last;
+
+    if (len == 0)
+        len = 1;
+    last = (addr + len - 1) >> 17;
+    if (last >= ROM_BANKS)
+        last = ROM_BANKS - 1;
+    for (; bank <= last; bank++) {
+        if (romindex.ri_entry[bank].kix_state != KIX_STATE_STALE) {
+            memset(&romindex.ri_entry[bank], 0, sizeof (romindex.ri_entry[0]));
+            romindex_dirty = 1;
+        }
+        if (scan.bank == bank)
+            scan.bank = ROM_BANKS;  // Abandon scan in progress
+    }
+    romindex_timer = timer_tick_plus_msec(ROMINDEX_SETTLE_MSEC);
+}
+
+/*
+ * romindex_invalidate_bank
+ * ------------------------
+ * Marks the index entries of a bank and the banks merged with it stale.
+ * This is used when the Amiga erases or programs the flash, as only
+ * the bank (and not the address) is then known.
+ */
+void
+romindex_invalidate_bank(uint bank)
+{
+    uint first = bank - (config.bi.bi_merge[bank] & 0xf);
+    uint count;
+
+    if (first >= ROM_BANKS)
+        first = bank;
+    count = (config.bi.bi_merge[first] >> 4) + 1;
+    romindex_invalidate(first << 17, count << 17);
+}
+
+/*
+ * romindex_bus_allowed
+ * --------------------
+ * Returns true if the flash bus may be driven for indexing. In an Amiga,
+ * the KBRST pin is sampled directly rather than relying on the state
+ * last seen by kbrst_poll(), as the Amiga may leave reset at any time.
+ */
+static bool
+romindex_bus_allowed(void)
+{
+    if (board_is_standalone)
+        return (true);
+    if ((config.board_rev >= 4) && !v5_stable)
+        return (false);
+    return ((amiga_not_in_reset == 0) &&
+            (gpio_get(KBRST_PORT, KBRST_PIN) == 0));
+}
+
+/*
+ * romindex_discard
+ * ----------------
+ * The Amiga left reset during an indexing step of the specified bank,
+ * so the data read may have been garbage. The entry is returned to
+ * stale, so nothing from the step is kept or written to STM32 flash,
+ * and the bank is indexed again at the next reset.
+ */
+static void
+romindex_discard(uint bank)
+{
+    memset(&romindex.ri_entry[bank], 0, sizeof (romindex.ri_entry[0]));
+    if (scan.bank == bank)
+        scan.bank = ROM_BANKS;
+}
+
+/*
+ * romindex_poll
+ * -------------
+ * Background service of the Kickstart index. Stale banks are indexed
+ * and the index is written to STM32 flash once things have settled.
+ */
+void
+romindex_poll(void)
+{
+    uint bank;
+
+    if ((romindex_timer != 0) && !timer_tick_has_elapsed(romindex_timer))
+        return;  // Flash recently changed; more changes may follow
+    romindex_timer = 0;
+
+    if (ee_erase_busy())
+        return;
+
+    if (romindex_bus_allowed()) {
+        if (romindex.ri_ee_mode != ee_mode) {
+            /* Index was built with the flash in another mode */
+            memset(romindex.ri_entry, 0, sizeof (romindex.ri_entry));
+            romindex.ri_ee_mode = ee_mode;
+            scan.bank = ROM_BANKS;
+        }
+        /*
+         * The bus is released after every step, as the Amiga may leave
+         * reset at any time.
+         */
+        ee_enable();
+        if (scan.bank < ROM_BANKS) {
+            bank = scan.bank;
+            romindex_scan();
+            ee_disable();
+            if (!romindex_bus_allowed())
+                romindex_discard(bank);
+            return;
+        }
+        for (bank = 0; bank < ROM_BANKS; bank++) {
+            ks_rom_index_t *kix = &romindex.ri_entry[bank];
+            if ((romindex_verify & BIT(bank)) &&
+                (kix->kix_state != KIX_STATE_STALE)) {
+                uint32_t fingerprint = romindex_fingerprint(bank);
+                if (!romindex_bus_allowed()) {
+                    ee_disable();
+                    return;  // Fingerprint is not reliable; verify later
+                }
+                romindex_verify &= ~BIT(bank);
+                if (kix->kix_fingerprint != fingerprint) {
+                    printf("ROM bank %u changed\n", bank);
+                    kix->kix_state = KIX_STATE_STALE;
+                }
+            }
+            if (kix->kix_state == KIX_STATE_STALE) {
+                romindex_verify &= ~BIT(bank);
+                romindex_start(bank);
+                break;
+            }
+        }
+        ee_disable();
+        if (bank < ROM_BANKS) {
+            if (!romindex_bus_allowed())
+                romindex_discard(bank);
+            return;
+        }
+    }
+
+    if (romindex_dirty && (scan.bank == ROM_BANKS)) {
+        romindex_dirty = 0;
+        romindex_write();
+    }
+}
+
+/*
+ * romindex_reply
+ * --------------
+ * Provide a copy of the index entry for the specified bank, optionally
+ * converted to big endian for the Amiga.
+ */
+void
+romindex_reply(uint bank, ks_rom_index_t *reply, uint swap)
+{
+    *reply = romindex.ri_entry[bank];
+    if (scan.bank == bank)
+        reply->kix_state = KIX_STATE_STALE;  // Scan not yet complete
+    if (swap) {
+        reply->kix_version     = __builtin_bswap16(reply->kix_version);
+        reply->kix_revision    = __builtin_bswap16(reply->kix_revision);
+        reply->kix_modules     = __builtin_bswap16(reply->kix_modules);
+        reply->kix_size        = __builtin_bswap32(reply->kix_size);
+        reply->kix_checksum    = __builtin_bswap32(reply->kix_checksum);
+        reply->kix_fingerprint = __builtin_bswap32(reply->kix_fingerprint);
+    }
+}
+
+/*
+ * romindex_ident
+ * --------------
+ * Provide the short Kickstart identification of a bank (host order).
+ */
+void
+romindex_ident(uint bank, ks_bank_ident_t *kbi)
+{
+    ks_rom_index_t *kix = &romindex.ri_entry[bank];
+
+    memset(kbi, 0, sizeof (*kbi));
+    kbi->kbi_state = (scan.bank == bank) ? KIX_STATE_STALE : kix->kix_state;
+    if (kbi->kbi_state != KIX_STATE_KICKSTART)
+        return;
+    kbi->kbi_version  = kix->kix_version;
+    kbi->kbi_revision = kix->kix_revision;
+    strcpy(kbi->kbi_name, kix->kix_release);
+}
+
+/*
+ * romindex_show
+ * -------------
+ * Display the Kickstart index. If a bank is specified, the resident
+ * modules of that bank are also shown.
+ */
+void
+romindex_show(int bank)
+{
+    uint cur;
+
+    printf("Bank  State      Version        Size  Checksum      Modules\n");
+    for (cur = 0; cur < ROM_BANKS; cur++) {
+        ks_rom_index_t *kix = &romindex.ri_entry[cur];
+        uint state = (scan.bank == cur) ? KIX_STATE_STALE : kix->kix_state;
+
+        if ((bank >= 0) && (cur != (uint) bank))
+            continue;
+        printf("%-5u %-10s ", cur, kix_state_names[state]);
+        if (state != KIX_STATE_KICKSTART) {
+            printf("\n");
+            continue;
+        }
+        printf("%2u.%-3u %-6s %4luK  %08lx %-3s %u%s\n",
+               kix->kix_version, kix->kix_revision, kix->kix_release,
+               kix->kix_size >> 10, kix->kix_checksum,
+               (kix->kix_flags & KIX_FLAG_CHECKSUM) ? "ok" : "BAD",
+               kix->kix_modules,
+               (kix->kix_flags & KIX_FLAG_TRUNCATED) ? "+" : "");
+        if (kix->kix_id[0] != '\0')
+            printf("      %s\n", kix->kix_id);
+        if (bank >= 0) {
+            const char *name = kix->kix_names;
+            while ((name < kix->kix_names + sizeof (kix->kix_names)) &&
+                   (*name != '\0')) {
+                printf("      %s\n", name);
+                name += strlen(name) + 1;
+            }
+        }
+    }
+    if (romindex_verify != 0)
+        printf("Index not yet verified (Amiga has not been in reset)\n");
+}
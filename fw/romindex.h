@@ -0,0 +1,25 @@
+/*
+ * This is free and unencumbered software released into the public domain.
+ * See the LICENSE file for additional details.
+ *
+ * Designed by Chris Hooper in 2024.
+ *
+ * ---------------------------------------------------------------------
+ *
+ * Kickstart image index of ROM banks.
+ */
+
+#ifndef _ROMINDEX_H
+#define _ROMINDEX_H
+
+#include "smash_cmd.h"
+
+void romindex_init(void);
+void romindex_poll(void);
+void romindex_invalidate(uint32_t addr, uint32_t len);
+void romindex_invalidate_bank(uint bank);
+void romindex_reply(uint bank, ks_rom_index_t *reply, uint swap);
+void romindex_ident(uint bank, ks_bank_ident_t *kbi);
+void romindex_show(int bank);
+
+#endif /* _ROMINDEX_H */
@@ -29,12 +29,14 @@
 #define KS_CMD_FLASH_ID      0x12  // Generate flash ID sequence
 #define KS_CMD_FLASH_ERASE   0x13  // Generate flash erase sequence
 #define KS_CMD_FLASH_WRITE   0x14  // Generate flash write sequence
-#define KS_CMD_FLASH_MWRITE  0x15  // Flash write multiple (not implemented)
+#define KS_CMD_FLASH_MWRITE  0x15  // Generate flash write buffer sequence
+#define KS_CMD_FLASH_GEOMETRY 0x16 // Get flash erase/program geometry (CFI)
 #define KS_CMD_BANK_INFO     0x20  // Get ROM bank information structure
 #define KS_CMD_BANK_SET      0x21  // Set bank (options in high bits)
 #define KS_CMD_BANK_MERGE    0x22  // Merge or unmerge banks
 #define KS_CMD_BANK_NAME     0x23  // Set a bank name
 #define KS_CMD_BANK_LRESET   0x24  // Set bank longreset sequence
+#define KS_CMD_BANK_SNAPSHOT 0x25  // Get ID, bank info, NV, and bank images
 #define KS_CMD_MSG_STATE     0x30  // Application state (for remote message)
 #define KS_CMD_MSG_INFO      0x31  // Query message queue sizes
 #define KS_CMD_MSG_SEND      0x32  // Send a remote message
@@ -59,6 +61,10 @@
 #define KS_SET_NV          0x0200  // Set non-volatile bytes
 
 #define KS_GET_NV          0x0200  // Get non-volatile bytes
+#define KS_GET_WEAR        0x0400  // Get flash sector wear counters
+#define KS_GET_TRIGGER     0x0800  // Get triggered bus capture
+#define KS_GET_PROFILE     0x1000  // Get ROM fetch profile (USB only)
+#define KS_GET_ROMINDEX    0x2000  // Get Kickstart index entry of a bank
 
 #define KS_BANK_SETCURRENT 0x0100  // Set current ROM bank (immediate change)
 #define KS_BANK_SETRESET   0x0200  // Set ROM bank in effect at next reset
@@ -80,6 +86,8 @@
 
 #define KS_HDR_AND_CRC_LEN (8 + 2 + 2 + 4)  // Magic+Len+Cmd+CRC = 16 bytes
 
+#define KS_MWRITE_MAX_WORDS 16  // Maximum values for KS_CMD_FLASH_MWRITE
+
 /* Application state bits */
 #define MSG_STATE_SERVICE_UP    0x0001  // Message service running
 #define MSG_STATE_HAVE_LOOPBACK 0x0002  // Loopback service available
@@ -191,7 +199,9 @@
  *        The final address should be the address within the flash sector
  *        which is to be erased. It is necessary for calling code to first
  *        select the appropriate flash bank (KS_CMD_BANK_SET) on which to
- *        operate.
+ *        operate. An optional 32-bit argument specifies the word address
+ *        (same units as the returned addresses) of the sector, which
+ *        Kicksmash uses to maintain sector wear counters (KS_GET_WEAR).
  *       *This command requires participation by code running under AmigaOS
  *        to generate the correct bus addresses to sequence the flash command.
  *   KS_CMD_FLASH_WRITE
@@ -203,13 +213,49 @@
  *       *This command requires participation by code running under AmigaOS
  *        to generate the correct bus addresses to sequence the flash command.
  *   KS_CMD_FLASH_MWRITE
- *        This command will set up a multiple data write sequence for the
- *        flash. It is not currently implemented.
+ *        Program a run of 32-bit or 16-bit values using the flash write
+ *        buffer. The argument is the 32-bit word address (same units as
+ *        the addresses returned by other flash commands) of the first
+ *        value, followed by 2 to KS_MWRITE_MAX_WORDS data values. The
+ *        reply data are the complete sequence of addresses which must be
+ *        generated, including data addresses. The caller should then poll
+ *        the last data address for completion. KS_STATUS_BADARG is
+ *        returned if the values cross a write buffer page of the flash
+ *        part, or if the flash parts do not report a write buffer (see
+ *        KS_CMD_FLASH_GEOMETRY).
+ *       *This command requires participation by code running under AmigaOS
+ *        to generate the correct bus addresses to sequence the flash command.
+ *   KS_CMD_FLASH_GEOMETRY
+ *        Report the flash geometry (flash_geometry_t) which Kicksmash
+ *        has cached from the CFI query table of the installed flash parts.
+ *        This includes the erase block regions, write buffer size, and
+ *        typical and maximum program and erase times. Multi-byte values
+ *        are in big endian format. If fg_valid is 0, then the flash parts
+ *        have not yet been queried (or do not support CFI) and the caller
+ *        should fall back to its own knowledge of the flash part. The
+ *        geometry is refreshed by Kicksmash whenever it accesses the flash
+ *        with the Amiga in reset (for example, "prom cfi" or an erase).
  *   KS_CMD_GET
- *        Get Kicksmash value. The following option must be specified with
+ *        Get Kicksmash value. One of the following options must be
+ *        specified with this command:
  *            KS_GET_NV - Get non-volatile byte(s). The following byte
  *                        specifies the starting byte number. The next byte
  *                        specifies the number of bytes to retrieve.
+ *            KS_GET_WEAR - Get flash sector wear counters (flash_wear_t).
+ *                        Values are big endian when requested by the Amiga
+ *                        and host native when requested over USB.
+ *            KS_GET_TRIGGER - Get the triggered bus capture
+ *                        (ks_trig_capture_t). Values are big endian when
+ *                        requested by the Amiga and host native when
+ *                        requested over USB.
+ *            KS_GET_PROFILE - Get the ROM fetch profile histogram
+ *                        (ks_profile_t) in host native format. This is
+ *                        only available over USB.
+ *            KS_GET_ROMINDEX - Get the Kickstart index entry
+ *                        (ks_rom_index_t) of a ROM bank. The following
+ *                        byte specifies the bank number. Values are big
+ *                        endian when requested by the Amiga and host
+ *                        native when requested over USB.
  *   KS_CMD_SET
  *        Set Kicksmash value. The following option must be specified with
  *        this command:
@@ -259,6 +305,17 @@
  *        This command is used to specify the long reset sequence. Up to
  *        8 banks may be specified in the sequence, and the command length
  *        is always 8 bytes. Unused bank numbers must be set to 0xff values.
+ *   KS_CMD_BANK_SNAPSHOT
+ *        Everything the ROM switcher needs at startup is returned in a
+ *        single reply, having structure ks_snapshot_t. This is the
+ *        KS_CMD_ID reply, the KS_CMD_BANK_INFO reply, all NV bytes, and
+ *        the Kickstart version of each bank (from the Kickstart index,
+ *        see KS_GET_ROMINDEX). kbi_state (KIX_STATE_*) tells whether
+ *        the bank holds a Kickstart image, is erased, holds something
+ *        else, or has not yet been indexed (KIX_STATE_STALE).
+ *        kbi_version is 0 unless the state is KIX_STATE_KICKSTART.
+ *        Multi-byte values are big endian, whether requested by the
+ *        Amiga or USB.
  *   KS_CMD_MSG_STATE
  *        Get application state information which is shared between Amiga
  *        and USB. Each is a 16-bit value:
@@ -343,6 +400,87 @@ typedef struct {
     uint8_t  si_unused[24];              // Unused space
 } smash_id_t;
 
+typedef struct {
+    uint16_t kbi_version;                // Kickstart version (0=unknown)
+    uint16_t kbi_revision;               // Kickstart revision
+    char     kbi_name[11];               // Release name ("3.1", "3.2", ...)
+    uint8_t  kbi_state;                  // Index state (KIX_STATE_*)
+} ks_bank_ident_t;
+
+typedef struct {
+    smash_id_t      kss_id;              // As reported by KS_CMD_ID
+    bank_info_t     kss_bi;              // As reported by KS_CMD_BANK_INFO
+    uint8_t         kss_nv[32];          // All non-volatile bytes
+    ks_bank_ident_t kss_ident[ROM_BANKS]; // Kickstart image in each bank
+} ks_snapshot_t;
+
+/*
+ * Kickstart index entry of a ROM bank, built by Kicksmash in the
+ * background while the Amiga is in reset (the flash can not otherwise
+ * be read by Kicksmash). The index is kept in STM32 flash, so it
+ * survives power cycles. An entry becomes KIX_STATE_STALE when its bank
+ * is erased or programmed, and is rebuilt at the next Amiga reset.
+ * kix_names holds the names of the resident modules (ROMTags) found in
+ * the image, each followed by a NIL.
+ */
+#define KIX_STATE_STALE     0      // Not yet indexed (or bank changed)
+#define KIX_STATE_EMPTY     1      // Bank is erased
+#define KIX_STATE_UNKNOWN   2      // Bank does not hold a Kickstart image
+#define KIX_STATE_KICKSTART 3      // Bank holds a Kickstart image
+
+#define KIX_FLAG_CHECKSUM   0x01   // Kickstart checksum is valid
+#define KIX_FLAG_TRUNCATED  0x02   // Not all module names fit in kix_names
+
+#define KIX_NAMES_LEN       196
+
+typedef struct {
+    uint8_t  kix_state;                  // KIX_STATE_*
+    uint8_t  kix_flags;                  // KIX_FLAG_*
+    uint16_t kix_version;                // Kickstart version
+    uint16_t kix_revision;               // Kickstart revision
+    uint16_t kix_modules;                // Resident modules found
+    uint32_t kix_size;                   // Kickstart image size in bytes
+    uint32_t kix_checksum;               // Checksum stored in the image
+    uint32_t kix_fingerprint;            // CRC of bank start and end
+    char     kix_release[8];             // Release name ("3.1", "3.2", ...)
+    char     kix_id[32];                 // exec.library ID string
+    char     kix_names[KIX_NAMES_LEN];   // Resident module names
+} ks_rom_index_t;
+
+#define FG_MAX_REGIONS 4
+typedef struct {
+    uint16_t er_blocks;                  // Number of blocks in region
+    uint16_t er_size;                    // Block size in 256-byte units
+} flash_erase_region_t;
+
+typedef struct {
+    uint32_t fg_chipid;                  // Device 1 vendor and device code
+    uint8_t  fg_valid;                   // 1=CFI data present
+    uint8_t  fg_regions;                 // Count of valid erase regions
+    uint8_t  fg_size_shift;              // Device size is 2^n bytes
+    uint8_t  fg_wbuf_shift;              // Write buffer is 2^n bytes (0=none)
+    uint16_t fg_word_prog_usec;          // Typical word program time
+    uint16_t fg_word_prog_max_usec;      // Maximum word program time
+    uint16_t fg_buf_prog_usec;           // Typical buffer program time
+    uint16_t fg_buf_prog_max_usec;       // Maximum buffer program time
+    uint16_t fg_block_erase_msec;        // Typical block erase time
+    uint16_t fg_block_erase_max_msec;    // Maximum block erase time
+    uint16_t fg_chip_erase_msec;         // Typical chip erase time
+    uint16_t fg_chip_erase_max_msec;     // Maximum chip erase time
+    flash_erase_region_t fg_region[FG_MAX_REGIONS]; // From lowest address
+} flash_geometry_t;
+
+/*
+ * Flash wear is tracked per 32K-word sector of the flash device (128KB in
+ * 32-bit mode). Each ROM bank spans FW_SECTORS / ROM_BANKS sectors.
+ */
+#define FW_SECTOR_SHIFT 15
+#define FW_SECTORS      32
+typedef struct {
+    uint16_t fw_erase_count[FW_SECTORS]; // Erases of sector (saturates)
+    uint32_t fw_erase_time[FW_SECTORS];  // Amiga time (sec) of last erase
+} flash_wear_t;
+
 typedef struct {
     uint16_t smi_atou_inuse;             // Amiga -> USB buffer bytes in use
     uint16_t smi_atou_avail;             // Amiga -> USB buffer bytes free
@@ -359,4 +497,75 @@ typedef struct {
     uint16_t km_tag;       // Message tag or sequence number
 } km_msg_hdr_t;
 
+/*
+ * Binary bus snoop stream, sent from Kicksmash to the USB host by the
+ * "snoop <mode> bin" command. Each frame is this header followed by
+ * ksf_count 16-bit address words, ksf_count 16-bit data words (both raw
+ * from the capture DMA rings), and then a 32-bit CRC over the header and
+ * payload. In address capture mode, A16-A19 are in bits 4-7 of the data
+ * word. All values are little-endian. A snoop trace file written by
+ * hostsmash is the sequence of frames exactly as received.
+ */
+#define KS_SNOOP_MAGIC         0x4e53534b  // "KSSN"
+#define KS_SNOOP_MAX           256         // Maximum entries in one frame
+#define KS_SNOOP_FLAG_OVERRUN  0x01        // Capture data lost before frame
+#define KS_SNOOP_FLAG_END      0x02        // Last frame of the capture
+
+typedef struct {
+    uint32_t ksf_magic;     // KS_SNOOP_MAGIC
+    uint16_t ksf_seq;       // Frame sequence number
+    uint16_t ksf_count;     // Number of entries in frame
+    uint8_t  ksf_mode;      // Capture mode (1=addr, 2=data lo, 3=data hi)
+    uint8_t  ksf_flags;     // KS_SNOOP_FLAG_*
+    uint16_t ksf_unused;    // Reserved (0)
+    uint32_t ksf_overruns;  // Capture ring overruns since capture start
+} ks_snoop_frame_t;
+
+/*
+ * Triggered bus capture, armed with the Kicksmash "snoop trig" command and
+ * retrieved with KS_CMD_GET | KS_GET_TRIGGER. Once the trigger condition
+ * is seen, the capture holds the pre-trigger accesses, the access which
+ * completed the trigger (at index ktc_trigger), and the post-trigger
+ * accesses. The capture is then frozen until the trigger is re-armed.
+ * Address and data words are as in ks_snoop_frame_t.
+ */
+#define KS_TRIG_MAX            256         // Maximum entries in a capture
+#define KS_TRIG_STATE_IDLE     0           // No trigger armed
+#define KS_TRIG_STATE_ARMED    1           // Waiting for trigger condition
+#define KS_TRIG_STATE_POST     2           // Capturing post-trigger accesses
+#define KS_TRIG_STATE_DONE     3           // Capture complete (frozen)
+
+typedef struct {
+    uint8_t  ktc_state;               // KS_TRIG_STATE_*
+    uint8_t  ktc_mode;                // Capture mode (1=addr, 2=data lo, ...)
+    uint16_t ktc_count;               // Number of valid entries
+    uint16_t ktc_trigger;             // Entry index of the trigger access
+    uint16_t ktc_unused;              // Reserved (0)
+    uint32_t ktc_when;                // Kicksmash uptime (msec) of trigger
+    uint16_t ktc_addr[KS_TRIG_MAX];   // Captured A0-A15
+    uint16_t ktc_data[KS_TRIG_MAX];   // Captured data or A16-A19
+} ks_trig_capture_t;
+
+/*
+ * ROM fetch profile, started with the Kicksmash "snoop prof" command and
+ * retrieved over USB with KS_CMD_GET | KS_GET_PROFILE. Every ROM access
+ * seen by the capture DMA is counted in the bin covering its ROM byte
+ * offset. Bin n covers offsets kp_base + (n << kp_bin_shift) through
+ * kp_base + ((n + 1) << kp_bin_shift) - 1. Accesses outside of all bins
+ * are counted in kp_other. kp_overruns counts the times the profiler
+ * fell a full capture ring behind and skipped the lost accesses.
+ */
+#define KS_PROF_BINS           2048        // Number of profile bins
+
+typedef struct {
+    uint8_t  kp_active;               // Profiling is running
+    uint8_t  kp_bin_shift;            // Bin size is (1 << kp_bin_shift) bytes
+    uint8_t  kp_word_shift;           // ROM word to byte address shift
+    uint8_t  kp_mode;                 // Capture mode (1=addr, 2=data lo, ...)
+    uint32_t kp_base;                 // ROM byte offset of first bin
+    uint32_t kp_other;                // Accesses outside of binned range
+    uint32_t kp_overruns;             // Capture ring laps (accesses lost)
+    uint32_t kp_count[KS_PROF_BINS];  // Accesses per bin
+} ks_profile_t;
+
 #endif /* _SMASH_CMD_H */
@@ -182,6 +182,7 @@ fill_rect_blit(uint fgpen, uint x1, uint y1, uint x2, uint y2, uint8_t xor,
 void
 fill_rect(uint fgpen, uint x1, uint y1, uint x2, uint y2)
 {
+    screen_damage(x1, y1, x2, y2);
     fill_rect_cpu(fgpen, x1, y1, x2, y2);
 //  fill_rect_blit(fgpen, x1, y1, x2, y2, FALSE, 1);
 }
@@ -267,6 +268,7 @@ void
 gray_rect(uint fgpen, uint x1, uint y1, uint x2, uint y2)
 {
     // XXX: gray_rect_cpu() can't handle the case where x2 - x1 < 16
+    screen_damage(x1, y1, x2, y2);
     gray_rect_cpu(fgpen, x1, y1, x2, y2);
 }
 
@@ -606,6 +608,18 @@ draw_line(uint fgpen, int x1, int y1, int x2, int y2)
     UBYTE omit_first_pixel = FALSE; // Is this ever desirable?
     UWORD line_pattern = 0xffff;    // maybe also 0xcccc
 
+    if (x1 < x2) {
+        if (y1 < y2)
+            screen_damage(x1, y1, x2, y2);
+        else
+            screen_damage(x1, y2, x2, y1);
+    } else {
+        if (y1 < y2)
+            screen_damage(x2, y1, x1, y2);
+        else
+            screen_damage(x2, y2, x1, y1);
+    }
+
     /*
      * Perform the same blitter set-bits operation on every plane which is
      * part of the current draw color. Planes which are not part of the
@@ -948,6 +962,8 @@ fill_polygon_cpu(uint fgpen, uint count, int16_t *vect)
 
     poly_bounding_box bounding_box = { 0, 0, 0, 0 };
     int top_i = poly_get_bounding_box(vect, count, &bounding_box);
+    screen_damage(bounding_box.min_x, bounding_box.min_y,
+                  bounding_box.max_x, bounding_box.max_y);
 
     // init memory to store x-positions of each line
     // inclusive of top and bottom
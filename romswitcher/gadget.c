@@ -29,6 +29,7 @@
 #include "main.h"
 
 static void GT_PutIMsg(IntuiMessage *imsg);
+static void gadget_invalidate(Gadget *gad);
 
 static Gadget *mouse_cur_gadget = NULL;
 static Gadget *click_cur_gadget = NULL;
@@ -694,7 +695,7 @@ gadget_update_mx_mouse(Gadget *gad)
 // printf("sh=%u,yo=%u,nsel=%u", sel_height, yoff, newsel);
         if (mx->mx_seldisplay != newsel) {
             mx->mx_seldisplay = newsel;
-            gadget_update_mx(gad);  // update selection
+            gadget_invalidate(gad);  // update selection
         }
     }
 }
@@ -841,6 +842,82 @@ gadget_draw_text(Gadget *gad)
         gadget_draw_bounding_box(gad, BBFT_RIDGE, FALSE);
 }
 
+/*
+ * gadget_invalidate() marks the screen area of a gadget as needing to be
+ * redrawn. The redraw is done by gadget_poll(), so several state changes
+ * to the same or neighboring gadgets within one poll are drawn only once.
+ */
+static void
+gadget_invalidate(Gadget *gad)
+{
+    intuition_invalidate(gad->LeftEdge, gad->TopEdge,
+                         gad->LeftEdge + gad->Width - 1,
+                         gad->TopEdge + gad->Height - 1);
+}
+
+/*
+ * gadget_button_select() sets the pressed state of a button gadget,
+ * invalidating its imagery only if the state changed.
+ */
+static void
+gadget_button_select(Gadget *gad, uint selected)
+{
+    uint16_t flags = gad->Flags & ~GFLG_SELECTED;
+
+    if (selected)
+        flags |= GFLG_SELECTED;
+    if (gad->Flags != flags) {
+        gad->Flags = flags;
+        gadget_invalidate(gad);
+    }
+}
+
+/*
+ * gadget_redraw_dirty() passes the pending dirty screen regions to the
+ * application redraw hook, then redraws the state imagery of all gadgets
+ * which intersect them.
+ */
+static void
+gadget_redraw_dirty(void)
+{
+    Rectangle   rect[DIRTY_RECT_MAX];
+    uint        count = intuition_dirty_take(rect);
+    GadContext *gc;
+    Gadget     *gad;
+    uint        cur;
+
+    if (count == 0)
+        return;
+
+    if (intuition_redraw_hook != NULL)
+        intuition_redraw_hook(rect, count);
+
+    for (gc = gad_context_head; gc != NULL; gc = gc->gc_next) {
+        for (gad = gc->gc_Gadget.NextGadget; gad != NULL;
+             gad = gad->NextGadget) {
+            for (cur = 0; cur < count; cur++) {
+                if ((gad->LeftEdge <= rect[cur].MaxX) &&
+                    (gad->LeftEdge + gad->Width - 1 >= rect[cur].MinX) &&
+                    (gad->TopEdge <= rect[cur].MaxY) &&
+                    (gad->TopEdge + gad->Height - 1 >= rect[cur].MinY)) {
+                    break;
+                }
+            }
+            if (cur == count)
+                continue;  // Gadget is not in a dirty region
+
+            switch (gad->GadgetType) {
+                case BUTTON_KIND:
+                    gadget_draw_button(gad, gad->Flags & GFLG_SELECTED);
+                    break;
+                case MX_KIND:
+                    gadget_update_mx(gad);
+                    break;
+            }
+        }
+    }
+}
+
 static void
 gadget_notify(Gadget *gad, uint class, uint code, uint qual)
 {
@@ -924,7 +1001,7 @@ RefreshGList(Gadget *gadgets, Window *window, Requester *requester, uint numGad)
             case GENERIC_KIND:
                 break;
             case BUTTON_KIND:
-                gadget_draw_button(gad, 0);
+                gadget_draw_button(gad, gad->Flags & GFLG_SELECTED);
                 break;
             case CHECKBOX_KIND:
                 break;
@@ -1721,6 +1798,7 @@ gadget_poll(void)
             gadget_handle_keyboard_input(ch);
         }
     }
+    gadget_redraw_dirty();
 }
 
 #define HOVER_AWAY    0  // Hover away from gadget while mouse button held
@@ -1749,13 +1827,13 @@ gadget_handle_click_hover(Gadget *gad, Gadget *oldgad, uint hover_type)
         case HOVER_AWAY:  // Hovered away from gadget while mouse button held
             switch (gad->GadgetType) {
                 case BUTTON_KIND:
-                    gadget_draw_button(gad, 0);
+                    gadget_button_select(gad, 0);
                     break;
                 case MX_KIND: {
                     MxInfo *mx = gad->SpecialInfo;
                     if (mx != NULL)
                         mx->mx_seldisplay = mx->mx_selected;
-                    gadget_update_mx(gad);  // update selection
+                    gadget_invalidate(gad);  // update selection
                     break;
                 }
             }
@@ -1763,7 +1841,7 @@ gadget_handle_click_hover(Gadget *gad, Gadget *oldgad, uint hover_type)
         case HOVER_ONTO:  // Hover back onto gadget while mouse button held
             switch (gad->GadgetType) {
                 case BUTTON_KIND:
-                    gadget_draw_button(gad, 1);
+                    gadget_button_select(gad, 1);
                     break;
                 case STRING_KIND:
                 case INTEGER_KIND:
@@ -1785,7 +1863,7 @@ gadget_handle_click_hover(Gadget *gad, Gadget *oldgad, uint hover_type)
         case HOVER_CLICK:  // Mouse button clicked on gadget
             switch (gad->GadgetType) {
                 case BUTTON_KIND:
-                    gadget_draw_button(gad, 1);
+                    gadget_button_select(gad, 1);
                     break;
                 case MX_KIND:
                     gadget_update_mx_mouse(gad);
@@ -1805,7 +1883,7 @@ gadget_handle_click_hover(Gadget *gad, Gadget *oldgad, uint hover_type)
         case HOVER_RELEASE:  // Mouse button released on gadget prev. clicked
             switch (gad->GadgetType) {
                 case BUTTON_KIND:
-                    gadget_draw_button(gad, 0);
+                    gadget_button_select(gad, 0);
                     break;
                 case STRING_KIND:
                 case INTEGER_KIND:
@@ -2053,7 +2131,7 @@ GT_SetGadgetAttrs(Gadget *gad, Window *win, Requester *req, ...)
                 gadget_update_string(gad, GADGET_STRING_UPDATE_ALL);
                 break;
             case BUTTON_KIND:
-                gadget_draw_button(gad, 0);
+                gadget_draw_button(gad, gad->Flags & GFLG_SELECTED);
                 break;
         }
     }
@@ -15,6 +15,7 @@
  */
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include "amiga_chipset.h"
 #include "util.h"
 #include "printf.h"
@@ -39,6 +40,128 @@ init_screen_struct(void)
 
 static struct GfxBase local_gfxbase;
 
+static Rectangle dirty_rect[DIRTY_RECT_MAX];
+static uint      dirty_rect_count;
+
+/*
+ * intuition_redraw_hook, if set, is called with the pending dirty regions
+ * before gadget imagery is redrawn, so that the application can redraw
+ * its own non-gadget content in those regions.
+ */
+void (*intuition_redraw_hook)(const Rectangle *rects, uint count);
+
+/*
+ * rect_touches
+ * ------------
+ * Return non-zero if two rectangles overlap or share an edge.
+ */
+static uint
+rect_touches(const Rectangle *a, const Rectangle *b)
+{
+    return ((a->MinX <= b->MaxX + 1) && (b->MinX <= a->MaxX + 1) &&
+            (a->MinY <= b->MaxY + 1) && (b->MinY <= a->MaxY + 1));
+}
+
+/*
+ * rect_union
+ * ----------
+ * Grow rectangle a to also cover rectangle b.
+ */
+static void
+rect_union(Rectangle *a, const Rectangle *b)
+{
+    if (a->MinX > b->MinX)
+        a->MinX = b->MinX;
+    if (a->MinY > b->MinY)
+        a->MinY = b->MinY;
+    if (a->MaxX < b->MaxX)
+        a->MaxX = b->MaxX;
+    if (a->MaxY < b->MaxY)
+        a->MaxY = b->MaxY;
+}
+
+static uint
+rect_area(const Rectangle *r)
+{
+    return ((r->MaxX - r->MinX + 1) * (r->MaxY - r->MinY + 1));
+}
+
+/*
+ * intuition_invalidate
+ * --------------------
+ * Mark a screen region (inclusive coordinates) as needing to be redrawn.
+ * A region which overlaps or touches one already pending is merged with
+ * it, and the merge is repeated until no pending regions touch. If the
+ * table is full, the new region is merged with whichever pending region
+ * grows the least by absorbing it.
+ */
+void
+intuition_invalidate(int x1, int y1, int x2, int y2)
+{
+    Rectangle rect;
+    uint      cur;
+
+    if (x1 < 0)
+        x1 = 0;
+    if (y1 < 0)
+        y1 = 0;
+    if (x2 > SCREEN_WIDTH - 1)
+        x2 = SCREEN_WIDTH - 1;
+    if (y2 > SCREEN_HEIGHT - 1)
+        y2 = SCREEN_HEIGHT - 1;
+    if ((x1 > x2) || (y1 > y2))
+        return;  // Entirely off screen
+
+    rect.MinX = x1;
+    rect.MinY = y1;
+    rect.MaxX = x2;
+    rect.MaxY = y2;
+
+merge_again:
+    for (cur = 0; cur < dirty_rect_count; cur++) {
+        if (rect_touches(&rect, &dirty_rect[cur])) {
+            rect_union(&rect, &dirty_rect[cur]);
+            dirty_rect[cur] = dirty_rect[--dirty_rect_count];
+            goto merge_again;
+        }
+    }
+
+    if (dirty_rect_count == DIRTY_RECT_MAX) {
+        uint best      = 0;
+        uint best_grow = 0xffffffff;
+        for (cur = 0; cur < dirty_rect_count; cur++) {
+            Rectangle merged = dirty_rect[cur];
+            uint      grow;
+            rect_union(&merged, &rect);
+            grow = rect_area(&merged) - rect_area(&dirty_rect[cur]);
+            if (best_grow > grow) {
+                best_grow = grow;
+                best = cur;
+            }
+        }
+        rect_union(&rect, &dirty_rect[best]);
+        dirty_rect[best] = dirty_rect[--dirty_rect_count];
+        goto merge_again;
+    }
+    dirty_rect[dirty_rect_count++] = rect;
+}
+
+/*
+ * intuition_dirty_take
+ * --------------------
+ * Copy out the pending dirty regions (at most DIRTY_RECT_MAX) and clear
+ * the pending list. Returns the number of regions copied.
+ */
+uint
+intuition_dirty_take(Rectangle *rects)
+{
+    uint count = dirty_rect_count;
+
+    memcpy(rects, dirty_rect, count * sizeof (*rects));
+    dirty_rect_count = 0;
+    return (count);
+}
+
 void
 init_intuition(void)
 {
@@ -57,6 +180,7 @@ OpenScreenTagList(struct NewScreen *ns, struct TagItem *taglist)
     (void) ns;
     (void) taglist;
     init_screen_struct();
+    screen_dbuf_enable(1);
     return (&sscreen);
 }
 
@@ -66,6 +190,7 @@ OpenScreenTags(struct NewScreen *ns, ULONG taglist, ...)
     (void) ns;
     (void) taglist;
     init_screen_struct();
+    screen_dbuf_enable(1);
     return (&sscreen);
 }
 
@@ -73,6 +198,7 @@ int
 CloseScreen(struct Screen *screen)
 {
     (void) screen;
+    screen_dbuf_enable(0);
     return (0);
 }
 
@@ -528,6 +528,8 @@ struct GfxBase {
     uint16_t  DisplayFlags;           // NTSC PAL GENLOC etc
 };
 
+#define DIRTY_RECT_MAX 8  // Pending screen regions before forced merge
+
 extern Screen sscreen;
 // extern struct Window window;
 
@@ -541,5 +543,9 @@ void   *GetVisualInfoA(struct Screen *screen, const struct TagItem *taglist);
 void    FreeVisualInfo(void *vi);
 void    ColdReboot(void);
 void    init_intuition(void);
+void    intuition_invalidate(int x1, int y1, int x2, int y2);
+uint    intuition_dirty_take(Rectangle *rects);
+
+extern void (*intuition_redraw_hook)(const Rectangle *rects, uint count);
 
 #endif /* _INTUITION_H */
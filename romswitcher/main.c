@@ -161,6 +161,7 @@ reset_hi(void)
 int
 main_poll()
 {
+    screen_present();  // Show anything drawn since the last poll
     if (cmdline())
         return (1);
     mouse_poll();     // handle mouse buttons
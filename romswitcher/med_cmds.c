@@ -24,6 +24,10 @@
 #include "printf.h"
 #include "serial.h"
 #include "util.h"
+#ifdef EMBEDDED_CMD
+#include "amiga_chipset.h"
+#include "screen.h"
+#endif
 
 #ifdef AMIGA
 #define IS_BIG_ENDIAN
@@ -148,18 +152,20 @@ const char cmd_patt_patterns[] =
 "value\n";
 
 const char cmd_test_help[] =
-"test[bwlqoh] <addr> <len> <mode> [<p>]\n"
+"test[bwlqohc] <addr> <len> <mode> [<p>]\n"
 "   b = 1 byte\n"
 "   w = word (2 bytes)\n"
 "   l = long (4 bytes)\n"
 "   q = quad (8 bytes)\n"
 "   o = oct (16 bytes)\n"
 "   h = hex (32 bytes)\n"
+"   c = use CPU only (chip RAM is otherwise filled and compared by blitter)\n"
 "   <len> is the length to test in bytes\n"
-"   <mode> may be one, zero, rand, walk0, walk1, read, or <value>\n"
+"   <mode> may be one, zero, rand, walk0, walk1, march, read, or <value>\n"
+"          march runs the March C- test and reports throughput\n"
 "   <p> is the number of test passes (default: 1)";
 const char cmd_test_patterns[] =
-    "<mode> may be one, zero, rand, walk0, walk1, read, or <value>\n";
+    "<mode> may be one, zero, rand, walk0, walk1, march, read, or <value>\n";
 
 const char cmd_time_help[] =
 "time cmd <cmd> - measure command execution time\n"
@@ -1503,6 +1509,336 @@ cmd_delay(int argc, char * const *argv)
     return (RC_SUCCESS);
 }
 
+/*
+ * memtest_miscompare
+ * ------------------
+ * Report a test miscompare, limiting the number reported.
+ */
+static void
+memtest_miscompare(uint64_t space, uint64_t addr, uint width,
+                   const uint8_t *wbuf, const uint8_t *rbuf,
+                   uint *mismatch_count)
+{
+    uint8_t rrbuf[MAX_TRANSFER];
+    uint    temp;
+    rc_t    rc;
+
+    if (*mismatch_count == 5) {
+        printf("...\n");
+    } else if (*mismatch_count < 5) {
+        printf("Miscompare at ");
+        print_addr(space, addr);
+        printf(": W=");
+        for (temp = 0; temp < width; temp++)
+            printf("%02x", wbuf[width - temp - 1]);
+        printf(" R=");
+        for (temp = 0; temp < width; temp++)
+            printf("%02x", rbuf[width - temp - 1]);
+        rc = data_read(space, addr, width, rrbuf);
+        if ((rc == RC_SUCCESS) && (memcmp(rbuf, rrbuf, width) != 0)) {
+            printf(" RR=");
+            for (temp = 0; temp < width; temp++)
+                printf("%02x", rrbuf[width - temp - 1]);
+        }
+        printf("\n");
+    }
+    (*mismatch_count)++;
+}
+
+/*
+ * memtest_scan
+ * ------------
+ * Compare a memory area against a repeating pattern using the CPU,
+ * reporting each miscompare.
+ */
+static rc_t
+memtest_scan(uint64_t space, uint64_t addr, uint len, uint width,
+             const uint8_t *buf, uint *mismatch_count)
+{
+    uint8_t rbuf[MAX_TRANSFER];
+    uint    offset;
+    rc_t    rc;
+
+    for (offset = 0; offset < len; offset += width) {
+        rc = data_read(space, addr + offset, width, rbuf);
+        if (rc != RC_SUCCESS) {
+            printf("Error reading %d bytes at ", width);
+            print_addr(space, addr + offset);
+            printf("\n");
+            return (rc);
+        }
+        if (memcmp(buf, rbuf, width) != 0)
+            memtest_miscompare(space, addr + offset, width, buf, rbuf,
+                               mismatch_count);
+        if (input_break_pending()) {
+            printf("^C\n");
+            return (RC_USR_ABORT);
+        }
+    }
+    return (RC_SUCCESS);
+}
+
+#ifdef EMBEDDED_CMD
+#define BLIT_MEM_LIMIT 0x200000  // Blitter reaches chip RAM below 2 MB
+#define BLIT_MAX_WORDS 64        // Maximum blit width in words
+#define BLIT_MAX_ROWS  1024      // Maximum blit height in rows
+
+/*
+ * blit_mem_ok
+ * -----------
+ * Return TRUE if the specified memory area can be handled by the blitter.
+ */
+static bool_t
+blit_mem_ok(uint64_t space, uint64_t addr, uint len)
+{
+    return ((space == SPACE_MEMORY) && ((addr & 1) == 0) &&
+            ((len & 1) == 0) && (len != 0) && (addr + len <= BLIT_MEM_LIMIT));
+}
+
+/*
+ * blit_mem_run
+ * ------------
+ * Run the blitter operation which has been set up in BLTCON0 and
+ * BLTCON1 over a linear memory area, split into pieces which fit the
+ * maximum blit size. The area is used as the A source if use_a is set
+ * and as the D destination if use_d is set. Pieces are processed from
+ * the end of the area when blitting in descending mode. Returns TRUE if
+ * any result word of the operation was not zero.
+ */
+static bool_t
+blit_mem_run(uint32_t addr, uint len, bool_t use_a, bool_t use_d, bool_t desc)
+{
+    bool_t nonzero = FALSE;
+
+    *BLTAFWM = 0xffff;
+    *BLTALWM = 0xffff;
+    *BLTAMOD = 0;
+    *BLTDMOD = 0;
+    while (len > 0) {
+        uint     words = len / 2;
+        uint     width = BLIT_MAX_WORDS;
+        uint     rows;
+        uint32_t start;
+
+        if (words < BLIT_MAX_WORDS) {
+            width = words;
+            rows  = 1;
+        } else {
+            rows = words / BLIT_MAX_WORDS;
+            if (rows > BLIT_MAX_ROWS)
+                rows = BLIT_MAX_ROWS;
+        }
+        start = desc ? (addr + len - 2) : addr;
+        if (use_a)
+            *BLTAPT = start;
+        if (use_d)
+            *BLTDPT = start;
+        *BLTSIZE = ((rows % BLIT_MAX_ROWS) << 6) | (width % BLIT_MAX_WORDS);
+        WaitBlit();
+        if ((*DMACONR & DMACON_BZERO) == 0)
+            nonzero = TRUE;
+
+        len -= width * rows * 2;
+        if (desc == FALSE)
+            addr += width * rows * 2;
+    }
+    return (nonzero);
+}
+
+/*
+ * blit_mem_fill
+ * -------------
+ * Fill a chip memory area with a 16-bit pattern.
+ */
+static void
+blit_mem_fill(uint32_t addr, uint len, uint16_t pattern)
+{
+    WaitBlit();
+    *BLTCON0 = BLTCON0_AREA_USED | 0xf0;  // D = A
+    *BLTCON1 = 0;
+    *BLTADAT = pattern;
+    blit_mem_run(addr, len, FALSE, TRUE, FALSE);
+}
+
+/*
+ * blit_mem_compare
+ * ----------------
+ * Compare a chip memory area against a 16-bit pattern by XOR of the
+ * memory with the pattern, without writing the result. Returns TRUE if
+ * the blitter zero flag shows any difference.
+ */
+static bool_t
+blit_mem_compare(uint32_t addr, uint len, uint16_t pattern)
+{
+    WaitBlit();
+    *BLTCON0 = BLTCON0_AREA_USEA | 0x3c;  // A ^ B (no D)
+    *BLTCON1 = 0;
+    *BLTBDAT = pattern;
+    return (blit_mem_run(addr, len, TRUE, FALSE, FALSE));
+}
+
+/*
+ * blit_mem_complement
+ * -------------------
+ * Read each word of a chip memory area and write back its complement,
+ * in ascending or descending address order.
+ */
+static void
+blit_mem_complement(uint32_t addr, uint len, bool_t desc)
+{
+    WaitBlit();
+    *BLTCON0 = BLTCON0_AREA_USEA | BLTCON0_AREA_USED | 0x0f;  // D = ~A
+    *BLTCON1 = desc ? BLTCON1_AREA_DESC : 0;
+    blit_mem_run(addr, len, TRUE, TRUE, desc);
+}
+
+/*
+ * pattern16
+ * ---------
+ * Return TRUE and the 16-bit pattern if the test pattern repeats every
+ * 16 bits (so it can be blitted).
+ */
+static bool_t
+pattern16(const uint8_t *buf, uint width, uint16_t *pattern)
+{
+    uint pos;
+
+    if (width == 1) {
+        *pattern = buf[0] | (buf[0] << 8);
+        return (TRUE);
+    }
+    for (pos = 2; pos < width; pos++)
+        if (buf[pos] != buf[pos & 1])
+            return (FALSE);
+    *pattern = *(uint16_t *) buf;
+    return (TRUE);
+}
+#endif /* EMBEDDED_CMD */
+
+/*
+ * memtest_march
+ * -------------
+ * March C- memory test:
+ *     up/down(w0) up(r0,w1) up(r1,w0) down(r0,w1) down(r1,w0) up/down(r0)
+ *
+ * Chip RAM is tested by the blitter: each read/write element is a single
+ * in-place complementing blit in the element's address order, followed
+ * by a compare blit which checks (with the zero flag) that every cell
+ * now holds the element's write value. Other memory is tested by the CPU
+ * one cell of <width> bytes at a time. Throughput is reported for the 10
+ * accesses per cell of the algorithm.
+ */
+static rc_t
+memtest_march(uint64_t space, uint64_t addr, uint len, uint width,
+              bool_t use_blit, uint *mismatch_count)
+{
+    static const struct {
+        uint8_t desc;   // Descending address order
+        uint8_t rval;   // Value expected to be read
+    } elements[] = {
+        { 0, 0x00 }, { 0, 0xff }, { 1, 0x00 }, { 1, 0xff },
+    };
+    uint8_t  buf[MAX_TRANSFER];
+    uint8_t  rbuf[MAX_TRANSFER];
+    uint8_t  wbuf[MAX_TRANSFER];
+    uint64_t start = timer_tick_get();
+    uint64_t usec;
+    uint     element;
+    uint     offset;
+    rc_t     rc;
+
+    len -= len % width;
+    if (len == 0)
+        return (RC_SUCCESS);
+
+#ifdef EMBEDDED_CMD
+    if (use_blit) {
+        blit_mem_fill(addr, len, 0x0000);
+        for (element = 0; element < ARRAY_SIZE(elements); element++) {
+            uint8_t wval = ~elements[element].rval;
+            blit_mem_complement(addr, len, elements[element].desc);
+            if (blit_mem_compare(addr, len, wval | (wval << 8))) {
+                memset(buf, wval, width);
+                rc = memtest_scan(space, addr, len, width, buf,
+                                  mismatch_count);
+                if (rc != RC_SUCCESS)
+                    return (rc);
+                blit_mem_fill(addr, len, wval | (wval << 8));
+            }
+            if (input_break_pending()) {
+                printf("^C\n");
+                return (RC_USR_ABORT);
+            }
+        }
+        if (blit_mem_compare(addr, len, 0x0000)) {
+            memset(buf, 0x00, width);
+            rc = memtest_scan(space, addr, len, width, buf, mismatch_count);
+            if (rc != RC_SUCCESS)
+                return (rc);
+        }
+        goto march_done;
+    }
+#else
+    (void) use_blit;
+#endif
+
+    memset(buf, 0x00, width);
+    for (offset = 0; offset < len; offset += width) {
+        rc = data_write(space, addr + offset, width, buf);
+        if (rc != RC_SUCCESS)
+            goto march_write_fail;
+    }
+    for (element = 0; element < ARRAY_SIZE(elements); element++) {
+        uint cell;
+        memset(buf, elements[element].rval, width);
+        memset(wbuf, (uint8_t) ~elements[element].rval, width);
+        for (cell = 0; cell < len / width; cell++) {
+            offset = (elements[element].desc ? (len / width - 1 - cell) :
+                                               cell) * width;
+            rc = data_read(space, addr + offset, width, rbuf);
+            if (rc != RC_SUCCESS)
+                goto march_read_fail;
+            if (memcmp(buf, rbuf, width) != 0)
+                memtest_miscompare(space, addr + offset, width, buf, rbuf,
+                                   mismatch_count);
+            rc = data_write(space, addr + offset, width, wbuf);
+            if (rc != RC_SUCCESS)
+                goto march_write_fail;
+        }
+        if (input_break_pending()) {
+            printf("^C\n");
+            return (RC_USR_ABORT);
+        }
+    }
+    memset(buf, 0x00, width);
+    rc = memtest_scan(space, addr, len, width, buf, mismatch_count);
+    if (rc != RC_SUCCESS)
+        return (rc);
+
+#ifdef EMBEDDED_CMD
+march_done:
+#endif
+    usec = timer_tick_to_usec(timer_tick_get() - start);
+    if (usec == 0)
+        usec = 1;
+    printf("March C- %u bytes (%s): %u ms, %u KB/s\n", len,
+           use_blit ? "blitter" : "CPU", (uint) (usec / 1000),
+           (uint) ((uint64_t) len * 10 * 1000000 / 1024 / usec));
+    return (RC_SUCCESS);
+
+march_read_fail:
+    printf("Error reading %d bytes at ", width);
+    print_addr(space, addr + offset);
+    printf("\n");
+    return (rc);
+
+march_write_fail:
+    printf("Error writing %d bytes at ", width);
+    print_addr(space, addr + offset);
+    printf("\n");
+    return (rc);
+}
+
 rc_t
 cmd_patt(int argc, char * const *argv)
 {
@@ -1617,6 +1953,18 @@ show_patterns:
         pattmode = PATT_VALUE;
     }
 
+#ifdef EMBEDDED_CMD
+    if (((pattmode == PATT_ONE) || (pattmode == PATT_ZERO) ||
+         (pattmode == PATT_VALUE)) && blit_mem_ok(space, addr, len)) {
+        uint16_t pattern;
+        if (pattern16(buf, width, &pattern)) {
+            /* Fixed pattern in chip RAM: fill using the blitter */
+            blit_mem_fill(addr, len, pattern);
+            return (RC_SUCCESS);
+        }
+    }
+#endif
+
     for (offset = 0; offset < len; offset += width) {
         switch (pattmode) {
             case PATT_ADDR: {
@@ -1746,9 +2094,13 @@ cmd_test(int argc, char * const *argv)
     char        other[32];
     uint8_t     buf[MAX_TRANSFER];
     uint8_t     rbuf[MAX_TRANSFER];
-    uint8_t     rrbuf[MAX_TRANSFER];
+#ifdef EMBEDDED_CMD
+    uint16_t    pattern;
+#endif
     uint32_t    srand_seed;
     bool_t      flag_N  = FALSE;  /* Don't print */
+    bool_t      flag_C  = FALSE;  /* CPU only (no blitter) */
+    bool_t      use_blit = FALSE;
     const char *cmd;
     char       *ptr;
     static enum {
@@ -1758,6 +2110,7 @@ cmd_test(int argc, char * const *argv)
         TEST_RAND,
         TEST_WALK0,
         TEST_WALK1,
+        TEST_MARCH,
     } testmode = TEST_VALUE;
     static enum {
         RWMODE_READ,
@@ -1776,6 +2129,10 @@ cmd_test(int argc, char * const *argv)
         return (RC_USER_HELP);
     for (ptr = other; *ptr != '\0'; ptr++) {
         switch (*ptr) {
+            case 'c':
+            case 'C':
+                flag_C = TRUE;
+                break;
             case 'n':
             case 'N':
                 flag_N = TRUE;
@@ -1824,6 +2181,8 @@ show_patterns:
     } else if (strcmp(argv[0], "walk1") == 0) {
         testmode = TEST_WALK1;
         memset(buf, 0x00, width);
+    } else if (strcmp(argv[0], "march") == 0) {
+        testmode = TEST_MARCH;
     } else if (strcmp(argv[0], "zero") == 0) {
         testmode = TEST_ZERO;
         memset(buf, 0x00, width);
@@ -1842,8 +2201,40 @@ show_patterns:
             return (RC_USER_HELP);
         }
     }
+#ifdef EMBEDDED_CMD
+    if ((flag_C == FALSE) && blit_mem_ok(space, addr, len))
+        use_blit = TRUE;
+#else
+    (void) flag_C;
+#endif
 
     for (pass = 0; pass < passes; pass++) {
+        if (testmode == TEST_MARCH) {
+            rc = memtest_march(space, addr, len, width, use_blit,
+                               &mismatch_count);
+            if (rc != RC_SUCCESS)
+                return (rc);
+            continue;
+        }
+#ifdef EMBEDDED_CMD
+        if (use_blit && (rwmode == RWMODE_WRITE) &&
+            ((testmode == TEST_VALUE) || (testmode == TEST_ZERO) ||
+             (testmode == TEST_ONE)) && pattern16(buf, width, &pattern)) {
+            /* Blitter fill, then blitter compare of the whole area */
+            blit_mem_fill(addr, len, pattern);
+            if (blit_mem_compare(addr, len, pattern)) {
+                rc = memtest_scan(space, addr, len & ~1, 2,
+                                  (uint8_t *) &pattern, &mismatch_count);
+                if (rc != RC_SUCCESS)
+                    return (rc);
+            }
+            if (input_break_pending()) {
+                printf("^C\n");
+                return (RC_USR_ABORT);
+            }
+            continue;
+        }
+#endif
         for (offset = 0; offset < len; offset += width) {
             if (rwmode == RWMODE_WRITE) {
                 switch (testmode) {
@@ -1894,28 +2285,8 @@ show_patterns:
                 return (rc);
             }
             if (memcmp(buf, rbuf, width) != 0) {
-                uint temp;
-                if (mismatch_count == 5) {
-                    printf("...\n");
-                } else if (mismatch_count < 5) {
-                    printf("Miscompare at ");
-                    print_addr(space, addr + offset);
-                    printf(": W=");
-                    for (temp = 0; temp < width; temp++)
-                        printf("%02x", buf[width - temp - 1]);
-                    printf(" R=");
-                    for (temp = 0; temp < width; temp++)
-                        printf("%02x", rbuf[width - temp - 1]);
-                    rc = data_read(space, addr + offset, width, rrbuf);
-                    if ((rc == RC_SUCCESS) &&
-                        (memcmp(rbuf, rrbuf, width) != 0)) {
-                        printf(" RR=");
-                        for (temp = 0; temp < width; temp++)
-                            printf("%02x", rrbuf[width - temp - 1]);
-                    }
-                    printf("\n");
-                }
-                mismatch_count++;
+                memtest_miscompare(space, addr + offset, width, buf, rbuf,
+                                   &mismatch_count);
             }
             if (input_break_pending()) {
                 printf("^C\n");
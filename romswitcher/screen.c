@@ -20,6 +20,7 @@
 #include "screen.h"
 #include "serial.h"
 #include "amiga_chipset.h"
+#include "timer.h"
 
 #define SCREEN_COLUMNS 80  // SCREEN_WIDTH / 8
 #define SCREEN_ROWS    26  // SCREEN_HEIGHT / 8
@@ -329,6 +330,285 @@ blit(void)
 }
 #endif
 
+/*
+ * Double-buffered display
+ *
+ * When enabled, a second set of bitplanes is allocated and all drawing
+ * goes to whichever set is not being displayed (the back buffer).
+ * screen_present() makes the back buffer visible by having the VBlank
+ * interrupt load the new bitplane pointers, so the switch never happens
+ * mid-frame. The areas drawn since the previous present are then copied
+ * by the blitter from the new front buffer into the new back buffer,
+ * so both stay identical outside of the frame being drawn.
+ */
+#define DBUF_LINES (BITPLANE_OFFSET / (SCREEN_WIDTH / 8))
+
+uint32_t bitplane_draw_base = BITPLANE_HOME;  // Bitplanes drawn into
+screen_frame_stats_t screen_frame_stats;      // Frame pacing statistics
+
+static volatile uint32_t bitplane_show_base = BITPLANE_HOME;  // Displayed
+static volatile uint32_t dbuf_flip_base;      // Bitplanes to show next
+static volatile uint8_t  dbuf_flip_pending;   // Flip at next vblank
+static volatile uint32_t dbuf_vblanks;        // Vertical blank count
+static uint32_t          dbuf_alloc;          // Second buffer (0 = off)
+static uint32_t          damage_vblank;       // dbuf_vblanks at first damage
+static uint8_t           damage_valid;        // Damage area is not empty
+static int16_t           damage_x1;           // Damage area left
+static int16_t           damage_y1;           // Damage area top
+static int16_t           damage_x2;           // Damage area right
+static int16_t           damage_y2;           // Damage area bottom
+
+/*
+ * screen_copy_area
+ * ----------------
+ * Copy a rectangle of all bitplanes from one buffer to another using the
+ * blitter. The rectangle is widened to whole words. The blit of the last
+ * bitplane may still be in progress on return.
+ */
+static void
+screen_copy_area(uint32_t src, uint32_t dst, uint x1, uint y1, uint x2, uint y2)
+{
+    uint words  = (x2 >> 4) - (x1 >> 4) + 1;
+    uint height = y2 - y1 + 1;
+    uint offset = y1 * SCREEN_WIDTH / 8 + (x1 >> 4) * 2;
+    uint plane;
+
+    WaitBlit();
+    *BLTCON0 = BLTCON0_AREA_USEA | BLTCON0_AREA_USED | 0xf0;  // D = A
+    *BLTCON1 = 0;
+    *BLTAFWM = 0xffff;
+    *BLTALWM = 0xffff;
+    *BLTAMOD = SCREEN_WIDTH / 8 - words * 2;
+    *BLTDMOD = SCREEN_WIDTH / 8 - words * 2;
+    for (plane = 0; plane < SCREEN_BITPLANES; plane++) {
+        if (plane != 0)
+            WaitBlit();
+        *BLTAPT  = src + plane * BITPLANE_OFFSET + offset;
+        *BLTDPT  = dst + plane * BITPLANE_OFFSET + offset;
+        *BLTSIZE = (height << 6) | words;
+    }
+    screen_frame_stats.fs_sync_words += words * height * SCREEN_BITPLANES;
+}
+
+/*
+ * screen_vblank
+ * -------------
+ * Called from the VBlank interrupt to (re)load the bitplane pointers,
+ * switching to the new front buffer if a present is pending.
+ */
+void
+screen_vblank(void)
+{
+    uint32_t base;
+
+    dbuf_vblanks++;
+    if (dbuf_flip_pending) {
+        bitplane_show_base = dbuf_flip_base;
+        dbuf_flip_pending = 0;
+    }
+    base = bitplane_show_base;
+    *BPL1PT = base;                        // Bitplane 0 base address
+    *BPL2PT = base + BITPLANE_OFFSET;      // Bitplane 1 base address
+    *BPL3PT = base + BITPLANE_OFFSET * 2;  // Bitplane 2 base address
+}
+
+/*
+ * screen_flip
+ * -----------
+ * Display the specified bitplanes starting with the next vertical blank,
+ * and wait for that to happen. Returns the time waited in microseconds.
+ */
+static uint
+screen_flip(uint32_t base)
+{
+    uint64_t start   = timer_tick_get();
+    uint64_t timeout = timer_tick_plus_msec(100);
+
+    dbuf_flip_base = base;
+    dbuf_flip_pending = 1;
+    while (dbuf_flip_pending) {
+        if (timer_tick_has_elapsed(timeout)) {
+            /* VBlank interrupt is not running; switch immediately */
+            uint32_t sr = irq_disable();
+            dbuf_flip_pending = 0;
+            bitplane_show_base = base;
+            *BPL1PT = base;
+            *BPL2PT = base + BITPLANE_OFFSET;
+            *BPL3PT = base + BITPLANE_OFFSET * 2;
+            irq_restore(sr);
+            break;
+        }
+    }
+    return (timer_tick_to_usec(timer_tick_get() - start));
+}
+
+/*
+ * screen_damage
+ * -------------
+ * Record that an area of the back buffer (inclusive pixel coordinates)
+ * has been drawn. Only a single bounding rectangle is kept; successive
+ * areas are merged into it.
+ */
+void
+screen_damage(int x1, int y1, int x2, int y2)
+{
+    if (dbuf_alloc == 0)
+        return;  // Single-buffered
+
+    if (x1 < 0)
+        x1 = 0;
+    if (y1 < 0)
+        y1 = 0;
+    if (x2 > SCREEN_WIDTH - 1)
+        x2 = SCREEN_WIDTH - 1;
+    if (y2 > DBUF_LINES - 1)
+        y2 = DBUF_LINES - 1;
+    if ((x1 > x2) || (y1 > y2))
+        return;
+
+    if (damage_valid == 0) {
+        damage_valid  = 1;
+        damage_vblank = dbuf_vblanks;
+        damage_x1 = x1;
+        damage_y1 = y1;
+        damage_x2 = x2;
+        damage_y2 = y2;
+        return;
+    }
+    if (damage_x1 > x1)
+        damage_x1 = x1;
+    if (damage_y1 > y1)
+        damage_y1 = y1;
+    if (damage_x2 < x2)
+        damage_x2 = x2;
+    if (damage_y2 < y2)
+        damage_y2 = y2;
+}
+
+/*
+ * screen_present
+ * --------------
+ * Show the frame drawn in the back buffer at the next vertical blank.
+ * Does nothing if single-buffered or if nothing was drawn.
+ */
+void
+screen_present(void)
+{
+    screen_frame_stats_t *fs = &screen_frame_stats;
+    uint32_t front = bitplane_show_base;
+    uint32_t back  = bitplane_draw_base;
+    uint     usec;
+    uint     latency;
+
+    if ((dbuf_alloc == 0) || (damage_valid == 0))
+        return;
+
+    WaitBlit();  // Queued blits to the back buffer must complete first
+    usec = screen_flip(back);
+
+    latency = dbuf_vblanks - damage_vblank - 1;
+    if (latency >= ARRAY_SIZE(fs->fs_latency))
+        latency = ARRAY_SIZE(fs->fs_latency) - 1;
+    fs->fs_latency[latency]++;
+    fs->fs_presents++;
+    fs->fs_wait_usec_total += usec;
+    if (fs->fs_wait_usec_max < usec)
+        fs->fs_wait_usec_max = usec;
+
+    /* The old front buffer becomes the back buffer; bring it up to date */
+    bitplane_draw_base = front;
+    screen_copy_area(back, front,
+                     damage_x1, damage_y1, damage_x2, damage_y2);
+    damage_valid = 0;
+    WaitBlit();
+}
+
+/*
+ * screen_console_present
+ * ----------------------
+ * Show console text drawn in the back buffer without waiting for the
+ * next main_poll(). This is called from the console output and input
+ * paths. At interrupt level (such as the debugger entered from the
+ * "Stuck?" check) the VBlank interrupt can not run to flip buffers, so
+ * the drawn area is instead copied directly into the displayed buffer.
+ * Otherwise, a flip is only done once the drawing is at least one frame
+ * old, so a burst of output does not wait for a vblank per line.
+ */
+void
+screen_console_present(void)
+{
+    if ((dbuf_alloc == 0) || (damage_valid == 0))
+        return;
+
+    if ((get_sr() & 0x0700) == 0) {
+        /* Task level */
+        if (dbuf_vblanks != damage_vblank)
+            screen_present();
+        return;
+    }
+
+    WaitBlit();
+    screen_copy_area(bitplane_draw_base, bitplane_show_base,
+                     damage_x1, damage_y1, damage_x2, damage_y2);
+    damage_valid = 0;
+    WaitBlit();
+}
+
+/*
+ * screen_dbuf_enable
+ * ------------------
+ * Enable or disable the double-buffered display. If the second buffer
+ * can not be allocated, the display remains single-buffered.
+ */
+void
+screen_dbuf_enable(uint enable)
+{
+    if (enable) {
+        void *buf;
+        if (dbuf_alloc != 0)
+            return;  // Already enabled
+        buf = malloc_chipmem(BITPLANE_OFFSET * SCREEN_BITPLANES);
+        if (buf == NULL)
+            return;
+        screen_copy_area(bitplane_show_base, (uintptr_t) buf,
+                         0, 0, SCREEN_WIDTH - 1, DBUF_LINES - 1);
+        WaitBlit();
+        dbuf_alloc = (uintptr_t) buf;
+        bitplane_draw_base = dbuf_alloc;
+        damage_valid = 0;
+        memset(&screen_frame_stats, 0, sizeof (screen_frame_stats));
+    } else {
+        if (dbuf_alloc == 0)
+            return;  // Already disabled
+        screen_present();
+        if (bitplane_show_base != BITPLANE_HOME) {
+            /* Move the displayed image home before releasing the buffer */
+            screen_copy_area(bitplane_show_base, BITPLANE_HOME,
+                             0, 0, SCREEN_WIDTH - 1, DBUF_LINES - 1);
+            WaitBlit();
+            screen_flip(BITPLANE_HOME);
+        }
+        bitplane_draw_base = BITPLANE_HOME;
+        free_chipmem((void *) dbuf_alloc);
+        dbuf_alloc = 0;
+    }
+}
+
+void
+screen_frame_stats_show(void)
+{
+    screen_frame_stats_t *fs = &screen_frame_stats;
+
+    printf("Frames presented  %u\n", fs->fs_presents);
+    printf("Present latency   %u %u %u %u  (0, 1, 2, 3+ vblanks)\n",
+           fs->fs_latency[0], fs->fs_latency[1],
+           fs->fs_latency[2], fs->fs_latency[3]);
+    printf("Flip wait         max %u usec, avg %u usec\n",
+           fs->fs_wait_usec_max,
+           fs->fs_presents ? fs->fs_wait_usec_total / fs->fs_presents : 0);
+    printf("Back buffer sync  %u words\n", fs->fs_sync_words);
+}
+
 void
 blitter_scroll(uint bitplane)
 {
@@ -336,10 +616,13 @@ blitter_scroll(uint bitplane)
     uint height = (SCREEN_ROWS + 1) * FONT_HEIGHT;  // max 1024
     uint32_t base = BITPLANE_0_BASE + BITPLANE_OFFSET * bitplane;
 
+    screen_damage(0, 0, SCREEN_WIDTH - 1, height - 1);
     WaitBlit();
 
     *BLTCON0 = 0x09f0;
     *BLTCON1 = 0;
+    *BLTAFWM = 0xffff;  // Text blits change the A channel masks
+    *BLTALWM = 0xffff;
     *BLTAMOD = 0;
     *BLTDMOD = 0;
     *BLTDPTH = base;                    // destination
@@ -376,61 +659,152 @@ render_char(uint8_t ch)
     uint8_t *bpl = ADDR8(BITPLANE_0_BASE + dbg_cursor_x +
                          dbg_cursor_y * SCREEN_WIDTH);
     uint line;
+
+    screen_damage(dbg_cursor_x * FONT_WIDTH, dbg_cursor_y * FONT_HEIGHT,
+                  dbg_cursor_x * FONT_WIDTH + FONT_WIDTH - 1,
+                  dbg_cursor_y * FONT_HEIGHT + FONT_HEIGHT - 1);
     for (line = 0; line < FONT_HEIGHT; line++) {
         *bpl = *(ptr++);
         bpl += (SCREEN_WIDTH / 8);
     }
 }
 
-#define RENDER_BUF_CHARS 128
+#define RENDER_BUF_CHARS  128
+#define RENDER_BUF_STRIDE (RENDER_BUF_CHARS + 2)  // Word pad for blitter shift
+#define FONT_GLYPHS       (sizeof (font_fixed_8x8) / FONT_HEIGHT)
 __attribute__((aligned(4)))
-uint8_t __chip render_buf[RENDER_BUF_CHARS * FONT_HEIGHT];
+uint8_t __chip render_buf[RENDER_BUF_STRIDE * FONT_HEIGHT];
 
 /*
- * render_char_to_buf
- * ------------------
- * Copy a single character to the specified buffer.
+ * Font glyphs expanded to a line-major atlas: font_atlas[line][glyph].
+ * Composing a string into render_buf is then one table lookup per byte,
+ * stored sequentially along each line of the buffer.
+ */
+static uint8_t __chip font_atlas[FONT_HEIGHT][FONT_GLYPHS];
+
+uint render_text_blit;  // Render text using the blitter
+
+/*
+ * font_atlas_init
+ * ---------------
+ * Build the line-major glyph atlas from the font.
  */
 static void
-render_char_to_buf(char ch, char *buf)
+font_atlas_init(void)
 {
-    const uint8_t *ptr = &font_fixed_8x8[(ch - ' ') * FONT_HEIGHT];
+    uint glyph;
     uint line;
+
+    for (glyph = 0; glyph < FONT_GLYPHS; glyph++)
+        for (line = 0; line < FONT_HEIGHT; line++)
+            font_atlas[line][glyph] = font_fixed_8x8[glyph * FONT_HEIGHT + line];
+}
+
+/*
+ * render_text_compose
+ * -------------------
+ * Compose up to maxlen characters of a string into render_buf, one line
+ * of the font at a time. The word after the string on each line is
+ * cleared so that a shifted blit pulls in only empty pixels. Returns the
+ * number of characters composed.
+ */
+static uint
+render_text_compose(const char *str, uint maxlen)
+{
+    uint8_t glyphs[RENDER_BUF_CHARS];
+    uint    len;
+    uint    line;
+    uint    pos;
+
+    if (maxlen > RENDER_BUF_CHARS)
+        maxlen = RENDER_BUF_CHARS;
+    for (len = 0; (len < maxlen) && (str[len] != '\0'); len++) {
+        uint8_t ch = str[len];
+        glyphs[len] = (ch < ' ') ? 0 : (ch - ' ');
+    }
+
     for (line = 0; line < FONT_HEIGHT; line++) {
-        *buf = *ptr;
-        buf += RENDER_BUF_CHARS;
-        ptr++;
+        const uint8_t *atlas = font_atlas[line];
+        uint8_t       *rbuf  = render_buf + line * RENDER_BUF_STRIDE;
+        for (pos = 0; pos < len; pos++)
+            *(rbuf++) = atlas[glyphs[pos]];
+        rbuf[0] = 0;
+        rbuf[1] = 0;
     }
+    return (len);
 }
 
 /*
- * render_text_at
- * --------------
- * Draw a string at the specified screen x and y coordinates.
- * Note that x and y are specified in pixels and not cursor position.
+ * render_text_blitter
+ * -------------------
+ * Draw the string composed in render_buf using one blit per bitplane.
+ * As in blit_copy(), A is a constant mask of the text area (through the
+ * first and last word masks), B is the shifted text, and C is the
+ * destination outside of the mask. The minterm selects one of the four
+ * fill modes for each bitplane (see render_text_cpu()). The operations
+ * for all bitplanes are queued first, so that blitter registers common
+ * to every bitplane are written only once.
  */
-void
-render_text_at(const char *str, uint maxlen, uint x, uint y,
-               uint fg_color, uint bg_color)
+static void
+render_text_blitter(uint len, uint x, uint y, uint fg_color, uint bg_color)
 {
-    char *rbuf = render_buf;
-    uint plane;
-    uint len = 0;
-    uint line;
-    static uint8_t recursion;
+    uint8_t  minterm[SCREEN_BITPLANES];
+    uint32_t dst[SCREEN_BITPLANES];
+    uint     shift       = x & 0xf;
+    uint     width_words = (shift + len * 8 + 0xf) >> 4;
+    uint     last_x      = (x + len * 8 - 1) & 0xf;
+    uint16_t first_mask  = 0xffff >> shift;
+    uint16_t last_mask   = 0xffff << (15 - last_x);
+    uint     plane;
 
-    if (recursion)
-        return;
+    /* Queue per-bitplane operations */
+    for (plane = 0; plane < SCREEN_BITPLANES; plane++) {
+        dst[plane] = BITPLANE_0_BASE + plane * BITPLANE_OFFSET +
+                     y * SCREEN_WIDTH / 8 + (x >> 4) * 2;
+        if ((fg_color & BIT(plane)) == 0) {
+            if ((bg_color & BIT(plane)) == 0)
+                minterm[plane] = 0x0a;  // A) Empty: D = A ? 0 : C
+            else
+                minterm[plane] = 0x3a;  // B) Invert Text: D = A ? ~B : C
+        } else {
+            if ((bg_color & BIT(plane)) == 0)
+                minterm[plane] = 0xca;  // C) Text: D = A ? B : C
+            else
+                minterm[plane] = 0xfa;  // D) Solid: D = A ? 1 : C
+        }
+    }
 
-    recursion = 1;
+    WaitBlit();
+    *BLTCON1 = shift * BLTCON1_SHF0;
+    *BLTBMOD = RENDER_BUF_STRIDE - width_words * 2;
+    *BLTCMOD = SCREEN_WIDTH / 8 - width_words * 2;
+    *BLTDMOD = SCREEN_WIDTH / 8 - width_words * 2;
+    *BLTAFWM = (width_words == 1) ? (first_mask & last_mask) : first_mask;
+    *BLTALWM = (width_words == 1) ? (first_mask & last_mask) : last_mask;
+    *BLTADAT = 0xffff;
 
-    if (maxlen > RENDER_BUF_CHARS)
-        maxlen = RENDER_BUF_CHARS;
-    for (rbuf = render_buf; *str != '\0'; str++) {
-        render_char_to_buf(*str, rbuf++);
-        if ((++len == maxlen))
-            break;
+    for (plane = 0; plane < SCREEN_BITPLANES; plane++) {
+        if (plane != 0)
+            WaitBlit();
+        *BLTCON0 = BLTCON0_AREA_USEB | BLTCON0_AREA_USEC | BLTCON0_AREA_USED |
+                   minterm[plane];
+        *BLTBPT  = (uintptr_t) render_buf;
+        *BLTCPT  = dst[plane];
+        *BLTDPT  = dst[plane];
+        *BLTSIZE = (FONT_HEIGHT << 6) | width_words;
     }
+}
+
+/*
+ * render_text_cpu
+ * ---------------
+ * Draw the string composed in render_buf using the CPU.
+ */
+static void
+render_text_cpu(uint len, uint x, uint y, uint fg_color, uint bg_color)
+{
+    uint plane;
+    uint line;
 
     if ((x & 7) == 0) {
         /* Horizontal position is aligned to byte - YAY! */
@@ -455,7 +829,7 @@ render_text_at(const char *str, uint maxlen, uint x, uint y,
                     /* B) Invert Text: only Bg color selects this bitplane */
                     for (line = 0; line < FONT_HEIGHT; line++) {
                         uint pos;
-                        uint8_t *rp = render_buf + line * RENDER_BUF_CHARS;
+                        uint8_t *rp = render_buf + line * RENDER_BUF_STRIDE;
                         for (pos = 0; pos < len; pos++)
                             bpl[pos] = *(rp++) ^ 0xff;
                         bpl += (SCREEN_WIDTH / 8);
@@ -465,7 +839,7 @@ render_text_at(const char *str, uint maxlen, uint x, uint y,
                 if ((bg_color & BIT(plane)) == 0) {
                     /* C) Text: only Fg color selects this bitplane */
                     for (line = 0; line < FONT_HEIGHT; line++) {
-                        memcpy(bpl, render_buf + line * RENDER_BUF_CHARS, len);
+                        memcpy(bpl, render_buf + line * RENDER_BUF_STRIDE, len);
                         bpl += (SCREEN_WIDTH / 8);
                     }
                 } else {
@@ -536,7 +910,7 @@ render_text_at(const char *str, uint maxlen, uint x, uint y,
 
             for (line = 0; line < FONT_HEIGHT; line++) {
                 uint8_t *ptr = rptr;
-                uint8_t *rend = ADDR8(render_buf + line * RENDER_BUF_CHARS);
+                uint8_t *rend = ADDR8(render_buf + line * RENDER_BUF_STRIDE);
                 uint8_t data = (*(rend++) & fill_and) ^ fill_xor;
 
                 /* Draw leading part of character */
@@ -560,6 +934,36 @@ render_text_at(const char *str, uint maxlen, uint x, uint y,
             }
         }
     }
+}
+
+/*
+ * render_text_at
+ * --------------
+ * Draw a string at the specified screen x and y coordinates.
+ * Note that x and y are specified in pixels and not cursor position.
+ */
+void
+render_text_at(const char *str, uint maxlen, uint x, uint y,
+               uint fg_color, uint bg_color)
+{
+    uint len;
+    static uint8_t recursion;
+
+    if (recursion)
+        return;
+
+    recursion = 1;
+
+    /* A previous text blit may still be reading render_buf */
+    WaitBlit();
+    len = render_text_compose(str, maxlen);
+    if (len != 0) {
+        screen_damage(x, y, x + len * FONT_WIDTH - 1, y + FONT_HEIGHT - 1);
+        if (render_text_blit)
+            render_text_blitter(len, x, y, fg_color, bg_color);
+        else
+            render_text_cpu(len, x, y, fg_color, bg_color);
+    }
     recursion = 0;
 }
 
@@ -824,6 +1228,9 @@ screen_init(void)
     *BLTSIZE  = (1 << 6) | 0x1;  // 1 pixel high, 1 pixel wide
     if (WaitBlit_timeout())
         serial_puts("[Blitter timeout]\n");
+    else
+        render_text_blit = 1;
+    font_atlas_init();
 
 #if 0
     /* Implementation of multiscan 31.56 kHz doesn't seem to work */
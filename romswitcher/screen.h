@@ -23,10 +23,20 @@
 #define FONT_HEIGHT         8  // pixels
 
 #define BITPLANE_OFFSET   (SCREEN_WIDTH / 8 * (SCREEN_HEIGHT + 64))
-#define BITPLANE_0_BASE   0x00020000
+#define BITPLANE_HOME     0x00020000          // Bitplanes shown at boot
+#define BITPLANE_0_BASE   bitplane_draw_base  // Bitplanes drawn into
 #define BITPLANE_1_BASE   (BITPLANE_0_BASE + BITPLANE_OFFSET)
 #define BITPLANE_2_BASE   (BITPLANE_1_BASE + BITPLANE_OFFSET)
 
+/* Double-buffered display frame pacing statistics */
+typedef struct {
+    uint32_t fs_presents;        // Frames presented
+    uint32_t fs_latency[4];      // Presents 0, 1, 2, 3+ vblanks after drawing
+    uint32_t fs_wait_usec_max;   // Longest wait for a flip to take effect
+    uint32_t fs_wait_usec_total; // Total time spent waiting for flips
+    uint32_t fs_sync_words;      // Words copied to keep back buffer current
+} screen_frame_stats_t;
+
 #define TEXTPEN      1  // Black
 #define HIGHLIGHTPEN 4  // Gold
 
@@ -39,6 +49,12 @@ void screen_init(void);
 void screen_beep_handle(void);
 void screen_displaybeep(void);
 void WaitBlit(void);
+void screen_damage(int x1, int y1, int x2, int y2);
+void screen_dbuf_enable(uint enable);
+void screen_present(void);
+void screen_console_present(void);
+void screen_vblank(void);
+void screen_frame_stats_show(void);
 void SetRGB4(void *vp, int32_t index, uint32_t red, uint32_t green,
              uint32_t blue);
 
@@ -51,5 +67,8 @@ extern uint dbg_cursor_x;    // Debug cursor column position on screen
 extern uint dbg_cursor_y;    // Debug cursor row position on screen
 extern uint dbg_all_scroll;  // Count of lines where all bitplanes should scroll
 extern uint displaybeep;     // DisplayBeep is active when non-zero
+extern uint render_text_blit; // Render text using the blitter
+extern uint32_t bitplane_draw_base;   // Bitplanes drawn into (back buffer)
+extern screen_frame_stats_t screen_frame_stats;
 
 #endif /* _SCREEN_H */
@@ -255,8 +255,11 @@ getchar(void)
         serial_poll();
         ch = input_rb_get();
     }
-    if (ch == -1)
+    if (ch == -1) {
+        /* Waiting for input; make sure any prompt is visible */
+        screen_console_present();
         return (ch);
+    }
 
     if ((ch_prev == '\r') && (ch == '\n'))
         return (-1);  // CRLF: skip LF
@@ -276,8 +279,11 @@ putchar(int ch)
 
     if (serial_output_enabled)
         serial_putc((uint) ch);
-    if (screen_output_enabled)
+    if (screen_output_enabled) {
         show_char((uint) ch);
+        if (ch == '\n')
+            screen_console_present();
+    }
     return (ch);
 }
 
@@ -292,6 +298,7 @@ puts(const char *str)
     if (screen_output_enabled) {
         show_string(str);
         show_string("\r\n");
+        screen_console_present();
     }
     return (0);
 }
@@ -20,6 +20,7 @@
 #include "screen.h"
 #include "intuition.h"
 #include "testdraw.h"
+#include "timer.h"
 
 /* Only one of these should be defined for test at a time */
 #undef TEST_LINE_DRAW
@@ -30,6 +31,8 @@
 #undef TEST_RECT_CPU_OVERLAP_COLORS_LINE_OVERLAY
 #undef TEST_RECT_BLIT_OVERLAP_MANY_SOLID
 #undef TEST_TEXT
+#undef TEST_TEXT_PERF
+#undef TEST_DBUF
 #undef TEST_POLYDRAW
 #undef TEST_AREAFILL
 #undef TEST_BLITFILL
@@ -317,6 +320,73 @@ test_text(void)
 }
 #endif
 
+#ifdef TEST_TEXT_PERF
+/*
+ * test_text_perf_frame
+ * --------------------
+ * Redraw a full screen of text, returning the elapsed time in microseconds.
+ */
+static uint
+test_text_perf_frame(uint xoff)
+{
+    static const char line[] =
+        "The quick brown fox jumps over the lazy dog 0123456789 ~!@#$%^&*()";
+    uint64_t start;
+    uint     row;
+
+    start = timer_tick_get();
+    for (row = 0; row < SCREEN_HEIGHT / FONT_HEIGHT; row++)
+        render_text_at(line, sizeof (line) - 1, xoff, row * FONT_HEIGHT,
+                       (row & 7) ? (row & 7) : 1, row >> 3);
+    WaitBlit();
+    return (timer_tick_to_usec(timer_tick_get() - start));
+}
+
+static void
+test_text_perf(void)
+{
+    /* Compare CPU and blitter text rendering of a full screen */
+    uint saved_blit = render_text_blit;
+    uint mode;
+
+    for (mode = 0; mode < 2; mode++) {
+        uint xoff;
+        render_text_blit = mode;
+        for (xoff = 0; xoff < 4; xoff += 3) {
+            uint frame;
+            uint usec = 0;
+            for (frame = 0; frame < 16; frame++)
+                usec += test_text_perf_frame(xoff);
+            usec /= 16;
+            printf("%s x=%u: %u usec/frame (%u.%02u vblanks)\n",
+                   mode ? "blitter" : "cpu    ", xoff, usec,
+                   usec * vblank_hz / 1000000,
+                   usec * vblank_hz / 10000 % 100);
+        }
+    }
+    render_text_blit = saved_blit;
+}
+#endif
+
+#ifdef TEST_DBUF
+static void
+test_dbuf(void)
+{
+    /* Animate text in the double-buffered display, then show pacing */
+    uint frame;
+
+    screen_dbuf_enable(1);
+    for (frame = 0; frame < 240; frame++) {
+        uint x = frame * 2;
+        fill_rect(0, x, 100, x + 1, 107);  // Erase trailing edge
+        render_text_at("Double-buffered", 15, x + 2, 100, 1, 3);
+        screen_present();
+    }
+    screen_frame_stats_show();
+    screen_dbuf_enable(0);
+}
+#endif
+
 #ifdef TEST_POLYDRAW
 static void
 test_polydraw(void)
@@ -485,6 +555,12 @@ static void (*test_handlers[])(void) = {
 #ifdef TEST_TEXT
     test_text,
 #endif
+#ifdef TEST_TEXT_PERF
+    test_text_perf,
+#endif
+#ifdef TEST_DBUF
+    test_dbuf,
+#endif
 #ifdef TEST_POLYDRAW
     test_polydraw,
 #endif
@@ -258,7 +258,9 @@ VBlank(void)
     uint16_t mouse_quad_cur;
 
     /*
-     * Reset bitplane DMA pointers. This could also be done by the copper.
+     * Reset bitplane DMA pointers, switching to the new front buffer if
+     * a double-buffered frame is being presented. This could also be
+     * done by the copper.
      *
      *   AddrPlanexH = address of bit plane x, bits 16-18
      *   AddrPlanexL = address of bit plane x, bits 0-15
@@ -273,9 +275,7 @@ VBlank(void)
      *   WAIT ($FF,$FE)
      *   ;end of the Copper list (wait for an impossible screen position)
      */
-    *BPL1PT = BITPLANE_0_BASE;  // Bitplane 0 base address
-    *BPL2PT = BITPLANE_1_BASE;  // Bitplane 1 base address
-    *BPL3PT = BITPLANE_2_BASE;  // Bitplane 2 base address
+    screen_vblank();
 
     *INTREQ = INTREQ_VERTB;
     COUNTER(3)++;  // 0x100c
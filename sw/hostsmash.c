@@ -47,6 +47,7 @@ typedef unsigned int uint;
 #include <inttypes.h>
 #ifdef LINUX
 #include <usb.h>
+#include <linux/fs.h>
 #endif
 #include <dirent.h>
 #include "../fw/crc32.h"
@@ -98,11 +99,17 @@ static const struct option long_opts[] = {
     { "len",      required_argument, NULL, 'l' },
     { "mount",    required_argument, NULL, 'm' },
     { "Mount",    required_argument, NULL, 'M' },
+    { "profile",  no_argument,       NULL, 0x80 + 'p' },
     { "read",     no_argument,       NULL, 'r' },
+    { "romindex", no_argument,       NULL, 0x80 + 'k' },
+    { "snoop-file", required_argument, NULL, 0x80 + 's' },
+    { "snoop-mode", required_argument, NULL, 0x80 + 'S' },
     { "swap",     required_argument, NULL, 's' },
     { "term",     no_argument,       NULL, 't' },
+    { "trigger-file", required_argument, NULL, 0x80 + 'T' },
     { "verify",   no_argument,       NULL, 'v' },
     { "version",  no_argument,       NULL, 'V' },
+    { "wear",     no_argument,       NULL, 'W' },
     { "write",    no_argument,       NULL, 'w' },
     { "yes",      no_argument,       NULL, 'y' },
     { NULL,       no_argument,       NULL,  0  }
@@ -112,6 +119,7 @@ static char short_opts[] = {
     ':',         // Missing argument
     'A',         // --all
     'V',         // --version
+    'W',         // --wear
     'a', ':',    // --addr <addr>
     'b', ':',    // --bank <num>
     'c', ':',    // --clock [show|set]
@@ -138,6 +146,7 @@ static const char usage_text[] =
 "hostsmash <opts> <dev>\n"
 "    -A --all                show all verify miscompares\n"
 "    -V --version            display version\n"
+"    -W --wear               show flash sector erase counts\n"
 "    -a --addr <addr>        starting EEPROM address\n"
 "    -b --bank <num>         starting EEPROM address as multiple of file size\n"
 "    -c --clock [show|set]   show or set Kicksmash time of day clock\n"
@@ -155,11 +164,16 @@ static const char usage_text[] =
 "    -i --identify           identify installed EEPROM\n"
 "    -l --len <num>          length in bytes\n"
 "    -m --mount <vol:> <dir> file serve directory path to Amiga volume\n"
+"       --profile            show ROM fetch profile (see \"snoop prof\")\n"
 "    -r --read <filename>    read EEPROM and write to file\n"
+"       --romindex           show Kickstart image found in each ROM bank\n"
 "    -s --swap <mode>        byte swap mode (2301, 3210, 1032, noswap=0123)\n"
+"       --snoop-file <file>  capture ROM bus activity to a trace file\n"
+"       --snoop-mode <mode>  snoop capture: addr, lo, or hi (default addr)\n"
 "    -v --verify <filename>  verify file matches EEPROM contents\n"
 "    -w --write <filename>   read file and write to EEPROM\n"
 "    -t --term [<command>]   operate in terminal mode (CLI) to KickSmash\n"
+"       --trigger-file <file> save triggered bus capture to a trace file\n"
 "    -y --yes                answer all prompts with 'yes'\n"
 "    TERM_DEBUG=`tty`        env variable for communication debug output\n"
 "    TERM_DEBUG_HEX=1        show debug output in hex instead of ASCII\n"
@@ -176,6 +190,8 @@ static const char usage_text[] =
 
 static uint debug_fs = 0;
 static uint debug_msg = 0;
+static const char *snoop_capmode = "addr";
+static volatile sig_atomic_t snoop_stop;
 
 #ifdef FILE_DEBUG
 ATTRIBUTE_PRINTF
@@ -231,8 +247,13 @@ timespec_to_timeval(struct timeval *tv, struct timespec *ts)
 #define MODE_VERIFY    0x0010
 #define MODE_WRITE     0x0020
 #define MODE_MSG       0x0040
+#define MODE_WEAR      0x0080
 #define MODE_CLOCK_GET 0x0100
 #define MODE_CLOCK_SET 0x0200
+#define MODE_SNOOP     0x0400
+#define MODE_TRIGGER   0x0800
+#define MODE_PROFILE   0x1000
+#define MODE_ROMINDEX  0x2000
 
 /* XXX: Need to register USB device ID at http://pid.codes */
 #define MX_VENDOR 0x1209
@@ -3873,7 +3894,41 @@ mem16_swap(void *buf, uint len)
     }
 }
 
-#define SEND_MSG_MAX 2000
+#define SEND_MSG_MAX        2000
+#define SEND_MSG_POLL_MSEC  50     // Interval to check Amiga drain progress
+#define SEND_MSG_STALL_MSEC 30000  // Give up if no drain progress this long
+
+/*
+ * send_msg_wait
+ * -------------
+ * Waits while the Kicksmash USB-to-Amiga buffer is too full to accept
+ * the next message packet. The Amiga may be slow to drain the buffer
+ * when it has several requests outstanding, so this only fails once
+ * the Amiga has made no progress (available space has not risen) for
+ * SEND_MSG_STALL_MSEC.
+ */
+static uint
+send_msg_wait(uint *stall_msec, uint *last_avail)
+{
+    smash_msg_info_t mi;
+    uint status;
+    uint avail;
+
+    time_delay_msec(1);
+    if ((++*stall_msec % SEND_MSG_POLL_MSEC) != 0)
+        return (0);
+
+    if (send_ks_cmd(KS_CMD_MSG_INFO, NULL, 0, &mi, sizeof (mi),
+                    &status, NULL, 0) == 0) {
+        avail = SWAP16(mi.smi_utoa_avail);
+        if (avail > *last_avail)
+            *stall_msec = 0;  // Amiga is draining the buffer
+        *last_avail = avail;
+    }
+    if (*stall_msec >= SEND_MSG_STALL_MSEC)
+        return (RC_TIMEOUT);
+    return (0);
+}
 
 /*
  * send_msg
@@ -3889,6 +3944,8 @@ send_msg(void *buf, uint len, uint *status)
     uint bodylen;
     uint pos;
     uint bodylen_rounded;
+    uint stall = 0;
+    uint last_avail = 0;
 
 #ifdef MSG_DEBUG
     km_msg_hdr_t *km = (km_msg_hdr_t *) buf;
@@ -3898,7 +3955,16 @@ send_msg(void *buf, uint len, uint *status)
     mem16_swap(buf, len);
     if (sendlen > SEND_MSG_MAX)
         sendlen = SEND_MSG_MAX;
-    rc = send_ks_cmd(KS_CMD_MSG_SEND, buf, sendlen, NULL, 0, status, NULL, 0);
+    do {
+        rc = send_ks_cmd(KS_CMD_MSG_SEND, buf, sendlen, NULL, 0, status,
+                         NULL, 0);
+        if ((rc != 0) || (*status != KS_STATUS_BADLEN))
+            break;
+        rc = send_msg_wait(&stall, &last_avail);  // Wait for Amiga to drain
+    } while (rc == 0);
+    if (rc == RC_TIMEOUT)
+        printf("Send timeout waiting for buffer\n");
+    stall = 0;
     if (rc == 0) {
         pos = sendlen;
         if (pos < len) {
@@ -3950,6 +4016,20 @@ send_msg(void *buf, uint len, uint *status)
                 printf("send msg failed at %x of %x\n", pos, len);
                 break;
             }
+            if (*status == KS_STATUS_BADLEN) {
+                /*
+                 * Amiga has not yet drained the buffer. This happens
+                 * when the Amiga has several requests outstanding
+                 * (pipelined reads), so wait for space and resend.
+                 */
+                rc = send_msg_wait(&stall, &last_avail);
+                if (rc == 0)
+                    continue;
+                printf("Send timeout waiting for buffer at %x of %x\n",
+                       pos, len);
+                break;
+            }
+            stall = 0;
             pos += bodylen;
 #undef DEBUG_SEND_MSG
 #ifdef DEBUG_SEND_MSG
@@ -4749,6 +4829,68 @@ sm_id(km_msg_hdr_t *km, uint *status)
     return (send_msg(km, sizeof (*km) + sizeof (*reply), status));
 }
 
+/*
+ * uaem_stat_fixup
+ * ---------------
+ * UAE support: if a .uaem file accompanies the specified host file,
+ * apply the Amiga permissions it records to the file's status.
+ */
+static void
+uaem_stat_fixup(const char *host_path, struct stat *st)
+{
+    char *host_path_uaem = malloc(strlen(host_path) + 6);
+    FILE *fp;
+
+    if (host_path_uaem == NULL)
+        return;
+    strcpy(host_path_uaem, host_path);
+    strcat(host_path_uaem, ".uaem");
+    if ((fp = fopen(host_path_uaem, "r")) != NULL) {
+        char f_perms[16];
+        char f_date[12];
+        char f_time[12];
+        if (fscanf(fp, "%15s %11s %11s", f_perms, f_date, f_time) == 3) {
+            uint32_t amiga_perms = amiga_perms_from_str(f_perms);
+            fsprintf("%s UAEM perms=%s\n", host_path_uaem, f_perms);
+            if (amiga_perms != 0xffffffff) {
+                st->st_mode = (st->st_mode & S_IFMT) |
+                              host_perms_from_amiga(amiga_perms);
+            }
+        }
+        fclose(fp);
+    }
+    free(host_path_uaem);
+}
+
+/*
+ * stat_to_hm_dirent
+ * -----------------
+ * Fills the times, sizes, ownership, and permissions of an Amiga
+ * directory entry (in Amiga byte order) from host file status.
+ */
+static void
+stat_to_hm_dirent(hm_fdirent_t *hm_dirent, struct stat *st)
+{
+    uint32_t time_a = get_localtime(st->st_atime);
+    uint32_t time_c = get_localtime(st->st_ctime);
+    uint32_t time_m = get_localtime(st->st_mtime);
+
+    hm_dirent->hmd_atime = SWAP32(time_a);
+    hm_dirent->hmd_ctime = SWAP32(time_c);
+    hm_dirent->hmd_mtime = SWAP32(time_m);
+#ifdef __MINGW32__
+    uint blksize = 1 << 20;
+    hm_dirent->hmd_blksize = SWAP32(blksize);
+    hm_dirent->hmd_blks = SWAP32(st->st_size / blksize);
+#else
+    hm_dirent->hmd_blksize = SWAP32(st->st_blksize);
+    hm_dirent->hmd_blks = SWAP32(st->st_blocks);
+#endif
+    hm_dirent->hmd_ouid = SWAP32(st->st_uid);
+    hm_dirent->hmd_ogid = SWAP32(st->st_gid);
+    hm_dirent->hmd_mode = SWAP32(st->st_mode);
+}
+
 static uint
 sm_fopen(hm_fopenhandle_t *hm, uint *status)
 {
@@ -4759,11 +4901,13 @@ sm_fopen(hm_fopenhandle_t *hm, uint *status)
     char         *name = NULL;
     uint16_t      hm_type;
     uint16_t      hm_mode = SWAP16(hm->hm_mode);
+    uint16_t      want_stat = hm_mode & HM_MODE_STAT;
     uint          oflags;
-    int           fd;
+    int           fd = -1;
     struct stat   st;
 
     fsprintf("fopen(%s %x) in %x\n", hm_name, hm_mode, hm->hm_handle);
+    hm_mode &= ~HM_MODE_STAT;
 
     hm->hm_hdr.km_op |= KM_OP_REPLY;
     hm->hm_hdr.km_status = KM_STATUS_OK;
@@ -4927,6 +5071,31 @@ open_success:
     hm->hm_handle = handle->he_handle;
     hm->hm_mode   = 0;
     fsprintf("  handle=%x\n", hm->hm_handle);
+    if (want_stat && (host_path != NULL)) {
+        /* Return file status with the open reply (saves a round trip) */
+        struct {
+            hm_fopenhandle_t hm;
+            hm_fdirent_t     dent;
+        } reply;
+        int rc = (fd >= 0) ? fstat(fd, &st) : lstat(host_path, &st);
+        if (rc == 0) {
+            uint64_t size = st.st_size;
+            memset(&reply, 0, sizeof (reply));
+            reply.hm = *hm;
+            uaem_stat_fixup(host_path, &st);
+            stat_to_hm_dirent(&reply.dent, &st);
+            reply.dent.hmd_type    = SWAP16(st_mode_to_hm_type(st.st_mode));
+            reply.dent.hmd_size_hi = SWAP32((uint32_t) (size >> 32));
+            reply.dent.hmd_size_lo = SWAP32((uint32_t) size);
+            reply.dent.hmd_aperms  = SWAP32(amiga_perms_from_host(st.st_mode));
+            reply.dent.hmd_ino     = SWAP32((uint32_t) st.st_ino);
+            reply.dent.hmd_nlink   = SWAP32((uint32_t) st.st_nlink);
+            free(host_path);
+            return (send_msg(&reply, sizeof (reply), status));
+        }
+    }
+    if (host_path != NULL)
+        free(host_path);
     return (send_msg(hm, sizeof (*hm), status));
 }
 
@@ -5350,59 +5519,14 @@ dir_read_common:
                 }
 
                 if (lstat(host_path, &st) == 0) {
-                    uint32_t time_a;
-                    uint32_t time_c;
-                    uint32_t time_m;
-                    char *host_path_uaem;
-
                     if (((he_mode & HM_MODE_NOFOLLOW) == 0) &&
                         (stat(host_path, &st) != 0)) {
                         /* Just use the result of previous lstat */
                         fsprintf("stat %s failed\n", host_path);
                     }
 
-                    /* UAE support: check for .uaem file */
-                    host_path_uaem = malloc(strlen(host_path) + 6);
-                    if (host_path_uaem != NULL) {
-                        FILE *fp;
-                        strcpy(host_path_uaem, host_path);
-                        strcat(host_path_uaem, ".uaem");
-                        if ((fp = fopen(host_path_uaem, "r")) != NULL) {
-                            char f_perms[16];
-                            char f_date[12];
-                            char f_time[12];
-                            if (fscanf(fp, "%s %s %s",
-                                       f_perms, f_date, f_time) == 3) {
-                                fsprintf("%s UAEM perms=%s\n",
-                                         host_path_uaem, f_perms);
-                                amiga_perms = amiga_perms_from_str(f_perms);
-                                if (amiga_perms != 0xffffffff) {
-                                    st.st_mode = (st.st_mode & S_IFMT) |
-                                             host_perms_from_amiga(amiga_perms);
-                                }
-                            }
-                            fclose(fp);
-                        }
-                        free(host_path_uaem);
-                    }
-
-                    time_a = get_localtime(st.st_atime);
-                    time_c = get_localtime(st.st_ctime);
-                    time_m = get_localtime(st.st_mtime);
-                    hm_dirent->hmd_atime = SWAP32(time_a);
-                    hm_dirent->hmd_ctime = SWAP32(time_c);
-                    hm_dirent->hmd_mtime = SWAP32(time_m);
-#ifdef __MINGW32__
-                    uint blksize = 1 << 20;
-                    hm_dirent->hmd_blksize = SWAP32(blksize);
-                    hm_dirent->hmd_blks = SWAP32(st.st_size / blksize);
-#else
-                    hm_dirent->hmd_blksize = SWAP32(st.st_blksize);
-                    hm_dirent->hmd_blks = SWAP32(st.st_blocks);
-#endif
-                    hm_dirent->hmd_ouid = SWAP32(st.st_uid);
-                    hm_dirent->hmd_ogid = SWAP32(st.st_gid);
-                    hm_dirent->hmd_mode = SWAP32(st.st_mode);
+                    uaem_stat_fixup(host_path, &st);
+                    stat_to_hm_dirent(hm_dirent, &st);
 
                     size_hi = ((uint64_t) st.st_size) >> 32;
                     size_lo = (uint32_t) st.st_size;
@@ -5963,6 +6087,782 @@ reply_rename_fail:
     return (send_msg(hm, sizeof (*hm), status));
 }
 
+#define FCOPY_SLICE_MSEC  200        // Maximum copy time per request
+#define FCOPY_CHUNK       (4 << 20)  // Maximum bytes per copy call
+#define FCOPY_BUFSIZE     (256 << 10) // read()/write() fallback buffer
+#define FCOPY_JOBS_MAX    4          // Concurrent copy jobs
+#define FCOPY_IDLE_SEC    60         // Job with no request is abandoned
+
+/* One object to be copied by a host-side copy job */
+typedef struct fcopy_ent {
+    struct fcopy_ent *ce_next;
+    char             *ce_src;   // Host source path
+    char             *ce_dst;   // Host destination path
+    uint              ce_type;  // HM_TYPE_FILE, HM_TYPE_DIR, or HM_TYPE_LINK
+} fcopy_ent_t;
+
+/* Host-side copy job state; several clients may each have a job */
+typedef struct {
+    uint32_t     cj_job;          // Job number (0 = no job active)
+    uint         cj_flags;        // HM_COPY_* flags
+    time_t       cj_last;         // Time of last request for this job
+    fcopy_ent_t *cj_head;         // Objects remaining to copy
+    fcopy_ent_t *cj_tail;         // Last object to copy
+    fcopy_ent_t *cj_rmdirs;       // Move: source dirs to remove (LIFO)
+    fcopy_ent_t *cj_cur;          // File currently being copied
+    int          cj_sfd;          // Current source file descriptor
+    int          cj_dfd;          // Current destination file descriptor
+    uint         cj_no_cfr;       // copy_file_range() not usable
+    uint8_t     *cj_buf;          // read()/write() fallback buffer
+    struct stat  cj_st;           // Current source file status
+    uint32_t     cj_files;        // Files copied
+    uint32_t     cj_files_total;  // Files to copy
+    uint64_t     cj_bytes;        // Bytes copied
+    uint64_t     cj_bytes_total;  // Bytes to copy
+} fcopy_job_t;
+
+static fcopy_job_t fcopy_jobs[FCOPY_JOBS_MAX];
+static uint32_t    fcopy_job_next = 1;
+
+static fcopy_ent_t *
+fcopy_ent_new(const char *src, const char *dst, uint type)
+{
+    uint         srclen = strlen(src) + 1;
+    uint         dstlen = strlen(dst) + 1;
+    fcopy_ent_t *ent = malloc(sizeof (*ent) + srclen + dstlen);
+
+    if (ent == NULL)
+        return (NULL);
+    ent->ce_next = NULL;
+    ent->ce_src  = (char *) (ent + 1);
+    ent->ce_dst  = ent->ce_src + srclen;
+    ent->ce_type = type;
+    memcpy(ent->ce_src, src, srclen);
+    memcpy(ent->ce_dst, dst, dstlen);
+    return (ent);
+}
+
+static void
+fcopy_job_free(fcopy_job_t *job)
+{
+    if (job->cj_job == 0)
+        return;  // Slot is not in use
+    fcopy_ent_t *ent;
+
+    if (job->cj_sfd >= 0)
+        close(job->cj_sfd);
+    if (job->cj_dfd >= 0)
+        close(job->cj_dfd);
+    if (job->cj_cur != NULL)
+        free(job->cj_cur);
+    while ((ent = job->cj_head) != NULL) {
+        job->cj_head = ent->ce_next;
+        free(ent);
+    }
+    while ((ent = job->cj_rmdirs) != NULL) {
+        job->cj_rmdirs = ent->ce_next;
+        free(ent);
+    }
+    if (job->cj_buf != NULL)
+        free(job->cj_buf);
+    memset(job, 0, sizeof (*job));
+    job->cj_sfd = -1;
+    job->cj_dfd = -1;
+}
+
+/*
+ * fcopy_queue
+ * -----------
+ * Adds the specified host object to the copy job. Directories (when
+ * recursive) are walked here, so the job knows the total amount of
+ * work before copying starts. A directory is always queued before
+ * its contents.
+ */
+static uint
+fcopy_queue(fcopy_job_t *job, const char *src, const char *dst)
+{
+    fcopy_ent_t   *ent;
+    struct stat    st;
+    DIR           *dir;
+    struct dirent *dent;
+    uint           type;
+    uint           rc = KM_STATUS_OK;
+
+    if (lstat(src, &st)) {
+        fsprintf("fcopy lstat(%s) fail: %d\n", src, errno);
+        return (errno_to_km_status());
+    }
+    type = st_mode_to_hm_type(st.st_mode);
+    if ((type == HM_TYPE_DIR) && ((job->cj_flags & HM_COPY_RECURSIVE) == 0))
+        return (KM_STATUS_INVALID);
+    if ((type != HM_TYPE_FILE) && (type != HM_TYPE_DIR) &&
+        (type != HM_TYPE_LINK)) {
+        fsprintf("fcopy skipping %s (type %x)\n", src, type);
+        return (KM_STATUS_OK);
+    }
+    if ((ent = fcopy_ent_new(src, dst, type)) == NULL)
+        return (KM_STATUS_FAIL);
+    if (job->cj_tail == NULL)
+        job->cj_head = ent;
+    else
+        job->cj_tail->ce_next = ent;
+    job->cj_tail = ent;
+
+    if (type == HM_TYPE_FILE) {
+        job->cj_files_total++;
+        job->cj_bytes_total += st.st_size;
+        return (KM_STATUS_OK);
+    }
+    if (type != HM_TYPE_DIR)
+        return (KM_STATUS_OK);
+
+    if (job->cj_flags & HM_COPY_MOVE) {
+        /* Source directories are removed deepest first after the copy */
+        fcopy_ent_t *rment = fcopy_ent_new(src, dst, type);
+        if (rment == NULL)
+            return (KM_STATUS_FAIL);
+        rment->ce_next = job->cj_rmdirs;
+        job->cj_rmdirs = rment;
+    }
+
+    if ((dir = opendir(src)) == NULL) {
+        fsprintf("fcopy opendir(%s) fail: %d\n", src, errno);
+        return (errno_to_km_status());
+    }
+    while ((rc == KM_STATUS_OK) && ((dent = readdir(dir)) != NULL)) {
+        char *nsrc;
+        char *ndst;
+        if ((strcmp(dent->d_name, ".") == 0) ||
+            (strcmp(dent->d_name, "..") == 0))
+            continue;
+        nsrc = malloc(strlen(src) + strlen(dent->d_name) + 2);
+        ndst = malloc(strlen(dst) + strlen(dent->d_name) + 2);
+        if ((nsrc == NULL) || (ndst == NULL)) {
+            rc = KM_STATUS_FAIL;
+        } else {
+            sprintf(nsrc, "%s/%s", src, dent->d_name);
+            sprintf(ndst, "%s/%s", dst, dent->d_name);
+            rc = fcopy_queue(job, nsrc, ndst);
+        }
+        if (nsrc != NULL)
+            free(nsrc);
+        if (ndst != NULL)
+            free(ndst);
+    }
+    closedir(dir);
+    return (rc);
+}
+
+static void
+fcopy_set_attrs(const char *path, struct stat *st)
+{
+#ifdef __MINGW32__
+    struct _utimbuf times;
+    times.actime  = st->st_atime;
+    times.modtime = st->st_mtime;
+    if (_utime(path, &times))
+        fsprintf("fcopy utime(%s) fail: %d\n", path, errno);
+#elif defined(OSX)
+    struct timeval times[2];
+    timespec_to_timeval(&times[0], &st->st_atimespec);
+    timespec_to_timeval(&times[1], &st->st_mtimespec);
+    if (utimes(path, times))
+        fsprintf("fcopy utimes(%s) fail: %d\n", path, errno);
+#else
+    struct timespec times[2];
+    times[0] = st->st_atim;
+    times[1] = st->st_mtim;
+    if (utimensat(AT_FDCWD, path, times, AT_SYMLINK_NOFOLLOW))
+        fsprintf("fcopy utimensat(%s) fail: %d\n", path, errno);
+#endif
+    if (chmod(path, st->st_mode & 07777))
+        fsprintf("fcopy chmod(%s) fail: %d\n", path, errno);
+}
+
+/*
+ * fcopy_file_start
+ * ----------------
+ * Opens the source and destination of a file copy. On Linux, an
+ * attempt is first made to clone (reflink) the file, which completes
+ * the copy without moving any data on filesystems which support it.
+ */
+static uint
+fcopy_file_start(fcopy_job_t *job, fcopy_ent_t *ent)
+{
+    uint oflags = O_WRONLY | O_CREAT | O_TRUNC;
+
+    job->cj_cur = ent;  // Freed with the job on failure
+    if (job->cj_flags & HM_COPY_NOCLOBBER)
+        oflags |= O_EXCL;
+#ifdef __MINGW32__
+    oflags |= O_BINARY;
+    job->cj_sfd = open(ent->ce_src, O_RDONLY | O_BINARY);
+#else
+    job->cj_sfd = open(ent->ce_src, O_RDONLY);
+#endif
+    if ((job->cj_sfd < 0) || fstat(job->cj_sfd, &job->cj_st)) {
+        fsprintf("fcopy open(%s) fail: %d\n", ent->ce_src, errno);
+        return (errno_to_km_status());
+    }
+    job->cj_dfd = open(ent->ce_dst, oflags, (job->cj_st.st_mode & 0777) | 0600);
+    if (job->cj_dfd < 0) {
+        fsprintf("fcopy create(%s) fail: %d\n", ent->ce_dst, errno);
+        return (errno_to_km_status());
+    }
+#if defined(LINUX) && defined(FICLONE)
+    if ((job->cj_st.st_size > 0) &&
+        (ioctl(job->cj_dfd, FICLONE, job->cj_sfd) == 0)) {
+        job->cj_bytes += job->cj_st.st_size;
+        if (lseek(job->cj_sfd, 0, SEEK_END) < 0)
+            return (errno_to_km_status());
+    }
+#endif
+    return (KM_STATUS_OK);
+}
+
+/*
+ * fcopy_file_chunk
+ * ----------------
+ * Copies the next portion of the current file. Returns KM_STATUS_EOF
+ * when the file has been completely copied.
+ */
+static uint
+fcopy_file_chunk(fcopy_job_t *job)
+{
+    ssize_t len;
+
+#ifdef LINUX
+    if (job->cj_no_cfr == 0) {
+        len = copy_file_range(job->cj_sfd, NULL, job->cj_dfd, NULL,
+                              FCOPY_CHUNK, 0);
+        if (len > 0) {
+            job->cj_bytes += len;
+            return (KM_STATUS_OK);
+        }
+        if (len == 0)
+            return (KM_STATUS_EOF);
+        if ((errno != EXDEV) && (errno != ENOSYS) && (errno != EINVAL) &&
+            (errno != EOPNOTSUPP)) {
+            return (errno_to_km_status());
+        }
+        /* Not supported between these files; fall back to read/write */
+        job->cj_no_cfr = 1;
+    }
+#endif
+    if ((job->cj_buf == NULL) &&
+        ((job->cj_buf = malloc(FCOPY_BUFSIZE)) == NULL)) {
+        return (KM_STATUS_FAIL);
+    }
+    len = read(job->cj_sfd, job->cj_buf, FCOPY_BUFSIZE);
+    if (len < 0)
+        return (errno_to_km_status());
+    if (len == 0)
+        return (KM_STATUS_EOF);
+    if (write(job->cj_dfd, job->cj_buf, len) != len)
+        return (errno_to_km_status());
+    job->cj_bytes += len;
+    return (KM_STATUS_OK);
+}
+
+static uint
+fcopy_file_finish(fcopy_job_t *job)
+{
+    fcopy_ent_t *ent = job->cj_cur;
+    uint         rc  = KM_STATUS_OK;
+
+    close(job->cj_sfd);
+    job->cj_sfd = -1;
+    if (close(job->cj_dfd))
+        rc = errno_to_km_status();
+    job->cj_dfd = -1;
+    job->cj_cur = NULL;
+    job->cj_no_cfr = 0;
+    if (rc == KM_STATUS_OK) {
+        fcopy_set_attrs(ent->ce_dst, &job->cj_st);
+        if ((job->cj_flags & HM_COPY_MOVE) && unlink(ent->ce_src))
+            rc = errno_to_km_status();
+        job->cj_files++;
+    }
+    free(ent);
+    return (rc);
+}
+
+static uint
+fcopy_object(fcopy_job_t *job, fcopy_ent_t *ent)
+{
+    struct stat st;
+
+    switch (ent->ce_type) {
+        case HM_TYPE_FILE:
+            return (fcopy_file_start(job, ent));
+        case HM_TYPE_DIR:
+            if (lstat(ent->ce_src, &st))
+                break;
+            if (mkdir(ent->ce_dst, (st.st_mode & 0777) | 0700)) {
+                if ((errno != EEXIST) || (lstat(ent->ce_dst, &st)) ||
+                    !S_ISDIR(st.st_mode)) {
+                    break;
+                }
+            }
+            free(ent);
+            return (KM_STATUS_OK);
+#ifdef ALLOW_CREATE_LINK
+        case HM_TYPE_LINK: {
+            char    lbuf[PATH_MAX];
+            ssize_t llen = readlink(ent->ce_src, lbuf, sizeof (lbuf) - 1);
+            if (llen < 0)
+                break;
+            lbuf[llen] = '\0';
+            if (symlink(lbuf, ent->ce_dst))
+                break;
+            if ((job->cj_flags & HM_COPY_MOVE) && unlink(ent->ce_src))
+                break;
+            free(ent);
+            return (KM_STATUS_OK);
+        }
+#endif
+        default:
+            fsprintf("fcopy skipping %s\n", ent->ce_src);
+            free(ent);
+            return (KM_STATUS_OK);
+    }
+    fsprintf("fcopy %s to %s fail: %d\n", ent->ce_src, ent->ce_dst, errno);
+    free(ent);
+    return (errno_to_km_status());
+}
+
+/*
+ * fcopy_run
+ * ---------
+ * Performs copy work until the job is complete, an error occurs, or
+ * the time slice for this request has expired. Returns KM_STATUS_EOF
+ * when the job is complete.
+ */
+static uint
+fcopy_run(fcopy_job_t *job)
+{
+    struct timeval tv_timeout;
+    fcopy_ent_t   *ent;
+    uint           rc;
+
+    calc_timeout_msec(&tv_timeout, FCOPY_SLICE_MSEC);
+    while (!time_has_elapsed(&tv_timeout)) {
+        if (job->cj_cur != NULL) {
+            rc = fcopy_file_chunk(job);
+            if (rc == KM_STATUS_EOF)
+                rc = fcopy_file_finish(job);
+            if (rc != KM_STATUS_OK)
+                return (rc);
+            continue;
+        }
+        if ((ent = job->cj_head) == NULL)
+            break;
+        job->cj_head = ent->ce_next;
+        if (job->cj_head == NULL)
+            job->cj_tail = NULL;
+        if ((rc = fcopy_object(job, ent)) != KM_STATUS_OK)
+            return (rc);
+    }
+    if ((job->cj_cur != NULL) || (job->cj_head != NULL))
+        return (KM_STATUS_OK);
+
+    /* Move: remove emptied source directories */
+    while ((ent = job->cj_rmdirs) != NULL) {
+        job->cj_rmdirs = ent->ce_next;
+        if (rmdir(ent->ce_src))
+            fsprintf("fcopy rmdir(%s) fail: %d\n", ent->ce_src, errno);
+        free(ent);
+    }
+    return (KM_STATUS_EOF);
+}
+
+/*
+ * fcopy_new_job
+ * -------------
+ * Resolves the source and destination names of a new copy request and
+ * builds the list of objects to copy. As with cp(1), a destination
+ * which is an existing directory receives a copy of the source within.
+ */
+static uint
+fcopy_new_job(hm_fcopy_t *hm, fcopy_job_t *job)
+{
+    handle_ent_t *phandle_src = handle_get(hm->hm_shandle);
+    handle_ent_t *phandle_dst = handle_get(hm->hm_dhandle);
+    char         *name_src    = (char *)(hm + 1);
+    char         *name_dst    = name_src + strlen(name_src) + 1;
+    char         *apath_src   = NULL;
+    char         *apath_dst   = NULL;
+    char         *path_src    = NULL;
+    char         *path_dst    = NULL;
+    uint          srclen;
+    uint          rc          = KM_STATUS_INVALID;
+    struct stat   st;
+
+    if (((apath_src = make_amiga_relpath(&phandle_src, name_src)) == NULL) ||
+        ((apath_dst = make_amiga_relpath(&phandle_dst, name_dst)) == NULL)) {
+        rc = KM_STATUS_NOEXIST;
+        goto fcopy_new_fail;
+    }
+    if ((phandle_src == NULL) || (phandle_dst == NULL)) {
+        fsprintf("fcopy can't copy to or from the volume directory\n");
+        goto fcopy_new_fail;
+    }
+    path_src = make_host_path(phandle_src->he_avolume, apath_src);
+    path_dst = make_host_path(phandle_dst->he_avolume, apath_dst);
+    if ((path_src == NULL) || (path_dst == NULL))
+        goto fcopy_new_fail;
+
+    if (volume_get_by_path(path_src, 0) != NULL) {
+        fsprintf("fcopy(%s) can't copy a volume\n", path_src);
+        rc = KM_STATUS_PERM;
+        goto fcopy_new_fail;
+    }
+
+    if ((stat(path_dst, &st) == 0) && S_ISDIR(st.st_mode)) {
+        /* Copy into existing directory */
+        const char *base = strrchr(path_src, '/');
+        char *npath = malloc(strlen(path_dst) + strlen(path_src) + 2);
+        base = (base == NULL) ? path_src : base + 1;
+        if (npath == NULL) {
+            rc = KM_STATUS_FAIL;
+            goto fcopy_new_fail;
+        }
+        sprintf(npath, "%s/%s", path_dst, base);
+        free(path_dst);
+        path_dst = npath;
+    }
+
+    /* Don't allow a directory to be copied inside itself */
+    srclen = strlen(path_src);
+    if ((strncmp(path_src, path_dst, srclen) == 0) &&
+        ((path_dst[srclen] == '/') || (path_dst[srclen] == '\0'))) {
+        fsprintf("fcopy(%s) destination %s is within source\n",
+                 path_src, path_dst);
+        goto fcopy_new_fail;
+    }
+
+    if ((job->cj_flags & HM_COPY_NOCLOBBER) && (lstat(path_dst, &st) == 0)) {
+        rc = KM_STATUS_EXIST;
+        goto fcopy_new_fail;
+    }
+
+    fsprintf("fcopy(%s to %s) flags=%x\n", path_src, path_dst, job->cj_flags);
+    if ((job->cj_flags & HM_COPY_MOVE) && (rename(path_src, path_dst) == 0)) {
+        /* Same filesystem: nothing to copy */
+        rc = KM_STATUS_OK;
+    } else if ((job->cj_flags & HM_COPY_MOVE) && (errno != EXDEV)) {
+        rc = errno_to_km_status();
+    } else {
+        rc = fcopy_queue(job, path_src, path_dst);
+    }
+
+fcopy_new_fail:
+    if (apath_src != NULL)
+        free(apath_src);
+    if (apath_dst != NULL)
+        free(apath_dst);
+    if (path_src != NULL)
+        free(path_src);
+    if (path_dst != NULL)
+        free(path_dst);
+    return (rc);
+}
+
+/*
+ * fcopy_job_alloc
+ * ---------------
+ * Finds a free copy job slot. A job which has had no request for
+ * FCOPY_IDLE_SEC was abandoned by its client, so its slot may be
+ * reclaimed. Returns NULL if all slots hold live jobs.
+ */
+static fcopy_job_t *
+fcopy_job_alloc(void)
+{
+    time_t       now  = time(NULL);
+    fcopy_job_t *idle = NULL;
+    uint         slot;
+
+    for (slot = 0; slot < ARRAY_SIZE(fcopy_jobs); slot++) {
+        fcopy_job_t *job = &fcopy_jobs[slot];
+        if (job->cj_job == 0)
+            return (job);
+        if ((now - job->cj_last >= FCOPY_IDLE_SEC) &&
+            ((idle == NULL) || (idle->cj_last > job->cj_last))) {
+            idle = job;
+        }
+    }
+    if (idle != NULL) {
+        fsprintf("fcopy job %x abandoned\n", idle->cj_job);
+        fcopy_job_free(idle);
+    }
+    return (idle);
+}
+
+/*
+ * fcopy_job_find
+ * --------------
+ * Returns the active copy job with the specified number, or NULL.
+ */
+static fcopy_job_t *
+fcopy_job_find(uint32_t jobnum)
+{
+    uint slot;
+
+    if (jobnum == 0)
+        return (NULL);
+    for (slot = 0; slot < ARRAY_SIZE(fcopy_jobs); slot++)
+        if (fcopy_jobs[slot].cj_job == jobnum)
+            return (&fcopy_jobs[slot]);
+    return (NULL);
+}
+
+/*
+ * sm_fcopy
+ * --------
+ * Copy (or move) a file or directory tree entirely on the USB host, so
+ * that the data need not pass through the Amiga. Work is done in time
+ * slices: see hm_fcopy_t.
+ */
+static uint
+sm_fcopy(hm_fcopy_t *hm, uint *status)
+{
+    static fcopy_job_t no_job;  // Reply progress when there is no job
+    fcopy_job_t *job;
+    uint         flags = SWAP16(hm->hm_flags);
+    uint         rc;
+
+    hm->hm_hdr.km_op |= KM_OP_REPLY;
+
+    if (hm->hm_job == 0) {
+        job = fcopy_job_alloc();
+        if (job == NULL) {
+            /* Don't disturb copies which other clients have in progress */
+            fsprintf("fcopy all %u jobs are busy\n", FCOPY_JOBS_MAX);
+            job = &no_job;
+            rc = KM_STATUS_UNAVAIL;
+        } else {
+            memset(job, 0, sizeof (*job));
+            job->cj_sfd   = -1;
+            job->cj_dfd   = -1;
+            job->cj_job   = fcopy_job_next++;
+            job->cj_flags = flags;
+            job->cj_last  = time(NULL);
+            if (fcopy_job_next == 0)
+                fcopy_job_next = 1;
+            rc = fcopy_new_job(hm, job);
+        }
+    } else if ((job = fcopy_job_find(hm->hm_job)) == NULL) {
+        fsprintf("fcopy job %x is not active\n", hm->hm_job);
+        job = &no_job;
+        rc = KM_STATUS_INVALID;
+    } else if (flags & HM_COPY_ABORT) {
+        fsprintf("fcopy job %x aborted\n", hm->hm_job);
+        rc = KM_STATUS_EOF;
+    } else {
+        job->cj_last = time(NULL);
+        rc = KM_STATUS_OK;
+    }
+    if ((rc == KM_STATUS_OK) && ((flags & HM_COPY_ABORT) == 0))
+        rc = fcopy_run(job);
+
+    hm->hm_job           = job->cj_job;
+    hm->hm_flags         = 0;
+    hm->hm_files         = SWAP32(job->cj_files);
+    hm->hm_files_total   = SWAP32(job->cj_files_total);
+    hm->hm_kbytes        = SWAP32((uint32_t) (job->cj_bytes >> 10));
+    hm->hm_kbytes_total  = SWAP32((uint32_t) (job->cj_bytes_total >> 10));
+    if (rc == KM_STATUS_EOF) {
+        hm->hm_flags = SWAP16(HM_COPY_DONE);
+        rc = KM_STATUS_OK;
+    }
+    if (rc != KM_STATUS_OK)
+        hm->hm_flags = SWAP16(HM_COPY_DONE);
+    if (hm->hm_flags != 0)
+        fcopy_job_free(job);
+    hm->hm_hdr.km_status = rc;
+    return (send_msg(hm, sizeof (*hm), status));
+}
+
+/*
+ * file_read_at
+ * ------------
+ * Reads from the specified file offset without disturbing the current
+ * file position, which is shared with other requests on the handle.
+ */
+static ssize_t
+file_read_at(int fd, void *buf, size_t len, off64_t offset)
+{
+    off64_t pos = lseek64(fd, 0, SEEK_CUR);
+    ssize_t rc;
+
+    if ((pos < 0) || (lseek64(fd, offset, SEEK_SET) < 0))
+        return (-1);
+    rc = read(fd, buf, len);
+    (void) lseek64(fd, pos, SEEK_SET);
+    return (rc);
+}
+
+/*
+ * sm_fsigs
+ * --------
+ * Replies with block signatures of an open file, for delta transfer.
+ * See hm_fsigs_t for the signature format.
+ */
+static uint
+sm_fsigs(hm_fsigs_t *hm, uint *status)
+{
+    handle_t      hm_handle  = hm->hm_handle;
+    uint          hm_blksize = SWAP32(hm->hm_blksize);
+    uint          hm_block   = SWAP32(hm->hm_block);
+    uint          hm_count   = SWAP32(hm->hm_count);
+    handle_ent_t *handle     = handle_get(hm_handle);
+    hm_fsigs_t   *hmr;
+    hm_fsig_t    *sig;
+    uint8_t      *buf;
+    uint          count;
+    uint          rc;
+
+    fsprintf("fsigs(%x, bs=%x b=%x c=%x)\n",
+             hm_handle, hm_blksize, hm_block, hm_count);
+    hm->hm_hdr.km_op |= KM_OP_REPLY;
+    hm->hm_count = 0;
+
+    if (handle == NULL) {
+        fsprintf("handle get %x failed\n", hm_handle);
+        hm->hm_hdr.km_status = KM_STATUS_FAIL;
+        return (send_msg(hm, sizeof (*hm), status));
+    }
+    if (((handle->he_mode & HM_MODE_READ) == 0) ||
+        (handle->he_mode & HM_MODE_DIR) ||
+        (handle->he_type != HM_TYPE_FILE) ||
+        (hm_blksize == 0) || (hm_blksize > HM_FSIGS_BYTES_MAX)) {
+        hm->hm_hdr.km_status = KM_STATUS_INVALID;
+        return (send_msg(hm, sizeof (*hm), status));
+    }
+    if (hm_count > HM_FSIGS_MAX)
+        hm_count = HM_FSIGS_MAX;
+    if (hm_count > HM_FSIGS_BYTES_MAX / hm_blksize)
+        hm_count = HM_FSIGS_BYTES_MAX / hm_blksize;
+
+    hmr = malloc(sizeof (*hmr) + hm_count * sizeof (*sig));
+    buf = malloc(hm_blksize);
+    if ((hmr == NULL) || (buf == NULL)) {
+        free(hmr);
+        free(buf);
+        hm->hm_hdr.km_status = KM_STATUS_FAIL;
+        return (send_msg(hm, sizeof (*hm), status));
+    }
+    memcpy(hmr, hm, sizeof (*hmr));
+    sig = (hm_fsig_t *) (hmr + 1);
+
+    rc = KM_STATUS_OK;
+    for (count = 0; count < hm_count; count++, sig++) {
+        off64_t  offset = (off64_t) (hm_block + count) * hm_blksize;
+        ssize_t  len    = file_read_at(handle->he_fd, buf, hm_blksize, offset);
+        uint32_t a = 0;
+        uint32_t b = 0;
+        uint     pos;
+
+        if (len < 0) {
+            rc = errno_to_km_status();
+            break;
+        }
+        if (len < hm_blksize)
+            break;  // Only complete blocks have signatures
+        for (pos = 0; pos < hm_blksize; pos++) {
+            a += buf[pos];
+            b += (hm_blksize - pos) * buf[pos];
+        }
+        sig->hs_weak   = SWAP32((a & 0xffff) | (b << 16));
+        sig->hs_strong = SWAP32(crc32(0, buf, hm_blksize));
+    }
+    free(buf);
+
+    hmr->hm_hdr.km_status = rc;
+    hmr->hm_count = SWAP32(count);
+    rc = send_msg(hmr, sizeof (*hmr) + count * sizeof (*sig), status);
+    free(hmr);
+    return (rc);
+}
+
+/*
+ * sm_fcopyrange
+ * -------------
+ * Copies a range of one open file to the current position of another.
+ * This allows a delta transfer to reuse data already present on the
+ * USB host.
+ */
+static uint
+sm_fcopyrange(hm_fcopyrange_t *hm, uint *status)
+{
+    handle_ent_t *shandle   = handle_get(hm->hm_shandle);
+    handle_ent_t *dhandle   = handle_get(hm->hm_dhandle);
+    uint          hm_length = SWAP32(hm->hm_length);
+    off64_t       offset    = ((uint64_t) SWAP32(hm->hm_off_hi) << 32) |
+                              SWAP32(hm->hm_off_lo);
+    uint8_t      *buf       = NULL;
+    uint          rc        = KM_STATUS_OK;
+    ssize_t       len;
+
+    fsprintf("fcopyrange(%x, o=%jx, %x, l=%x)\n", hm->hm_shandle,
+             (intmax_t) offset, hm->hm_dhandle, hm_length);
+    hm->hm_hdr.km_op |= KM_OP_REPLY;
+
+    if ((shandle == NULL) || (dhandle == NULL)) {
+        fsprintf("handle get %x or %x failed\n",
+                 hm->hm_shandle, hm->hm_dhandle);
+        rc = KM_STATUS_FAIL;
+        goto reply_copyrange;
+    }
+    if (((shandle->he_mode & HM_MODE_READ) == 0) ||
+        ((dhandle->he_mode & HM_MODE_WRITE) == 0) ||
+        (shandle->he_type != HM_TYPE_FILE) ||
+        (dhandle->he_type != HM_TYPE_FILE) ||
+        (hm_length > HM_FCOPYRANGE_MAX)) {
+        rc = KM_STATUS_INVALID;
+        goto reply_copyrange;
+    }
+
+#ifdef LINUX
+    while (hm_length > 0) {
+        loff_t off_in = offset;
+        len = copy_file_range(shandle->he_fd, &off_in, dhandle->he_fd, NULL,
+                              hm_length, 0);
+        if (len <= 0)
+            break;
+        offset += len;
+        hm_length -= len;
+    }
+#endif
+    while (hm_length > 0) {
+        uint rlen = (hm_length < FCOPY_BUFSIZE) ? hm_length : FCOPY_BUFSIZE;
+        if ((buf == NULL) && ((buf = malloc(FCOPY_BUFSIZE)) == NULL)) {
+            rc = KM_STATUS_FAIL;
+            break;
+        }
+        len = file_read_at(shandle->he_fd, buf, rlen, offset);
+        if (len < 0) {
+            rc = errno_to_km_status();
+            break;
+        }
+        if (len == 0) {
+            rc = KM_STATUS_EOF;  // Source is shorter than expected
+            break;
+        }
+        if (write(dhandle->he_fd, buf, len) != len) {
+            rc = errno_to_km_status();
+            break;
+        }
+        offset += len;
+        hm_length -= len;
+    }
+    free(buf);
+
+reply_copyrange:
+    hm->hm_hdr.km_status = rc;
+    return (send_msg(hm, sizeof (*hm), status));
+}
+
 static uint
 sm_fpath(hm_fhandle_t *hm, uint *status)
 {
@@ -6337,6 +7237,7 @@ process_msg(uint status, uint8_t *rxdata, uint rxlen)
     do {
         switch (op) {
             case KM_OP_NULL:
+            case KM_OP_NOP:
                 rc = sm_null(km, &status);
                 break;
             case KM_OP_LOOPBACK:
@@ -6381,6 +7282,15 @@ process_msg(uint status, uint8_t *rxdata, uint rxlen)
             case KM_OP_FSETPERMS:
                 rc = sm_fsetprotect((hm_fopenhandle_t *)rxdata, &status);
                 break;
+            case KM_OP_FCOPY:
+                rc = sm_fcopy((hm_fcopy_t *)rxdata, &status);
+                break;
+            case KM_OP_FSIGS:
+                rc = sm_fsigs((hm_fsigs_t *)rxdata, &status);
+                break;
+            case KM_OP_FCOPYRANGE:
+                rc = sm_fcopyrange((hm_fcopyrange_t *)rxdata, &status);
+                break;
             default:
                 rc = sm_unknown(km, &status);
                 break;
@@ -6597,6 +7507,434 @@ clock_ks_show(int enter)
     return (0);
 }
 
+#ifndef __MINGW32__
+/*
+ * snoop_sig_stop() requests that a running bus snoop capture stop.
+ */
+static void
+snoop_sig_stop(int sig)
+{
+    snoop_stop = 1;
+}
+#endif
+
+/*
+ * snoop_capture
+ * -------------
+ * Starts a binary bus snoop on Kicksmash and writes the received frames
+ * to a trace file until interrupted (^C) or at least max_ent entries have
+ * been captured (0 = no limit). Frames which fail the CRC check are
+ * dropped, and the input is scanned for the next frame magic. Frame
+ * sequence gaps and capture ring overruns reported by Kicksmash are
+ * summarized at the end.
+ */
+static int
+snoop_capture(const char *filename, uint max_ent)
+{
+    static uint16_t  payload[KS_SNOOP_MAX * 2 + 2];
+    ks_snoop_frame_t hdr;
+    char             cmd[32];
+    FILE            *fp;
+    uint32_t         crc;
+    uint             plen;
+    uint             frames    = 0;
+    uint             entries   = 0;
+    uint             lentries  = 0;
+    uint             overruns  = 0;
+    uint             bad       = 0;
+    uint             missing   = 0;
+    uint             skipped   = 0;
+    uint             seq       = 0;
+    uint             idle      = 0;
+    uint             stopping  = 0;
+    uint             ended     = 0;
+    int              rc        = 0;
+#ifndef __MINGW32__
+    struct sigaction sa;
+    struct sigaction osa;
+#endif
+
+    fp = fopen(filename, "wb");
+    if (fp == NULL) {
+        warn("Failed to open %s", filename);
+        return (1);
+    }
+
+    snprintf(cmd, sizeof (cmd), "snoop %s bin", snoop_capmode);
+    if (send_cmd(cmd)) {
+        fclose(fp);
+        return (1);  // "timeout" was reported in this case
+    }
+
+    snoop_stop = 0;
+#ifndef __MINGW32__
+    memset(&sa, 0, sizeof (sa));
+    sa.sa_handler = snoop_sig_stop;
+    (void) sigaction(SIGINT, &sa, &osa);
+    printf("Capturing to %s; press ^C to stop\n", filename);
+#endif
+
+    while (1) {
+        if ((snoop_stop || ((max_ent != 0) && (entries >= max_ent))) &&
+            !stopping) {
+            stopping = 1;
+            send_ll_str("\n");  // Any input stops the capture
+        }
+
+        /* Locate the next frame */
+        if (receive_ll(&hdr.ksf_magic, sizeof (hdr.ksf_magic),
+                       100, false) != sizeof (hdr.ksf_magic)) {
+            if (stopping && (++idle > 4)) {
+                warnx("No end of capture from Kicksmash");
+                rc = 1;
+                break;
+            }
+            continue;
+        }
+        idle = 0;
+        while (hdr.ksf_magic != KS_SNOOP_MAGIC) {
+            uint8_t ch;
+            if (receive_ll(&ch, 1, 100, false) != 1)
+                break;
+            hdr.ksf_magic = (hdr.ksf_magic >> 8) | ((uint32_t) ch << 24);
+            skipped++;
+        }
+        if (hdr.ksf_magic != KS_SNOOP_MAGIC)
+            continue;
+
+        if ((receive_ll((uint8_t *) &hdr + sizeof (hdr.ksf_magic),
+                        sizeof (hdr) - sizeof (hdr.ksf_magic), 100, true) !=
+             sizeof (hdr) - sizeof (hdr.ksf_magic)) ||
+            (hdr.ksf_count > KS_SNOOP_MAX)) {
+            bad++;
+            continue;
+        }
+        plen = hdr.ksf_count * 2 * sizeof (uint16_t);
+        if (receive_ll(payload, plen + sizeof (crc), 100, true) !=
+            plen + sizeof (crc)) {
+            bad++;
+            continue;
+        }
+        crc = crc32(0, &hdr, sizeof (hdr));
+        crc = crc32(crc, payload, plen);
+        if (memcmp(&crc, (uint8_t *) payload + plen, sizeof (crc)) != 0) {
+            bad++;
+            continue;
+        }
+
+        if ((frames != 0) && (hdr.ksf_seq != (uint16_t) seq))
+            missing += (uint16_t) (hdr.ksf_seq - seq);
+        seq       = hdr.ksf_seq + 1;
+        overruns  = hdr.ksf_overruns;
+        entries  += hdr.ksf_count;
+        frames++;
+
+        if ((fwrite(&hdr, sizeof (hdr), 1, fp) != 1) ||
+            (fwrite(payload, plen + sizeof (crc), 1, fp) != 1)) {
+            warn("Failed to write %s", filename);
+            rc = 1;
+            break;
+        }
+        if (hdr.ksf_flags & KS_SNOOP_FLAG_END) {
+            ended = 1;
+            break;
+        }
+        if (entries - lentries >= 0x10000) {
+            lentries = entries;
+            printf("\r%u entries  %u overruns", entries, overruns);
+            fflush(stdout);
+        }
+    }
+
+    if (!ended)
+        send_ll_str("\n");
+    discard_input(250);  // Command prompt
+#ifndef __MINGW32__
+    (void) sigaction(SIGINT, &osa, NULL);
+#endif
+    if (fclose(fp) != 0) {
+        warn("Failed to write %s", filename);
+        rc = 1;
+    }
+
+    printf("\r%u entries in %u frames written to %s\n",
+           entries, frames, filename);
+    if (overruns || missing || bad || skipped) {
+        printf("Capture overruns %u  missing frames %u  bad frames %u  "
+               "bytes skipped %u\n", overruns, missing, bad, skipped);
+    }
+    return (rc);
+}
+
+/*
+ * trigger_fetch
+ * -------------
+ * Retrieves the triggered bus capture from Kicksmash (armed with the
+ * "snoop trig" command) and writes it to a trace file in the same frame
+ * format as snoop_capture(), so that it may be examined by snooptrace.
+ */
+static int
+trigger_fetch(const char *filename)
+{
+    static ks_trig_capture_t cap;
+    static uint16_t  payload[KS_TRIG_MAX * 2];
+    ks_snoop_frame_t hdr;
+    FILE            *fp;
+    uint32_t         crc;
+    uint             rxlen;
+    uint             status;
+    uint             count;
+    rc_t             rc;
+
+    if (send_cmd("prom service")) {
+        printf("could not enter prom service\n");
+        return (RC_TIMEOUT); // "timeout" was reported in this case
+    }
+    rc = send_ks_cmd(KS_CMD_GET | KS_GET_TRIGGER, NULL, 0, &cap, sizeof (cap),
+                     &status, &rxlen, 0);
+    if (rc != 0) {
+        printf("KS trigger request failed: %d (%s)\n", rc, smash_err(rc));
+        return (rc);
+    }
+    if (cap.ktc_state != KS_TRIG_STATE_DONE) {
+        printf("No triggered capture available (trigger is %s)\n",
+               (cap.ktc_state == KS_TRIG_STATE_ARMED) ? "armed" :
+               (cap.ktc_state == KS_TRIG_STATE_POST) ? "still capturing" :
+               "not armed");
+        return (1);
+    }
+    count = cap.ktc_count;
+    if (count > KS_SNOOP_MAX)
+        count = KS_SNOOP_MAX;
+
+    fp = fopen(filename, "wb");
+    if (fp == NULL) {
+        warn("Failed to open %s", filename);
+        return (1);
+    }
+    memset(&hdr, 0, sizeof (hdr));
+    hdr.ksf_magic = KS_SNOOP_MAGIC;
+    hdr.ksf_count = count;
+    hdr.ksf_mode  = cap.ktc_mode;
+    memcpy(payload, cap.ktc_addr, count * sizeof (uint16_t));
+    memcpy(payload + count, cap.ktc_data, count * sizeof (uint16_t));
+    crc = crc32(0, &hdr, sizeof (hdr));
+    crc = crc32(crc, payload, count * 2 * sizeof (uint16_t));
+    if ((fwrite(&hdr, sizeof (hdr), 1, fp) != 1) ||
+        (fwrite(payload, count * 2 * sizeof (uint16_t), 1, fp) != 1) ||
+        (fwrite(&crc, sizeof (crc), 1, fp) != 1)) {
+        warn("Failed to write %s", filename);
+        fclose(fp);
+        return (1);
+    }
+
+    /* End frame */
+    hdr.ksf_seq++;
+    hdr.ksf_count  = 0;
+    hdr.ksf_flags |= KS_SNOOP_FLAG_END;
+    crc = crc32(0, &hdr, sizeof (hdr));
+    if ((fwrite(&hdr, sizeof (hdr), 1, fp) != 1) ||
+        (fwrite(&crc, sizeof (crc), 1, fp) != 1) ||
+        (fclose(fp) != 0)) {
+        warn("Failed to write %s", filename);
+        return (1);
+    }
+    printf("%u entries written to %s; trigger at entry %u "
+           "(Kicksmash uptime %u.%03u sec)\n", count, filename,
+           cap.ktc_trigger, cap.ktc_when / 1000, cap.ktc_when % 1000);
+    return (0);
+}
+
+static const ks_profile_t *profile_sort;
+
+static int
+profile_compare(const void *ap, const void *bp)
+{
+    uint32_t a = profile_sort->kp_count[*(const uint *) ap];
+    uint32_t b = profile_sort->kp_count[*(const uint *) bp];
+
+    if (a != b)
+        return ((a < b) ? 1 : -1);
+    return ((*(const uint *) ap < *(const uint *) bp) ? -1 : 1);
+}
+
+/*
+ * profile_show
+ * ------------
+ * Retrieves the ROM fetch profile from Kicksmash and displays the bins
+ * in order of decreasing access count.
+ */
+static int
+profile_show(void)
+{
+    static ks_profile_t prof;
+    static uint bins[KS_PROF_BINS];
+    uint64_t total;
+    uint64_t sum = 0;
+    uint     count = 0;
+    uint     rxlen;
+    uint     status;
+    uint     bin;
+    rc_t     rc;
+
+    if (send_cmd("prom service")) {
+        printf("could not enter prom service\n");
+        return (RC_TIMEOUT); // "timeout" was reported in this case
+    }
+    rc = send_ks_cmd(KS_CMD_GET | KS_GET_PROFILE, NULL, 0, &prof,
+                     sizeof (prof), &status, &rxlen, 0);
+    if (rc != 0) {
+        printf("KS profile request failed: %d (%s)\n", rc, smash_err(rc));
+        return (rc);
+    }
+
+    total = prof.kp_other;
+    for (bin = 0; bin < KS_PROF_BINS; bin++) {
+        if (prof.kp_count[bin] != 0) {
+            bins[count++] = bin;
+            total += prof.kp_count[bin];
+        }
+    }
+    printf("Profile %s, %u byte bins, %" PRIu64 " accesses\n",
+           prof.kp_active ? "running" : "stopped", 1U << prof.kp_bin_shift,
+           total);
+    if (prof.kp_overruns != 0)
+        printf("Overruns %u (capture ring lapped; accesses not counted)\n",
+               prof.kp_overruns);
+    if (total == 0)
+        return (0);
+
+    profile_sort = &prof;
+    qsort(bins, count, sizeof (bins[0]), profile_compare);
+    printf("ROMOffset AmigaAddr      Count   Pct   Cum\n");
+    for (bin = 0; bin < count; bin++) {
+        uint32_t offset = prof.kp_base + (bins[bin] << prof.kp_bin_shift);
+        uint32_t word   = offset >> prof.kp_word_shift;
+        uint32_t amiga  = offset |
+                          ((word & (1 << 16)) ? 0x00e00000 : 0x00f80000);
+        sum += prof.kp_count[bins[bin]];
+        printf("%06x    %06x %13u %5.1f %5.1f\n", offset, amiga,
+               prof.kp_count[bins[bin]],
+               prof.kp_count[bins[bin]] * 100.0 / total, sum * 100.0 / total);
+    }
+    if (prof.kp_other != 0)
+        printf("other            %13u %5.1f\n", prof.kp_other,
+               prof.kp_other * 100.0 / total);
+    return (0);
+}
+
+/*
+ * wear_ks_show
+ * ------------
+ * Displays the flash sector erase counts tracked by Kicksmash.
+ */
+static rc_t
+wear_ks_show(void)
+{
+    flash_wear_t wear;
+    uint         sector;
+    uint         rxlen;
+    uint         status;
+    rc_t         rc;
+
+    if (send_cmd("prom service")) {
+        printf("could not enter prom service\n");
+        return (RC_TIMEOUT); // "timeout" was reported in this case
+    }
+    rc = send_ks_cmd(KS_CMD_GET | KS_GET_WEAR, NULL, 0, &wear, sizeof (wear),
+                     &status, &rxlen, 0);
+    if (rc != 0) {
+        printf("KS wear request failed: %d (%s)\n", rc, smash_err(rc));
+        return (rc);
+    }
+
+    printf("Sector Bank WordAddr Erases LastErase\n");
+    for (sector = 0; sector < FW_SECTORS; sector++) {
+        printf("%-6u %-4u %05x   %-6u ", sector,
+               sector / (FW_SECTORS / ROM_BANKS), sector << FW_SECTOR_SHIFT,
+               wear.fw_erase_count[sector]);
+        if (wear.fw_erase_time[sector] == 0) {
+            printf("-\n");
+        } else {
+            time_t timev;
+            struct tm *tm;
+            timev = get_utctime(wear.fw_erase_time[sector] +
+                                AMIGA_SEC_TO_UNIX_SEC);
+            tm = localtime(&timev);
+            printf("%04u-%02u-%02u %02u:%02u:%02u\n",
+                   tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
+                   tm->tm_hour, tm->tm_min, tm->tm_sec);
+        }
+    }
+    return (0);
+}
+
+/*
+ * romindex_show
+ * -------------
+ * Displays the Kickstart index which Kicksmash maintains for its ROM
+ * banks, including the resident modules found in each image.
+ */
+static rc_t
+romindex_show(void)
+{
+    static const char * const state_names[] = {
+        "Stale", "Empty", "Unknown", "Kickstart"
+    };
+    ks_rom_index_t kix;
+    uint8_t        arg[2];
+    uint           bank;
+    uint           rxlen;
+    uint           status;
+    rc_t           rc;
+
+    if (send_cmd("prom service")) {
+        printf("could not enter prom service\n");
+        return (RC_TIMEOUT); // "timeout" was reported in this case
+    }
+
+    printf("Bank  State      Version        Size  Checksum      Modules\n");
+    for (bank = 0; bank < ROM_BANKS; bank++) {
+        const char *name;
+
+        arg[0] = bank;
+        arg[1] = 0;
+        rc = send_ks_cmd(KS_CMD_GET | KS_GET_ROMINDEX, arg, sizeof (arg),
+                         &kix, sizeof (kix), &status, &rxlen, 0);
+        if (rc != 0) {
+            printf("KS romindex request failed: %d (%s)\n",
+                   rc, smash_err(rc));
+            return (rc);
+        }
+        printf("%-5u %-10s ", bank,
+               (kix.kix_state < ARRAY_SIZE(state_names)) ?
+               state_names[kix.kix_state] : "?");
+        if (kix.kix_state != KIX_STATE_KICKSTART) {
+            printf("\n");
+            continue;
+        }
+        kix.kix_release[sizeof (kix.kix_release) - 1] = '\0';
+        kix.kix_id[sizeof (kix.kix_id) - 1] = '\0';
+        printf("%2u.%-3u %-6s %4uK  %08x %-3s %u%s\n",
+               kix.kix_version, kix.kix_revision, kix.kix_release,
+               kix.kix_size >> 10, kix.kix_checksum,
+               (kix.kix_flags & KIX_FLAG_CHECKSUM) ? "ok" : "BAD",
+               kix.kix_modules,
+               (kix.kix_flags & KIX_FLAG_TRUNCATED) ? "+" : "");
+        if (kix.kix_id[0] != '\0')
+            printf("      %s\n", kix.kix_id);
+        name = kix.kix_names;
+        while ((name < kix.kix_names + sizeof (kix.kix_names)) &&
+               (*name != '\0')) {
+            printf("      %.*s\n",
+                   (int) (kix.kix_names + sizeof (kix.kix_names) - name),
+                   name);
+            name += strnlen(name, kix.kix_names + sizeof (kix.kix_names) -
+                            name) + 1;
+        }
+    }
+    return (0);
+}
 
 /*
  * run_mode() handles command line options provided by the user.
@@ -6646,6 +7984,18 @@ run_mode(uint mode, uint bank, uint baseaddr, uint len_specified,
         // XXX: Also add regular clock set service to message mode
         return (clock_ks_show(enter));
     }
+    if (mode & MODE_WEAR)
+        return (wear_ks_show());
+    if (mode & MODE_TRIGGER)
+        return (trigger_fetch(file1));
+    if (mode & MODE_PROFILE)
+        return (profile_show());
+    if (mode & MODE_ROMINDEX)
+        return (romindex_show());
+    if (mode & MODE_SNOOP) {
+        return (snoop_capture(file1,
+                              (len == EEPROM_SIZE_NOT_SPECIFIED) ? 0 : len));
+    }
     if (((file1 == NULL) || (file1[0] == '\0')) &&
         (mode & (MODE_READ | MODE_VERIFY | MODE_WRITE))) {
         warnx("You must specify a filename with -r or -v or -w option\n");
@@ -6981,6 +8331,12 @@ errx(EXIT_FAILURE, "how did we get here?");
                     errx(EXIT_FAILURE, "Only one of -irtv may be specified");
                 mode |= MODE_VERIFY;
                 break;
+            case 'W':
+                if (mode != MODE_UNKNOWN)
+                    errx(EXIT_FAILURE,
+                         "-%c may not be specified with any other mode", ch);
+                mode = MODE_WEAR;
+                break;
             case 'V':
                 print_version(stdout);
                 exit(EXIT_SUCCESS);
@@ -6999,6 +8355,43 @@ errx(EXIT_FAILURE, "how did we get here?");
             case 0x80 + 'm':
                 debug_msg++;
                 break;
+            case 0x80 + 's':
+                if (mode != MODE_UNKNOWN)
+                    errx(EXIT_FAILURE,
+                         "--snoop-file may not be specified with any other "
+                         "mode");
+                mode = MODE_SNOOP;
+                file1 = optarg;
+                break;
+            case 0x80 + 'p':
+                if (mode != MODE_UNKNOWN)
+                    errx(EXIT_FAILURE,
+                         "--profile may not be specified with any other mode");
+                mode = MODE_PROFILE;
+                break;
+            case 0x80 + 'k':
+                if (mode != MODE_UNKNOWN)
+                    errx(EXIT_FAILURE,
+                         "--romindex may not be specified with any other mode");
+                mode = MODE_ROMINDEX;
+                break;
+            case 0x80 + 'T':
+                if (mode != MODE_UNKNOWN)
+                    errx(EXIT_FAILURE,
+                         "--trigger-file may not be specified with any other "
+                         "mode");
+                mode = MODE_TRIGGER;
+                file1 = optarg;
+                break;
+            case 0x80 + 'S':
+                if ((strcmp(optarg, "addr") != 0) &&
+                    (strcmp(optarg, "lo") != 0) &&
+                    (strcmp(optarg, "hi") != 0)) {
+                    errx(EXIT_FAILURE, "Invalid snoop mode \"%s\": "
+                         "use addr, lo, or hi", optarg);
+                }
+                snoop_capmode = optarg;
+                break;
             default:
                 warnx("Unknown option -%c 0x%x", ch, ch);
                 usage(stderr);
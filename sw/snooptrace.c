@@ -0,0 +1,663 @@
+/*
+ * snooptrace
+ * ----------
+ * Offline analyzer for Kicksmash ROM bus snoop traces, as captured by
+ * "hostsmash --snoop-file". Captured ROM addresses are mapped to ROM
+ * offsets and, given a copy of the Kickstart image, to the resident
+ * modules found by walking the image's ROMTag structures. Reported are:
+ *     Access counts per resident module
+ *     The most frequently accessed addresses (hot addresses)
+ *     A timeline of which modules dominate each part of the trace
+ *     Kicksmash message sequences found among the normal ROM fetches
+ *
+ * The trace carries no timestamps, so the timeline is in units of
+ * captured ROM accesses rather than time.
+ *
+ * cc -o snooptrace snooptrace.c crc32.c
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../fw/crc32.h"
+#include "../fw/smash_cmd.h"
+
+#define ARRAY_SIZE(x) (int)((sizeof (x) / sizeof ((x)[0])))
+
+typedef unsigned int uint;
+
+#define ROM_WORDS       0x100000    // 20-bit ROM word address space
+#define ROM_MAX_SIZE    0x80000     // Largest Kickstart image handled
+#define RTC_MATCHWORD   0x4afc      // ROMTag match word
+#define MODULES_MAX     256
+#define TIMELINE_ROWS   40          // Default number of timeline rows
+#define HOT_DEFAULT     20          // Default number of hot addresses shown
+
+#define CAPTURE_ADDR    1
+#define CAPTURE_DATA_LO 2
+#define CAPTURE_DATA_HI 3
+
+static const uint16_t sm_magic[] = { 0x0204, 0x1017, 0x0119, 0x0117 };
+
+/* Resident module found in the ROM image */
+typedef struct {
+    uint     mod_start;     // ROM offset of ROMTag
+    uint     mod_end;       // ROM offset of rt_EndSkip
+    uint8_t  mod_version;   // rt_Version
+    int8_t   mod_pri;       // rt_Pri
+    char     mod_name[40];  // rt_Name
+    uint64_t mod_count;     // Accesses within module
+} module_t;
+
+/* One timeline row */
+typedef struct {
+    uint     *tl_mod_count;  // Accesses per module (index modules + 1)
+    uint      tl_msg;        // Accesses which were message traffic
+    uint      tl_gaps;       // Capture overruns or missing frames
+} timeline_t;
+
+/* Message sequence parser state */
+typedef struct {
+    uint     ms_pos;         // Position in message sequence
+    uint     ms_words;       // Payload words remaining
+    uint     ms_start;       // Entry index of magic start
+    uint     ms_inmsg;       // Entries consumed by the current message
+    uint16_t ms_len;         // Message payload length
+    uint16_t ms_cmd;         // Message command
+} msg_parse_t;
+
+static const char usage_text[] =
+"snooptrace <opts> <trace file>\n"
+"    -h          display usage\n"
+"    -k <file>   Kickstart ROM image for resident module names\n"
+"    -m          list each Kicksmash message found\n"
+"    -n <num>    number of hot addresses to show (default 20)\n"
+"    -t <num>    accesses per timeline row (default trace length / 40)\n"
+"    -w <16|32>  ROM bus width (default 32)\n";
+
+static uint8_t  *rom;                    // Kickstart image (big-endian)
+static uint      rom_size;               // Kickstart image size
+static uint      rom_base;               // Amiga address of Kickstart image
+static module_t  modules[MODULES_MAX];
+static uint      module_count;
+static uint      bus_shift = 2;          // ROM word to byte address shift
+static uint      flag_list_msgs;
+
+static uint     *addr_count;             // Accesses per ROM word address
+static uint      msg_count;              // Complete messages found
+static uint      msg_entries;            // Accesses which were messages
+static uint      msg_aborted;            // Partial magic sequences
+static uint      msg_cmd_count[256];     // Messages by command
+
+static uint16_t
+get16(const uint8_t *ptr)
+{
+    return (ptr[0] | (ptr[1] << 8));
+}
+
+static uint32_t
+get32(const uint8_t *ptr)
+{
+    return (ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | ((uint32_t) ptr[3] << 24));
+}
+
+static uint32_t
+rom_get32(uint off)
+{
+    return (((uint32_t) rom[off] << 24) | (rom[off + 1] << 16) |
+            (rom[off + 2] << 8) | rom[off + 3]);
+}
+
+/*
+ * rom_load
+ * --------
+ * Loads a Kickstart image and determines its base address. Images in
+ * byte-swapped order (as read directly from some ROM sockets) are
+ * converted to Amiga big-endian order.
+ */
+static int
+rom_load(const char *filename)
+{
+    FILE *fp = fopen(filename, "rb");
+    uint  pos;
+
+    if (fp == NULL) {
+        perror(filename);
+        return (1);
+    }
+    rom = malloc(ROM_MAX_SIZE);
+    if (rom == NULL) {
+        fclose(fp);
+        printf("Failed to allocate ROM buffer\n");
+        return (1);
+    }
+    rom_size = fread(rom, 1, ROM_MAX_SIZE, fp);
+    fclose(fp);
+
+    if ((rom_size != 0x40000) && (rom_size != 0x80000)) {
+        printf("%s: unsupported Kickstart image size 0x%x\n",
+               filename, rom_size);
+        return (1);
+    }
+    if ((rom[0] == 0x14) && (rom[1] == 0x11)) {
+        /* Byte-swapped image */
+        for (pos = 0; pos < rom_size; pos += 2) {
+            uint8_t temp = rom[pos];
+            rom[pos] = rom[pos + 1];
+            rom[pos + 1] = temp;
+        }
+    }
+    if ((rom[0] != 0x11) || ((rom[1] != 0x11) && (rom[1] != 0x14))) {
+        printf("%s: does not look like a Kickstart image\n", filename);
+        return (1);
+    }
+    rom_base = 0x01000000 - rom_size;
+    return (0);
+}
+
+/*
+ * rom_scan_residents
+ * ------------------
+ * Walks the Kickstart image for ROMTag structures in the same manner as
+ * exec: a match word followed by a pointer to itself, with the scan
+ * continuing at rt_EndSkip.
+ */
+static void
+rom_scan_residents(void)
+{
+    uint off = 0;
+
+    while ((off + 26 <= rom_size) && (module_count < MODULES_MAX)) {
+        module_t *mod;
+        uint32_t  name;
+        uint32_t  end;
+        uint      pos;
+
+        if ((((rom[off] << 8) | rom[off + 1]) != RTC_MATCHWORD) ||
+            (rom_get32(off + 2) != rom_base + off)) {
+            off += 2;
+            continue;
+        }
+        mod = &modules[module_count++];
+        end = rom_get32(off + 6);
+        mod->mod_start   = off;
+        mod->mod_end     = ((end > rom_base + off) &&
+                            (end <= rom_base + rom_size)) ?
+                           end - rom_base : off + 26;
+        mod->mod_version = rom[off + 11];
+        mod->mod_pri     = (int8_t) rom[off + 13];
+        name = rom_get32(off + 14) - rom_base;
+        for (pos = 0; (pos < sizeof (mod->mod_name) - 1) &&
+                      (name + pos < rom_size); pos++) {
+            char ch = rom[name + pos];
+            if ((ch == '\0') || (ch == '\r') || (ch == '\n'))
+                break;
+            mod->mod_name[pos] = ch;
+        }
+        mod->mod_name[pos] = '\0';
+        off = (mod->mod_end + 1) & ~1;
+    }
+}
+
+/*
+ * rom_offset
+ * ----------
+ * Converts a captured ROM word address to a byte offset in the ROM bank.
+ */
+static uint
+rom_offset(uint addr)
+{
+    return ((addr << bus_shift) & (ROM_MAX_SIZE - 1));
+}
+
+/*
+ * amiga_addr
+ * ----------
+ * Converts a captured ROM word address to the Amiga CPU address, in the
+ * same manner as the Kicksmash firmware "log" command.
+ */
+static uint
+amiga_addr(uint addr)
+{
+    uint amigaaddr = addr << bus_shift;
+
+    if (addr & (1 << 16))
+        amigaaddr |= 0x00e00000;
+    else
+        amigaaddr |= 0x00f80000;
+    return (amigaaddr);
+}
+
+/*
+ * module_find
+ * -----------
+ * Returns the index of the resident module containing the specified
+ * ROM offset, or -1 if there is none.
+ */
+static int
+module_find(uint offset)
+{
+    int low = 0;
+    int high = module_count - 1;
+
+    if (rom_size != 0)
+        offset &= rom_size - 1;  // 256K ROMs are mirrored
+
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        if (offset < modules[mid].mod_start)
+            high = mid - 1;
+        else if (offset >= modules[mid].mod_end)
+            low = mid + 1;
+        else
+            return (mid);
+    }
+    return (-1);
+}
+
+/*
+ * msg_parse
+ * ---------
+ * Follows the Kicksmash message protocol through the stream of captured
+ * addresses: magic, length, command, payload words, optional pad, and
+ * CRC. Returns non-zero if the address belongs to a message. A magic
+ * sequence which is broken by other ROM fetches is counted as aborted.
+ */
+static uint
+msg_parse(msg_parse_t *ms, uint16_t addr, uint index)
+{
+    if (ms->ms_pos < ARRAY_SIZE(sm_magic)) {
+        if (addr == sm_magic[ms->ms_pos]) {
+            if (ms->ms_pos++ == 0) {
+                ms->ms_start = index;
+                ms->ms_inmsg = 0;
+            }
+            ms->ms_inmsg++;
+            return (1);
+        }
+        if (ms->ms_pos != 0) {
+            msg_aborted++;
+            msg_entries -= ms->ms_inmsg;  // Were not a message after all
+            ms->ms_pos = 0;
+            if (addr == sm_magic[0])
+                return (msg_parse(ms, addr, index));
+        }
+        return (0);
+    }
+
+    ms->ms_inmsg++;
+    switch (ms->ms_pos++) {
+        case ARRAY_SIZE(sm_magic):
+            ms->ms_len = addr;
+            ms->ms_words = (addr + 1) / 2;
+            if (ms->ms_words & 1)
+                ms->ms_words++;  // Pad to 32-bit alignment
+            break;
+        case ARRAY_SIZE(sm_magic) + 1:
+            ms->ms_cmd = addr;
+            break;
+        default:
+            if (ms->ms_words != 0) {
+                ms->ms_words--;
+                ms->ms_pos--;    // Stay in payload phase
+                break;
+            }
+            if (ms->ms_pos == ARRAY_SIZE(sm_magic) + 4) {
+                /* Second CRC word: message complete */
+                msg_count++;
+                msg_cmd_count[ms->ms_cmd & 0xff]++;
+                if (flag_list_msgs) {
+                    printf("msg at %-10u cmd=%04x len=%u\n",
+                           ms->ms_start, ms->ms_cmd, ms->ms_len);
+                }
+                ms->ms_pos = 0;
+            }
+            break;
+    }
+    return (1);
+}
+
+static int
+hot_compare(const void *ap, const void *bp)
+{
+    uint a = *(const uint *) ap;
+    uint b = *(const uint *) bp;
+
+    if (addr_count[a] != addr_count[b])
+        return ((addr_count[a] < addr_count[b]) ? 1 : -1);
+    return ((a < b) ? -1 : 1);
+}
+
+static int
+module_compare(const void *ap, const void *bp)
+{
+    const module_t *a = ap;
+    const module_t *b = bp;
+
+    if (a->mod_count != b->mod_count)
+        return ((a->mod_count < b->mod_count) ? 1 : -1);
+    return ((a->mod_start < b->mod_start) ? -1 : 1);
+}
+
+static const char *
+module_name(int mod)
+{
+    if (mod < 0)
+        return ((module_count == 0) ? "" : "(no module)");
+    return (modules[mod].mod_name);
+}
+
+static uint
+percent10(uint64_t part, uint64_t total)
+{
+    if (total == 0)
+        return (0);
+    return ((uint) (part * 1000 / total));
+}
+
+/*
+ * trace_pass
+ * ----------
+ * Reads all frames of the trace file, calling the per-entry handling
+ * for either the counting pass (timeline == NULL) or the timeline pass.
+ * Returns the number of entries found.
+ */
+static uint64_t
+trace_pass(FILE *fp, timeline_t *timeline, uint rows, uint row_size,
+           uint *frames, uint *bad, uint *gaps, uint *overruns, uint *mode)
+{
+    static uint8_t buf[sizeof (ks_snoop_frame_t) +
+                       KS_SNOOP_MAX * 2 * sizeof (uint16_t) + 4];
+    msg_parse_t ms;
+    uint64_t    entries = 0;
+    uint        seq = 0;
+    uint        last_overruns = 0;
+    uint        hdrlen = sizeof (ks_snoop_frame_t);
+
+    memset(&ms, 0, sizeof (ms));
+    rewind(fp);
+    *frames = 0;
+    *bad = 0;
+    *gaps = 0;
+    *overruns = 0;
+
+    while (fread(buf, hdrlen, 1, fp) == 1) {
+        uint     count = get16(buf + 6);
+        uint     fmode = buf[8];
+        uint     flags = buf[9];
+        uint     fseq  = get16(buf + 4);
+        uint     fover = get32(buf + 12);
+        uint     plen  = count * 2 * sizeof (uint16_t);
+        uint32_t crc;
+        uint     pos;
+        uint     gap = 0;
+
+        if ((get32(buf) != KS_SNOOP_MAGIC) || (count > KS_SNOOP_MAX)) {
+            printf("Trace file is corrupt at frame %u\n", *frames);
+            break;
+        }
+        if (fread(buf + hdrlen, plen + 4, 1, fp) != 1) {
+            printf("Trace file is truncated at frame %u\n", *frames);
+            break;
+        }
+        crc = crc32(0, buf, hdrlen + plen);
+        if (crc != get32(buf + hdrlen + plen)) {
+            (*bad)++;
+            continue;
+        }
+        if ((*frames != 0) && ((uint16_t) fseq != (uint16_t) seq))
+            gap++;
+        if ((flags & KS_SNOOP_FLAG_OVERRUN) || (fover != last_overruns))
+            gap++;
+        *gaps += gap;
+        seq = fseq + 1;
+        last_overruns = fover;
+        *overruns = fover;
+        *mode = fmode;
+        (*frames)++;
+
+        for (pos = 0; pos < count; pos++, entries++) {
+            uint addr = get16(buf + hdrlen + pos * 2);
+            uint data = get16(buf + hdrlen + count * 2 + pos * 2);
+            uint is_msg;
+
+            if (fmode == CAPTURE_ADDR)
+                addr |= (data & 0xf0) << (16 - 4);
+            is_msg = msg_parse(&ms, addr & 0xffff, entries);
+
+            if (timeline == NULL) {
+                addr_count[addr]++;
+                if (is_msg)
+                    msg_entries++;
+            } else {
+                uint row = entries / row_size;
+                int  mod = module_find(rom_offset(addr));
+                if (row >= rows)
+                    row = rows - 1;
+                timeline[row].tl_mod_count[mod + 1]++;
+                if (is_msg)
+                    timeline[row].tl_msg++;
+                if (gap && (pos == 0))
+                    timeline[row].tl_gaps += gap;
+            }
+        }
+    }
+    return (entries);
+}
+
+static void
+usage(void)
+{
+    printf("%s", usage_text);
+}
+
+int
+main(int argc, char *argv[])
+{
+    FILE       *fp;
+    timeline_t *timeline;
+    uint       *hot;
+    uint64_t    entries;
+    uint        frames;
+    uint        bad;
+    uint        gaps;
+    uint        overruns;
+    uint        mode = CAPTURE_ADDR;
+    uint        hot_max = HOT_DEFAULT;
+    uint        row_size = 0;
+    uint        rows;
+    uint        unique = 0;
+    uint        addr;
+    uint        row;
+    uint        pos;
+    int         mod;
+    int         ch;
+
+    while ((ch = getopt(argc, argv, "hk:mn:t:w:")) != -1) {
+        switch (ch) {
+            case 'k':
+                if (rom_load(optarg))
+                    exit(1);
+                rom_scan_residents();
+                break;
+            case 'm':
+                flag_list_msgs++;
+                break;
+            case 'n':
+                hot_max = atoi(optarg);
+                break;
+            case 't':
+                row_size = atoi(optarg);
+                break;
+            case 'w':
+                if (strcmp(optarg, "16") == 0) {
+                    bus_shift = 1;
+                } else if (strcmp(optarg, "32") == 0) {
+                    bus_shift = 2;
+                } else {
+                    printf("Invalid bus width %s: use 16 or 32\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'h':
+            default:
+                usage();
+                exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+        exit(1);
+    }
+
+    fp = fopen(argv[optind], "rb");
+    if (fp == NULL) {
+        perror(argv[optind]);
+        exit(1);
+    }
+    addr_count = calloc(ROM_WORDS, sizeof (*addr_count));
+    hot = malloc(ROM_WORDS * sizeof (*hot));
+    if ((addr_count == NULL) || (hot == NULL)) {
+        printf("Failed to allocate address tables\n");
+        exit(1);
+    }
+
+    /* First pass: address counts and messages */
+    entries = trace_pass(fp, NULL, 0, 0, &frames, &bad, &gaps, &overruns,
+                         &mode);
+    printf("Trace %s: %llu accesses in %u frames, mode %s\n", argv[optind],
+           (unsigned long long) entries, frames,
+           (mode == CAPTURE_ADDR) ? "addr" :
+           (mode == CAPTURE_DATA_LO) ? "data lo" :
+           (mode == CAPTURE_DATA_HI) ? "data hi" : "?");
+    if (bad || gaps || overruns) {
+        printf("  bad frames %u  gaps %u  capture overruns %u\n",
+               bad, gaps, overruns);
+    }
+    if (entries == 0)
+        exit(0);
+    if (mode != CAPTURE_ADDR) {
+        printf("  A16-A19 are not captured in data modes; ROM offsets "
+               "are modulo 0x%x\n", 0x10000 << bus_shift);
+    }
+
+    for (addr = 0; addr < ROM_WORDS; addr++) {
+        if (addr_count[addr] != 0) {
+            int m = module_find(rom_offset(addr));
+            hot[unique++] = addr;
+            if (m >= 0)
+                modules[m].mod_count += addr_count[addr];
+        }
+    }
+    printf("  %u unique addresses\n", unique);
+
+    /* Hot addresses */
+    if (hot_max > unique)
+        hot_max = unique;
+    qsort(hot, unique, sizeof (*hot), hot_compare);
+    printf("\nHot addresses\n"
+           "AmigaAddr ROMOffset   Count Pct%%  Module+Offset\n");
+    for (pos = 0; pos < hot_max; pos++) {
+        uint offset = rom_offset(hot[pos]);
+        addr = hot[pos];
+        mod = module_find(offset);
+        printf("%06x    %05x %10u %3u.%u  %s", amiga_addr(addr), offset,
+               addr_count[addr],
+               percent10(addr_count[addr], entries) / 10,
+               percent10(addr_count[addr], entries) % 10, module_name(mod));
+        if (mod >= 0)
+            printf("+0x%x", (offset & (rom_size - 1)) -
+                             modules[mod].mod_start);
+        printf("\n");
+    }
+
+    /* Module histogram (sorting reorders modules, so done after lookups) */
+    if (module_count != 0) {
+        uint64_t other = entries;
+        module_t *sorted = malloc(module_count * sizeof (*sorted));
+        if (sorted == NULL) {
+            printf("Failed to allocate module table\n");
+            exit(1);
+        }
+        memcpy(sorted, modules, module_count * sizeof (*sorted));
+        qsort(sorted, module_count, sizeof (*sorted), module_compare);
+        printf("\nResident modules by access count\n"
+               "     Count Pct%%  ROMOffset     Ver  Module\n");
+        for (pos = 0; pos < module_count; pos++) {
+            module_t *m = &sorted[pos];
+            if (m->mod_count == 0)
+                break;
+            other -= m->mod_count;
+            printf("%10llu %3u.%u  %05x-%05x %3u  %s\n",
+                   (unsigned long long) m->mod_count,
+                   percent10(m->mod_count, entries) / 10,
+                   percent10(m->mod_count, entries) % 10,
+                   m->mod_start, m->mod_end, m->mod_version, m->mod_name);
+        }
+        printf("%10llu %3u.%u  (outside of any module)\n",
+               (unsigned long long) other, percent10(other, entries) / 10,
+               percent10(other, entries) % 10);
+        free(sorted);
+    }
+
+    /* Kicksmash messages */
+    printf("\nKicksmash messages: %u (%u accesses, %u.%u%%), %u aborted "
+           "magic sequences\n", msg_count, msg_entries,
+           percent10(msg_entries, entries) / 10,
+           percent10(msg_entries, entries) % 10, msg_aborted);
+    for (pos = 0; pos < ARRAY_SIZE(msg_cmd_count); pos++) {
+        if (msg_cmd_count[pos] != 0)
+            printf("  cmd %02x: %u\n", pos, msg_cmd_count[pos]);
+    }
+
+    /* Second pass: timeline */
+    if (row_size == 0)
+        row_size = (entries + TIMELINE_ROWS - 1) / TIMELINE_ROWS;
+    if (row_size == 0)
+        row_size = 1;
+    rows = (entries + row_size - 1) / row_size;
+    timeline = calloc(rows, sizeof (*timeline));
+    if (timeline == NULL) {
+        printf("Failed to allocate timeline\n");
+        exit(1);
+    }
+    for (row = 0; row < rows; row++) {
+        timeline[row].tl_mod_count = calloc(module_count + 1, sizeof (uint));
+        if (timeline[row].tl_mod_count == NULL) {
+            printf("Failed to allocate timeline\n");
+            exit(1);
+        }
+    }
+    msg_count = 0;
+    msg_aborted = 0;
+    flag_list_msgs = 0;
+    (void) trace_pass(fp, timeline, rows, row_size, &frames, &bad, &gaps,
+                      &overruns, &mode);
+
+    printf("\nTimeline (%u accesses per row, ! = capture gap)\n"
+           "     Start  Msg%%  Top module\n", row_size);
+    for (row = 0; row < rows; row++) {
+        uint total = 0;
+        uint best = 0;
+        int  best_mod = -1;
+        for (pos = 0; pos <= module_count; pos++) {
+            total += timeline[row].tl_mod_count[pos];
+            if (timeline[row].tl_mod_count[pos] > best) {
+                best = timeline[row].tl_mod_count[pos];
+                best_mod = (int) pos - 1;
+            }
+        }
+        printf("%10u%c %3u  ", row * row_size,
+               timeline[row].tl_gaps ? '!' : ' ',
+               percent10(timeline[row].tl_msg, total) / 10);
+        if ((module_count == 0) || (total == 0))
+            printf("\n");
+        else
+            printf("%-24s %3u%%\n", module_name(best_mod),
+                   percent10(best, total) / 10);
+    }
+
+    fclose(fp);
+    exit(0);
+}